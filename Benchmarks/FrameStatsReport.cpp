@@ -0,0 +1,232 @@
+// FrameStatsReport.cpp: accuracy of the FrameStats percentiles, stutters and exports.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 FrameStatsReport.cpp ../FrameStats.cpp -o FrameStatsReport
+// Feeds frame time distributions to the histogram and compares its percentiles with the
+// exact ones of the sorted times. Checks that
+//	- p50, p95, p99 are within 1 / LatencyHistogram::SubBuckets of the exact values plus
+//	  the rounding to microseconds, min and max are exact
+//	- every injected spike is a stutter and steady frames are not
+//	- the CSV has the last frames of the ring, oldest first, and the JSON is well formed
+// and reports the cost of a frame.
+//
+// Usage: FrameStatsReport [options]
+//	--frames n	frames of every distribution, 1000000 by default
+//	--file name	base name of the CSV and JSON files, FrameStatsReport by default
+// Exit code is 1 if a check fails.
+
+#include "../FrameStats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+	const double Percentiles[] = { 0.5, 0.95, 0.99 };
+
+	struct Distribution {
+		const char* name;
+		std::vector<double> times;
+	};
+
+	// frame times in milliseconds
+	std::vector<Distribution> CreateDistributions(uint numFrames)
+	{
+		std::mt19937 random(1);
+		std::vector<Distribution> distributions(4);
+		distributions[0].name = "uniform 5-20 ms";
+		distributions[1].name = "lognormal 8 ms";
+		distributions[2].name = "60 Hz, 1% spikes";
+		distributions[3].name = "uniform 10-100 us";
+		std::uniform_real_distribution<double> uniform(5.0, 20.0);
+		std::lognormal_distribution<double> lognormal(log(8.0), 0.3);
+		std::normal_distribution<double> normal(16.7, 0.5);
+		std::uniform_real_distribution<double> spike(0.0, 1.0);
+		std::uniform_real_distribution<double> small(0.01, 0.1);
+		for (uint i = 0; i < numFrames; ++i) {
+			distributions[0].times.push_back(uniform(random));
+			distributions[1].times.push_back(lognormal(random));
+			distributions[2].times.push_back(spike(random) < 0.01 ? 50.0 + 50.0 * spike(random) : normal(random));
+			distributions[3].times.push_back(small(random));
+		}
+		return distributions;
+	}
+
+	// nearest rank of the times rounded like the histogram
+	double GetExactPercentile(const std::vector<double>& sorted, double percentile)
+	{
+		const size_t rank = std::max(static_cast<size_t>(ceil(percentile * sorted.size())), size_t(1));
+		return floor(sorted[rank - 1] * 1000.0 + 0.5) * 0.001;
+	}
+
+	bool IsClose(double value, double exact)
+	{
+		return fabs(value - exact) <= exact / LatencyHistogram::SubBuckets + 0.001;
+	}
+
+	bool ReadFile(const char* fileName, std::string& text)
+	{
+		FILE* f = fopen(fileName, "rb");
+		if (!f) {
+			return false;
+		}
+		char buffer[4096];
+		size_t size;
+		while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+			text.append(buffer, size);
+		}
+		fclose(f);
+		return true;
+	}
+
+	// brackets balance outside strings
+	bool IsBalanced(const std::string& text)
+	{
+		std::vector<char> brackets;
+		bool inString = false;
+		for (char c : text) {
+			if (inString) {
+				inString = c != '"';
+			} else if (c == '"') {
+				inString = true;
+			} else if (c == '{' || c == '[') {
+				brackets.push_back(c == '{' ? '}' : ']');
+			} else if (c == '}' || c == ']') {
+				if (brackets.empty() || brackets.back() != c) {
+					return false;
+				}
+				brackets.pop_back();
+			}
+		}
+		return brackets.empty() && !inString;
+	}
+
+	// rows of the CSV follow each other and end with lastFrame
+	bool CheckCSV(const std::string& text, uint numRows, uint lastFrame)
+	{
+		if (text.compare(0, 20, "frame,cpu_ms,gpu_ms\n")) {
+			return false;
+		}
+		uint rows = 0;
+		unsigned long long previous = 0;
+		size_t begin = 20;
+		while (begin < text.size()) {
+			size_t end = text.find('\n', begin);
+			if (end == std::string::npos) {
+				return false;
+			}
+			unsigned long long frame;
+			double cpuTime;
+			if (sscanf(text.c_str() + begin, "%llu,%lf", &frame, &cpuTime) != 2 || (rows && frame != previous + 1)) {
+				return false;
+			}
+			previous = frame;
+			++rows;
+			begin = end + 1;
+		}
+		return rows == numRows && previous == lastFrame;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numFrames = 1000000;
+	std::string fileName = "FrameStatsReport";
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--frames") && hasValue) {
+			numFrames = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--file") && hasValue) {
+			fileName = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [--frames n] [--file name]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (numFrames < 1000) {
+		fprintf(stderr, "Frames must be at least 1000\n");
+		return 2;
+	}
+
+	bool isValid = true;
+	printf("%-18s %9s %9s %9s %9s %9s %9s (ms)\n", "Distribution", "p50", "exact", "p99", "exact", "max", "error");
+	double nanosecondsPerFrame = 0.0;
+	for (Distribution& distribution : CreateDistributions(numFrames)) {
+		FrameStats stats;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (double time : distribution.times) {
+			stats.AddFrame(time, -1.0);
+		}
+		nanosecondsPerFrame = std::max(nanosecondsPerFrame, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / numFrames);
+		const FrameStats::Summary summary = stats.GetSummary(FrameStats::CPUTime);
+		std::vector<double>& sorted = distribution.times;
+		std::sort(sorted.begin(), sorted.end());
+		const double values[] = { summary.p50, summary.p95, summary.p99 };
+		double maxError = 0.0;
+		for (uint i = 0; i < sizeof(Percentiles) / sizeof(Percentiles[0]); ++i) {
+			const double exact = GetExactPercentile(sorted, Percentiles[i]);
+			maxError = std::max(maxError, fabs(values[i] - exact) / exact);
+			if (!IsClose(values[i], exact)) {
+				printf("%s: p%g is %.4f ms, not %.4f ms\n", distribution.name, Percentiles[i] * 100.0, values[i], exact);
+				isValid = false;
+			}
+		}
+		if (summary.min != GetExactPercentile(sorted, 0.0) || summary.max != GetExactPercentile(sorted, 1.0) || summary.numFrames != numFrames) {
+			printf("%s: min %.4f ms, max %.4f ms, %llu frames\n", distribution.name, summary.min, summary.max, static_cast<unsigned long long>(summary.numFrames));
+			isValid = false;
+		}
+		if (stats.GetSummary(FrameStats::GPUTime).numFrames) {
+			printf("%s: unknown GPU times are counted\n", distribution.name);
+			isValid = false;
+		}
+		printf("%-18s %9.3f %9.3f %9.3f %9.3f %9.3f %8.2f%%\n", distribution.name, summary.p50, GetExactPercentile(sorted, 0.5), summary.p99, GetExactPercentile(sorted, 0.99),
+			summary.max, maxError * 100.0);
+	}
+
+	// a spike every 100 frames of 10 ms, the GPU doesn't stutter
+	const uint ringCapacity = 1000;
+	FrameStats stats(ringCapacity);
+	const uint numSteadyFrames = 100;
+	const uint numSpikes = 25;
+	for (uint i = 0; i < numSteadyFrames * numSpikes; ++i) {
+		stats.AddFrame(i % numSteadyFrames == numSteadyFrames - 1 ? 30.0 : 10.0 + (i % 3) * 0.5, 5.0);
+	}
+	const FrameStats::Summary cpu = stats.GetSummary(FrameStats::CPUTime);
+	const FrameStats::Summary gpu = stats.GetSummary(FrameStats::GPUTime);
+	if (cpu.numStutters != numSpikes || gpu.numStutters) {
+		printf("%llu CPU and %llu GPU stutters, not %u and 0\n", static_cast<unsigned long long>(cpu.numStutters), static_cast<unsigned long long>(gpu.numStutters), numSpikes);
+		isValid = false;
+	}
+
+	const std::string csvName = fileName + ".csv";
+	const std::string jsonName = fileName + ".json";
+	std::string csv;
+	std::string json;
+	if (!stats.WriteCSV(csvName.c_str()) || !stats.WriteJSON(jsonName.c_str()) || !ReadFile(csvName.c_str(), csv) || !ReadFile(jsonName.c_str(), json)) {
+		printf("can't write %s and %s\n", csvName.c_str(), jsonName.c_str());
+		return 1;
+	}
+	if (!CheckCSV(csv, ringCapacity, numSteadyFrames * numSpikes - 1)) {
+		printf("%s doesn't have the last %u frames\n", csvName.c_str(), ringCapacity);
+		isValid = false;
+	}
+	if (!IsBalanced(json) || json.find("\"p99\"") == std::string::npos) {
+		printf("%s is not well formed\n", jsonName.c_str());
+		isValid = false;
+	}
+
+	printf("overlay              %s\n", stats.GetOverlayText().c_str());
+	printf("frame                %8.1f ns\n", nanosecondsPerFrame);
+	printf("histogram            %8.1f KB per series\n", LatencyHistogram::NumBuckets * sizeof(uint64) / 1024.0);
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
@@ -0,0 +1,361 @@
+// FrustumReport.cpp: the SIMD frustum tests against the scalar tests per plane.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -ffp-contract=off FrustumReport.cpp ../Matrix4x4.cpp ../CPUFeatures.cpp -o FrustumReport
+// The scalar tests are the ones Frustum had before the planes were tested in one pass: the
+// sphere is outside if SignedDistanceToPoint(center) <= -radius for a plane, the box is outside
+// if Classify with the near point mask of a plane gives BACK_PLANE. Planes are tested in the
+// order near, far, right, left, top, bottom, and isIntersect is set by the IN_PLANE results
+// before the first BACK_PLANE. The distances are summed in the same order, so every result
+// has to be the same, on the planes too. Checks
+//	- SphereInFrustum, BoundingBoxInFrustum and BoundingBoxInFrustum with isIntersect, which
+//	  has to keep a true isIntersect and set a false one like the scalar test
+//	- SpheresInFrustum and both BoundingBoxesInFrustum overloads with every count up to 40
+//	  and a large batch, so every tail of the 4-wide loops runs
+// for frustums from ExtractFrustum of Direct3D and OpenGL view projections and of a float
+// matrix, CalculateNearFarPlanes, and planes set by GetPlane and UpdatePlanes, axis aligned
+// with integer inputs that land on the planes and oblique ones. Coordinates up to 1e37 check
+// that the padding planes of the SIMD tests contain everything.
+//
+// Usage: FrustumReport [options]
+//	--frustums n	frustums of every case, 200 by default
+//	--objects n		spheres and boxes per frustum, 1000 by default
+// Exit code is 1 if a check fails.
+
+#include "../Frustum.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+	const uint MaxTail = 40;
+
+	// Frustum::Classify with the mask computed from the plane again
+	int Classify(const Plane& plane, const Vector3D& minPoint, const Vector3D& maxPoint, bool& isIntersect)
+	{
+		int nearPointMask;
+		plane.ComputeNearPointMask(nearPointMask);
+		if (plane.ClassifyPoint(plane.MakeNearPoint(nearPointMask, minPoint, maxPoint)) == Plane::FRONT_PLANE) {
+			return Plane::FRONT_PLANE;
+		}
+		if (plane.ClassifyPoint(plane.MakeFarPoint(nearPointMask, minPoint, maxPoint)) == Plane::BACK_PLANE) {
+			return Plane::BACK_PLANE;
+		}
+		isIntersect = true;
+		return Plane::IN_PLANE;
+	}
+
+	bool SphereInFrustumReference(const Frustum& frustum, const Vector3D& center, float radius)
+	{
+		const uint order[] = { Frustum::NEARPLANE, Frustum::FARPLANE, Frustum::LEFTPLANE, Frustum::RIGHTPLANE, Frustum::TOPPLANE, Frustum::BOTTOMPLANE };
+		for (uint p : order) {
+			if (frustum.GetPlane(p).SignedDistanceToPoint(center) <= -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool BoundingBoxInFrustumReference(const Frustum& frustum, const Vector3D& minPoint, const Vector3D& maxPoint, bool& isIntersect)
+	{
+		const uint order[] = { Frustum::NEARPLANE, Frustum::FARPLANE, Frustum::RIGHTPLANE, Frustum::LEFTPLANE, Frustum::TOPPLANE, Frustum::BOTTOMPLANE };
+		for (uint p : order) {
+			if (Classify(frustum.GetPlane(p), minPoint, maxPoint, isIntersect) == Plane::BACK_PLANE) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	struct Objects {
+		std::vector<Vector4D> spheres;
+		std::vector<Vector3D> minPoints;
+		std::vector<Vector3D> maxPoints;
+		// boxes as structure of arrays
+		std::vector<float> box[6];
+	};
+
+	class Inputs  {
+	private:
+		std::mt19937 random;
+		std::uniform_real_distribution<float> value;
+	public:
+		Inputs() : random(1), value(-1.0f, 1.0f)
+		{
+		}
+		float Float()
+		{
+			return value(random);
+		}
+		// integer in [-n, n]
+		float Integer(int n)
+		{
+			return static_cast<float>(static_cast<int>(random() % (2 * n + 1)) - n);
+		}
+		Matrix4x4 View()
+		{
+			Matrix4x4 x, y, z;
+			x.LoadIdentity();
+			y.LoadIdentity();
+			z.LoadIdentity();
+			x.RotateX(Float() * 3.0f);
+			y.RotateY(Float() * 3.0f);
+			z.RotateZ(Float() * 3.0f);
+			Matrix4x4 view = x * y * z;
+			view.Translate(Float() * 50.0f, Float() * 50.0f, Float() * 50.0f);
+			return view;
+		}
+		Matrix4x4 Projection(bool isOpenGL)
+		{
+			Matrix4x4 m;
+			const float fov = 60.0f + Float() * 30.0f;
+			const float aspect = 1.5f + Float() * 0.5f;
+			const float zNear = 0.5f + Float() * 0.4f;
+			const float zFar = 150.0f + Float() * 50.0f;
+			if (isOpenGL) {
+				m.PerspectiveFovOpenGL(fov, aspect, zNear, zFar);
+			} else {
+				m.PerspectiveFovDirect3D(fov, aspect, zNear, zFar);
+			}
+			return m;
+		}
+		// axis aligned box frustum with integer distances
+		void AxisAligned(Frustum& frustum)
+		{
+			const float extent[] = { 2.0f + Integer(8) + 8.0f, 2.0f + Integer(8) + 8.0f, 2.0f + Integer(8) + 8.0f };
+			const uint axes[] = { 0, 0, 1, 1, 2, 2 };
+			for (uint i = 0; i < Frustum::NumPlanes; ++i) {
+				const float sign = i & 1 ? 1.0f : -1.0f;
+				const uint axis = axes[i];
+				frustum.GetPlane(i).ComputePlane(axis == 0 ? sign : 0.0f, axis == 1 ? sign : 0.0f, axis == 2 ? sign : 0.0f, extent[axis]);
+			}
+			frustum.UpdatePlanes();
+		}
+		// random planes with normals of any length
+		void Oblique(Frustum& frustum)
+		{
+			for (uint i = 0; i < Frustum::NumPlanes; ++i) {
+				frustum.GetPlane(i).ComputePlane(Float() * 2.0f, Float() * 2.0f, Float() * 2.0f, 20.0f + Float() * 20.0f);
+			}
+			frustum.UpdatePlanes();
+		}
+		// mostly around the frustums, some integer ones that touch the axis aligned planes and
+		// some huge ones
+		void Make(Objects& objects, size_t numObjects)
+		{
+			objects.spheres.resize(numObjects);
+			objects.minPoints.resize(numObjects);
+			objects.maxPoints.resize(numObjects);
+			for (std::vector<float>& v : objects.box) {
+				v.resize(numObjects);
+			}
+			for (size_t i = 0; i < numObjects; ++i) {
+				Vector3D center;
+				Vector3D extent;
+				float radius;
+				switch (random() % 8) {
+				case 0:
+					center = Vector3D(Integer(20), Integer(20), Integer(20));
+					extent = Vector3D(Integer(3) + 3.0f, Integer(3) + 3.0f, Integer(3) + 3.0f);
+					radius = Integer(3) + 3.0f;
+					break;
+				case 1:
+					center = Vector3D(Float(), Float(), Float()) * 1e37f;
+					extent = Vector3D(Float() + 1.0f, Float() + 1.0f, Float() + 1.0f) * 1e36f;
+					radius = (Float() + 1.0f) * 1e36f;
+					break;
+				default:
+					center = Vector3D(Float(), Float(), Float()) * 250.0f;
+					extent = Vector3D(Float() + 1.0f, Float() + 1.0f, Float() + 1.0f) * 10.0f;
+					radius = (Float() + 1.0f) * 10.0f;
+					break;
+				}
+				objects.spheres[i] = Vector4D(center.x, center.y, center.z, radius);
+				objects.minPoints[i] = center - extent;
+				objects.maxPoints[i] = center + extent;
+				objects.box[0][i] = objects.minPoints[i].x;
+				objects.box[1][i] = objects.minPoints[i].y;
+				objects.box[2][i] = objects.minPoints[i].z;
+				objects.box[3][i] = objects.maxPoints[i].x;
+				objects.box[4][i] = objects.maxPoints[i].y;
+				objects.box[5][i] = objects.maxPoints[i].z;
+			}
+		}
+	};
+
+	struct TestResult {
+		const char* name;
+		size_t numTests;
+		size_t numVisible;
+		size_t numMismatches;
+	};
+
+	enum {
+		SPHERE,
+		SPHERES,
+		BOX,
+		BOX_INTERSECT,
+		BOXES,
+		BOXES_SOA,
+		NUM_TESTS
+	};
+
+	void AddResult(TestResult& result, bool isVisible, bool isSame)
+	{
+		++result.numTests;
+		result.numVisible += isVisible;
+		result.numMismatches += !isSame;
+	}
+
+	// the batch on objects [first, first + count)
+	void CheckBatches(const Frustum& frustum, const Objects& objects, const ubyte* spheres, const ubyte* boxes, size_t first, size_t count, TestResult* results)
+	{
+		// every result is written, the byte after the batch stays untouched
+		std::vector<ubyte> visible(count + 1, 0xcd);
+		frustum.SpheresInFrustum(objects.spheres.data() + first, count, visible.data());
+		for (size_t i = 0; i < count; ++i) {
+			AddResult(results[SPHERES], visible[i] != 0, visible[i] == spheres[first + i]);
+		}
+		results[SPHERES].numMismatches += visible[count] != 0xcd;
+		std::fill(visible.begin(), visible.end(), 0xcd);
+		frustum.BoundingBoxesInFrustum(objects.minPoints.data() + first, objects.maxPoints.data() + first, count, visible.data());
+		for (size_t i = 0; i < count; ++i) {
+			AddResult(results[BOXES], visible[i] != 0, visible[i] == boxes[first + i]);
+		}
+		results[BOXES].numMismatches += visible[count] != 0xcd;
+		std::fill(visible.begin(), visible.end(), 0xcd);
+		frustum.BoundingBoxesInFrustum(objects.box[0].data() + first, objects.box[1].data() + first, objects.box[2].data() + first,
+			objects.box[3].data() + first, objects.box[4].data() + first, objects.box[5].data() + first, count, visible.data());
+		for (size_t i = 0; i < count; ++i) {
+			AddResult(results[BOXES_SOA], visible[i] != 0, visible[i] == boxes[first + i]);
+		}
+		results[BOXES_SOA].numMismatches += visible[count] != 0xcd;
+	}
+
+	// numMismatches of the frustum
+	size_t Check(const Frustum& frustum, const Objects& objects, TestResult* results)
+	{
+		size_t numMismatches = 0;
+		for (uint i = 0; i < NUM_TESTS; ++i) {
+			numMismatches -= results[i].numMismatches;
+		}
+		const size_t numObjects = objects.spheres.size();
+		std::vector<ubyte> spheres(numObjects);
+		std::vector<ubyte> boxes(numObjects);
+		for (size_t i = 0; i < numObjects; ++i) {
+			const Vector4D& s = objects.spheres[i];
+			const Vector3D center(s.x, s.y, s.z);
+			const Vector3D& minPoint = objects.minPoints[i];
+			const Vector3D& maxPoint = objects.maxPoints[i];
+			spheres[i] = SphereInFrustumReference(frustum, center, s.w) ? 1 : 0;
+			AddResult(results[SPHERE], spheres[i] != 0, frustum.SphereInFrustum(center, s.w) == (spheres[i] != 0));
+			bool isIntersect = false;
+			boxes[i] = BoundingBoxInFrustumReference(frustum, minPoint, maxPoint, isIntersect) ? 1 : 0;
+			AddResult(results[BOX], boxes[i] != 0, frustum.BoundingBoxInFrustum(minPoint, maxPoint) == (boxes[i] != 0));
+			bool isIntersectSIMD = false;
+			const bool isVisible = frustum.BoundingBoxInFrustum(minPoint, maxPoint, isIntersectSIMD);
+			bool isStillIntersect = true;
+			frustum.BoundingBoxInFrustum(minPoint, maxPoint, isStillIntersect);
+			AddResult(results[BOX_INTERSECT], isVisible, isVisible == (boxes[i] != 0) && isIntersectSIMD == isIntersect && isStillIntersect);
+		}
+		// every tail, from every start modulo 4
+		for (size_t count = 0; count <= MaxTail && count <= numObjects; ++count) {
+			const size_t first = (numObjects - count) < count % 4 ? 0 : count % 4;
+			CheckBatches(frustum, objects, spheres.data(), boxes.data(), first, count, results);
+		}
+		CheckBatches(frustum, objects, spheres.data(), boxes.data(), 0, numObjects, results);
+		for (uint i = 0; i < NUM_TESTS; ++i) {
+			numMismatches += results[i].numMismatches;
+		}
+		return numMismatches;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numFrustums = 200;
+	size_t numObjects = 1000;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--frustums") && hasValue) {
+			numFrustums = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--objects") && hasValue) {
+			numObjects = static_cast<size_t>(atoi(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--frustums n] [--objects n]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	const char* const frustumNames[] = {
+		"Direct3D",
+		"OpenGL",
+		"float matrix",
+		"near far planes",
+		"axis aligned",
+		"oblique"
+	};
+	const uint numFrustumCases = sizeof(frustumNames) / sizeof(frustumNames[0]);
+	size_t frustumMismatches[numFrustumCases] = {};
+	TestResult results[NUM_TESTS] = {
+		{ "SphereInFrustum", 0, 0, 0 },
+		{ "SpheresInFrustum", 0, 0, 0 },
+		{ "BoundingBoxInFrustum", 0, 0, 0 },
+		{ "isIntersect", 0, 0, 0 },
+		{ "BoundingBoxes", 0, 0, 0 },
+		{ "BoundingBoxes SoA", 0, 0, 0 }
+	};
+	Inputs inputs;
+	Objects objects;
+	for (uint f = 0; f < numFrustums; ++f) {
+		inputs.Make(objects, numObjects);
+		for (uint c = 0; c < numFrustumCases; ++c) {
+			Frustum frustum;
+			switch (c) {
+			case 0:
+			case 1:
+				frustum.ExtractFrustum(inputs.Projection(c == 1), inputs.View());
+				break;
+			case 2:
+				frustum = Frustum((inputs.Projection(false) * inputs.View()).Matrix);
+				break;
+			case 3: {
+				const Matrix4x4 proj = inputs.Projection(false);
+				const Matrix4x4 view = inputs.View();
+				frustum.ExtractFrustum(proj, view);
+				frustum.CalculateNearFarPlanes(proj.Matrix, view.Matrix);
+				break;
+			}
+			case 4:
+				inputs.AxisAligned(frustum);
+				break;
+			default:
+				inputs.Oblique(frustum);
+				break;
+			}
+			frustumMismatches[c] += Check(frustum, objects, results);
+		}
+	}
+
+	bool isValid = true;
+	printf("%-20s %10s %8s %10s\n", "Test", "tests", "visible", "mismatches");
+	for (const TestResult& result : results) {
+		const double visible = result.numTests ? 100.0 * result.numVisible / result.numTests : 0.0;
+		printf("%-20s %10zu %7.1f%% %10zu\n", result.name, result.numTests, visible, result.numMismatches);
+		isValid = isValid && !result.numMismatches;
+	}
+	printf("\n%-20s %10s\n", "Frustum", "mismatches");
+	for (uint c = 0; c < numFrustumCases; ++c) {
+		printf("%-20s %10zu\n", frustumNames[c], frustumMismatches[c]);
+	}
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+// GPUTimerReport.cpp: ring and statistics of GPUTimer against a mock GPU.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 GPUTimerReport.cpp ../GPUTimer.cpp -o GPUTimerReport
+// The mock GPU runs the passes of the renderer on a direct and a compute queue with
+// different timestamp frequencies; a frame completes a few frames after it is recorded.
+// Checks that
+//	- a frame slot is never read before its frame completes nor written while it waits
+//	  to be read
+//	- with a slot per frame in flight no frame is dropped, with fewer slots frames are
+//	  dropped instead of overwritten
+//	- mean durations match the costs of the mock and passes skipped by a frame have no samples
+//	- durations with the end before the begin are dropped
+//
+// Usage: GPUTimerReport [options]
+//	--frames n	recorded frames, 2000 by default
+//	--latency n	frames the GPU runs behind the CPU, 2 by default
+//	--window n	durations of the rolling statistics, 256 by default
+// Exit code is 1 if a check fails.
+
+#include "../GPUTimer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+	// passes of LightIndexedDeferredRendering
+	enum Pass {
+		CullingPass,
+		DepthPass,
+		LightVolumePass,
+		ShadingPass,
+		LightSourcePass,
+		NumPasses
+	};
+	const char* PassNames[NumPasses] = { "Light culling", "Depth prepass", "Light volumes", "Shading", "Light sources" };
+	// milliseconds of the mock
+	const double PassCosts[NumPasses] = { 0.15, 0.8, 2.5, 1.7, 0.3 };
+	// frames of forward lighting skip the light volumes
+	const uint ForwardFrameInterval = 8;
+	// a frame with a disjoint timestamp
+	const uint DisjointFrame = 100;
+
+	struct Queue {
+		uint64 frequency;
+		uint64 ticks;
+	};
+
+	// timestamps of a slot are taken when they are written, they are seen once the
+	// frame completes; misuse of the ring is counted
+	class MockQuerySource : public GPUTimer::QuerySource  {
+	private:
+		struct Slot {
+			std::vector<uint64> queries;
+			std::vector<uint64> readback;
+			uint64 frame;
+			bool isResolved;
+		};
+		std::vector<Slot> slots;
+		uint64 recordedFrame;
+		uint64 completedFrame;
+		uint seed;
+	public:
+		uint numEarlyReads;
+		uint numOverwrites;
+		bool isDisjoint;
+
+		MockQuerySource(uint numSlots, uint numQueries) : slots(numSlots), recordedFrame(0), completedFrame(0), seed(1), numEarlyReads(0), numOverwrites(0), isDisjoint(false)
+		{
+			for (Slot& slot : slots) {
+				slot.queries.assign(numQueries, 0);
+				slot.readback.assign(numQueries, 0);
+				slot.frame = 0;
+				slot.isResolved = false;
+			}
+		}
+		void SetRecordedFrame(uint64 frame)
+		{
+			recordedFrame = frame;
+		}
+		void SetCompletedFrame(uint64 frame)
+		{
+			completedFrame = frame;
+		}
+		// uniform in [-1, 1]
+		double GetJitter()
+		{
+			seed = seed * 1664525u + 1013904223u;
+			return (seed >> 8) / static_cast<double>(1 << 23) - 1.0;
+		}
+		void WriteTimestamp(void* commandList, uint slot, uint query) override
+		{
+			Queue& queue = *static_cast<Queue *>(commandList);
+			Slot& s = slots[slot];
+			if (s.isResolved && s.frame != recordedFrame) {
+				++numOverwrites;
+			}
+			s.isResolved = false;
+			s.frame = recordedFrame;
+			const double cost = query % 2 ? PassCosts[query / 2] * (1.0 + 0.1 * GetJitter()) : 0.05;
+			queue.ticks += static_cast<uint64>(cost * 0.001 * queue.frequency);
+			s.queries[query] = query % 2 && isDisjoint ? 0 : queue.ticks;
+		}
+		void Resolve(void* /*commandList*/, uint slot, uint firstQuery, uint numQueries) override
+		{
+			Slot& s = slots[slot];
+			for (uint i = firstQuery; i < firstQuery + numQueries; ++i) {
+				s.readback[i] = s.queries[i];
+			}
+			s.isResolved = true;
+		}
+		bool Read(uint slot, uint firstQuery, uint numQueries, uint64* timestamps) override
+		{
+			Slot& s = slots[slot];
+			if (s.frame > completedFrame) {
+				++numEarlyReads;
+			}
+			s.isResolved = false;
+			memcpy(timestamps, s.readback.data() + firstQuery, numQueries * sizeof(uint64));
+			return true;
+		}
+	};
+
+	struct RunResult {
+		uint numDroppedFrames;
+		uint numInvalidSamples;
+		uint numEarlyReads;
+		uint numOverwrites;
+		GPUTimer::Stats stats[NumPasses];
+		std::string report;
+	};
+
+	RunResult Run(uint numFrames, uint latency, uint numSlots, uint window, bool hasDisjointFrame)
+	{
+		Queue directQueue = { 1000000000ull, 1ull << 40 };
+		Queue computeQueue = { 19200000ull, 1ull << 30 };
+		MockQuerySource source(numSlots, NumPasses * 2);
+		GPUTimer timer;
+		timer.Init(&source, NumPasses, numSlots, window);
+		for (uint i = 0; i < NumPasses; ++i) {
+			timer.SetPass(i, PassNames[i], i == CullingPass ? computeQueue.frequency : directQueue.frequency);
+		}
+		// the last frames are collected after the loop
+		for (uint frame = 0; frame < numFrames + latency; ++frame) {
+			if (frame < numFrames) {
+				source.SetRecordedFrame(frame);
+				source.isDisjoint = hasDisjointFrame && frame == DisjointFrame;
+				timer.BeginFrame(frame);
+				for (uint pass = 0; pass < NumPasses; ++pass) {
+					if (pass == LightVolumePass && frame % ForwardFrameInterval == 0) {
+						continue;
+					}
+					Queue* queue = pass == CullingPass ? &computeQueue : &directQueue;
+					timer.BeginPass(queue, pass);
+					timer.EndPass(queue, pass);
+				}
+				timer.EndFrame();
+			}
+			if (frame >= latency) {
+				source.SetCompletedFrame(frame - latency);
+				timer.Collect(frame - latency);
+			}
+		}
+		RunResult result;
+		result.numDroppedFrames = timer.GetNumDroppedFrames();
+		result.numInvalidSamples = timer.GetNumInvalidSamples();
+		result.numEarlyReads = source.numEarlyReads;
+		result.numOverwrites = source.numOverwrites;
+		for (uint i = 0; i < NumPasses; ++i) {
+			result.stats[i] = timer.GetStats(i);
+		}
+		result.report = timer.GetReport();
+		return result;
+	}
+
+	bool CheckRing(const RunResult& result, const char* name)
+	{
+		if (result.numEarlyReads || result.numOverwrites) {
+			printf("%s: %u slots read before their frame completed, %u slots written before they were read\n", name, result.numEarlyReads, result.numOverwrites);
+			return false;
+		}
+		return true;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numFrames = 2000;
+	uint latency = 2;
+	uint window = GPUTimer::DefaultWindow;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--frames") && hasValue) {
+			numFrames = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--latency") && hasValue) {
+			latency = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--window") && hasValue) {
+			window = static_cast<uint>(atoi(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--frames n] [--latency n] [--window n]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (numFrames <= DisjointFrame + window || !latency || !window) {
+		fprintf(stderr, "Frames must be above %u + window, latency and window above 0\n", DisjointFrame);
+		return 2;
+	}
+
+	bool isValid = true;
+	// a slot per frame in flight
+	const RunResult full = Run(numFrames, latency, latency + 1, window, true);
+	isValid = CheckRing(full, "full ring") && isValid;
+	if (full.numDroppedFrames) {
+		printf("full ring: %u frames dropped\n", full.numDroppedFrames);
+		isValid = false;
+	}
+	if (full.numInvalidSamples != NumPasses) {
+		printf("full ring: %u invalid durations, not %u\n", full.numInvalidSamples, static_cast<uint>(NumPasses));
+		isValid = false;
+	}
+	for (uint i = 0; i < NumPasses; ++i) {
+		const GPUTimer::Stats& stats = full.stats[i];
+		// jitter is 10% and uniform, ticks are truncated
+		const double error = fabs(stats.mean - PassCosts[i]) / PassCosts[i];
+		if (stats.numSamples != window || error > 0.02 || stats.min < PassCosts[i] * 0.89 || stats.max > PassCosts[i] * 1.11) {
+			printf("%s: %u samples, mean %.4f ms, min %.4f ms, max %.4f ms, cost %.4f ms\n", PassNames[i], stats.numSamples, stats.mean, stats.min, stats.max, PassCosts[i]);
+			isValid = false;
+		}
+	}
+
+	// the GPU is further behind than the ring: frames are dropped, slots stay safe
+	const RunResult behind = Run(numFrames, latency + 2, latency + 1, window, false);
+	isValid = CheckRing(behind, "short ring") && isValid;
+	if (!behind.numDroppedFrames) {
+		printf("short ring: no frame dropped\n");
+		isValid = false;
+	}
+
+	// skipped passes
+	const RunResult skipped = Run(ForwardFrameInterval * window, latency, latency + 1, ForwardFrameInterval * window, false);
+	const uint expectedSamples = ForwardFrameInterval * window - window;
+	if (skipped.stats[LightVolumePass].numSamples != expectedSamples) {
+		printf("light volumes: %u samples, not %u\n", skipped.stats[LightVolumePass].numSamples, expectedSamples);
+		isValid = false;
+	}
+
+	printf("%s", full.report.c_str());
+	printf("frames               %8u, GPU %u frames behind\n", numFrames, latency);
+	printf("dropped frames       %8u with %u slots, %u with the GPU %u frames behind\n", full.numDroppedFrames, latency + 1, behind.numDroppedFrames, latency + 3);
+	printf("invalid durations    %8u\n", full.numInvalidSamples);
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+// GridGeneratorBenchmark.cpp: serial and parallel generation of large grids.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -pthread GridGeneratorBenchmark.cpp ../MeshGenerator.cpp ../VertexFormat.cpp ../GridGenerator.cpp -o GridGeneratorBenchmark
+// Times MeshGenerator::CreatePlane against GridGenerator with 1 to n workers, flat and
+// with a heightfield, in the float and the quantized vertex formats. Output of every
+// worker count is compared with the output of one worker.
+//
+// Usage: GridGeneratorBenchmark [options]
+//	--size n	grid of n x n cells, 2048 by default (4096 is a streamed terrain tile)
+//	--threads n	largest worker count, the hardware threads by default
+//	--runs n	runs of every case, the median is reported, 3 by default
+// Exit code is 1 if a parallel grid differs from the serial one.
+
+#include "../GridGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+	template<class Function>
+	double Measure(uint runs, Function function)
+	{
+		std::vector<double> times;
+		for (uint run = 0; run < runs; ++run) {
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			function();
+			times.push_back(Milliseconds(std::chrono::steady_clock::now() - start).count());
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	void PrintRow(const char* name, uint numThreads, double ms, uint numVertices)
+	{
+		printf("  %-22s %7u %10.2f ms %8.1f Mvertices/s\n", name, numThreads, ms, numVertices / (ms * 1e3));
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint size = 2048;
+	uint maxThreads = GridGenerator::GetDefaultNumThreads();
+	uint runs = 3;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--size") && hasValue) {
+			size = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--threads") && hasValue) {
+			maxThreads = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--runs") && hasValue) {
+			runs = static_cast<uint>(atoi(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--size n] [--threads n] [--runs n]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (size < 2 || size % 2 || !maxThreads || !runs) {
+		fprintf(stderr, "Size must be even and at least 2, threads and runs above 0\n");
+		return 2;
+	}
+
+	GridGenerator::Desc desc;
+	desc.numCellsX = size;
+	desc.numCellsZ = size;
+	desc.cellSize = Vector2D(2.0f, 2.0f);
+	desc.origin = Vector3D(-static_cast<float>(size), 0.0f, -static_cast<float>(size));
+	const uint numVertices = GridGenerator::GetNumVertices(desc);
+	const uint numIndices = GridGenerator::GetNumIndices(desc);
+	std::vector<float> heights(numVertices);
+	for (uint z = 0; z <= size; ++z) {
+		for (uint x = 0; x <= size; ++x) {
+			heights[static_cast<size_t>(z) * (size + 1) + x] = 20.0f * sinf(x * 0.05f) * cosf(z * 0.03f);
+		}
+	}
+	printf("grid %ux%u: %u vertices, %u triangles\n", size, size, numVertices, numIndices / 3);
+	printf("  %-22s %7s %13s %19s\n", "Case", "Threads", "Time", "Rate");
+
+	// the serial generator makes the same number of vertices
+	const double planeTime = Measure(runs, [size]()
+	{
+		Mesh mesh;
+		MeshGenerator::CreatePlane(mesh, 2 * size, 2 * size, 2, 2);
+	});
+	PrintRow("CreatePlane", 1, planeTime, numVertices);
+
+	bool identical = true;
+	std::vector<uint> indices(numIndices);
+	for (uint q = VertexFormat::NoQuantization; q <= VertexFormat::Quantization16; ++q) {
+		for (uint heightfield = 0; heightfield < 2; ++heightfield) {
+			desc.heights = heightfield ? heights.data() : nullptr;
+			VertexFormat format = VertexFormat::Create(VertexFormat::TexCoord, static_cast<VertexFormat::Quantization>(q));
+			Vector3D minimum;
+			Vector3D maximum;
+			GridGenerator::GetBounds(desc, minimum, maximum);
+			format.SetBounds(minimum, maximum);
+			std::vector<ubyte> reference(static_cast<size_t>(numVertices) * format.GetStride());
+			std::vector<uint> referenceIndices(numIndices);
+			std::vector<ubyte> vertices(reference.size());
+			const std::string name = std::string(heightfield ? "heightfield " : "flat ") + VertexFormat::GetName(static_cast<VertexFormat::Quantization>(q));
+			for (uint numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+				const double ms = Measure(runs, [&]()
+				{
+					GridGenerator::Create(desc, format, vertices.data(), indices.data(), sizeof(uint), numThreads);
+				});
+				PrintRow(name.c_str(), numThreads, ms, numVertices);
+				if (numThreads == 1) {
+					reference.swap(vertices);
+					referenceIndices.swap(indices);
+				} else if (vertices != reference || indices != referenceIndices) {
+					printf("  output of %u workers differs\n", numThreads);
+					identical = false;
+				}
+			}
+		}
+	}
+	return identical ? 0 : 1;
+}
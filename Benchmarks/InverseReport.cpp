@@ -0,0 +1,313 @@
+// InverseReport.cpp: precision of the Matrix4x4 inverses against a double precision reference.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -ffp-contract=off InverseReport.cpp ../Matrix4x4.cpp ../CPUFeatures.cpp -o InverseReport
+// Inverts random matrices with Invert (SIMD::InvertMatrix) and InvertAffine
+// (SIMD::InvertAffineMatrix) and compares them with Gauss-Jordan elimination in double.
+// The error of an inverse is the largest difference of an element relative to the largest
+// element of the reference. It grows with the condition number of the matrix, so the bound is
+//	error <= 128 * cond(M) * 2^-24, cond(M) = |M| |M^-1| in the max row sum norm
+// Cramer's rule has a long tail there, 20 million near singular matrices reach 100. The bound
+// holds up to condition numbers of 1e5, above that the determinant may cancel to 0 and the
+// inverse becomes inf. Checks the bound for
+//	- general matrices, matrices near singular (a column close to another one, condition
+//	  numbers from 1e2 to 1e5) and projections
+//	- affine matrices with rotation, scale from 1e-2 to 1e2 per axis, shear and translation,
+//	  the last row of their inverse has to be exactly 0, 0, 0, 1
+// and that InvertMany and InvertAffineMany give the bits of Invert and InvertAffine, in
+// place too, and that a singular matrix gives inf or NaN.
+//
+// Usage: InverseReport [options]
+//	--matrices n	random matrices of every case, 100000 by default
+// Exit code is 1 if a check fails.
+
+#include "../Matrix4x4.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+	// largest error in units of cond(M) * 2^-24
+	const double Bound = 128.0;
+	const double Epsilon = 1.0 / (1 << 24);
+
+	// Gauss-Jordan elimination with partial pivoting, false if m is singular
+	bool InvertReference(const float* m, double* out)
+	{
+		double a[4][8];
+		for (uint r = 0; r < 4; ++r) {
+			for (uint c = 0; c < 4; ++c) {
+				a[r][c] = m[c * 4 + r];
+				a[r][4 + c] = r == c ? 1.0 : 0.0;
+			}
+		}
+		for (uint c = 0; c < 4; ++c) {
+			uint pivot = c;
+			for (uint r = c + 1; r < 4; ++r) {
+				if (fabs(a[r][c]) > fabs(a[pivot][c])) {
+					pivot = r;
+				}
+			}
+			if (a[pivot][c] == 0.0) {
+				return false;
+			}
+			for (uint k = 0; k < 8; ++k) {
+				std::swap(a[c][k], a[pivot][k]);
+			}
+			for (uint r = 0; r < 4; ++r) {
+				if (r != c) {
+					const double f = a[r][c] / a[c][c];
+					for (uint k = 0; k < 8; ++k) {
+						a[r][k] -= f * a[c][k];
+					}
+				}
+			}
+		}
+		for (uint r = 0; r < 4; ++r) {
+			for (uint c = 0; c < 4; ++c) {
+				out[c * 4 + r] = a[r][4 + c] / a[r][r];
+			}
+		}
+		return true;
+	}
+
+	// max row sum
+	template <typename T>
+	double GetNorm(const T* m)
+	{
+		double norm = 0.0;
+		for (uint r = 0; r < 4; ++r) {
+			double sum = 0.0;
+			for (uint c = 0; c < 4; ++c) {
+				sum += fabs(static_cast<double>(m[c * 4 + r]));
+			}
+			norm = sum > norm ? sum : norm;
+		}
+		return norm;
+	}
+
+	// 0 if m is singular
+	double GetCondition(const Matrix4x4& m)
+	{
+		double inverse[16];
+		return InvertReference(m.Matrix, inverse) ? GetNorm(m.Matrix) * GetNorm(inverse) : 0.0;
+	}
+
+	struct CaseResult {
+		const char* name;
+		uint numMatrices;
+		double maxCondition;
+		// in units of cond(M) * 2^-24
+		double maxError;
+		uint numFailures;
+	};
+
+	void AddResult(CaseResult& result, const Matrix4x4& m, const Matrix4x4& inverse)
+	{
+		double reference[16];
+		if (!InvertReference(m.Matrix, reference)) {
+			return;
+		}
+		double scale = 0.0;
+		double error = 0.0;
+		for (uint i = 0; i < 16; ++i) {
+			scale = fabs(reference[i]) > scale ? fabs(reference[i]) : scale;
+		}
+		for (uint i = 0; i < 16; ++i) {
+			const double e = fabs(inverse.Matrix[i] - reference[i]) / scale;
+			// NaN counts as a failure
+			error = e > error || e != e ? e : error;
+		}
+		const double condition = GetNorm(m.Matrix) * GetNorm(reference);
+		const double units = error / (condition * Epsilon);
+		++result.numMatrices;
+		result.maxCondition = condition > result.maxCondition ? condition : result.maxCondition;
+		result.maxError = units > result.maxError ? units : result.maxError;
+		result.numFailures += !(units <= Bound);
+	}
+
+	class Inputs  {
+	private:
+		std::mt19937 random;
+		std::uniform_real_distribution<float> value;
+	public:
+		Inputs() : random(1), value(-1.0f, 1.0f)
+		{
+		}
+		float Float()
+		{
+			return value(random);
+		}
+		Matrix4x4 General()
+		{
+			Matrix4x4 m;
+			for (uint i = 0; i < 16; ++i) {
+				m.Matrix[i] = Float() * 10.0f;
+			}
+			return m;
+		}
+		// column 3 is column 0 plus a perturbation of relative size 10^-(1..5), condition
+		// numbers from 1e2 to 1e5
+		Matrix4x4 NearSingular()
+		{
+			for (;;) {
+				Matrix4x4 m = General();
+				const float delta = powf(10.0f, -1.0f - 4.0f * (Float() * 0.5f + 0.5f));
+				for (uint r = 0; r < 4; ++r) {
+					m.Matrix[12 + r] = m.Matrix[r] * (1.0f + delta * Float()) + delta * Float();
+				}
+				const double condition = GetCondition(m);
+				if (condition >= 1e2 && condition <= 1e5) {
+					return m;
+				}
+			}
+		}
+		Matrix4x4 Rotation()
+		{
+			Matrix4x4 x, y, z;
+			x.LoadIdentity();
+			y.LoadIdentity();
+			z.LoadIdentity();
+			x.RotateX(Float() * 3.0f);
+			y.RotateY(Float() * 3.0f);
+			z.RotateZ(Float() * 3.0f);
+			return x * y * z;
+		}
+		// view projection of a camera
+		Matrix4x4 Projection()
+		{
+			Matrix4x4 m;
+			m.PerspectiveFovDirect3D(60.0f + Float() * 30.0f, 1.5f + Float() * 0.5f, 0.1f + Float() * 0.05f, 1000.0f + Float() * 500.0f);
+			Matrix4x4 view = Rotation();
+			view.Translate(Float() * 100.0f, Float() * 100.0f, Float() * 100.0f);
+			return m * view;
+		}
+		// rotation, scale per axis from 1e-2 to 1e2, shear and translation
+		Matrix4x4 Affine()
+		{
+			const Matrix4x4 rotation = Rotation();
+			Matrix4x4 scale;
+			scale.LoadIdentity();
+			for (uint i = 0; i < 3; ++i) {
+				scale.Matrix[i * 5] = powf(10.0f, 2.0f * Float());
+			}
+			Matrix4x4 shear;
+			shear.LoadIdentity();
+			shear.Matrix[4] = Float();
+			shear.Matrix[8] = Float();
+			shear.Matrix[9] = Float();
+			Matrix4x4 m = rotation * shear * scale;
+			m.Matrix[3] = m.Matrix[7] = m.Matrix[11] = 0.0f;
+			m.Matrix[12] = Float() * 100.0f;
+			m.Matrix[13] = Float() * 100.0f;
+			m.Matrix[14] = Float() * 100.0f;
+			m.Matrix[15] = 1.0f;
+			return m;
+		}
+	};
+
+	bool IsSame(const Matrix4x4& a, const Matrix4x4& b)
+	{
+		return !memcmp(a.Matrix, b.Matrix, sizeof(a.Matrix));
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numMatrices = 100000;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--matrices") && hasValue) {
+			numMatrices = static_cast<uint>(atoi(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--matrices n]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	bool isValid = true;
+	Inputs inputs;
+	CaseResult results[] = {
+		{ "general", 0, 0.0, 0.0, 0 },
+		{ "near singular", 0, 0.0, 0.0, 0 },
+		{ "projection", 0, 0.0, 0.0, 0 },
+		{ "affine", 0, 0.0, 0.0, 0 },
+		{ "affine, general", 0, 0.0, 0.0, 0 }
+	};
+	uint numAffineRows = 0;
+	std::vector<Matrix4x4> general(numMatrices);
+	std::vector<Matrix4x4> affine(numMatrices);
+	std::vector<Matrix4x4> inverses(numMatrices);
+	std::vector<Matrix4x4> affineInverses(numMatrices);
+	for (uint i = 0; i < numMatrices; ++i) {
+		general[i] = i % 2 ? inputs.General() : inputs.NearSingular();
+		affine[i] = inputs.Affine();
+		inverses[i].Invert(general[i]);
+		affineInverses[i].InvertAffine(affine[i]);
+		AddResult(results[i % 2 ? 0 : 1], general[i], inverses[i]);
+		const Matrix4x4 projection = inputs.Projection();
+		AddResult(results[2], projection, Invert(projection));
+		AddResult(results[3], affine[i], affineInverses[i]);
+		AddResult(results[4], affine[i], Invert(affine[i]));
+		const float* row = affineInverses[i].Matrix;
+		numAffineRows += row[3] != 0.0f || row[7] != 0.0f || row[11] != 0.0f || row[15] != 1.0f;
+	}
+	printf("%-20s %10s %12s %10s\n", "Case", "matrices", "max cond", "max error");
+	for (const CaseResult& result : results) {
+		printf("%-20s %10u %12.3g %10.3f\n", result.name, result.numMatrices, result.maxCondition, result.maxError);
+		if (result.numFailures) {
+			printf("%s: %u inverses above %.0f * cond(M) * 2^-24\n", result.name, result.numFailures, Bound);
+			isValid = false;
+		}
+	}
+	if (numAffineRows) {
+		printf("affine: %u inverses without the last row 0, 0, 0, 1\n", numAffineRows);
+		isValid = false;
+	}
+
+	// batches give the bits of the single inverses, in place too
+	std::vector<Matrix4x4> many(numMatrices);
+	Matrix4x4::InvertMany(general.data(), many.data(), numMatrices);
+	std::vector<Matrix4x4> inPlace = affine;
+	Matrix4x4::InvertAffineMany(inPlace.data(), inPlace.data(), numMatrices);
+	uint numManyMismatches = 0;
+	uint numAffineManyMismatches = 0;
+	for (uint i = 0; i < numMatrices; ++i) {
+		numManyMismatches += !IsSame(many[i], inverses[i]);
+		numAffineManyMismatches += !IsSame(inPlace[i], affineInverses[i]);
+	}
+	inPlace = general;
+	Matrix4x4::InvertMany(inPlace.data(), inPlace.data(), numMatrices);
+	for (uint i = 0; i < numMatrices; ++i) {
+		numManyMismatches += !IsSame(inPlace[i], inverses[i]);
+	}
+	if (numManyMismatches || numAffineManyMismatches) {
+		printf("InvertMany: %u, InvertAffineMany: %u results differ from the single inverse\n", numManyMismatches, numAffineManyMismatches);
+		isValid = false;
+	}
+
+	// two equal columns
+	Matrix4x4 singular = inputs.General();
+	memcpy(singular.Matrix + 4, singular.Matrix, 4 * sizeof(float));
+	const Matrix4x4 singularInverse = Invert(singular);
+	bool isFinite = true;
+	for (uint i = 0; i < 16; ++i) {
+		isFinite = isFinite && std::isfinite(singularInverse.Matrix[i]);
+	}
+	if (isFinite) {
+		printf("singular matrix has a finite inverse\n");
+		isValid = false;
+	}
+
+	printf("bound                %8.0f * cond(M) * 2^-24\n", Bound);
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
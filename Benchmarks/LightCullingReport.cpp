@@ -0,0 +1,347 @@
+// LightCullingReport.cpp: LightCullingEmulator against a reference cull.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -ffp-contract=off LightCullingReport.cpp -o LightCullingReport
+// Culls random lights around a camera with the emulator of the CullLights compute shader
+// and with a reference in double precision which walks the lights in order. Lights closer
+// to a plane or a LOD threshold than the float error are moved, so both have to agree.
+// Checks that
+//	- the instance count of every bucket is the count of the reference
+//	- every bucket holds the lights of the reference in light order (the emulator appends
+//	  the groups in dispatch order)
+//	- Validate accepts the emulation, the emulation with the chunks of a bucket in another
+//	  order and chunks of a wave size, and rejects a swapped pair, a missing light and a
+//	  wrong count
+//	- IndirectLightCommands::Build on the bucket counts of the emulation, and on them with
+//	  every set of buckets emptied, writes the command count of every pass, compacts the
+//	  templates of the non empty buckets in LOD order from the argument offset of the pass,
+//	  patches the bucket count in at InstanceCountOffset and leaves the other bytes alone
+// and reports the time of the emulation.
+//
+// Usage: LightCullingReport [options]
+//	--lights n	lights, 100000 by default
+// Exit code is 1 if a check fails.
+
+#include "../LightCullingEmulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+	// LightPassRadius and LightLodRatios of LightIndexedDeferredRendering
+	const float PassRadius[IndirectLightCommands::NumPasses] = { 0.0f, 1.0f };
+	const float LodRatios[IndirectLightCommands::NumLods - 1] = { 0.25f, 0.05f };
+	// lights this close (relative) to a plane or a LOD threshold are moved
+	const double Margin = 1e-4;
+	// threads of a wave of the cs_6_0 kernel
+	const uint WaveSize = 32;
+
+	typedef std::vector<LightInstanceData> Bucket;
+
+	// camera at the origin looking along z, 60 degree field of view, planes point inside
+	void InitConstants(CullingConstants& constants, uint numLights)
+	{
+		memset(&constants, 0, sizeof(constants));
+		const double halfAngle = 30.0 * 3.14159265358979 / 180.0;
+		const double c = cos(halfAngle);
+		const double s = sin(halfAngle);
+		const double planes[CullingConstants::NumPlanes][4] = {
+			{ c, 0.0, s, 0.0 }, { -c, 0.0, s, 0.0 },
+			{ 0.0, c, s, 0.0 }, { 0.0, -c, s, 0.0 },
+			{ 0.0, 0.0, 1.0, -1.0 }, { 0.0, 0.0, -1.0, 1000.0 }
+		};
+		for (uint i = 0; i < CullingConstants::NumPlanes; ++i) {
+			for (uint j = 0; j < 4; ++j) {
+				constants.planes[i][j] = static_cast<float>(planes[i][j]);
+			}
+		}
+		for (uint i = 0; i < IndirectLightCommands::NumLods - 1; ++i) {
+			constants.lodThresholds[i] = LodRatios[i] * LodRatios[i];
+		}
+		memcpy(constants.passRadius, PassRadius, sizeof(PassRadius));
+		constants.numLights = numLights;
+	}
+
+	// LOD of the light in the pass, or InvalidLod if it is culled; isClose is set when
+	// float rounding could change the result
+	uint ClassifyReference(const CullingConstants& constants, uint pass, const float* posRange, bool& isClose)
+	{
+		const double radius = constants.passRadius[pass] > 0.0f ? constants.passRadius[pass] : posRange[3];
+		bool isVisible = true;
+		for (uint i = 0; i < CullingConstants::NumPlanes; ++i) {
+			const float* plane = constants.planes[i];
+			const double d = static_cast<double>(plane[0]) * posRange[0] + static_cast<double>(plane[1]) * posRange[1] + static_cast<double>(plane[2]) * posRange[2] + plane[3];
+			const double scale = fabs(posRange[0]) + fabs(posRange[1]) + fabs(posRange[2]) + fabs(plane[3]) + radius;
+			isClose = isClose || fabs(d + radius) <= Margin * scale;
+			isVisible = isVisible && d > -radius;
+		}
+		if (!isVisible) {
+			return LightCullingEmulator::InvalidLod;
+		}
+		double d2 = 0.0;
+		for (uint i = 0; i < 3; ++i) {
+			const double v = static_cast<double>(posRange[i]) - constants.cameraPosition[i];
+			d2 += v * v;
+		}
+		const double r2 = radius * radius;
+		uint lod = 0;
+		for (uint i = 0; i < IndirectLightCommands::NumLods - 1; ++i) {
+			const double t = constants.lodThresholds[i] * d2;
+			isClose = isClose || fabs(r2 - t) <= Margin * t;
+			lod += r2 < t ? 1 : 0;
+		}
+		return lod;
+	}
+
+	// lights in a box around the frustum, none of them close to a decision of the cull
+	std::vector<CullingLightInfo> CreateLights(const CullingConstants& constants, uint numLights, uint& numMoved)
+	{
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> xy(-700.0f, 700.0f);
+		std::uniform_real_distribution<float> z(-50.0f, 1100.0f);
+		std::uniform_real_distribution<float> range(1.0f, 60.0f);
+		std::vector<CullingLightInfo> lights(numLights);
+		numMoved = 0;
+		for (uint i = 0; i < numLights; ++i) {
+			CullingLightInfo& light = lights[i];
+			memset(&light, 0, sizeof(light));
+			light.instanceData.lightIndex = i;
+			bool isClose = true;
+			while (isClose) {
+				float* posRange = light.instanceData.posRange;
+				posRange[0] = xy(random);
+				posRange[1] = xy(random);
+				posRange[2] = z(random);
+				posRange[3] = range(random);
+				isClose = false;
+				for (uint pass = 0; pass < IndirectLightCommands::NumPasses; ++pass) {
+					ClassifyReference(constants, pass, posRange, isClose);
+				}
+				numMoved += isClose ? 1 : 0;
+			}
+		}
+		return lights;
+	}
+
+	// visible lights of every bucket in light order
+	std::vector<Bucket> CullReference(const CullingConstants& constants, const std::vector<CullingLightInfo>& lights)
+	{
+		std::vector<Bucket> buckets(IndirectLightCommands::NumCommands);
+		for (uint pass = 0; pass < IndirectLightCommands::NumPasses; ++pass) {
+			for (const CullingLightInfo& light : lights) {
+				bool isClose = false;
+				const uint lod = ClassifyReference(constants, pass, light.instanceData.posRange, isClose);
+				if (lod != LightCullingEmulator::InvalidLod) {
+					buckets[IndirectLightCommands::GetCommandIndex(pass, lod)].push_back(light.instanceData);
+				}
+			}
+		}
+		return buckets;
+	}
+
+	bool IsEqual(const LightInstanceData& a, const LightInstanceData& b)
+	{
+		return !memcmp(&a, &b, sizeof(LightInstanceData));
+	}
+
+	// Build on the bucket counts, false with the first mismatch printed
+	bool CheckCommands(const uint* bucketCounts)
+	{
+		typedef IndirectLightCommands Commands;
+		// templates with distinct bytes and a stale instance count
+		Commands::Command templates[Commands::NumCommands];
+		for (uint command = 0; command < Commands::NumCommands; ++command) {
+			ubyte* bytes = reinterpret_cast<ubyte *>(&templates[command]);
+			for (uint i = 0; i < sizeof(Commands::Command); ++i) {
+				bytes[i] = static_cast<ubyte>(command * 31 + i + 1);
+			}
+		}
+		std::vector<uint> countBuffer(Commands::GetCountBufferSize() / sizeof(uint), 0xcdcdcdcd);
+		for (uint command = 0; command < Commands::NumCommands; ++command) {
+			countBuffer[Commands::GetBucketCountOffset(command) / sizeof(uint)] = bucketCounts[command];
+		}
+		// commands past the count of a pass keep the bytes of the clear
+		std::vector<ubyte> arguments(Commands::NumCommands * sizeof(Commands::Command), 0xcd);
+		Commands::Build(templates, countBuffer.data(), reinterpret_cast<Commands::Command *>(arguments.data()));
+		for (uint command = 0; command < Commands::NumCommands; ++command) {
+			if (countBuffer[Commands::GetBucketCountOffset(command) / sizeof(uint)] != bucketCounts[command]) {
+				printf("Build changed the instance count of pass %u LOD %u\n", command / Commands::NumLods, command % Commands::NumLods);
+				return false;
+			}
+		}
+		const std::vector<ubyte> cleared(sizeof(Commands::Command), 0xcd);
+		for (uint pass = 0; pass < Commands::NumPasses; ++pass) {
+			uint numCommands = 0;
+			for (uint lod = 0; lod < Commands::NumLods; ++lod) {
+				const uint command = Commands::GetCommandIndex(pass, lod);
+				if (!bucketCounts[command]) {
+					continue;
+				}
+				ubyte expected[sizeof(Commands::Command)];
+				memcpy(expected, &templates[command], sizeof(expected));
+				memcpy(expected + Commands::InstanceCountOffset, &bucketCounts[command], sizeof(uint));
+				const ubyte* written = &arguments[Commands::GetArgumentOffset(pass) + numCommands++ * sizeof(Commands::Command)];
+				if (memcmp(written, expected, sizeof(expected))) {
+					printf("command %u of pass %u is not the template of LOD %u with %u instances\n", numCommands - 1, pass, lod, bucketCounts[command]);
+					return false;
+				}
+			}
+			if (countBuffer[Commands::GetCountOffset(pass) / sizeof(uint)] != numCommands) {
+				printf("pass %u has %u commands, not %u\n", pass, countBuffer[Commands::GetCountOffset(pass) / sizeof(uint)], numCommands);
+				return false;
+			}
+			for (uint i = numCommands; i < Commands::NumLods; ++i) {
+				if (memcmp(&arguments[Commands::GetArgumentOffset(pass) + i * sizeof(Commands::Command)], cleared.data(), cleared.size())) {
+					printf("command %u of pass %u is written past the count\n", i, pass);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// the chunks of chunkSize lights of every bucket in reverse order, as the groups
+	// or waves of the shader may reach the atomic
+	std::vector<LightInstanceData> ReverseChunks(const CullingConstants& constants, const std::vector<CullingLightInfo>& lights, uint chunkSize, const uint* counts)
+	{
+		const uint numLights = constants.numLights;
+		std::vector<LightInstanceData> output(IndirectLightCommands::NumCommands * numLights);
+		std::vector<Bucket> chunks;
+		for (uint command = 0; command < IndirectLightCommands::NumCommands; ++command) {
+			const uint pass = command / IndirectLightCommands::NumLods;
+			const uint lod = command % IndirectLightCommands::NumLods;
+			chunks.clear();
+			for (uint first = 0; first < numLights; first += chunkSize) {
+				Bucket chunk;
+				for (uint i = first; i < first + chunkSize && i < numLights; ++i) {
+					if (LightCullingEmulator::Classify(constants, pass, lights[i].instanceData.posRange) == lod) {
+						chunk.push_back(lights[i].instanceData);
+					}
+				}
+				if (!chunk.empty()) {
+					chunks.push_back(chunk);
+				}
+			}
+			uint pos = 0;
+			for (std::vector<Bucket>::reverse_iterator it = chunks.rbegin(); it != chunks.rend(); ++it) {
+				std::copy(it->begin(), it->end(), output.begin() + command * numLights + pos);
+				pos += static_cast<uint>(it->size());
+			}
+			if (pos != counts[command]) {
+				output.clear();
+				break;
+			}
+		}
+		return output;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numLights = 100000;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--lights") && hasValue) {
+			numLights = static_cast<uint>(atoi(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--lights n]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (numLights < 2 * LightCullingEmulator::GroupSize) {
+		fprintf(stderr, "Lights must be at least %u\n", 2 * LightCullingEmulator::GroupSize);
+		return 2;
+	}
+
+	CullingConstants constants;
+	InitConstants(constants, numLights);
+	uint numMoved = 0;
+	const std::vector<CullingLightInfo> lights = CreateLights(constants, numLights, numMoved);
+
+	std::vector<LightInstanceData> output(IndirectLightCommands::NumCommands * numLights);
+	uint counts[IndirectLightCommands::NumCommands];
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	LightCullingEmulator::Run(constants, lights.data(), output.data(), counts);
+	const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	bool isValid = true;
+	const std::vector<Bucket> reference = CullReference(constants, lights);
+	printf("%-20s %10s %10s\n", "Bucket", "emulator", "reference");
+	for (uint command = 0; command < IndirectLightCommands::NumCommands; ++command) {
+		const Bucket& expected = reference[command];
+		const uint count = static_cast<uint>(expected.size());
+		uint firstMismatch = count;
+		for (uint i = 0; i < count && i < counts[command] && firstMismatch == count; ++i) {
+			if (!IsEqual(output[command * numLights + i], expected[i])) {
+				firstMismatch = i;
+			}
+		}
+		printf("pass %u LOD %u %17u %10u\n", command / IndirectLightCommands::NumLods, command % IndirectLightCommands::NumLods, counts[command], count);
+		if (counts[command] != count) {
+			printf("pass %u LOD %u: %u lights, not %u\n", command / IndirectLightCommands::NumLods, command % IndirectLightCommands::NumLods, counts[command], count);
+			isValid = false;
+		} else if (firstMismatch != count) {
+			printf("pass %u LOD %u: instance %u is light %u, not %u\n", command / IndirectLightCommands::NumLods, command % IndirectLightCommands::NumLods, firstMismatch,
+				output[command * numLights + firstMismatch].lightIndex, expected[firstMismatch].lightIndex);
+			isValid = false;
+		}
+	}
+	if (!isValid) {
+		printf("failed\n");
+		return 1;
+	}
+
+	if (!LightCullingEmulator::Validate(constants, lights.data(), output.data(), counts)) {
+		printf("Validate rejects the emulation\n");
+		isValid = false;
+	}
+	const std::vector<LightInstanceData> groups = ReverseChunks(constants, lights, LightCullingEmulator::GroupSize, counts);
+	if (groups.empty() || !LightCullingEmulator::Validate(constants, lights.data(), groups.data(), counts)) {
+		printf("Validate rejects the groups in reverse order\n");
+		isValid = false;
+	}
+	const std::vector<LightInstanceData> waves = ReverseChunks(constants, lights, WaveSize, counts);
+	if (waves.empty() || !LightCullingEmulator::Validate(constants, lights.data(), waves.data(), counts, WaveSize)) {
+		printf("Validate rejects the waves in reverse order\n");
+		isValid = false;
+	}
+	// the largest bucket is broken in every way
+	const uint command = static_cast<uint>(std::max_element(counts, counts + IndirectLightCommands::NumCommands) - counts);
+	std::vector<LightInstanceData> swapped = output;
+	std::swap(swapped[command * numLights], swapped[command * numLights + 1]);
+	std::vector<LightInstanceData> missing = output;
+	missing[command * numLights + counts[command] / 2].lightIndex = ~0u;
+	uint wrongCounts[IndirectLightCommands::NumCommands];
+	memcpy(wrongCounts, counts, sizeof(counts));
+	--wrongCounts[command];
+	if (LightCullingEmulator::Validate(constants, lights.data(), swapped.data(), counts) || LightCullingEmulator::Validate(constants, lights.data(), missing.data(), counts) ||
+		LightCullingEmulator::Validate(constants, lights.data(), output.data(), wrongCounts)) {
+		printf("Validate accepts a broken bucket\n");
+		isValid = false;
+	}
+	// the commands of the culled counts, then with every set of buckets empty
+	const uint numPatterns = 1 << IndirectLightCommands::NumCommands;
+	for (uint pattern = 0; pattern < numPatterns && isValid; ++pattern) {
+		uint bucketCounts[IndirectLightCommands::NumCommands];
+		for (uint i = 0; i < IndirectLightCommands::NumCommands; ++i) {
+			bucketCounts[i] = (pattern >> i) & 1 ? 0 : counts[i];
+		}
+		isValid = CheckCommands(bucketCounts);
+	}
+
+	printf("lights               %8u, %u moved off a decision of the cull\n", numLights, numMoved);
+	printf("emulation            %8.2f ms, %.1f ns per light\n", time, time * 1e6 / numLights);
+	printf("indirect commands    %8u sets of empty buckets\n", numPatterns);
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
@@ -0,0 +1,647 @@
+// MathBenchmark.cpp: micro benchmarks of the math classes.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -ffp-contract=off MathBenchmark.cpp ../Vector3D.cpp ../Vector4D.cpp ../Matrix4x4.cpp ../Quaternion.cpp ../CPUFeatures.cpp -o MathBenchmark
+// Add -mavx2 for the AVX2 backend of SIMD.h or -DSIMD_FORCE_SCALAR for the scalar one.
+// Operations of the headers run on the backend SIMD.h is compiled with, their names
+// end with the backend. Batch kernels are dispatched at run time, they are measured
+// on every level the CPU supports and their names end with the level.
+//
+// Usage: MathBenchmark [options]
+//	--filter text		run benchmarks whose name contains text
+//	--min-time ms		time of every benchmark, 200 by default
+//	--write file		save results as JSON baseline
+//	--compare file		compare with a baseline, exit code is 1 if any benchmark regressed
+//	--threshold percent	allowed slowdown against the baseline, 10 by default
+
+#include "../Vector2D.h"
+#include "../Vector3D.h"
+#include "../Vector4D.h"
+#include "../Matrix4x4.h"
+#include "../Quaternion.h"
+#include "../Plane.h"
+#include "../Frustum.h"
+#include "../BoundingBox.h"
+#include "../BoundingSphere.h"
+#include "../CPUFeatures.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace {
+
+#if defined(SIMD_AVX2)
+	const char* const BackendName = "AVX2";
+#elif defined(SIMD_SSE2)
+	const char* const BackendName = "SSE2";
+#elif defined(SIMD_NEON)
+	const char* const BackendName = "NEON";
+#else
+	const char* const BackendName = "Scalar";
+#endif
+
+	// elements processed by every call of a benchmark, inputs stay in L1/L2
+	const size_t NumElements = 1024;
+	// a benchmark is timed several times, the fastest trial is the one least disturbed
+	// by interrupts and other processes
+	const uint NumTrials = 7;
+	// a benchmark slower than the baseline is measured again before it counts as regression
+	const uint NumRetries = 2;
+
+	struct Benchmark {
+		std::string name;
+		std::function<void()> func;
+		// operations done by one call of func
+		size_t numOps;
+		// level of the batch kernels
+		CPUFeatures::SIMDLevel level;
+	};
+
+	struct Result {
+		std::string name;
+		double nsPerOp;
+		// TSC cycles, 0 if there is no time stamp counter
+		double cyclesPerOp;
+	};
+
+	// results are accumulated so the compiler can't drop the measured code
+	volatile float sink;
+
+	// inputs and outputs of all benchmarks
+	struct Data {
+		float x[NumElements];
+		float y[NumElements];
+		float z[NumElements];
+		float w[NumElements];
+		float t[NumElements];
+		float outX[NumElements];
+		float outY[NumElements];
+		float outZ[NumElements];
+		float outW[NumElements];
+		float minX[NumElements];
+		float minY[NumElements];
+		float minZ[NumElements];
+		float maxX[NumElements];
+		float maxY[NumElements];
+		float maxZ[NumElements];
+		Vector3D v3[NumElements];
+		Vector3D u3[NumElements];
+		Vector3D out3[NumElements];
+		Vector4D v4[NumElements];
+		Vector4D u4[NumElements];
+		Vector4D out4[NumElements];
+		Quaternion q[NumElements];
+		Quaternion p[NumElements];
+		Quaternion outQ[NumElements];
+		Matrix4x4 m[NumElements];
+		Matrix4x4 outM[NumElements];
+		BoundingBox boxes[NumElements];
+		BoundingSphere spheres[NumElements];
+		Vector4D sphereData[NumElements];
+		Vector3D minPoints[NumElements];
+		Vector3D maxPoints[NumElements];
+		Plane planes[NumElements];
+		ubyte visible[NumElements];
+		Frustum frustum;
+		Matrix4x4 viewProj;
+	};
+	Data* data;
+
+	// deterministic inputs, the same on every run
+	uint seed = 1;
+	float Random(float minValue, float maxValue)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return minValue + (maxValue - minValue) * ((seed >> 8) * (1.0f / 16777216.0f));
+	}
+
+	void InitData(Data& d)
+	{
+		for (size_t i = 0; i < NumElements; ++i) {
+			d.x[i] = Random(-10.0f, 10.0f);
+			d.y[i] = Random(-10.0f, 10.0f);
+			d.z[i] = Random(-10.0f, 10.0f);
+			d.w[i] = Random(0.5f, 2.0f);
+			d.t[i] = Random(0.0f, 1.0f);
+			d.v3[i] = Vector3D(d.x[i], d.y[i], d.z[i]);
+			d.u3[i] = Vector3D(d.y[i], d.z[i], d.x[i]);
+			d.v4[i] = Vector4D(d.x[i], d.y[i], d.z[i], d.w[i]);
+			d.u4[i] = Vector4D(d.w[i], d.z[i], d.y[i], d.x[i]);
+			d.q[i].CreateFromAxisAngle(Vector3D(d.x[i], d.y[i], d.z[i]).Normalize(), d.t[i] * 360.0f);
+			d.p[i].CreateFromAxisAngle(Vector3D(d.z[i], d.x[i], d.y[i]).Normalize(), d.w[i] * 90.0f);
+			// invertible affine transforms
+			d.m[i].FromQuaternion(d.q[i]);
+			d.m[i].Translate(d.x[i], d.y[i], d.z[i]);
+			const Vector3D size(d.w[i], d.w[i] * 0.5f, d.w[i] * 2.0f);
+			d.minPoints[i] = d.v3[i] - size;
+			d.maxPoints[i] = d.v3[i] + size;
+			d.minX[i] = d.minPoints[i].x;
+			d.minY[i] = d.minPoints[i].y;
+			d.minZ[i] = d.minPoints[i].z;
+			d.maxX[i] = d.maxPoints[i].x;
+			d.maxY[i] = d.maxPoints[i].y;
+			d.maxZ[i] = d.maxPoints[i].z;
+			d.boxes[i].InitBoundingBox(d.minPoints[i], d.maxPoints[i]);
+			d.spheres[i] = BoundingSphere(d.v3[i], d.w[i]);
+			d.sphereData[i] = d.v4[i];
+			d.planes[i].ComputePlane(d.u3[i].Normalize(), d.v3[i]);
+		}
+		Matrix4x4 proj;
+		proj.PerspectiveFovDirect3D(60.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+		Matrix4x4 view;
+		view.LookAtDirect3D(Vector3D(0.0f, 0.0f, -15.0f), Vector3D(0.0f, 0.0f, 0.0f), Vector3D(0.0f, 1.0f, 0.0f));
+		d.viewProj = view * proj;
+		d.frustum.ExtractFrustum(d.viewProj);
+	}
+
+	uint64 ReadCycles()
+	{
+#ifdef CPU_X86
+		return __rdtsc();
+#else
+		return 0;
+#endif
+	}
+
+	Result Measure(const Benchmark& benchmark, double minTime)
+	{
+		typedef std::chrono::steady_clock Clock;
+		CPUFeatures::SetSIMDLevel(benchmark.level);
+		benchmark.func();
+		// calls of a trial, doubled until a trial takes its share of minTime
+		const double trialTime = minTime / NumTrials;
+		size_t numCalls = 1;
+		for (;;) {
+			const Clock::time_point start = Clock::now();
+			for (size_t i = 0; i < numCalls; ++i) {
+				benchmark.func();
+			}
+			const double time = std::chrono::duration<double>(Clock::now() - start).count();
+			if (time >= trialTime || numCalls >= (1u << 30)) {
+				break;
+			}
+			numCalls *= 2;
+		}
+		Result result;
+		result.name = benchmark.name;
+		result.nsPerOp = DBL_MAX;
+		result.cyclesPerOp = DBL_MAX;
+		for (uint trial = 0; trial < NumTrials; ++trial) {
+			const Clock::time_point start = Clock::now();
+			const uint64 startCycles = ReadCycles();
+			for (size_t i = 0; i < numCalls; ++i) {
+				benchmark.func();
+			}
+			const uint64 endCycles = ReadCycles();
+			const double time = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+			const double numOps = static_cast<double>(numCalls) * benchmark.numOps;
+			result.nsPerOp = std::min(result.nsPerOp, time / numOps);
+			result.cyclesPerOp = std::min(result.cyclesPerOp, (endCycles - startCycles) / numOps);
+		}
+		return result;
+	}
+
+	void Add(std::vector<Benchmark>& benchmarks, const char* name, std::function<void()> func, size_t numOps = NumElements)
+	{
+		Benchmark benchmark;
+		benchmark.name = std::string(name) + "/" + BackendName;
+		benchmark.func = func;
+		benchmark.numOps = numOps;
+		benchmark.level = CPUFeatures::GetMaxSIMDLevel();
+		benchmarks.push_back(benchmark);
+	}
+
+	// batch kernel on every supported level
+	void AddBatch(std::vector<Benchmark>& benchmarks, const char* name, std::function<void()> func, size_t numOps = NumElements)
+	{
+		for (uint level = CPUFeatures::ScalarLevel; level <= CPUFeatures::GetMaxSIMDLevel(); ++level) {
+			Benchmark benchmark;
+			benchmark.level = static_cast<CPUFeatures::SIMDLevel>(level);
+			benchmark.name = std::string(name) + "/" + CPUFeatures::GetName(benchmark.level);
+			benchmark.func = func;
+			benchmark.numOps = numOps;
+			benchmarks.push_back(benchmark);
+		}
+	}
+
+	void AddConstruction(std::vector<Benchmark>& benchmarks)
+	{
+		Add(benchmarks, "Vector3D::Vector3D", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.out3[i] = Vector3D(d.x[i], d.y[i], d.z[i]);
+			}
+		});
+		Add(benchmarks, "Vector4D::Vector4D", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.out4[i] = Vector4D(d.x[i], d.y[i], d.z[i], d.w[i]);
+			}
+		});
+		Add(benchmarks, "Matrix4x4::MakePerspectiveDirect3D", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.outM[i] = Matrix4x4::MakePerspectiveDirect3D(d.w[i], d.w[i] + 1.0f, 0.1f, 100.0f);
+			}
+		});
+		Add(benchmarks, "Matrix4x4::FromQuaternion", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.outM[i].FromQuaternion(d.q[i]);
+			}
+		});
+		Add(benchmarks, "Quaternion::CreateFromAxisAngle", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.outQ[i].CreateFromAxisAngle(d.x[i], d.y[i], d.z[i], d.t[i]);
+			}
+		});
+	}
+
+	void AddProducts(std::vector<Benchmark>& benchmarks)
+	{
+		Add(benchmarks, "Vector3D::dotProduct", [] {
+			Data& d = *data;
+			float sum = 0.0f;
+			for (size_t i = 0; i < NumElements; ++i) {
+				sum += dotProduct(d.v3[i], d.u3[i]);
+			}
+			sink = sum;
+		});
+		Add(benchmarks, "Vector3D::crossProduct", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.out3[i] = crossProduct(d.v3[i], d.u3[i]);
+			}
+		});
+		Add(benchmarks, "Vector4D::operator*", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.out4[i] = d.v4[i] * d.u4[i];
+			}
+		});
+		Add(benchmarks, "Matrix4x4::operator*(Matrix4x4)", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.outM[i] = d.m[i] * d.viewProj;
+			}
+		});
+		Add(benchmarks, "Matrix4x4::operator*(Vector3D)", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.out3[i] = d.viewProj * d.v3[i];
+			}
+		});
+		Add(benchmarks, "Quaternion::operator*", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.outQ[i] = d.q[i] * d.p[i];
+			}
+		});
+		AddBatch(benchmarks, "Matrix4x4::TransformPoints", [] {
+			Data& d = *data;
+			d.viewProj.TransformPoints(d.x, d.y, d.z, d.outX, d.outY, d.outZ, NumElements);
+		});
+		AddBatch(benchmarks, "Matrix4x4::TransformPoints(Vector3D)", [] {
+			Data& d = *data;
+			d.viewProj.TransformPoints(d.v3, sizeof(Vector3D), d.out3, sizeof(Vector3D), NumElements);
+		});
+		AddBatch(benchmarks, "Quaternion::MulMany", [] {
+			Data& d = *data;
+			const QuaternionArrays a = { d.x, d.y, d.z, d.w };
+			const QuaternionArrays b = { d.y, d.z, d.w, d.x };
+			const QuaternionArrays out = { d.outX, d.outY, d.outZ, d.outW };
+			Quaternion::MulMany(a, b, out, NumElements);
+		});
+		AddBatch(benchmarks, "Quaternion::ToMatrixMany", [] {
+			Data& d = *data;
+			const QuaternionArrays q = { d.x, d.y, d.z, d.w };
+			Quaternion::ToMatrixMany(q, d.outM, NumElements);
+		});
+	}
+
+	void AddNormalization(std::vector<Benchmark>& benchmarks)
+	{
+		Add(benchmarks, "Vector3D::Normalize", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.out3[i] = d.v3[i];
+				d.out3[i].Normalize();
+			}
+		});
+		Add(benchmarks, "Vector4D::Normalize", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.out4[i] = d.v4[i];
+				d.out4[i].Normalize();
+			}
+		});
+		Add(benchmarks, "Quaternion::Normalize", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.outQ[i] = d.q[i];
+				d.outQ[i] *= 2.0f;
+				d.outQ[i].Normalize();
+			}
+		});
+		Add(benchmarks, "Quaternion::Slerp", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				Slerp(d.q[i], d.p[i], d.t[i], d.outQ[i]);
+			}
+		});
+		Add(benchmarks, "Quaternion::Nlerp", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				Nlerp(d.q[i], d.p[i], d.t[i], d.outQ[i]);
+			}
+		});
+		AddBatch(benchmarks, "Vector3D::NormalizeMany", [] {
+			Data& d = *data;
+			Vector3D::NormalizeMany(d.x, d.y, d.z, d.outX, d.outY, d.outZ, NumElements);
+		});
+		AddBatch(benchmarks, "Vector3D::NormalizeMany(NormalizeFast)", [] {
+			Data& d = *data;
+			Vector3D::NormalizeMany(d.x, d.y, d.z, d.outX, d.outY, d.outZ, NumElements, Vector3D::NormalizeFast);
+		});
+		Add(benchmarks, "Vector4D::NormalizeMany", [] {
+			Data& d = *data;
+			Vector4D::NormalizeMany(d.v4, d.out4, NumElements);
+		});
+		Add(benchmarks, "Vector4D::NormalizeMany(NormalizeFast)", [] {
+			Data& d = *data;
+			Vector4D::NormalizeMany(d.v4, d.out4, NumElements, Vector4D::NormalizeFast);
+		});
+		AddBatch(benchmarks, "Quaternion::NormalizeMany", [] {
+			Data& d = *data;
+			const QuaternionArrays q = { d.x, d.y, d.z, d.w };
+			const QuaternionArrays out = { d.outX, d.outY, d.outZ, d.outW };
+			Quaternion::NormalizeMany(q, out, NumElements);
+		});
+		AddBatch(benchmarks, "Quaternion::SlerpMany(SlerpFast)", [] {
+			Data& d = *data;
+			const QuaternionArrays a = { d.x, d.y, d.z, d.w };
+			const QuaternionArrays b = { d.y, d.z, d.w, d.x };
+			const QuaternionArrays out = { d.outX, d.outY, d.outZ, d.outW };
+			Quaternion::SlerpMany(a, b, d.t, out, NumElements, Quaternion::SlerpFast);
+		});
+	}
+
+	void AddInverse(std::vector<Benchmark>& benchmarks)
+	{
+		Add(benchmarks, "Matrix4x4::Invert", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.outM[i].Invert(d.m[i]);
+			}
+		});
+		Add(benchmarks, "Matrix4x4::InvertAffine", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.outM[i].InvertAffine(d.m[i]);
+			}
+		});
+		Add(benchmarks, "Matrix4x4::InvertMany", [] {
+			Data& d = *data;
+			Matrix4x4::InvertMany(d.m, d.outM, NumElements);
+		});
+		Add(benchmarks, "Matrix4x4::InvertAffineMany", [] {
+			Data& d = *data;
+			Matrix4x4::InvertAffineMany(d.m, d.outM, NumElements);
+		});
+	}
+
+	void AddFrustum(std::vector<Benchmark>& benchmarks)
+	{
+		Add(benchmarks, "Frustum::ExtractFrustum", [] {
+			Data& d = *data;
+			Frustum frustum;
+			for (size_t i = 0; i < NumElements; ++i) {
+				frustum.ExtractFrustum(d.m[i]);
+			}
+			sink = frustum.GetPlane(0).GetD();
+		});
+		Add(benchmarks, "Frustum::SphereInFrustum", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.visible[i] = d.frustum.SphereInFrustum(d.v3[i], d.w[i]);
+			}
+		});
+		Add(benchmarks, "Frustum::SpheresInFrustum", [] {
+			Data& d = *data;
+			d.frustum.SpheresInFrustum(d.sphereData, NumElements, d.visible);
+		});
+		Add(benchmarks, "Frustum::BoundingBoxInFrustum", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.visible[i] = d.frustum.BoundingBoxInFrustum(d.minPoints[i], d.maxPoints[i]);
+			}
+		});
+		Add(benchmarks, "Frustum::BoundingBoxesInFrustum", [] {
+			Data& d = *data;
+			d.frustum.BoundingBoxesInFrustum(d.minX, d.minY, d.minZ, d.maxX, d.maxY, d.maxZ, NumElements, d.visible);
+		});
+	}
+
+	void AddBounds(std::vector<Benchmark>& benchmarks)
+	{
+		Add(benchmarks, "BoundingBox::OverlapsAABB", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.visible[i] = d.boxes[i].OverlapsAABB(d.boxes[(i + 1) % NumElements]);
+			}
+		});
+		Add(benchmarks, "BoundingBox::Contains", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.visible[i] = d.boxes[i].Contains(d.u3[i]);
+			}
+		});
+		Add(benchmarks, "BoundingSphere::OverlapsSphere", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.visible[i] = d.spheres[i].OverlapsSphere(d.spheres[(i + 1) % NumElements]);
+			}
+		});
+		Add(benchmarks, "Plane::SignedDistanceToPoint", [] {
+			Data& d = *data;
+			for (size_t i = 0; i < NumElements; ++i) {
+				d.outX[i] = d.planes[i].SignedDistanceToPoint(d.u3[i]);
+			}
+		});
+	}
+
+	bool WriteBaseline(const char* fileName, const std::vector<Result>& results)
+	{
+		FILE* file = fopen(fileName, "w");
+		if (!file) {
+			return false;
+		}
+		fprintf(file, "{\n\t\"backend\": \"%s\",\n\t\"maxLevel\": \"%s\",\n\t\"benchmarks\": [\n", BackendName, CPUFeatures::GetName(CPUFeatures::GetMaxSIMDLevel()));
+		for (size_t i = 0; i < results.size(); ++i) {
+			fprintf(file, "\t\t{ \"name\": \"%s\", \"ns_per_op\": %.4f, \"cycles_per_op\": %.4f }%s\n", results[i].name.c_str(),
+				results[i].nsPerOp, results[i].cyclesPerOp, i + 1 < results.size() ? "," : "");
+		}
+		fprintf(file, "\t]\n}\n");
+		return fclose(file) == 0;
+	}
+
+	// Reads the files of WriteBaseline, only names and ns_per_op are needed
+	bool ReadBaseline(const char* fileName, std::vector<Result>& results)
+	{
+		FILE* file = fopen(fileName, "rb");
+		if (!file) {
+			return false;
+		}
+		std::string text;
+		char buffer[4096];
+		for (size_t size; (size = fread(buffer, 1, sizeof(buffer), file)) != 0;) {
+			text.append(buffer, size);
+		}
+		fclose(file);
+		const std::string nameKey = "\"name\"";
+		const std::string nsKey = "\"ns_per_op\"";
+		for (size_t pos = text.find(nameKey); pos != std::string::npos; pos = text.find(nameKey, pos)) {
+			const size_t first = text.find('"', text.find(':', pos + nameKey.size()));
+			const size_t last = text.find('"', first + 1);
+			const size_t value = text.find(nsKey, last);
+			if (first == std::string::npos || last == std::string::npos || value == std::string::npos) {
+				return false;
+			}
+			Result result;
+			result.name = text.substr(first + 1, last - first - 1);
+			result.nsPerOp = strtod(text.c_str() + text.find(':', value) + 1, NULL);
+			result.cyclesPerOp = 0.0;
+			results.push_back(result);
+			pos = last;
+		}
+		return !results.empty();
+	}
+
+	const Result* FindResult(const std::vector<Result>& results, const std::string& name)
+	{
+		for (const Result& result : results) {
+			if (result.name == name) {
+				return &result;
+			}
+		}
+		return NULL;
+	}
+
+	bool IsRegression(const Result& result, const Result* base, double threshold)
+	{
+		return base && base->nsPerOp > 0.0 && result.nsPerOp > base->nsPerOp * (1.0 + threshold * 0.01);
+	}
+
+	// Returns the number of regressions
+	uint Compare(const std::vector<Result>& results, const std::vector<Result>& baseline, double threshold)
+	{
+		uint numRegressions = 0;
+		printf("\n%-48s %10s %10s %8s\n", "Benchmark", "ns/op", "baseline", "change");
+		for (const Result& result : results) {
+			const Result* base = FindResult(baseline, result.name);
+			if (!base || base->nsPerOp <= 0.0) {
+				printf("%-48s %10.3f %10s %8s\n", result.name.c_str(), result.nsPerOp, "-", "new");
+				continue;
+			}
+			const double change = (result.nsPerOp / base->nsPerOp - 1.0) * 100.0;
+			const bool isRegression = IsRegression(result, base, threshold);
+			numRegressions += isRegression;
+			printf("%-48s %10.3f %10.3f %+7.1f%%%s\n", result.name.c_str(), result.nsPerOp, base->nsPerOp, change, isRegression ? "  REGRESSION" : "");
+		}
+		return numRegressions;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	const char* filter = NULL;
+	const char* writeFile = NULL;
+	const char* compareFile = NULL;
+	double threshold = 10.0;
+	double minTime = 0.2;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--filter") && hasValue) {
+			filter = argv[++i];
+		} else if (!strcmp(argv[i], "--min-time") && hasValue) {
+			minTime = atof(argv[++i]) * 0.001;
+		} else if (!strcmp(argv[i], "--write") && hasValue) {
+			writeFile = argv[++i];
+		} else if (!strcmp(argv[i], "--compare") && hasValue) {
+			compareFile = argv[++i];
+		} else if (!strcmp(argv[i], "--threshold") && hasValue) {
+			threshold = atof(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [--filter text] [--min-time ms] [--write file] [--compare file] [--threshold percent]\n", argv[0]);
+			return 2;
+		}
+	}
+	std::vector<Result> baseline;
+	if (compareFile && !ReadBaseline(compareFile, baseline)) {
+		fprintf(stderr, "Can't read baseline %s\n", compareFile);
+		return 2;
+	}
+
+	data = new Data();
+	InitData(*data);
+	std::vector<Benchmark> benchmarks;
+	AddConstruction(benchmarks);
+	AddProducts(benchmarks);
+	AddNormalization(benchmarks);
+	AddInverse(benchmarks);
+	AddFrustum(benchmarks);
+	AddBounds(benchmarks);
+
+	printf("SIMD.h backend %s, batch kernels up to %s\n\n", BackendName, CPUFeatures::GetName(CPUFeatures::GetMaxSIMDLevel()));
+	printf("%-48s %10s %10s\n", "Benchmark", "ns/op", "cycles/op");
+	std::vector<Result> results;
+	for (const Benchmark& benchmark : benchmarks) {
+		if (filter && benchmark.name.find(filter) == std::string::npos) {
+			continue;
+		}
+		Result result = Measure(benchmark, minTime);
+		const Result* base = FindResult(baseline, result.name);
+		for (uint retry = 0; retry < NumRetries && IsRegression(result, base, threshold); ++retry) {
+			const Result again = Measure(benchmark, minTime);
+			result.nsPerOp = std::min(result.nsPerOp, again.nsPerOp);
+			result.cyclesPerOp = std::min(result.cyclesPerOp, again.cyclesPerOp);
+		}
+		printf("%-48s %10.3f %10.2f\n", result.name.c_str(), result.nsPerOp, result.cyclesPerOp);
+		fflush(stdout);
+		results.push_back(result);
+	}
+	delete data;
+
+	if (writeFile && !WriteBaseline(writeFile, results)) {
+		fprintf(stderr, "Can't write baseline %s\n", writeFile);
+		return 2;
+	}
+	if (compareFile) {
+		const uint numRegressions = Compare(results, baseline, threshold);
+		if (numRegressions) {
+			printf("\n%u benchmark(s) regressed by more than %.1f%%\n", numRegressions, threshold);
+			return 1;
+		}
+		printf("\nNo regressions above %.1f%%\n", threshold);
+	}
+	return 0;
+}
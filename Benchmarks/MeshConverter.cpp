@@ -0,0 +1,103 @@
+// MeshConverter.cpp: writes the procedural meshes as mesh files.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 MeshConverter.cpp ../MeshGenerator.cpp ../MeshOptimizer.cpp ../VertexFormat.cpp ../MeshFile.cpp -o MeshConverter
+// Generates a mesh as LightIndexedDeferredRendering does, optimizes it, builds its
+// meshlets and writes it in the vertex format. The file is read back and verified.
+//
+// Usage: MeshConverter output [options]
+//	--plane width height stepX stepZ	grid of Vertex, the scene ground (500 500 20 20) by default
+//	--sphere rings sectors radius		sphere of positions, the light volume
+//	--format Float|Quantized16	Quantized16 by default
+//	--method Forsyth|Tipsify		vertex cache optimization, Tipsify by default
+
+#include "../MeshFile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argv[1][0] == '-') {
+		fprintf(stderr, "Usage: %s output [--plane width height stepX stepZ | --sphere rings sectors radius] [--format Float|Quantized16] [--method Forsyth|Tipsify]\n", argv[0]);
+		return 2;
+	}
+	const char* fileName = argv[1];
+	bool isSphere = false;
+	uint plane[4] = { 500, 500, 20, 20 };
+	uint rings = 40;
+	uint sectors = 20;
+	float radius = 1.0f;
+	VertexFormat::Quantization quantization = VertexFormat::Quantization16;
+	MeshOptimizer::VertexCacheMethod method = MeshOptimizer::Tipsify;
+	for (int i = 2; i < argc; ++i) {
+		if (!strcmp(argv[i], "--plane") && i + 4 < argc) {
+			for (uint j = 0; j < 4; ++j) {
+				plane[j] = static_cast<uint>(atoi(argv[++i]));
+			}
+			isSphere = false;
+		} else if (!strcmp(argv[i], "--sphere") && i + 3 < argc) {
+			rings = static_cast<uint>(atoi(argv[++i]));
+			sectors = static_cast<uint>(atoi(argv[++i]));
+			radius = static_cast<float>(atof(argv[++i]));
+			isSphere = true;
+		} else if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+			const char* name = argv[++i];
+			uint q = 0;
+			while (q < VertexFormat::NumQuantizations && strcmp(name, VertexFormat::GetName(static_cast<VertexFormat::Quantization>(q)))) {
+				++q;
+			}
+			if (q == VertexFormat::NumQuantizations) {
+				fprintf(stderr, "Unknown format %s\n", name);
+				return 2;
+			}
+			quantization = static_cast<VertexFormat::Quantization>(q);
+		} else if (!strcmp(argv[i], "--method") && i + 1 < argc) {
+			const char* name = argv[++i];
+			if (strcmp(name, "Forsyth") && strcmp(name, "Tipsify")) {
+				fprintf(stderr, "Unknown method %s\n", name);
+				return 2;
+			}
+			method = !strcmp(name, "Forsyth") ? MeshOptimizer::Forsyth : MeshOptimizer::Tipsify;
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (isSphere ? rings < 2 || sectors < 3 || radius <= 0.0f : !plane[0] || !plane[1] || !plane[2] || !plane[3] || plane[2] > plane[0] || plane[3] > plane[1]) {
+		fprintf(stderr, "Invalid mesh size\n");
+		return 2;
+	}
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Mesh mesh;
+	if (isSphere) {
+		MeshGenerator::CreateSphere(mesh, rings, sectors, radius);
+	} else {
+		MeshGenerator::CreatePlane(mesh, plane[0], plane[1], plane[2], plane[3]);
+	}
+	MeshOptimizer::Optimize(mesh, method);
+	std::vector<Meshlet> meshlets;
+	std::vector<uint> meshletVertices;
+	MeshOptimizer::BuildMeshlets(mesh, meshlets, meshletVertices);
+	const VertexFormat format = VertexFormat::Create(isSphere ? VertexFormat::Position : VertexFormat::TexCoord, quantization);
+	if (!MeshFile::Write(fileName, mesh, format, meshlets, meshletVertices)) {
+		fprintf(stderr, "Can't write %s\n", fileName);
+		return 1;
+	}
+	const std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+
+	MeshFile file;
+	if (!file.Open(fileName) || !file.VerifyChecksum()) {
+		fprintf(stderr, "%s is not valid after writing\n", fileName);
+		return 1;
+	}
+	const MeshFile::Header& header = file.GetHeader();
+	printf("%s: %u vertices of %u bytes (%s), %u %u bit indices, %u meshlets, written in %.1f ms\n", fileName, header.numVertices, header.stride,
+		VertexFormat::GetName(quantization), header.numIndices, header.indexSize * 8, header.numMeshlets, ms.count());
+	return 0;
+}
@@ -0,0 +1,157 @@
+// MeshLoaderBenchmark.cpp: load time of the procedural, read and mapped scene geometry.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 MeshLoaderBenchmark.cpp ../MeshGenerator.cpp ../MeshOptimizer.cpp ../VertexFormat.cpp ../MeshFile.cpp -o MeshLoaderBenchmark
+// Compares the ways a grid reaches upload memory:
+//	generate	CreatePlane, optimization, meshlets and encoding, as the renderer does without a file
+//	read		fread of the file into memory, then the sections are copied to upload memory
+//	map		the mapped sections are copied to upload memory
+// The file is written first, so read and map are measured with the file in the page cache.
+//
+// Usage: MeshLoaderBenchmark [options]
+//	--size n	grid of n x n with step 2, 2000 by default
+//	--runs n	runs of read and map, the median is reported, 10 by default
+//	--file name	temporary mesh file, MeshLoaderBenchmark.lmsh by default
+
+#include "../MeshFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+	// copies vertices and indices to upload memory as StagingUploader does
+	void CopySections(const void* vertices, const void* indices, const MeshFile::Header& header, std::vector<ubyte>& uploadMemory)
+	{
+		const size_t vertexSize = static_cast<size_t>(header.sectionSizes[MeshFile::Vertices]);
+		memcpy(uploadMemory.data(), vertices, vertexSize);
+		memcpy(uploadMemory.data() + vertexSize, indices, static_cast<size_t>(header.sectionSizes[MeshFile::Indices]));
+	}
+
+	bool ReadFile(const char* fileName, std::vector<ubyte>& fileData)
+	{
+		FILE* f = fopen(fileName, "rb");
+		if (!f) {
+			return false;
+		}
+		bool res = !fseek(f, 0, SEEK_END);
+		const long size = res ? ftell(f) : -1;
+		res = size >= static_cast<long>(sizeof(MeshFile::Header)) && !fseek(f, 0, SEEK_SET);
+		if (res) {
+			fileData.resize(static_cast<size_t>(size));
+			res = fread(fileData.data(), 1, fileData.size(), f) == fileData.size();
+		}
+		fclose(f);
+		return res;
+	}
+
+	double Median(std::vector<double>& values)
+	{
+		std::sort(values.begin(), values.end());
+		return values[values.size() / 2];
+	}
+
+	void PrintRow(const char* name, double ms, size_t bytes)
+	{
+		printf("  %-10s %10.3f ms %8.2f GB/s\n", name, ms, bytes / (ms * 1e6));
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint gridSize = 2000;
+	uint runs = 10;
+	const char* fileName = "MeshLoaderBenchmark.lmsh";
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--size") && hasValue) {
+			gridSize = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--runs") && hasValue) {
+			runs = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--file") && hasValue) {
+			fileName = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [--size n] [--runs n] [--file name]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (gridSize < 2 || !runs) {
+		fprintf(stderr, "Size must be at least 2 and runs above 0\n");
+		return 2;
+	}
+
+	// procedural path, measured once as it takes seconds for large grids
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Mesh mesh;
+	MeshGenerator::CreatePlane(mesh, gridSize, gridSize, 2, 2);
+	MeshOptimizer::Optimize(mesh);
+	std::vector<Meshlet> meshlets;
+	std::vector<uint> meshletVertices;
+	MeshOptimizer::BuildMeshlets(mesh, meshlets, meshletVertices);
+	const VertexFormat format = VertexFormat::Create(VertexFormat::TexCoord, VertexFormat::Quantization16);
+	Mesh encoded = mesh;
+	VertexFormat meshFormat = format;
+	meshFormat.SetBounds(encoded);
+	meshFormat.Encode(encoded);
+	const Milliseconds generateTime = std::chrono::steady_clock::now() - start;
+
+	if (!MeshFile::Write(fileName, mesh, format, meshlets, meshletVertices)) {
+		fprintf(stderr, "Can't write %s\n", fileName);
+		return 1;
+	}
+	MeshFile file;
+	if (!file.Open(fileName) || !file.VerifyChecksum()) {
+		fprintf(stderr, "%s is not valid\n", fileName);
+		remove(fileName);
+		return 1;
+	}
+	const MeshFile::Header header = file.GetHeader();
+	file.Close();
+	// vertices and indices go to the GPU, the upload memory is touched before
+	const size_t uploadSize = static_cast<size_t>(header.sectionSizes[MeshFile::Vertices] + header.sectionSizes[MeshFile::Indices]);
+	std::vector<ubyte> uploadMemory(uploadSize, 1);
+
+	std::vector<double> readTimes;
+	std::vector<double> mapTimes;
+	std::vector<ubyte> fileData;
+	bool isValid = true;
+	for (uint run = 0; run < runs && isValid; ++run) {
+		start = std::chrono::steady_clock::now();
+		std::vector<ubyte>().swap(fileData);
+		isValid = ReadFile(fileName, fileData);
+		if (isValid) {
+			const MeshFile::Header& fileHeader = *reinterpret_cast<const MeshFile::Header *>(fileData.data());
+			CopySections(&fileData[static_cast<size_t>(fileHeader.sectionOffsets[MeshFile::Vertices])], &fileData[static_cast<size_t>(fileHeader.sectionOffsets[MeshFile::Indices])], fileHeader, uploadMemory);
+		}
+		readTimes.push_back(Milliseconds(std::chrono::steady_clock::now() - start).count());
+
+		start = std::chrono::steady_clock::now();
+		isValid = isValid && file.Open(fileName);
+		if (isValid) {
+			CopySections(file.GetSection(MeshFile::Vertices), file.GetSection(MeshFile::Indices), file.GetHeader(), uploadMemory);
+			file.Close();
+		}
+		mapTimes.push_back(Milliseconds(std::chrono::steady_clock::now() - start).count());
+	}
+	remove(fileName);
+	if (!isValid) {
+		fprintf(stderr, "Can't load %s\n", fileName);
+		return 1;
+	}
+
+	printf("grid %ux%u: %u vertices of %u bytes, %u triangles, %u meshlets, %.1f MB uploaded\n", gridSize, gridSize, header.numVertices, header.stride,
+		header.numIndices / 3, header.numMeshlets, uploadSize / (1024.0 * 1024.0));
+	PrintRow("generate", generateTime.count(), uploadSize);
+	PrintRow("read", Median(readTimes), uploadSize);
+	PrintRow("map", Median(mapTimes), uploadSize);
+	return 0;
+}
@@ -0,0 +1,210 @@
+// MeshOptimizerReport.cpp: vertex cache and overdraw metrics of the generated meshes.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 MeshOptimizerReport.cpp ../MeshGenerator.cpp ../MeshOptimizer.cpp -o MeshOptimizerReport
+// Prints ACMR, ATVR and overdraw of the scene meshes as generated and after the
+// optimization with every vertex cache method, with the time of the optimization.
+// Overdraw is rasterized with back faces culled, so the convex scene meshes have 1.
+// Non-convex meshes of outward facing spheres show what the overdraw pass gains, the
+// "Cache OD" column is the overdraw of the vertex cache order before that pass.
+// Meshlets of every mesh are built and validated, a large grid with 32 bit indices
+// shows the sizes the terrain needs.
+//
+// Usage: MeshOptimizerReport [options]
+//	--cache-size n		FIFO cache of the metrics and Tipsify, 16 by default
+//	--threshold factor	ACMR growth allowed by the overdraw optimization, 1.05 by default
+// Exit code is 1 if any meshlet fails the validation or the overdraw pass doesn't reduce
+// the overdraw of a non-convex mesh.
+
+#include "../MeshGenerator.h"
+#include "../MeshOptimizer.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+	struct SceneMesh {
+		std::string name;
+		Mesh mesh;
+		// the overdraw pass has to reduce the overdraw
+		bool isNonConvex;
+	};
+
+	// copy of source scaled and moved, light spheres face inwards so their winding may be flipped
+	void Append(Mesh& mesh, const Mesh& source, const Vector3D& offset, float scale, bool isFlipped)
+	{
+		const uint base = mesh.GetNumVertices();
+		const size_t first = mesh.vertices.size();
+		mesh.stride = source.stride;
+		mesh.vertices.insert(mesh.vertices.end(), source.vertices.begin(), source.vertices.end());
+		for (uint v = 0; v < source.GetNumVertices(); ++v) {
+			Vector3D& p = *reinterpret_cast<Vector3D *>(&mesh.vertices[first + static_cast<size_t>(v) * mesh.stride]);
+			p = p * scale + offset;
+		}
+		for (size_t i = 0; i < source.indices.size(); i += 3) {
+			mesh.indices.push_back(base + source.indices[i]);
+			mesh.indices.push_back(base + source.indices[i + (isFlipped ? 2 : 1)]);
+			mesh.indices.push_back(base + source.indices[i + (isFlipped ? 1 : 2)]);
+		}
+	}
+
+	// meshes created by LightIndexedDeferredRendering
+	void CreateSceneMeshes(std::vector<SceneMesh>& meshes)
+	{
+		const uint LightLodRings[] = { 250, 40, 12 };
+		const uint LightLodSectors[] = { 20, 20, 12 };
+		SceneMesh plane;
+		plane.isNonConvex = false;
+		plane.name = "plane 500x500 step 20";
+		MeshGenerator::CreatePlane(plane.mesh, 500, 500, 20, 20);
+		meshes.push_back(plane);
+		for (uint lod = 0; lod < 3; ++lod) {
+			SceneMesh sphere;
+			sphere.isNonConvex = false;
+			sphere.name = "light sphere LOD " + std::to_string(lod);
+			MeshGenerator::CreateSphere(sphere.mesh, LightLodRings[lod], LightLodSectors[lod], 1.0f);
+			meshes.push_back(sphere);
+		}
+		SceneMesh terrain;
+		terrain.isNonConvex = false;
+		terrain.name = "grid 2000x2000 step 2";
+		MeshGenerator::CreatePlane(terrain.mesh, 2000, 2000, 2, 2);
+		meshes.push_back(terrain);
+	}
+
+	// outward facing meshes a SceneMesh file may have
+	void CreateNonConvexMeshes(std::vector<SceneMesh>& meshes)
+	{
+		Mesh sphere;
+		MeshGenerator::CreateSphere(sphere, 40, 20, 1.0f);
+		SceneMesh nested;
+		nested.isNonConvex = true;
+		nested.name = "sphere inside a sphere, inner one first";
+		Append(nested.mesh, sphere, Vector3D(0.0f, 0.0f, 0.0f), 0.5f, true);
+		Append(nested.mesh, sphere, Vector3D(0.0f, 0.0f, 0.0f), 1.0f, true);
+		meshes.push_back(nested);
+		SceneMesh ring;
+		ring.isNonConvex = true;
+		ring.name = "ring of 8 spheres around one";
+		Append(ring.mesh, sphere, Vector3D(0.0f, 0.0f, 0.0f), 0.6f, true);
+		for (uint i = 0; i < 8; ++i) {
+			const float angle = i * 0.785398f;
+			Append(ring.mesh, sphere, Vector3D(cosf(angle), 0.0f, sinf(angle)), 0.6f, true);
+		}
+		meshes.push_back(ring);
+		SceneMesh bumpy;
+		bumpy.isNonConvex = true;
+		bumpy.name = "sphere with 5x5 bumps";
+		Mesh dense;
+		MeshGenerator::CreateSphere(dense, 120, 120, 1.0f);
+		Append(bumpy.mesh, dense, Vector3D(0.0f, 0.0f, 0.0f), 1.0f, true);
+		for (uint v = 0; v < bumpy.mesh.GetNumVertices(); ++v) {
+			Vector3D& p = *reinterpret_cast<Vector3D *>(&bumpy.mesh.vertices[static_cast<size_t>(v) * bumpy.mesh.stride]);
+			const float length = p.Length();
+			const float theta = acosf(p.y / length);
+			const float phi = atan2f(p.z, p.x);
+			p *= (1.0f + 0.3f * sinf(5.0f * theta) * sinf(5.0f * phi)) / length;
+		}
+		meshes.push_back(bumpy);
+	}
+
+	bool PrintMeshlets(const Mesh& optimized)
+	{
+		Mesh mesh = optimized;
+		std::vector<Meshlet> meshlets;
+		std::vector<uint> meshletVertices;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		MeshOptimizer::BuildMeshlets(mesh, meshlets, meshletVertices);
+		const std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+		const bool valid = MeshOptimizer::ValidateMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.stride, meshlets, meshletVertices);
+		double triangles = 0.0;
+		double vertices = 0.0;
+		uint cones = 0;
+		for (const Meshlet& meshlet : meshlets) {
+			triangles += meshlet.triangleCount;
+			vertices += meshlet.vertexCount;
+			cones += meshlet.coneCutoff < 1.0f;
+		}
+		const double count = meshlets.empty() ? 1.0 : static_cast<double>(meshlets.size());
+		printf("  %u bit indices, %zu meshlets in %.3f ms, %.1f triangles and %.1f vertices per meshlet, %u normal cones, %s\n",
+			mesh.Needs32BitIndices() ? 32 : 16, meshlets.size(), ms.count(), triangles / count, vertices / count, cones, valid ? "valid" : "INVALID");
+		return valid;
+	}
+
+	// overdraw of the vertex cache order is negative for the generated row
+	float PrintRow(const char* method, const Mesh& mesh, uint cacheSize, float cacheOverdraw, double ms)
+	{
+		const MeshOptimizer::Statistics statistics = MeshOptimizer::Analyze(mesh, cacheSize);
+		printf("  %-10s %9u %9u %8.3f %8.3f %9.3f", method, mesh.GetNumFaces(), mesh.GetNumVertices(), statistics.acmr, statistics.atvr, statistics.overdraw);
+		if (cacheOverdraw >= 0.0f) {
+			printf(" %9.3f %9.3f", cacheOverdraw, ms);
+		}
+		printf("\n");
+		return statistics.overdraw;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint cacheSize = MeshOptimizer::DefaultCacheSize;
+	float threshold = MeshOptimizer::DefaultOverdrawThreshold;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--cache-size") && hasValue) {
+			cacheSize = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--threshold") && hasValue) {
+			threshold = static_cast<float>(atof(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--cache-size n] [--threshold factor]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (cacheSize <= 3 || threshold < 1.0f) {
+		fprintf(stderr, "Cache size must be above 3 and threshold at least 1\n");
+		return 2;
+	}
+
+	std::vector<SceneMesh> meshes;
+	CreateSceneMeshes(meshes);
+	CreateNonConvexMeshes(meshes);
+	const char* const MethodNames[] = { "Forsyth", "Tipsify" };
+	bool allValid = true;
+	bool isOverdrawReduced = true;
+	printf("FIFO cache of %u vertices, overdraw threshold %.2f\n", cacheSize, threshold);
+	for (const SceneMesh& sceneMesh : meshes) {
+		printf("\n%s\n", sceneMesh.name.c_str());
+		printf("  %-10s %9s %9s %8s %8s %9s %9s %9s\n", "Order", "Triangles", "Vertices", "ACMR", "ATVR", "Overdraw", "Cache OD", "ms");
+		PrintRow("Generated", sceneMesh.mesh, cacheSize, -1.0f, 0.0);
+		for (uint method = MeshOptimizer::Forsyth; method <= MeshOptimizer::Tipsify; ++method) {
+			Mesh mesh = sceneMesh.mesh;
+			const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			const uint numVertices = mesh.GetNumVertices();
+			MeshOptimizer::OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), numVertices, static_cast<MeshOptimizer::VertexCacheMethod>(method), cacheSize);
+			const std::chrono::duration<double, std::milli> cacheMs = std::chrono::steady_clock::now() - start;
+			const float cacheOverdraw = MeshOptimizer::AnalyzeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.stride, numVertices);
+			const std::chrono::steady_clock::time_point overdrawStart = std::chrono::steady_clock::now();
+			MeshOptimizer::OptimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.stride, numVertices, threshold, cacheSize);
+			const uint numUsed = MeshOptimizer::OptimizeVertexFetch(mesh.vertices.data(), mesh.stride, numVertices, mesh.indices.data(), mesh.indices.size());
+			mesh.vertices.resize(static_cast<size_t>(numUsed) * mesh.stride);
+			const std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - overdrawStart;
+			const float overdraw = PrintRow(MethodNames[method], mesh, cacheSize, cacheOverdraw, cacheMs.count() + ms.count());
+			if (sceneMesh.isNonConvex && !(overdraw < cacheOverdraw)) {
+				printf("  overdraw pass doesn't reduce the overdraw\n");
+				isOverdrawReduced = false;
+			}
+			if (method == MeshOptimizer::Tipsify) {
+				allValid &= PrintMeshlets(mesh);
+			}
+		}
+	}
+	return allValid && isOverdrawReduced ? 0 : 1;
+}
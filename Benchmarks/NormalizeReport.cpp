@@ -0,0 +1,170 @@
+// NormalizeReport.cpp: ulp error of the batch normalizations against a double precision reference.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -ffp-contract=off NormalizeReport.cpp ../Vector3D.cpp ../Vector4D.cpp ../CPUFeatures.cpp -o NormalizeReport
+// Normalizes random vectors with Vector3D::NormalizeMany and Vector4D::NormalizeMany in
+// both modes on every level the CPU supports (scalar, SSE2, AVX2, AVX-512) and measures
+// the error of every component against x / |xyz| in double, in units in the last place
+// of the reference. The headers promise
+//	NormalizeAccurate	4 ulp, 2.98 measured over 3e8 vectors
+//	NormalizeFast		7 ulp, 5.67 measured, the rsqrt estimate has 1.5 * 2^-12
+//				relative error before the Newton-Raphson step. NEON refines its
+//				8 bit estimate by two steps, the scalar build 1 / sqrt by one
+// Vectors have lengths from 1e-15 to 1e15, some lie on an axis or have components of very
+// different size, zero vectors have to stay zero. The strided Vector3D version has to give
+// the bits of the arrays version, NormalizeAccurate of Vector4D the bits of Normalize.
+//
+// Usage: NormalizeReport [options]
+//	--vectors n	random vectors, 1000003 by default
+// Exit code is 1 if a check fails.
+
+#include "../Vector3D.h"
+#include "../Vector4D.h"
+#include "../CPUFeatures.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+	const double MaxUlps[2] = { 4.0, 7.0 };
+	const char* ModeNames[2] = { "accurate", "fast" };
+
+	// error of value in ulps of the float nearest to reference
+	double GetUlps(float value, double reference)
+	{
+		const float rounded = static_cast<float>(reference);
+		if (rounded == 0.0f) {
+			return value == 0.0f ? 0.0 : HUGE_VAL;
+		}
+		const double ulp = ldexp(1.0, ilogbf(rounded) - 23);
+		// NaN counts as a failure
+		const double ulps = fabs(value - reference) / ulp;
+		return ulps == ulps ? ulps : HUGE_VAL;
+	}
+
+	std::vector<Vector4D> CreateVectors(size_t n)
+	{
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+		std::vector<Vector4D> vectors(n);
+		for (size_t i = 0; i < n; ++i) {
+			const float scale = powf(10.0f, 15.0f * value(random));
+			Vector4D& v = vectors[i];
+			v = Vector4D(value(random) * scale, value(random) * scale, value(random) * scale, value(random) * scale);
+			switch (i % 97) {
+			case 0:
+				v = Vector4D(0.0f, 0.0f, 0.0f, value(random));
+				break;
+			case 1:
+				v.y = v.z = 0.0f;
+				break;
+			case 2:
+				v.x *= 1e-6f;
+				break;
+			case 3:
+				v.x *= 1e-6f;
+				v.y *= 1e-3f;
+				break;
+			}
+		}
+		return vectors;
+	}
+
+	struct LevelResult {
+		double maxUlps3D;
+		double maxUlps4D;
+		// zero vectors not zero, strided or Vector4D results not the expected bits
+		uint numMismatches;
+	};
+
+	LevelResult CheckLevel(const std::vector<Vector4D>& vectors, Vector3D::NormalizeMode mode)
+	{
+		const size_t n = vectors.size();
+		LevelResult result = { 0.0, 0.0, 0 };
+		std::vector<float> x(n), y(n), z(n);
+		std::vector<Vector3D> packed(n);
+		for (size_t i = 0; i < n; ++i) {
+			x[i] = vectors[i].x;
+			y[i] = vectors[i].y;
+			z[i] = vectors[i].z;
+			packed[i] = Vector3D(x[i], y[i], z[i]);
+		}
+		std::vector<float> outX(n), outY(n), outZ(n);
+		Vector3D::NormalizeMany(x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), n, mode);
+		std::vector<Vector3D> strided(n);
+		Vector3D::NormalizeMany(packed.data(), sizeof(Vector3D), strided.data(), sizeof(Vector3D), n, mode);
+		std::vector<Vector4D> out(n);
+		Vector4D::NormalizeMany(vectors.data(), out.data(), n, static_cast<Vector4D::NormalizeMode>(mode));
+
+		for (size_t i = 0; i < n; ++i) {
+			const Vector4D& v = vectors[i];
+			const double length = sqrt(static_cast<double>(v.x) * v.x + static_cast<double>(v.y) * v.y + static_cast<double>(v.z) * v.z);
+			result.numMismatches += strided[i].x != outX[i] || strided[i].y != outY[i] || strided[i].z != outZ[i];
+			if (length == 0.0) {
+				result.numMismatches += outX[i] != 0.0f || outY[i] != 0.0f || outZ[i] != 0.0f || !out[i].IsZero();
+				continue;
+			}
+			if (mode == Vector3D::NormalizeAccurate) {
+				Vector4D normalized = v;
+				normalized.Normalize();
+				result.numMismatches += !!memcmp(&normalized, &out[i], sizeof(Vector4D));
+			}
+			const double ulps3D[3] = { GetUlps(outX[i], v.x / length), GetUlps(outY[i], v.y / length), GetUlps(outZ[i], v.z / length) };
+			const double ulps4D[4] = { GetUlps(out[i].x, v.x / length), GetUlps(out[i].y, v.y / length), GetUlps(out[i].z, v.z / length), GetUlps(out[i].w, v.w / length) };
+			for (double u : ulps3D) {
+				result.maxUlps3D = u > result.maxUlps3D ? u : result.maxUlps3D;
+			}
+			for (double u : ulps4D) {
+				result.maxUlps4D = u > result.maxUlps4D ? u : result.maxUlps4D;
+			}
+		}
+		return result;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numVectors = 1000003;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--vectors") && hasValue) {
+			numVectors = static_cast<uint>(atoi(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--vectors n]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	const std::vector<Vector4D> vectors = CreateVectors(numVectors);
+	const CPUFeatures::SIMDLevel maxLevel = CPUFeatures::GetMaxSIMDLevel();
+	bool isValid = true;
+	printf("%-20s %-10s %10s %10s %10s\n", "Level", "Mode", "Vector3D", "Vector4D", "mismatches");
+	for (uint level = 0; level < CPUFeatures::NumSIMDLevels; ++level) {
+		const char* name = CPUFeatures::GetName(static_cast<CPUFeatures::SIMDLevel>(level));
+		if (level > static_cast<uint>(maxLevel)) {
+			printf("%-20s skipped, not supported by the CPU\n", name);
+			continue;
+		}
+		CPUFeatures::SetSIMDLevel(static_cast<CPUFeatures::SIMDLevel>(level));
+		for (uint mode = 0; mode < 2; ++mode) {
+			const LevelResult result = CheckLevel(vectors, static_cast<Vector3D::NormalizeMode>(mode));
+			printf("%-20s %-10s %10.3f %10.3f %10u\n", name, ModeNames[mode], result.maxUlps3D, result.maxUlps4D, result.numMismatches);
+			if (!(result.maxUlps3D <= MaxUlps[mode] && result.maxUlps4D <= MaxUlps[mode]) || result.numMismatches) {
+				printf("%s, %s: above %.0f ulp or mismatches\n", name, ModeNames[mode], MaxUlps[mode]);
+				isValid = false;
+			}
+		}
+	}
+	CPUFeatures::SetSIMDLevel(maxLevel);
+	printf("vectors              %8u, bounds %.0f ulp accurate, %.0f ulp fast\n", numVectors, MaxUlps[0], MaxUlps[1]);
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+// ProfilerReport.cpp: cost of the profiler zones and validity of the Chrome trace.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -pthread ProfilerReport.cpp ../Profiler.cpp ../Timer.cpp -o ProfilerReport
+// Times an empty zone with and without a capture, then captures frames of nested zones
+// on several threads and reads the trace back. Checks that
+//	- every zone and frame marker is in the trace
+//	- zones of a thread nest: a zone is inside its parent or after it
+//	- the trace is well formed JSON as far as brackets and strings go
+//
+// Usage: ProfilerReport [options]
+//	--threads n	worker threads, 4 by default
+//	--frames n	captured frames, 100 by default
+//	--file name	trace file, ProfilerReport.json by default, kept for chrome://tracing
+// Exit code is 1 if a check fails.
+
+#include "../Profiler.h"
+
+#ifndef USE_PROFILER
+#error ProfilerReport needs the profiler compiled in
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <map>
+#include <vector>
+
+namespace {
+
+	typedef std::chrono::duration<double, std::nano> Nanoseconds;
+
+	// zones in the trace
+	struct TraceZone {
+		double begin;
+		double end;
+	};
+
+	double MeasureZone(uint numZones)
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (uint i = 0; i < numZones; ++i) {
+			PROFILE_SCOPE("Empty");
+		}
+		return Nanoseconds(std::chrono::steady_clock::now() - start).count() / numZones;
+	}
+
+	// a frame of a worker: 3 levels of zones, 1 + 4 + 8 zones
+	void RunFrame()
+	{
+		PROFILE_SCOPE("Frame work");
+		for (uint i = 0; i < 4; ++i) {
+			PROFILE_SCOPE("Task");
+			for (uint j = 0; j < 2; ++j) {
+				PROFILE_SCOPE("Job \"quoted\"");
+				volatile uint sum = 0;
+				for (uint k = 0; k < 1000; ++k) {
+					sum = sum + k;
+				}
+			}
+		}
+	}
+	const uint ZonesPerFrame = 13;
+
+	bool ReadFile(const char* fileName, std::string& text)
+	{
+		FILE* f = fopen(fileName, "rb");
+		if (!f) {
+			return false;
+		}
+		char buffer[4096];
+		size_t size;
+		while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+			text.append(buffer, size);
+		}
+		fclose(f);
+		return true;
+	}
+
+	// brackets balance outside strings, escapes are skipped
+	bool IsBalanced(const std::string& text)
+	{
+		std::vector<char> brackets;
+		bool inString = false;
+		for (size_t i = 0; i < text.size(); ++i) {
+			const char c = text[i];
+			if (inString) {
+				if (c == '\\') {
+					++i;
+				} else if (c == '"') {
+					inString = false;
+				}
+				continue;
+			}
+			if (c == '"') {
+				inString = true;
+			} else if (c == '{' || c == '[') {
+				brackets.push_back(c == '{' ? '}' : ']');
+			} else if (c == '}' || c == ']') {
+				if (brackets.empty() || brackets.back() != c) {
+					return false;
+				}
+				brackets.pop_back();
+			}
+		}
+		return brackets.empty() && !inString;
+	}
+
+	// zones in the order of the trace, per thread; a line is an event
+	void ParseZones(const std::string& text, std::map<uint, std::vector<TraceZone> >& zones, uint& numFrames)
+	{
+		numFrames = 0;
+		size_t begin = 0;
+		while (begin < text.size()) {
+			size_t end = text.find('\n', begin);
+			if (end == std::string::npos) {
+				end = text.size();
+			}
+			const std::string line = text.substr(begin, end - begin);
+			begin = end + 1;
+			const size_t phase = line.find("\"ph\":\"");
+			if (phase == std::string::npos) {
+				continue;
+			}
+			if (line[phase + 6] == 'i') {
+				++numFrames;
+				continue;
+			}
+			uint tid;
+			TraceZone zone;
+			double duration;
+			if (line[phase + 6] == 'X' && sscanf(line.c_str() + phase, "\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lf,\"dur\":%lf", &tid, &zone.begin, &duration) == 3) {
+				zone.end = zone.begin + duration;
+				zones[tid].push_back(zone);
+			}
+		}
+	}
+
+	// every zone is inside the open zone it starts in
+	bool AreNested(const std::vector<TraceZone>& zones)
+	{
+		std::vector<double> parents;
+		for (const TraceZone& zone : zones) {
+			while (!parents.empty() && zone.begin >= parents.back()) {
+				parents.pop_back();
+			}
+			if (!parents.empty() && zone.end > parents.back()) {
+				return false;
+			}
+			parents.push_back(zone.end);
+		}
+		return true;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numThreads = 4;
+	uint numFrames = 100;
+	const char* fileName = "ProfilerReport.json";
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--threads") && hasValue) {
+			numThreads = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--frames") && hasValue) {
+			numFrames = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--file") && hasValue) {
+			fileName = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [--threads n] [--frames n] [--file name]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!numFrames || numFrames * ZonesPerFrame > Profiler::MaxThreadEvents) {
+		fprintf(stderr, "Frames must be above 0 and fit the buffer of a thread\n");
+		return 2;
+	}
+	Profiler::SetThreadName("Main");
+
+	const uint numZones = 1000000;
+	const double idleCost = MeasureZone(numZones);
+	Profiler::StartCapture(0, nullptr);
+	// the buffer keeps the first events
+	const double captureCost = MeasureZone(Profiler::MaxThreadEvents);
+	Profiler::CancelCapture();
+
+	// frames of the main thread and the workers, written after the last one
+	bool isValid = true;
+	Profiler::StartCapture(numFrames, fileName);
+	for (uint frame = 0; frame <= numFrames; ++frame) {
+		if (!Profiler::BeginFrame()) {
+			printf("can't write %s\n", fileName);
+			return 1;
+		}
+		if (!Profiler::IsCapturing()) {
+			break;
+		}
+		PROFILE_SCOPE("Main frame");
+		std::vector<std::future<void> > tasks;
+		for (uint i = 0; i < numThreads; ++i) {
+			tasks.push_back(std::async(std::launch::async, RunFrame));
+		}
+		RunFrame();
+		for (std::future<void>& task : tasks) {
+			task.get();
+		}
+	}
+	if (Profiler::IsCapturing()) {
+		printf("the capture didn't end after %u frames\n", numFrames);
+		isValid = false;
+	}
+
+	std::string text;
+	if (!ReadFile(fileName, text)) {
+		printf("can't read %s\n", fileName);
+		return 1;
+	}
+	if (!IsBalanced(text)) {
+		printf("%s is not well formed\n", fileName);
+		isValid = false;
+	}
+	std::map<uint, std::vector<TraceZone> > zones;
+	uint numTraceFrames = 0;
+	ParseZones(text, zones, numTraceFrames);
+	uint numTraceZones = 0;
+	for (const std::pair<const uint, std::vector<TraceZone> >& thread : zones) {
+		numTraceZones += static_cast<uint>(thread.second.size());
+		if (!AreNested(thread.second)) {
+			printf("zones of thread %u don't nest\n", thread.first);
+			isValid = false;
+		}
+	}
+	const uint expectedZones = numFrames * ((numThreads + 1) * ZonesPerFrame + 1);
+	if (numTraceZones != expectedZones || numTraceFrames != numFrames) {
+		printf("trace has %u zones and %u frames, not %u and %u\n", numTraceZones, numTraceFrames, expectedZones, numFrames);
+		isValid = false;
+	}
+
+	printf("zone without capture %8.1f ns\n", idleCost);
+	printf("zone with capture    %8.1f ns\n", captureCost);
+	printf("trace                %8u zones, %u frames, %u threads, %.1f KB\n", numTraceZones, numTraceFrames, static_cast<uint>(zones.size()), text.size() / 1024.0);
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
@@ -0,0 +1,292 @@
+// QuaternionReport.cpp: batch operations of Quaternion on every SIMD level against the scalar ones.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -ffp-contract=off QuaternionReport.cpp ../Quaternion.cpp ../Matrix4x4.cpp ../CPUFeatures.cpp -o QuaternionReport
+// Runs NormalizeMany, MulMany, ToMatrixMany and SlerpMany in both modes on every level the
+// CPU supports (scalar, SSE2, AVX2, AVX-512) and checks bit for bit that they give
+// Normalize, operator *, Matrix4x4::FromQuaternion, Slerp and Nlerp, for every count
+// from 0 to 40 (tails of the 4 and 8 wide kernels) and a few large ones, into other arrays
+// with a guard after the outputs and in place. Interpolation inputs include t <= 0, t >= 1,
+// pairs with a negative dot and nearly equal pairs.
+// Then checks that Nlerp, the SlerpFast mode, is less than 0.1 degrees from a double
+// precision slerp for random unit quaternions and t.
+//
+// Usage: QuaternionReport [options]
+//	--pairs n	random pairs of the Nlerp angle check, 1000000 by default
+// Exit code is 1 if a check fails.
+
+#include "../Quaternion.h"
+#include "../Matrix4x4.h"
+#include "../CPUFeatures.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+	// degrees
+	const double MaxNlerpAngle = 0.1;
+	const float Guard = 12345.0f;
+
+	// structure of arrays with a guard element after the quaternions
+	class Arrays  {
+	private:
+		std::vector<float> components[4];
+	public:
+		explicit Arrays(size_t n)
+		{
+			for (std::vector<float>& c : components) {
+				c.assign(n + 1, Guard);
+			}
+		}
+		QuaternionArrays Get()
+		{
+			const QuaternionArrays q = { components[0].data(), components[1].data(), components[2].data(), components[3].data() };
+			return q;
+		}
+		Quaternion Get(size_t i) const
+		{
+			return Quaternion(components[0][i], components[1][i], components[2][i], components[3][i]);
+		}
+		void Set(size_t i, const Quaternion& q)
+		{
+			components[0][i] = q.x;
+			components[1][i] = q.y;
+			components[2][i] = q.z;
+			components[3][i] = q.w;
+		}
+		bool IsGuarded(size_t n) const
+		{
+			return components[0][n] == Guard && components[1][n] == Guard && components[2][n] == Guard && components[3][n] == Guard;
+		}
+	};
+
+	bool IsSame(const Quaternion& a, const Quaternion& b)
+	{
+		return !memcmp(&a, &b, sizeof(Quaternion));
+	}
+
+	class Inputs  {
+	private:
+		std::mt19937 random;
+		std::uniform_real_distribution<float> value;
+	public:
+		Inputs() : random(1), value(-1.0f, 1.0f)
+		{
+		}
+		float Float()
+		{
+			return value(random);
+		}
+		Quaternion Any()
+		{
+			return Quaternion(Float() * 10.0f, Float() * 10.0f, Float() * 10.0f, Float() * 10.0f);
+		}
+		Quaternion Unit()
+		{
+			Quaternion q(Float(), Float(), Float(), Float());
+			while (q.Length() < 0.1f) {
+				q = Quaternion(Float(), Float(), Float(), Float());
+			}
+			q.Normalize();
+			return q;
+		}
+		// end points, outside of [0, 1] and inside
+		float Parameter(size_t i)
+		{
+			switch (i % 16) {
+			case 0:
+				return 0.0f;
+			case 1:
+				return 1.0f;
+			case 2:
+				return -0.25f;
+			case 3:
+				return 1.5f;
+			default:
+				return Float() * 0.5f + 0.5f;
+			}
+		}
+	};
+
+	struct Data {
+		Arrays any;
+		Arrays a;
+		Arrays b;
+		std::vector<float> t;
+		explicit Data(size_t n) : any(n), a(n), b(n), t(n)
+		{
+		}
+	};
+
+	Data CreateData(Inputs& inputs, size_t n)
+	{
+		Data data(n);
+		for (size_t i = 0; i < n; ++i) {
+			data.any.Set(i, inputs.Any());
+			const Quaternion a = inputs.Unit();
+			data.a.Set(i, a);
+			// every 5th pair nearly equal, every 7th has a negative dot
+			Quaternion b = inputs.Unit();
+			if (i % 5 == 0) {
+				b = Quaternion(a.x + inputs.Float() * 0.001f, a.y, a.z, a.w);
+				b.Normalize();
+			}
+			if (i % 7 == 0 && dotProduct(a, b) > 0.0f) {
+				b = Quaternion(-b.x, -b.y, -b.z, -b.w);
+			}
+			data.b.Set(i, b);
+			data.t[i] = inputs.Parameter(i);
+		}
+		return data;
+	}
+
+	// mismatches of every batch operation for the first n quaternions of data
+	uint CheckLevel(Data& data, size_t n)
+	{
+		uint numErrors = 0;
+		Arrays out(n);
+		Quaternion::NormalizeMany(data.any.Get(), out.Get(), n);
+		for (size_t i = 0; i < n; ++i) {
+			Quaternion r = data.any.Get(i);
+			r.Normalize();
+			numErrors += !IsSame(out.Get(i), r);
+		}
+		numErrors += !out.IsGuarded(n);
+		Quaternion::MulMany(data.any.Get(), data.b.Get(), out.Get(), n);
+		for (size_t i = 0; i < n; ++i) {
+			numErrors += !IsSame(out.Get(i), data.any.Get(i) * data.b.Get(i));
+		}
+		numErrors += !out.IsGuarded(n);
+		const Quaternion::SlerpMode modes[] = { Quaternion::SlerpExact, Quaternion::SlerpFast };
+		for (Quaternion::SlerpMode mode : modes) {
+			Quaternion::SlerpMany(data.a.Get(), data.b.Get(), data.t.data(), out.Get(), n, mode);
+			for (size_t i = 0; i < n; ++i) {
+				Quaternion r;
+				if (mode == Quaternion::SlerpFast) {
+					Nlerp(data.a.Get(i), data.b.Get(i), data.t[i], r);
+				}
+				else {
+					Slerp(data.a.Get(i), data.b.Get(i), data.t[i], r);
+				}
+				numErrors += !IsSame(out.Get(i), r);
+			}
+			numErrors += !out.IsGuarded(n);
+		}
+
+		std::vector<Matrix4x4> matrices(n + 1);
+		matrices[n].Matrix[0] = Guard;
+		Quaternion::ToMatrixMany(data.a.Get(), matrices.data(), n);
+		for (size_t i = 0; i < n; ++i) {
+			Matrix4x4 m;
+			m.LoadIdentity();
+			m.FromQuaternion(data.a.Get(i));
+			numErrors += !!memcmp(m.Matrix, matrices[i].Matrix, sizeof(m.Matrix));
+		}
+		numErrors += matrices[n].Matrix[0] != Guard;
+
+		// in place, out is the first input
+		Arrays inPlace = data.any;
+		Quaternion::NormalizeMany(inPlace.Get(), inPlace.Get(), n);
+		Quaternion::MulMany(inPlace.Get(), data.b.Get(), inPlace.Get(), n);
+		for (size_t i = 0; i < n; ++i) {
+			Quaternion r = data.any.Get(i);
+			r.Normalize();
+			numErrors += !IsSame(inPlace.Get(i), r * data.b.Get(i));
+		}
+		inPlace = data.a;
+		Quaternion::SlerpMany(inPlace.Get(), data.b.Get(), data.t.data(), inPlace.Get(), n, Quaternion::SlerpFast);
+		for (size_t i = 0; i < n; ++i) {
+			Quaternion r;
+			Nlerp(data.a.Get(i), data.b.Get(i), data.t[i], r);
+			numErrors += !IsSame(inPlace.Get(i), r);
+		}
+		return numErrors;
+	}
+
+	// angle in degrees between the rotations of Nlerp and of a slerp in double
+	double GetNlerpAngle(const Quaternion& a, const Quaternion& b, float t)
+	{
+		Quaternion r;
+		Nlerp(a, b, t, r);
+		double cosOmega = static_cast<double>(a.x) * b.x + static_cast<double>(a.y) * b.y + static_cast<double>(a.z) * b.z + static_cast<double>(a.w) * b.w;
+		const double sign = cosOmega < 0.0 ? -1.0 : 1.0;
+		cosOmega = fabs(cosOmega) < 1.0 ? fabs(cosOmega) : 1.0;
+		const double omega = acos(cosOmega);
+		const double sinOmega = sin(omega);
+		const double k0 = sinOmega > 1e-9 ? sin((1.0 - t) * omega) / sinOmega : 1.0 - t;
+		const double k1 = (sinOmega > 1e-9 ? sin(t * omega) / sinOmega : t) * sign;
+		const double slerp[4] = { k0 * a.x + k1 * b.x, k0 * a.y + k1 * b.y, k0 * a.z + k1 * b.z, k0 * a.w + k1 * b.w };
+		const double length = sqrt(slerp[0] * slerp[0] + slerp[1] * slerp[1] + slerp[2] * slerp[2] + slerp[3] * slerp[3]);
+		double dot = fabs(slerp[0] * r.x + slerp[1] * r.y + slerp[2] * r.z + slerp[3] * r.w) / length;
+		dot = dot < 1.0 ? dot : 1.0;
+		return 2.0 * acos(dot) * 180.0 / 3.14159265358979323846;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numPairs = 1000000;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--pairs") && hasValue) {
+			numPairs = static_cast<uint>(atoi(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--pairs n]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	// every tail of the 4 and 8 wide kernels, then counts over several blocks
+	std::vector<size_t> counts;
+	for (size_t n = 0; n <= 40; ++n) {
+		counts.push_back(n);
+	}
+	counts.push_back(127);
+	counts.push_back(1003);
+	counts.push_back(4099);
+
+	Inputs inputs;
+	Data data = CreateData(inputs, counts.back());
+	const CPUFeatures::SIMDLevel maxLevel = CPUFeatures::GetMaxSIMDLevel();
+	bool isValid = true;
+	for (uint level = 0; level < CPUFeatures::NumSIMDLevels; ++level) {
+		const char* name = CPUFeatures::GetName(static_cast<CPUFeatures::SIMDLevel>(level));
+		if (level > static_cast<uint>(maxLevel)) {
+			printf("%-20s skipped, not supported by the CPU\n", name);
+			continue;
+		}
+		CPUFeatures::SetSIMDLevel(static_cast<CPUFeatures::SIMDLevel>(level));
+		uint numErrors = 0;
+		for (size_t n : counts) {
+			numErrors += CheckLevel(data, n);
+		}
+		printf("%-20s %8u mismatches\n", name, numErrors);
+		isValid = isValid && !numErrors;
+	}
+	CPUFeatures::SetSIMDLevel(maxLevel);
+	printf("counts               0-40, 127, 1003, 4099\n");
+
+	double maxAngle = 0.0;
+	for (uint i = 0; i < numPairs; ++i) {
+		const Quaternion a = inputs.Unit();
+		const Quaternion b = inputs.Unit();
+		const double angle = GetNlerpAngle(a, b, inputs.Float() * 0.5f + 0.5f);
+		// NaN counts as a failure
+		maxAngle = angle > maxAngle || angle != angle ? angle : maxAngle;
+	}
+	printf("Nlerp                %8.4f degrees max from slerp, %u pairs\n", maxAngle, numPairs);
+	if (!(maxAngle < MaxNlerpAngle)) {
+		printf("Nlerp: %.4f degrees, the bound is %.1f\n", maxAngle, MaxNlerpAngle);
+		isValid = false;
+	}
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
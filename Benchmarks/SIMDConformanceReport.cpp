@@ -0,0 +1,285 @@
+// SIMDConformanceReport.cpp: results of the SIMD.h backends compared through hashes.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux, once per backend:
+//	g++ -std=c++14 -O2 -ffp-contract=off -DSIMD_FORCE_SCALAR SIMDConformanceReport.cpp -o SIMDConformanceScalar
+//	g++ -std=c++14 -O2 -ffp-contract=off SIMDConformanceReport.cpp -o SIMDConformanceSSE2
+//	g++ -std=c++14 -O2 -ffp-contract=off -mavx2 SIMDConformanceReport.cpp -o SIMDConformanceAVX2
+// Runs the operations of Vector4D, Matrix4x4, Quaternion and Plane which go through
+// SIMD.h on seeded random inputs and hashes the bits of every result (FNV-1a), one hash
+// per class. SIMD.h promises the same bits on every backend, so the hashes of a build
+// have to match the ones written by another build:
+//	./SIMDConformanceScalar --write scalar.txt
+//	./SIMDConformanceSSE2 --compare scalar.txt
+//	./SIMDConformanceAVX2 --compare scalar.txt
+// The batch kernels of the .cpp files are dispatched at run time, TransformReport checks them.
+//
+// Usage: SIMDConformanceReport [options]
+//	--iterations n	random inputs of every operation, 100000 by default
+//	--write file	save the hashes
+//	--compare file	compare the hashes with a file written by another build
+// Exit code is 1 if a hash differs.
+
+#include "../Matrix4x4.h"
+#include "../Quaternion.h"
+#include "../Plane.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+namespace {
+
+	enum Group {
+		Vector4DGroup,
+		Matrix4x4Group,
+		QuaternionGroup,
+		PlaneGroup,
+		NumGroups
+	};
+	const char* GroupNames[NumGroups] = { "Vector4D", "Matrix4x4", "Quaternion", "Plane" };
+
+	// FNV-1a
+	class Hash  {
+	private:
+		unsigned long long value;
+	public:
+		Hash() : value(14695981039346656037ull)
+		{
+		}
+		void Add(const void* data, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char *>(data);
+			for (size_t i = 0; i < size; ++i) {
+				value = (value ^ bytes[i]) * 1099511628211ull;
+			}
+		}
+		template <typename T>
+		void Add(const T& v)
+		{
+			Add(&v, sizeof(v));
+		}
+		unsigned long long Get() const
+		{
+			return value;
+		}
+	};
+
+	class Inputs  {
+	private:
+		std::mt19937 random;
+		std::uniform_real_distribution<float> value;
+	public:
+		Inputs() : random(1), value(-100.0f, 100.0f)
+		{
+		}
+		float Float()
+		{
+			return value(random);
+		}
+		// never 0, for divisions
+		float NonZero()
+		{
+			const float v = value(random);
+			return v < 0.0f ? v - 0.5f : v + 0.5f;
+		}
+		Vector3D Vector3()
+		{
+			return Vector3D(Float(), Float(), Float());
+		}
+		Vector4D Vector4()
+		{
+			return Vector4D(Float(), Float(), Float(), Float());
+		}
+		Matrix4x4 Matrix()
+		{
+			Matrix4x4 m;
+			for (uint i = 0; i < 16; ++i) {
+				m.Matrix[i] = Float() * 0.1f;
+			}
+			return m;
+		}
+		Quaternion Rotation()
+		{
+			Quaternion q;
+			q.CreateFromAxisAngle(Float(), Float(), Float() + 200.0f, Float() * 0.03f);
+			return q;
+		}
+	};
+
+	void HashVector4D(Inputs& inputs, Hash& hash)
+	{
+		const Vector4D a = inputs.Vector4();
+		const Vector4D b = inputs.Vector4();
+		const Vector4D nonZero(inputs.NonZero(), inputs.NonZero(), inputs.NonZero(), inputs.NonZero());
+		const float s = inputs.NonZero();
+		hash.Add(a + b);
+		hash.Add(a - b);
+		hash.Add(a * b);
+		hash.Add(a * s);
+		hash.Add(s * a);
+		hash.Add(a / s);
+		hash.Add(s / nonZero);
+		Vector4D c = a;
+		c += b;
+		c *= s;
+		c -= a;
+		c /= nonZero;
+		c *= b;
+		c /= s;
+		hash.Add(c);
+	}
+
+	void HashMatrix4x4(Inputs& inputs, Hash& hash)
+	{
+		const Matrix4x4 a = inputs.Matrix();
+		const Matrix4x4 b = inputs.Matrix();
+		const Vector4D v = inputs.Vector4();
+		const Vector3D p = inputs.Vector3();
+		hash.Add(a * b);
+		Matrix4x4 c = a;
+		c = c * b;
+		hash.Add(c);
+		hash.Add(a * v);
+		hash.Add(v * a);
+		hash.Add(a * p);
+		hash.Add(p * a);
+		hash.Add(Invert(a));
+		Matrix4x4 affine = a;
+		affine[3] = affine[7] = affine[11] = 0.0f;
+		affine[15] = 1.0f;
+		Matrix4x4 inverse;
+		inverse.InvertAffine(affine);
+		hash.Add(inverse);
+		// in place
+		affine.Invert();
+		hash.Add(affine);
+		Matrix4x4 transposed = a;
+		transposed.Transpose();
+		hash.Add(transposed);
+	}
+
+	void HashQuaternion(Inputs& inputs, Hash& hash)
+	{
+		const Quaternion a(inputs.Float(), inputs.Float(), inputs.Float(), inputs.Float());
+		const Quaternion b(inputs.Float(), inputs.Float(), inputs.Float(), inputs.Float());
+		const Quaternion nonZero(inputs.NonZero(), inputs.NonZero(), inputs.NonZero(), inputs.NonZero());
+		const float s = inputs.NonZero();
+		hash.Add(a * b);
+		hash.Add(a + b);
+		hash.Add(a - b);
+		Quaternion c = a;
+		c *= b;
+		c *= s;
+		c /= s;
+		c /= nonZero;
+		hash.Add(c);
+		const Quaternion r = inputs.Rotation();
+		const Vector3D v = inputs.Vector3();
+		hash.Add(r);
+		hash.Add(v * r);
+		hash.Add(r * v);
+		Quaternion n = a;
+		n.Normalize();
+		hash.Add(n);
+	}
+
+	void HashPlane(Inputs& inputs, Hash& hash)
+	{
+		Plane plane;
+		plane.ComputePlane(inputs.Vector3(), inputs.Vector3(), inputs.Vector3());
+		hash.Add(plane);
+		const Vector3D p = inputs.Vector3();
+		hash.Add(plane.SignedDistanceToPoint(p));
+		plane *= inputs.NonZero();
+		hash.Add(plane);
+		plane.Flip();
+		hash.Add(plane);
+		Plane other(inputs.Float(), inputs.Float(), inputs.Float(), inputs.Float());
+		other *= 0.5f;
+		hash.Add(other);
+		Vector3D reflected = p;
+		plane.ReflectDir(reflected);
+		hash.Add(reflected);
+	}
+
+	bool ReadHashes(const char* fileName, unsigned long long* hashes)
+	{
+		FILE* f = fopen(fileName, "r");
+		if (!f) {
+			return false;
+		}
+		bool res = true;
+		for (uint i = 0; i < NumGroups && res; ++i) {
+			char name[32];
+			res = fscanf(f, "%31s %llx", name, &hashes[i]) == 2 && !strcmp(name, GroupNames[i]);
+		}
+		fclose(f);
+		return res;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numIterations = 100000;
+	const char* writeFileName = nullptr;
+	const char* compareFileName = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--iterations") && hasValue) {
+			numIterations = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--write") && hasValue) {
+			writeFileName = argv[++i];
+		} else if (!strcmp(argv[i], "--compare") && hasValue) {
+			compareFileName = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [--iterations n] [--write file] [--compare file]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	Hash hashes[NumGroups];
+	Inputs inputs;
+	for (uint i = 0; i < numIterations; ++i) {
+		HashVector4D(inputs, hashes[Vector4DGroup]);
+		HashMatrix4x4(inputs, hashes[Matrix4x4Group]);
+		HashQuaternion(inputs, hashes[QuaternionGroup]);
+		HashPlane(inputs, hashes[PlaneGroup]);
+	}
+
+	printf("backend              %s, %u iterations\n", SIMD::GetBackendName(), numIterations);
+	for (uint i = 0; i < NumGroups; ++i) {
+		printf("%-20s %016llx\n", GroupNames[i], hashes[i].Get());
+	}
+	if (writeFileName) {
+		FILE* f = fopen(writeFileName, "w");
+		if (!f) {
+			printf("can't write %s\n", writeFileName);
+			return 1;
+		}
+		for (uint i = 0; i < NumGroups; ++i) {
+			fprintf(f, "%s %016llx\n", GroupNames[i], hashes[i].Get());
+		}
+		fclose(f);
+	}
+	bool isValid = true;
+	if (compareFileName) {
+		unsigned long long expected[NumGroups];
+		if (!ReadHashes(compareFileName, expected)) {
+			printf("can't read %s\n", compareFileName);
+			return 1;
+		}
+		for (uint i = 0; i < NumGroups; ++i) {
+			if (hashes[i].Get() != expected[i]) {
+				printf("%s: %016llx, %s has %016llx\n", GroupNames[i], hashes[i].Get(), compareFileName, expected[i]);
+				isValid = false;
+			}
+		}
+	}
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
@@ -0,0 +1,400 @@
+// ShaderCacheReport.cpp: keys, entry files, validation and eviction of the ShaderCache.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 ShaderCacheReport.cpp ../ShaderCache.cpp -o ShaderCacheReport
+// Works in a scratch cache directory and checks that
+//	- Hasher gives the FNV-1a reference values and string boundaries change the hash
+//	- the key changes with the source, a define name or value, the define order, the
+//	  entry point, the target, the flags, the compiler version and the salt, and is
+//	  stable otherwise
+//	- a stored entry loads back byte for byte, also from a new cache on the directory
+//	- a truncated entry, a bad magic, a bad version, a key of another entry and a payload
+//	  not matching its checksum are misses and the file is removed
+//	- the least recently used entry is evicted first, the order survives a restart and
+//	  the entry just stored is never evicted
+//	- a stale .tmp file of an entry or the index left by a crash is a miss and is
+//	  replaced by the next Store
+//	- Init counts entry files missing in an old or lost index and evicts them over the
+//	  budget, and removes entry files of another version or with a damaged header
+// The directory is removed at the end.
+//
+// Usage: ShaderCacheReport [options]
+//	--dir name	scratch cache directory, ShaderCacheReport.tmp by default
+// Exit code is 1 if a check fails.
+
+#include "../ShaderCache.h"
+#include "../Hasher.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+	bool isValid = true;
+
+	void Check(bool condition, const char* text)
+	{
+		if (!condition) {
+			printf("%s\n", text);
+			isValid = false;
+		}
+	}
+
+	// layout of the entry header of ShaderCache.cpp
+	const size_t HeaderSize = 32;
+	const size_t MagicOffset = 0;
+	const size_t VersionOffset = 4;
+	const size_t KeyOffset = 8;
+
+	std::string directory;
+
+	std::string GetEntryPath(uint64 key)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.bin", static_cast<unsigned long long>(key));
+		return directory + name;
+	}
+
+	bool FileExists(const std::string& fileName)
+	{
+		FILE* f = fopen(fileName.c_str(), "rb");
+		if (f) {
+			fclose(f);
+		}
+		return f != nullptr;
+	}
+
+	bool ReadFile(const std::string& fileName, std::vector<ubyte>& data)
+	{
+		FILE* f = fopen(fileName.c_str(), "rb");
+		if (!f) {
+			return false;
+		}
+		data.clear();
+		ubyte buffer[4096];
+		size_t size;
+		while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+			data.insert(data.end(), buffer, buffer + size);
+		}
+		fclose(f);
+		return true;
+	}
+
+	bool WriteFile(const std::string& fileName, const std::vector<ubyte>& data)
+	{
+		FILE* f = fopen(fileName.c_str(), "wb");
+		if (!f) {
+			return false;
+		}
+		const bool res = data.empty() || fwrite(data.data(), 1, data.size(), f) == data.size();
+		return !fclose(f) && res;
+	}
+
+	std::vector<ubyte> MakePayload(size_t size, uint seed)
+	{
+		std::vector<ubyte> payload(size);
+		for (size_t i = 0; i < size; ++i) {
+			seed = seed * 1664525u + 1013904223u;
+			payload[i] = static_cast<ubyte>(seed >> 24);
+		}
+		return payload;
+	}
+
+	void CheckHasher()
+	{
+		// FNV-1a test vectors
+		Check(Hasher::Hash("", 0) == 0xcbf29ce484222325ull, "hasher: empty input is not the offset basis");
+		Check(Hasher::Hash("a", 1) == 0xaf63dc4c8601ec8cull, "hasher: hash of \"a\" is not the FNV-1a value");
+		Check(Hasher::Hash("foobar", 6) == 0x85944171f73967e8ull, "hasher: hash of \"foobar\" is not the FNV-1a value");
+		Hasher ab;
+		ab.Add("ab");
+		ab.Add("c");
+		Hasher bc;
+		bc.Add("a");
+		bc.Add("bc");
+		Check(ab.Get() != bc.Get(), "hasher: string boundaries don't change the hash");
+		Hasher empty;
+		empty.Add(static_cast<const char *>(nullptr));
+		Hasher emptyString;
+		emptyString.Add("");
+		Check(empty.Get() == emptyString.Get(), "hasher: null string is not the empty string");
+	}
+
+	void CheckKeys()
+	{
+		ShaderCache cache;
+		const char source[] = "float4 main() : SV_Target { return 1; }";
+		const char otherSource[] = "float4 main() : SV_Target { return 0; }";
+		const size_t sourceSize = sizeof(source) - 1;
+		ShaderCache::Defines defines = { { "NUM_LIGHTS", "16" }, { "USE_SHADOWS", "" } };
+		const uint64 key = cache.MakeKey(source, sourceSize, defines, "main", "ps_5_0", 0);
+		Check(key == cache.MakeKey(source, sourceSize, defines, "main", "ps_5_0", 0), "keys: same inputs give another key");
+
+		std::vector<uint64> keys;
+		keys.push_back(cache.MakeKey(otherSource, sourceSize, defines, "main", "ps_5_0", 0));
+		keys.push_back(cache.MakeKey(source, sourceSize - 1, defines, "main", "ps_5_0", 0));
+		ShaderCache::Defines changed = defines;
+		changed[0].first = "NUM_LIGHT";
+		keys.push_back(cache.MakeKey(source, sourceSize, changed, "main", "ps_5_0", 0));
+		changed = defines;
+		changed[0].second = "32";
+		keys.push_back(cache.MakeKey(source, sourceSize, changed, "main", "ps_5_0", 0));
+		// name and value boundary
+		changed = defines;
+		changed[0].first = "NUM_LIGHTS1";
+		changed[0].second = "6";
+		keys.push_back(cache.MakeKey(source, sourceSize, changed, "main", "ps_5_0", 0));
+		changed = { defines[1], defines[0] };
+		keys.push_back(cache.MakeKey(source, sourceSize, changed, "main", "ps_5_0", 0));
+		changed = defines;
+		changed.pop_back();
+		keys.push_back(cache.MakeKey(source, sourceSize, changed, "main", "ps_5_0", 0));
+		keys.push_back(cache.MakeKey(source, sourceSize, defines, "psMain", "ps_5_0", 0));
+		keys.push_back(cache.MakeKey(source, sourceSize, defines, "main", "ps_5_1", 0));
+		keys.push_back(cache.MakeKey(source, sourceSize, defines, "main", "ps_5_0", 1));
+		keys.push_back(cache.MakeKey(source, sourceSize, defines, "main", "ps_5_0", 0, 1));
+		keys.push_back(cache.MakeKey("main"));
+		static const char* Names[] = { "source", "source size", "define name", "define value", "define boundary", "define order",
+			"define count", "entry point", "target", "flags", "compiler version", "named key" };
+		for (size_t i = 0; i < keys.size(); ++i) {
+			if (keys[i] == key) {
+				printf("keys: changed %s gives the same key\n", Names[i]);
+				isValid = false;
+			}
+			for (size_t j = 0; j < i; ++j) {
+				if (keys[i] == keys[j]) {
+					printf("keys: changed %s and %s give the same key\n", Names[i], Names[j]);
+					isValid = false;
+				}
+			}
+		}
+
+		ShaderCache salted;
+		salted.Init(directory, 0, 1);
+		Check(salted.MakeKey(source, sourceSize, defines, "main", "ps_5_0", 0) != key, "keys: salt doesn't change the key");
+		Check(salted.MakeKey("main") != cache.MakeKey("main"), "keys: salt doesn't change a named key");
+	}
+
+	void CheckRoundTrip()
+	{
+		const std::vector<ubyte> payload = MakePayload(10000, 1);
+		const uint64 key = 0x1234;
+		{
+			ShaderCache cache;
+			cache.Init(directory);
+			ShaderCache::Blob data;
+			Check(!cache.Load(key, data), "round trip: empty cache has the entry");
+			Check(cache.Store(key, payload.data(), payload.size()), "round trip: store failed");
+			Check(cache.Store(key + 1, nullptr, 0), "round trip: store of an empty blob failed");
+			Check(cache.Load(key, data) && data == payload, "round trip: entry doesn't load back");
+			Check(cache.GetNumEntries() == 2 && cache.GetTotalSize() == payload.size(), "round trip: entries are not counted");
+		}
+		// the index was written by the destructor
+		ShaderCache cache;
+		cache.Init(directory);
+		Check(cache.GetNumEntries() == 2 && cache.GetTotalSize() == payload.size(), "round trip: index doesn't survive a restart");
+		ShaderCache::Blob data;
+		Check(cache.Load(key, data) && data == payload, "round trip: entry doesn't load after a restart");
+		Check(cache.Load(key + 1, data) && data.empty(), "round trip: empty entry doesn't load after a restart");
+	}
+
+	// entry of key with its file changed by corrupt is a miss and is removed
+	template <typename Corrupt>
+	void CheckCorrupted(const char* name, Corrupt corrupt)
+	{
+		const std::vector<ubyte> payload = MakePayload(1000, 2);
+		const uint64 key = 0x5678;
+		ShaderCache cache;
+		cache.Init(directory);
+		cache.Store(key, payload.data(), payload.size());
+		std::vector<ubyte> file;
+		if (!ReadFile(GetEntryPath(key), file) || file.size() != HeaderSize + payload.size()) {
+			printf("corrupted %s: entry file is not header and payload\n", name);
+			isValid = false;
+			return;
+		}
+		corrupt(file);
+		WriteFile(GetEntryPath(key), file);
+		const size_t numEntries = cache.GetNumEntries();
+		ShaderCache::Blob data;
+		if (cache.Load(key, data)) {
+			printf("corrupted %s: entry loads\n", name);
+			isValid = false;
+		}
+		if (FileExists(GetEntryPath(key)) || cache.GetNumEntries() != numEntries - 1) {
+			printf("corrupted %s: entry is not removed\n", name);
+			isValid = false;
+		}
+	}
+
+	void CheckValidation()
+	{
+		CheckCorrupted("truncated payload", [](std::vector<ubyte>& file) { file.pop_back(); });
+		CheckCorrupted("truncated header", [](std::vector<ubyte>& file) { file.resize(HeaderSize - 1); });
+		CheckCorrupted("empty file", [](std::vector<ubyte>& file) { file.clear(); });
+		CheckCorrupted("appended byte", [](std::vector<ubyte>& file) { file.push_back(0); });
+		CheckCorrupted("magic", [](std::vector<ubyte>& file) { file[MagicOffset] ^= 1; });
+		CheckCorrupted("version", [](std::vector<ubyte>& file) { ++file[VersionOffset]; });
+		CheckCorrupted("key", [](std::vector<ubyte>& file) { file[KeyOffset] ^= 1; });
+		CheckCorrupted("payload", [](std::vector<ubyte>& file) { file[HeaderSize + 500] ^= 0x80; });
+	}
+
+	void CheckEviction()
+	{
+		const size_t entrySize = 300;
+		const std::vector<ubyte> payload = MakePayload(entrySize, 3);
+		ShaderCache::Blob data;
+		{
+			ShaderCache cache;
+			cache.Init(directory, 1000);
+			cache.Store(1, payload.data(), payload.size());
+			cache.Store(2, payload.data(), payload.size());
+			cache.Store(3, payload.data(), payload.size());
+			// 1 is used again, 2 is the least recently used
+			cache.Load(1, data);
+			cache.Store(4, payload.data(), payload.size());
+			Check(!FileExists(GetEntryPath(2)) && FileExists(GetEntryPath(1)) && FileExists(GetEntryPath(3)) && FileExists(GetEntryPath(4)),
+				"eviction: the least recently used entry is not the one evicted");
+			Check(cache.GetTotalSize() == 3 * entrySize, "eviction: size is over the budget");
+		}
+		{
+			// recency from the index: 3, 1, 4
+			ShaderCache cache;
+			cache.Init(directory, 1000);
+			cache.Store(5, payload.data(), payload.size());
+			Check(!FileExists(GetEntryPath(3)) && cache.Load(1, data) && cache.Load(4, data) && cache.Load(5, data),
+				"eviction: recency is lost by a restart");
+			// larger than the budget, it stays alone
+			const std::vector<ubyte> large = MakePayload(2000, 4);
+			cache.Store(6, large.data(), large.size());
+			Check(cache.GetNumEntries() == 1 && cache.Load(6, data) && data == large, "eviction: entry just stored is evicted");
+		}
+	}
+
+	void CheckStaleTemporary()
+	{
+		const std::vector<ubyte> payload = MakePayload(500, 5);
+		const std::vector<ubyte> garbage = MakePayload(100, 6);
+		const uint64 key = 0x9abc;
+		const std::string tmpName = GetEntryPath(key) + ".tmp";
+		const std::string indexTmpName = directory + "/index.bin.tmp";
+		// a crash between the write of the temporary file and the rename
+		WriteFile(tmpName, garbage);
+		WriteFile(indexTmpName, garbage);
+		ShaderCache cache;
+		cache.Init(directory);
+		ShaderCache::Blob data;
+		Check(!cache.Load(key, data), "stale temporary: a .tmp file is loaded");
+		Check(cache.Store(key, payload.data(), payload.size()) && !FileExists(tmpName), "stale temporary: store doesn't replace the .tmp file");
+		Check(cache.Load(key, data) && data == payload, "stale temporary: entry doesn't load after the .tmp file");
+		Check(cache.SaveIndex() && !FileExists(indexTmpName), "stale temporary: index doesn't replace the .tmp file");
+		ShaderCache reopened;
+		reopened.Init(directory);
+		Check(reopened.Load(key, data) && data == payload, "stale temporary: index is not valid after the .tmp file");
+	}
+
+	void CheckScan()
+	{
+		const size_t entrySize = 300;
+		const std::vector<ubyte> payload = MakePayload(entrySize, 7);
+		const std::string indexName = directory + "/index.bin";
+		std::vector<ubyte> oldIndex;
+		{
+			ShaderCache cache;
+			cache.Init(directory);
+			cache.Store(7, payload.data(), payload.size());
+		}
+		ReadFile(indexName, oldIndex);
+		{
+			ShaderCache cache;
+			cache.Init(directory);
+			cache.Store(8, payload.data(), payload.size());
+		}
+		// a crash before the index of the second run was written
+		WriteFile(indexName, oldIndex);
+		ShaderCache::Blob data;
+		{
+			ShaderCache cache;
+			cache.Init(directory);
+			Check(cache.GetNumEntries() == 2 && cache.GetTotalSize() == 2 * entrySize, "scan: entry missing in the index is not counted");
+			Check(cache.Load(8, data) && data == payload, "scan: entry missing in the index doesn't load");
+		}
+		remove(indexName.c_str());
+		{
+			ShaderCache cache;
+			cache.Init(directory);
+			Check(cache.GetNumEntries() == 2 && cache.GetTotalSize() == 2 * entrySize, "scan: entries are not counted without an index");
+		}
+		// an entry of an older version and one with a truncated header under valid names
+		std::vector<ubyte> file;
+		ReadFile(GetEntryPath(7), file);
+		file[KeyOffset] = 9;
+		--file[VersionOffset];
+		WriteFile(GetEntryPath(9), file);
+		file.resize(HeaderSize / 2);
+		WriteFile(GetEntryPath(10), file);
+		{
+			ShaderCache cache;
+			cache.Init(directory);
+			Check(!FileExists(GetEntryPath(9)) && !FileExists(GetEntryPath(10)) && cache.GetNumEntries() == 2, "scan: entries of another version are not removed");
+		}
+		remove(indexName.c_str());
+		// both entries are the least recently used, one goes
+		ShaderCache cache;
+		cache.Init(directory, entrySize + entrySize / 2);
+		Check(cache.GetNumEntries() == 1 && cache.GetTotalSize() == entrySize && FileExists(GetEntryPath(7)) != FileExists(GetEntryPath(8)),
+			"scan: entries over the budget are not evicted on Init");
+	}
+
+	// entries of the checks and the index
+	void RemoveDirectory()
+	{
+		static const uint64 Keys[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0x1234, 0x1235, 0x5678, 0x9abc };
+		for (uint64 key : Keys) {
+			remove(GetEntryPath(key).c_str());
+			remove((GetEntryPath(key) + ".tmp").c_str());
+		}
+		remove((directory + "/index.bin").c_str());
+		remove((directory + "/index.bin.tmp").c_str());
+		remove(directory.c_str());
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	directory = "ShaderCacheReport.tmp";
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--dir") && hasValue) {
+			directory = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [--dir name]\n", argv[0]);
+			return 2;
+		}
+	}
+	RemoveDirectory();
+	CheckHasher();
+	CheckKeys();
+	RemoveDirectory();
+	CheckRoundTrip();
+	RemoveDirectory();
+	CheckValidation();
+	RemoveDirectory();
+	CheckEviction();
+	RemoveDirectory();
+	CheckStaleTemporary();
+	RemoveDirectory();
+	CheckScan();
+	RemoveDirectory();
+	if (FileExists(directory)) {
+		printf("%s is not empty at the end\n", directory.c_str());
+	}
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+// TerrainReport.cpp: residency and LOD selection of the streamed terrain along a camera path.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -pthread TerrainReport.cpp ../MeshGenerator.cpp ../VertexFormat.cpp ../GridGenerator.cpp ../Terrain.cpp -o TerrainReport
+// Flies the viewer through the terrain and updates it every frame as the renderer does,
+// then checks that
+//	- no resident tile is beyond the eviction distance
+//	- the LOD of every tile is the LOD of its distance up to the hysteresis
+//	- the indices of every LOD of a generated tile address the vertices of the LOD
+//	- the cracks between LODs are shallower than the skirts
+//	- the normals on the border of a tile are the normals of its neighbours there
+//	- every tile in the load radius is resident once the viewer stops
+// and reports the resident tiles, the triangles drawn and the time of Update.
+//
+// Usage: TerrainReport [options]
+//	--frames n	frames of the flight, 1000 by default
+//	--speed s	distance per frame, 8 by default
+//	--frame-time ms	length of a frame, the tiles are generated meanwhile, 10 by default
+//	--format name	Float or Quantized16, Quantized16 by default
+// Exit code is 1 if a check fails.
+
+#include "../Terrain.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+	// the indices of every LOD are below the vertices of the LOD
+	bool CheckTileMesh(const Terrain& terrain, const Terrain::TileMesh& mesh)
+	{
+		const uint numLods = terrain.GetSettings().numLods;
+		const uint numVertices = static_cast<uint>(mesh.vertices.size() / terrain.GetVertexFormat().GetStride());
+		for (uint lod = 0; lod < numLods; ++lod) {
+			const Terrain::Lod& tileLod = mesh.lods[lod];
+			const uint end = lod + 1 < numLods ? mesh.lods[lod + 1].baseVertex : numVertices;
+			if (!tileLod.indexCount || tileLod.startIndex + tileLod.indexCount > mesh.indices.size()) {
+				return false;
+			}
+			for (uint i = tileLod.startIndex; i < tileLod.startIndex + tileLod.indexCount; ++i) {
+				if (tileLod.baseVertex + mesh.indices[i] >= end) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// LOD l covers lodDistance * 2^(l - 1) to lodDistance * 2^l, widened by the hysteresis
+	bool IsLodInRange(const Terrain::Settings& settings, uint lod, float distance)
+	{
+		const float start = lod ? settings.lodDistance * (1 << (lod - 1)) : 0.0f;
+		const float end = lod + 1 < settings.numLods ? settings.lodDistance * (1 << lod) : FLT_MAX;
+		return lod < settings.numLods && distance * (1.0f + settings.lodHysteresis) >= start && distance * (1.0f - settings.lodHysteresis) < end;
+	}
+
+	// largest height difference along a tile border between LOD 0 and the coarser LODs
+	float GetMaxBorderGap(const Terrain& terrain)
+	{
+		const Terrain::Settings& settings = terrain.GetSettings();
+		const float step = settings.tileSize / settings.numCells;
+		float maxGap = 0.0f;
+		for (uint lod = 1; lod < settings.numLods; ++lod) {
+			const uint cellSteps = 1 << lod;
+			for (uint i = 0; i < settings.numCells * 4; ++i) {
+				// sampled along z = 0 and x = 0 of a few tiles
+				const float offset = (i % settings.numCells) * step + (i / settings.numCells) * settings.tileSize;
+				const float cellStart = floorf(offset / (step * cellSteps)) * step * cellSteps;
+				const float t = (offset - cellStart) / (step * cellSteps);
+				const float edgeX = (1.0f - t) * terrain.GetHeight(cellStart, 0.0f) + t * terrain.GetHeight(cellStart + step * cellSteps, 0.0f);
+				const float edgeZ = (1.0f - t) * terrain.GetHeight(0.0f, cellStart) + t * terrain.GetHeight(0.0f, cellStart + step * cellSteps);
+				maxGap = std::max(maxGap, fabsf(edgeX - terrain.GetHeight(offset, 0.0f)));
+				maxGap = std::max(maxGap, fabsf(edgeZ - terrain.GetHeight(0.0f, offset)));
+			}
+		}
+		return maxGap;
+	}
+
+	// largest difference of the LOD 0 normals on the borders a tile shares with its +X and +Z neighbours
+	float GetMaxSeamNormalError(const Terrain& terrain, const Terrain::TileKey& key)
+	{
+		const uint numCells = terrain.GetSettings().numCells;
+		const uint numColumns = numCells + 1;
+		const VertexFormat& format = terrain.GetVertexFormat();
+		const uint stride = format.GetStride();
+		const Terrain::TileKey neighbourKeys[] = {{key.x + 1, key.z}, {key.x, key.z + 1}};
+		Terrain::TileMesh mesh;
+		terrain.CreateTileMesh(key, mesh);
+		float maxError = 0.0f;
+		for (uint n = 0; n < 2; ++n) {
+			Terrain::TileMesh neighbour;
+			terrain.CreateTileMesh(neighbourKeys[n], neighbour);
+			for (uint i = 0; i < numColumns; ++i) {
+				// x = numCells against x = 0 of the +X neighbour, z = numCells against z = 0 of the +Z one
+				const uint vertex = n ? numCells * numColumns + i : i * numColumns + numCells;
+				const uint neighbourVertex = n ? i : i * numColumns;
+				Vector3D normal;
+				Vector3D neighbourNormal;
+				format.Decode(&mesh.vertices[static_cast<size_t>(vertex) * stride], nullptr, &normal, nullptr);
+				format.Decode(&neighbour.vertices[static_cast<size_t>(neighbourVertex) * stride], nullptr, &neighbourNormal, nullptr);
+				maxError = std::max(maxError, (normal - neighbourNormal).Length());
+			}
+		}
+		return maxError;
+	}
+
+	// the viewer goes around a large circle and crosses it
+	Vector3D GetPosition(uint frame, uint numFrames, float speed)
+	{
+		const float length = numFrames * speed;
+		const float radius = length / (4.0f * Pi);
+		const float distance = frame * speed;
+		if (distance < length * 0.5f) {
+			const float angle = distance / radius;
+			return Vector3D(radius * cosf(angle), 20.0f, radius * sinf(angle));
+		}
+		return Vector3D(radius - (distance - length * 0.5f) * 2.0f * radius / (length * 0.5f), 20.0f, 0.0f);
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numFrames = 1000;
+	float speed = 8.0f;
+	uint frameTime = 10;
+	VertexFormat::Quantization quantization = VertexFormat::Quantization16;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--frames") && hasValue) {
+			numFrames = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--speed") && hasValue) {
+			speed = static_cast<float>(atof(argv[++i]));
+		} else if (!strcmp(argv[i], "--frame-time") && hasValue) {
+			frameTime = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--format") && hasValue) {
+			const char* name = argv[++i];
+			uint q = 0;
+			while (q < VertexFormat::NumQuantizations && strcmp(name, VertexFormat::GetName(static_cast<VertexFormat::Quantization>(q)))) {
+				++q;
+			}
+			if (q == VertexFormat::NumQuantizations) {
+				fprintf(stderr, "Unknown format %s\n", name);
+				return 2;
+			}
+			quantization = static_cast<VertexFormat::Quantization>(q);
+		} else {
+			fprintf(stderr, "Usage: %s [--frames n] [--speed s] [--frame-time ms] [--format Float|Quantized16]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!numFrames || speed <= 0.0f) {
+		fprintf(stderr, "Frames and speed must be above 0\n");
+		return 2;
+	}
+
+	const Terrain::Settings settings;
+	Terrain terrain(settings, Terrain::CreateVertexFormat(quantization));
+	const float evictDistance = (settings.loadRadius + 1) * settings.tileSize;
+	bool isValid = true;
+	uint numLoaded = 0;
+	uint numEvicted = 0;
+	size_t maxResident = 0;
+	size_t maxTriangles = 0;
+	size_t tileBytes = 0;
+	double maxUpdateTime = 0.0;
+	double totalUpdateTime = 0.0;
+	double generateTime = 0.0;
+	std::vector<Terrain::TileMesh> loadedTiles;
+	std::vector<Terrain::TileKey> evictedTiles;
+	for (uint frame = 0; frame <= numFrames && isValid; ++frame) {
+		const Vector3D position = GetPosition(frame, numFrames, speed);
+		loadedTiles.clear();
+		evictedTiles.clear();
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		terrain.Update(position, loadedTiles, evictedTiles);
+		const double updateTime = Milliseconds(std::chrono::steady_clock::now() - start).count();
+		maxUpdateTime = std::max(maxUpdateTime, updateTime);
+		totalUpdateTime += updateTime;
+		numLoaded += static_cast<uint>(loadedTiles.size());
+		numEvicted += static_cast<uint>(evictedTiles.size());
+		for (const Terrain::TileMesh& mesh : loadedTiles) {
+			tileBytes = std::max(tileBytes, mesh.vertices.size() + mesh.indices.size() * sizeof(ushort));
+			if (!CheckTileMesh(terrain, mesh)) {
+				printf("frame %u: indices of tile (%d, %d) are out of range\n", frame, mesh.key.x, mesh.key.z);
+				isValid = false;
+			}
+		}
+		size_t numTriangles = 0;
+		for (const Terrain::Tiles::value_type& tile : terrain.GetTiles()) {
+			const float distance = Terrain::GetDistance(tile.second.bounds, position);
+			if (terrain.GetTileDistance(tile.first, position) > evictDistance) {
+				printf("frame %u: tile (%d, %d) is resident beyond the eviction distance\n", frame, tile.first.x, tile.first.z);
+				isValid = false;
+			}
+			if (!IsLodInRange(settings, tile.second.lod, distance)) {
+				printf("frame %u: tile (%d, %d) at %.1f has LOD %u\n", frame, tile.first.x, tile.first.z, distance, tile.second.lod);
+				isValid = false;
+			}
+			numTriangles += tile.second.lods[tile.second.lod].indexCount / 3;
+		}
+		maxResident = std::max(maxResident, terrain.GetTiles().size());
+		maxTriangles = std::max(maxTriangles, numTriangles);
+		std::this_thread::sleep_for(std::chrono::milliseconds(frameTime));
+	}
+
+	// the viewer stops, every tile in the radius gets loaded
+	const Vector3D position = GetPosition(numFrames, numFrames, speed);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	do {
+		loadedTiles.clear();
+		evictedTiles.clear();
+		terrain.Wait();
+		terrain.Update(position, loadedTiles, evictedTiles);
+		numLoaded += static_cast<uint>(loadedTiles.size());
+		numEvicted += static_cast<uint>(evictedTiles.size());
+	} while (terrain.GetNumPendingTiles());
+	const uint loadRadius = settings.loadRadius;
+	const Terrain::TileKey center = terrain.GetTileKey(position);
+	for (int z = center.z - static_cast<int>(loadRadius); z <= center.z + static_cast<int>(loadRadius); ++z) {
+		for (int x = center.x - static_cast<int>(loadRadius); x <= center.x + static_cast<int>(loadRadius); ++x) {
+			const Terrain::TileKey key = {x, z};
+			if (terrain.GetTileDistance(key, position) <= loadRadius * settings.tileSize && !terrain.GetTiles().count(key)) {
+				printf("tile (%d, %d) in the load radius is not resident\n", x, z);
+				isValid = false;
+			}
+		}
+	}
+	// generation of one tile, on the caller
+	start = std::chrono::steady_clock::now();
+	Terrain::TileMesh mesh;
+	terrain.CreateTileMesh(center, mesh);
+	generateTime = Milliseconds(std::chrono::steady_clock::now() - start).count();
+	const float maxGap = GetMaxBorderGap(terrain);
+	if (maxGap >= settings.skirtDepth) {
+		printf("cracks of %.2f are deeper than the skirts\n", maxGap);
+		isValid = false;
+	}
+	// neighbour tiles sample the same heights on their borders, the normals are the same
+	const float maxSeamError = GetMaxSeamNormalError(terrain, center);
+	if (maxSeamError > 0.0f) {
+		printf("normals on the tile borders differ by %.4f\n", maxSeamError);
+		isValid = false;
+	}
+
+	printf("terrain %s: tiles of %.0f with %u cells and %u LODs, load radius %u tiles\n", VertexFormat::GetName(quantization), settings.tileSize, settings.numCells,
+		settings.numLods, settings.loadRadius);
+	printf("  frames             %10u\n", numFrames);
+	printf("  tiles loaded       %10u\n", numLoaded);
+	printf("  tiles evicted      %10u\n", numEvicted);
+	printf("  max resident tiles %10u\n", static_cast<uint>(maxResident));
+	printf("  max triangles      %10u\n", static_cast<uint>(maxTriangles));
+	printf("  tile size          %10.1f KB\n", tileBytes / 1024.0);
+	printf("  max resident size  %10.1f MB\n", maxResident * tileBytes / (1024.0 * 1024.0));
+	printf("  tile generation    %10.3f ms\n", generateTime);
+	printf("  mean Update        %10.3f ms\n", totalUpdateTime / (numFrames + 1));
+	printf("  max Update         %10.3f ms\n", maxUpdateTime);
+	printf("  max crack          %10.3f (skirt %.1f)\n", maxGap, settings.skirtDepth);
+	printf("  max seam normal    %10.4f\n", maxSeamError);
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
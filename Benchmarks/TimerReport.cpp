@@ -0,0 +1,179 @@
+// TimerReport.cpp: monotonicity, resolution and drift of the Timer tick source.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -pthread TimerReport.cpp ../Timer.cpp -o TimerReport
+// Checks that
+//	- ticks never go back on a thread and between threads
+//	- TicksToNanoseconds is exact up to 2^63 ticks
+//	- the absolute timer equals the sum of the frame times
+//	- the tick source drifts from std::chrono::steady_clock by less than 1000 ppm
+//	  (steady_clock is slewed by NTP by up to 500 ppm, CLOCK_MONOTONIC_RAW is not)
+// and reports the frequency, the resolution and the cost of a reading.
+//
+// Usage: TimerReport [options]
+//	--readings n	readings of the monotonicity test per thread, 10000000 by default
+//	--threads n	threads of the monotonicity test, the hardware threads (at least 2) by default
+//	--duration s	seconds of the drift test, 2 by default
+// Exit code is 1 if a check fails.
+
+#include "../Timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	struct MonotonicityResult {
+		bool isMonotonic;
+		// smallest step above 0 in ticks
+		uint64 resolution;
+		double nanosecondsPerReading;
+	};
+
+	// every reading is compared with the last one of the thread and the latest one of all threads
+	MonotonicityResult CheckMonotonicity(std::atomic<uint64>& latest, uint numReadings)
+	{
+		MonotonicityResult result = { true, ~0ull, 0.0 };
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint64 previous = Timer::GetTicks();
+		for (uint i = 0; i < numReadings; ++i) {
+			const uint64 published = latest.load();
+			const uint64 ticks = Timer::GetTicks();
+			if (ticks < previous || ticks < published) {
+				result.isMonotonic = false;
+			}
+			if (ticks > previous) {
+				result.resolution = std::min(result.resolution, ticks - previous);
+			}
+			previous = ticks;
+			uint64 expected = published;
+			while (expected < ticks && !latest.compare_exchange_weak(expected, ticks)) {
+			}
+		}
+		result.nanosecondsPerReading = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / numReadings;
+		return result;
+	}
+
+	// against the exact product in 128 bits
+	bool CheckConversion()
+	{
+#ifdef __SIZEOF_INT128__
+		const uint64 frequency = Timer::GetFrequency();
+		uint64 ticks = 1;
+		for (uint i = 0; i < 63 * 4; ++i) {
+			// powers of 2 and their neighbours
+			const uint64 value = ticks + (i % 4) - 1;
+			const unsigned __int128 exact = static_cast<unsigned __int128>(value) * Timer::NanosecondsPerSecond / frequency;
+			if (Timer::TicksToNanoseconds(value) != static_cast<uint64>(exact)) {
+				printf("TicksToNanoseconds(%llu) is %llu, not %llu\n", static_cast<unsigned long long>(value), static_cast<unsigned long long>(Timer::TicksToNanoseconds(value)),
+					static_cast<unsigned long long>(exact));
+				return false;
+			}
+			if (i % 4 == 3) {
+				ticks *= 2;
+			}
+		}
+#endif
+		return true;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numReadings = 10000000;
+	uint numThreads = std::max(2u, std::thread::hardware_concurrency());
+	double duration = 2.0;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--readings") && hasValue) {
+			numReadings = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--threads") && hasValue) {
+			numThreads = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--duration") && hasValue) {
+			duration = atof(argv[++i]);
+		} else {
+			fprintf(stderr, "Usage: %s [--readings n] [--threads n] [--duration s]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!numReadings || !numThreads || duration <= 0.0) {
+		fprintf(stderr, "Readings, threads and duration must be above 0\n");
+		return 2;
+	}
+
+	bool isValid = true;
+	std::atomic<uint64> latest(0);
+	std::vector<std::future<MonotonicityResult> > tasks;
+	for (uint i = 0; i < numThreads; ++i) {
+		tasks.push_back(std::async(std::launch::async, CheckMonotonicity, std::ref(latest), numReadings));
+	}
+	MonotonicityResult monotonicity = { true, ~0ull, 0.0 };
+	for (std::future<MonotonicityResult>& task : tasks) {
+		const MonotonicityResult result = task.get();
+		monotonicity.isMonotonic = monotonicity.isMonotonic && result.isMonotonic;
+		monotonicity.resolution = std::min(monotonicity.resolution, result.resolution);
+	}
+	// cost of a reading without the other threads
+	monotonicity.nanosecondsPerReading = CheckMonotonicity(latest, numReadings).nanosecondsPerReading;
+	if (!monotonicity.isMonotonic) {
+		printf("ticks went back\n");
+		isValid = false;
+	}
+	if (!CheckConversion()) {
+		isValid = false;
+	}
+
+	// frames of 1 ms, their sum is the absolute time
+	Timer timer;
+	uint64 frameTime = 0;
+	const uint numFrames = 200;
+	for (uint i = 0; i < numFrames; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		frameTime += timer.DiffTimeInt();
+	}
+	const uint64 absoluteTime = timer.AbsoluteDiffTimeInt();
+	// one reading apart, rounding of every frame is below a nanosecond
+	const uint64 maxFrameError = 1000000;
+	if (absoluteTime < frameTime || absoluteTime - frameTime > maxFrameError) {
+		printf("absolute time %llu ns differs from the frame times %llu ns\n", static_cast<unsigned long long>(absoluteTime), static_cast<unsigned long long>(frameTime));
+		isValid = false;
+	}
+
+	// both clocks are read back to back around a sleep
+	timer.RestartAbsoluteTimer();
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+	const double timerSeconds = timer.AbsoluteDiffTime();
+	const double steadySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const double drift = (timerSeconds - steadySeconds) / steadySeconds * 1e6;
+	const double maxDrift = 1000.0;
+	if (fabs(drift) > maxDrift) {
+		printf("drift of %.1f ppm\n", drift);
+		isValid = false;
+	}
+
+	// precision of the old float seconds after hours of uptime
+	const float floatPrecision = nextafterf(4.0f * 3600.0f, 1e9f) - 4.0f * 3600.0f;
+	const double doublePrecision = nextafter(4.0 * 3600.0, 1e9) - 4.0 * 3600.0;
+
+	printf("frequency            %14llu Hz\n", static_cast<unsigned long long>(Timer::GetFrequency()));
+	printf("resolution           %14.1f ns\n", Timer::TicksToSeconds(monotonicity.resolution) * 1e9);
+	printf("reading              %14.1f ns\n", monotonicity.nanosecondsPerReading);
+	printf("monotonic            %14s (%u threads x %u readings)\n", monotonicity.isMonotonic ? "yes" : "no", numThreads, numReadings);
+	printf("frame sum error      %14lld ns (%u frames)\n", static_cast<long long>(absoluteTime - frameTime), numFrames);
+	printf("drift                %14.2f ppm over %.1f s\n", drift, steadySeconds);
+	printf("4h uptime precision  %14.3g s as float, %.3g s as double\n", floatPrecision, doublePrecision);
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
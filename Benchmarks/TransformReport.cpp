@@ -0,0 +1,199 @@
+// TransformReport.cpp: batch transforms of Matrix4x4 on every SIMD level against the operators.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 -ffp-contract=off TransformReport.cpp ../Matrix4x4.cpp ../CPUFeatures.cpp -o TransformReport
+// Transforms random points and vectors with TransformPoints and TransformVectors on every
+// level the CPU supports (scalar, SSE2, AVX2, AVX-512) and checks bit for bit that
+//	- points are v * mat + GetPosition() and the xyz of the homogeneous mat * (v, 1)
+//	- vectors are v * mat
+// for structure of arrays input, for array of structures input with strides larger than
+// Vector3D and in place, for every count from 0 to 70 (tails of every kernel width) and
+// a few large ones. Levels the CPU doesn't support are reported as skipped.
+//
+// Usage: TransformReport [options]
+//	--matrices n	random matrices, 200 by default
+// Exit code is 1 if a check fails.
+
+#include "../Matrix4x4.h"
+#include "../CPUFeatures.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+	// light data as LightIndexedDeferredRendering keeps it, the position is not the first member
+	struct StridedPoint {
+		float range;
+		Vector3D position;
+		uint index;
+	};
+
+	struct Reference {
+		std::vector<Vector3D> points;
+		std::vector<Vector3D> homogeneous;
+		std::vector<Vector3D> vectors;
+	};
+
+	bool IsSame(const Vector3D& a, const Vector3D& b)
+	{
+		return !memcmp(&a, &b, sizeof(Vector3D));
+	}
+
+	bool IsSame(float x, float y, float z, const Vector3D& b)
+	{
+		const Vector3D a(x, y, z);
+		return IsSame(a, b);
+	}
+
+	Reference Transform(const Matrix4x4& m, const std::vector<Vector3D>& in)
+	{
+		Reference reference;
+		for (const Vector3D& v : in) {
+			Vector3D p = v * m;
+			p += m.GetPosition();
+			reference.points.push_back(p);
+			const Vector4D h = m * Vector4D(v.x, v.y, v.z, 1.0f);
+			reference.homogeneous.push_back(Vector3D(h.x, h.y, h.z));
+			reference.vectors.push_back(v * m);
+		}
+		return reference;
+	}
+
+	// mismatches of every form of the batch transforms for the first n points
+	uint CheckLevel(const Matrix4x4& m, const std::vector<Vector3D>& in, const Reference& reference, size_t n)
+	{
+		uint numErrors = 0;
+		std::vector<float> x(n), y(n), z(n);
+		for (size_t i = 0; i < n; ++i) {
+			x[i] = in[i].x;
+			y[i] = in[i].y;
+			z[i] = in[i].z;
+		}
+		// structure of arrays, the guard after the outputs must stay untouched
+		const float Guard = 12345.0f;
+		std::vector<float> outX(n + 1, Guard), outY(n + 1, Guard), outZ(n + 1, Guard);
+		m.TransformPoints(x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), n);
+		for (size_t i = 0; i < n; ++i) {
+			numErrors += !IsSame(outX[i], outY[i], outZ[i], reference.points[i]) || !IsSame(outX[i], outY[i], outZ[i], reference.homogeneous[i]);
+		}
+		numErrors += outX[n] != Guard || outY[n] != Guard || outZ[n] != Guard;
+		m.TransformVectors(x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), n);
+		for (size_t i = 0; i < n; ++i) {
+			numErrors += !IsSame(outX[i], outY[i], outZ[i], reference.vectors[i]);
+		}
+		// in place
+		m.TransformPoints(x.data(), y.data(), z.data(), x.data(), y.data(), z.data(), n);
+		for (size_t i = 0; i < n; ++i) {
+			numErrors += !IsSame(x[i], y[i], z[i], reference.points[i]);
+		}
+
+		// array of structures, into structures of another stride
+		std::vector<StridedPoint> strided(n);
+		for (size_t i = 0; i < n; ++i) {
+			strided[i].range = 1.0f;
+			strided[i].position = in[i];
+			strided[i].index = static_cast<uint>(i);
+		}
+		std::vector<Vector4D> out4(n, Vector4D(Guard, Guard, Guard, Guard));
+		Vector3D* out = n ? reinterpret_cast<Vector3D *>(&out4[0]) : nullptr;
+		const Vector3D* points = n ? &strided[0].position : nullptr;
+		m.TransformPoints(points, sizeof(StridedPoint), out, sizeof(Vector4D), n);
+		for (size_t i = 0; i < n; ++i) {
+			numErrors += !IsSame(Vector3D(out4[i].x, out4[i].y, out4[i].z), reference.points[i]) || out4[i].w != Guard;
+		}
+		m.TransformVectors(points, sizeof(StridedPoint), out, sizeof(Vector4D), n);
+		for (size_t i = 0; i < n; ++i) {
+			numErrors += !IsSame(Vector3D(out4[i].x, out4[i].y, out4[i].z), reference.vectors[i]);
+		}
+		// in place, the other members stay
+		std::vector<StridedPoint> inPlace = strided;
+		Vector3D* positions = n ? &inPlace[0].position : nullptr;
+		m.TransformPoints(positions, sizeof(StridedPoint), positions, sizeof(StridedPoint), n);
+		for (size_t i = 0; i < n; ++i) {
+			numErrors += !IsSame(inPlace[i].position, reference.points[i]) || inPlace[i].range != 1.0f || inPlace[i].index != i;
+		}
+		// packed Vector3D
+		std::vector<Vector3D> packed(in.begin(), in.begin() + n);
+		if (n) {
+			m.TransformVectors(&packed[0], sizeof(Vector3D), &packed[0], sizeof(Vector3D), n);
+		}
+		for (size_t i = 0; i < n; ++i) {
+			numErrors += !IsSame(packed[i], reference.vectors[i]);
+		}
+		return numErrors;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numMatrices = 200;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--matrices") && hasValue) {
+			numMatrices = static_cast<uint>(atoi(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--matrices n]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	// every tail of the 4, 8 and 16 wide kernels and the 64 point blocks of the strided
+	// transforms, then counts over several blocks
+	std::vector<size_t> counts;
+	for (size_t n = 0; n <= 70; ++n) {
+		counts.push_back(n);
+	}
+	counts.push_back(127);
+	counts.push_back(1000);
+	counts.push_back(4099);
+	const size_t maxCount = counts.back();
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> value(-1000.0f, 1000.0f);
+	std::vector<Vector3D> in(maxCount);
+	const CPUFeatures::SIMDLevel maxLevel = CPUFeatures::GetMaxSIMDLevel();
+	uint numErrors[CPUFeatures::NumSIMDLevels] = {};
+	for (uint i = 0; i < numMatrices; ++i) {
+		Matrix4x4 m;
+		for (uint k = 0; k < 16; ++k) {
+			m.Matrix[k] = value(random);
+		}
+		// affine matrices as the renderer uses, a projective one now and then
+		if (i % 4) {
+			m.Matrix[3] = m.Matrix[7] = m.Matrix[11] = 0.0f;
+			m.Matrix[15] = 1.0f;
+		}
+		for (Vector3D& v : in) {
+			v = Vector3D(value(random), value(random), value(random));
+		}
+		const Reference reference = Transform(m, in);
+		for (uint level = 0; level <= static_cast<uint>(maxLevel); ++level) {
+			CPUFeatures::SetSIMDLevel(static_cast<CPUFeatures::SIMDLevel>(level));
+			for (size_t n : counts) {
+				numErrors[level] += CheckLevel(m, in, reference, n);
+			}
+		}
+	}
+	CPUFeatures::SetSIMDLevel(maxLevel);
+
+	bool isValid = true;
+	for (uint level = 0; level < CPUFeatures::NumSIMDLevels; ++level) {
+		const char* name = CPUFeatures::GetName(static_cast<CPUFeatures::SIMDLevel>(level));
+		if (level > static_cast<uint>(maxLevel)) {
+			printf("%-20s skipped, not supported by the CPU\n", name);
+			continue;
+		}
+		printf("%-20s %8u mismatches\n", name, numErrors[level]);
+		isValid = isValid && !numErrors[level];
+	}
+	printf("matrices             %8u, counts 0-70, 127, 1000, 4099\n", numMatrices);
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
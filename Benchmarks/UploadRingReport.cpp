@@ -0,0 +1,370 @@
+// UploadRingReport.cpp: allocation and retirement of the UploadRing staging allocator.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 UploadRingReport.cpp -o UploadRingReport
+// Drives the ring with a fake fence and checks
+//	- wraparound: an allocation which doesn't fit the end of the ring goes to its start
+//	  and the skipped end is given back with its batch
+//	- alignment padding is counted as used and given back
+//	- a full ring and an allocation larger than the ring return InvalidOffset
+//	- Retire with a stale fence value doesn't free anything, one value frees all the
+//	  batches up to it
+//	- random allocations with random GPU latency never overlap a live allocation
+//	- uploads larger than the ring arrive intact when they go in pieces as in
+//	  StagingUploader::UploadBuffer; the copy queue reads the ring only when its
+//	  submission executes, so a piece overwritten too early corrupts the destination
+//
+// Usage: UploadRingReport [options]
+//	--allocations n	allocations of the random test, 1000000 by default
+//	--file name	also uploads the bytes of a file through a ring of the renderer's size
+// Exit code is 1 if a check fails.
+
+#include "../UploadRing.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace {
+
+	bool isValid = true;
+
+	void Check(bool condition, const char* text)
+	{
+		if (!condition) {
+			printf("%s\n", text);
+			isValid = false;
+		}
+	}
+
+	void CheckWraparound()
+	{
+		UploadRing ring(1024);
+		Check(ring.Allocate(400) == 0, "wraparound: first allocation is not at 0");
+		ring.Submit(1);
+		Check(ring.Allocate(400) == 400, "wraparound: second allocation is not at 400");
+		ring.Submit(2);
+		ring.Retire(1);
+		// 224 bytes are left at the end, 400 at the start
+		Check(ring.Allocate(300) == 0, "wraparound: allocation didn't wrap to 0");
+		Check(ring.GetUsedSize() == 400 + 224 + 300, "wraparound: skipped end is not counted");
+		Check(ring.Allocate(200) == UploadRing::InvalidOffset, "wraparound: allocation overlaps the live batch");
+		Check(ring.Allocate(100) == 300, "wraparound: allocation after the wrap is not at 300");
+		ring.Submit(3);
+		ring.Retire(2);
+		Check(ring.GetUsedSize() == 224 + 300 + 100, "wraparound: retired batch is still counted");
+		ring.Retire(3);
+		Check(ring.IsEmpty(), "wraparound: ring is not empty after the last batch");
+		Check(ring.Allocate(1024) == 0, "wraparound: empty ring doesn't start at 0");
+	}
+
+	void CheckAlignment()
+	{
+		UploadRing ring(1024);
+		Check(ring.Allocate(10) == 0, "alignment: first allocation is not at 0");
+		Check(ring.Allocate(16, 256) == 256, "alignment: allocation is not aligned");
+		Check(ring.GetUsedSize() == 256 + 16 && ring.GetPendingSize() == 256 + 16, "alignment: padding is not counted");
+		Check(ring.Allocate(1, 512) == 512, "alignment: allocation is not aligned");
+		ring.Submit(1);
+		Check(ring.GetPendingSize() == 0, "alignment: submitted bytes are pending");
+		ring.Retire(1);
+		Check(ring.IsEmpty(), "alignment: padding is not given back");
+	}
+
+	void CheckFull()
+	{
+		UploadRing ring(1024);
+		Check(ring.Allocate(1025) == UploadRing::InvalidOffset, "full: allocation larger than the ring");
+		Check(ring.Allocate(1024) == 0, "full: allocation of the whole ring");
+		Check(ring.Allocate(1) == UploadRing::InvalidOffset, "full: allocation from a full ring");
+		ring.Submit(1);
+		Check(ring.GetOldestFenceValue() == 1, "full: oldest fence value is not the batch");
+		Check(ring.Allocate(1) == UploadRing::InvalidOffset, "full: allocation before the batch retired");
+		ring.Retire(1);
+		Check(ring.GetOldestFenceValue() == 0 && ring.Allocate(1) == 0, "full: ring is not free after the batch retired");
+	}
+
+	void CheckRetireOrder()
+	{
+		UploadRing ring(1024);
+		for (uint i = 1; i <= 4; ++i) {
+			ring.Allocate(100);
+			ring.Submit(i * 10);
+		}
+		// nothing to submit, no batch is added
+		ring.Submit(50);
+		ring.Retire(5);
+		Check(ring.GetUsedSize() == 400, "retire: a batch retired before its fence value");
+		ring.Retire(30);
+		Check(ring.GetUsedSize() == 100 && ring.GetOldestFenceValue() == 40, "retire: batches up to the value are not all retired");
+		// a stale completed value
+		ring.Retire(20);
+		Check(ring.GetUsedSize() == 100, "retire: stale value changed the ring");
+		Check(ring.Allocate(600) == 400 && ring.Allocate(300) == 0, "retire: memory of the retired batches is not reused");
+		ring.Submit(60);
+		ring.Retire(1000);
+		Check(ring.IsEmpty(), "retire: ring is not empty after all batches");
+	}
+
+	struct Allocation {
+		uint64 offset;
+		uint64 size;
+		uint64 fenceValue;
+	};
+
+	bool Overlaps(const Allocation& a, uint64 offset, uint64 size)
+	{
+		return offset < a.offset + a.size && a.offset < offset + size;
+	}
+
+	// submissions of 1-8 allocations complete 0-4 submissions later
+	void CheckRandom(uint numAllocations)
+	{
+		const uint64 ringSize = 64 * 1024;
+		UploadRing ring(ringSize);
+		std::mt19937 random(1);
+		std::deque<Allocation> live;
+		uint64 fenceValue = 0;
+		uint64 completedFenceValue = 0;
+		uint numFailures = 0;
+		uint numInBatch = 0;
+		for (uint i = 0; i < numAllocations && isValid; ++i) {
+			const uint64 size = 1 + random() % (ringSize / 4);
+			const uint64 alignment = 1ull << (random() % 9);
+			uint64 offset = ring.Allocate(size, alignment);
+			while (offset == UploadRing::InvalidOffset) {
+				// as StagingUploader: submit the pending allocations, wait for the oldest batch
+				++numFailures;
+				if (ring.GetPendingSize()) {
+					ring.Submit(++fenceValue);
+					numInBatch = 0;
+				}
+				if (ring.IsEmpty() || !ring.GetOldestFenceValue()) {
+					Check(false, "random: empty ring can't allocate");
+					return;
+				}
+				completedFenceValue = ring.GetOldestFenceValue();
+				ring.Retire(completedFenceValue);
+				while (!live.empty() && live.front().fenceValue <= completedFenceValue) {
+					live.pop_front();
+				}
+				offset = ring.Allocate(size, alignment);
+			}
+			Check(offset % alignment == 0 && offset + size <= ringSize, "random: allocation is out of the ring or not aligned");
+			for (const Allocation& a : live) {
+				if (Overlaps(a, offset, size)) {
+					Check(false, "random: allocation overlaps a live one");
+					break;
+				}
+			}
+			// fence value of the next submission
+			const Allocation allocation = { offset, size, fenceValue + 1 };
+			live.push_back(allocation);
+			if (++numInBatch == 1 + random() % 8) {
+				ring.Submit(++fenceValue);
+				numInBatch = 0;
+			}
+			const uint64 lag = random() % 5;
+			if (fenceValue > completedFenceValue + lag) {
+				completedFenceValue = fenceValue - lag;
+				ring.Retire(completedFenceValue);
+				while (!live.empty() && live.front().fenceValue <= completedFenceValue) {
+					live.pop_front();
+				}
+			}
+		}
+		ring.Submit(++fenceValue);
+		ring.Retire(fenceValue);
+		Check(ring.IsEmpty(), "random: ring is not empty after all batches");
+		printf("random               %8u allocations, %u waits for the GPU\n", numAllocations, numFailures);
+	}
+
+	// StagingRingSize of LightIndexedDeferredRendering
+	const uint64 StagingRingSize = 4 * 1024 * 1024;
+
+	// StagingUploader with a copy queue which runs a submission only when it is waited for
+	class MockUploader  {
+	private:
+		struct Copy {
+			uint64 destOffset;
+			uint64 ringOffset;
+			uint64 size;
+		};
+		struct Submission {
+			std::vector<Copy> copies;
+			uint64 fenceValue;
+		};
+		UploadRing ring;
+		std::vector<ubyte> ringData;
+		std::vector<ubyte>* dest;
+		std::deque<Submission> submissions;
+		std::vector<Copy> recording;
+		uint64 fenceValue;
+		uint64 completedFenceValue;
+	public:
+		uint numWaits;
+
+		explicit MockUploader(uint64 ringSize) : ring(ringSize), ringData(static_cast<size_t>(ringSize)), dest(nullptr), fenceValue(0), completedFenceValue(0), numWaits(0)
+		{
+		}
+		void WaitForFenceValue(uint64 value)
+		{
+			++numWaits;
+			while (!submissions.empty() && submissions.front().fenceValue <= value) {
+				for (const Copy& copy : submissions.front().copies) {
+					memcpy(dest->data() + copy.destOffset, ringData.data() + copy.ringOffset, static_cast<size_t>(copy.size));
+				}
+				completedFenceValue = submissions.front().fenceValue;
+				submissions.pop_front();
+			}
+		}
+		uint64 AllocateStaging(size_t size, size_t alignment)
+		{
+			if (size > ring.GetSize()) {
+				return UploadRing::InvalidOffset;
+			}
+			ring.Retire(completedFenceValue);
+			uint64 offset = ring.Allocate(size, alignment);
+			while (offset == UploadRing::InvalidOffset) {
+				if (ring.GetPendingSize()) {
+					Flush();
+				}
+				WaitForFenceValue(ring.GetOldestFenceValue());
+				ring.Retire(completedFenceValue);
+				offset = ring.Allocate(size, alignment);
+			}
+			return offset;
+		}
+		bool UploadBuffer(std::vector<ubyte>& destBuffer, uint64 destOffset, const void* data, size_t size)
+		{
+			dest = &destBuffer;
+			const ubyte* source = static_cast<const ubyte *>(data);
+			const size_t chunkSize = static_cast<size_t>(ring.GetChunkSize());
+			for (size_t copied = 0; copied < size; copied += chunkSize) {
+				const size_t chunk = size - copied < chunkSize ? size - copied : chunkSize;
+				const uint64 offset = AllocateStaging(chunk, 16);
+				if (offset == UploadRing::InvalidOffset) {
+					return false;
+				}
+				memcpy(ringData.data() + offset, source + copied, chunk);
+				const Copy copy = { destOffset + copied, offset, chunk };
+				recording.push_back(copy);
+			}
+			return true;
+		}
+		void Flush()
+		{
+			if (recording.empty()) {
+				return;
+			}
+			Submission submission;
+			submission.copies.swap(recording);
+			submission.fenceValue = ++fenceValue;
+			submissions.push_back(submission);
+			ring.Submit(fenceValue);
+		}
+		void WaitForIdle()
+		{
+			Flush();
+			WaitForFenceValue(fenceValue);
+			ring.Retire(completedFenceValue);
+		}
+		bool IsEmpty() const
+		{
+			return ring.IsEmpty() && submissions.empty();
+		}
+	};
+
+	// uploads of the sizes one after the other into one destination, as the sections of a mesh file
+	bool CheckUpload(const char* name, const std::vector<ubyte>& data, const std::vector<size_t>& sizes)
+	{
+		MockUploader uploader(StagingRingSize);
+		std::vector<ubyte> dest(data.size(), 0);
+		size_t offset = 0;
+		for (size_t size : sizes) {
+			if (!uploader.UploadBuffer(dest, offset, data.data() + offset, size)) {
+				printf("%s: upload of %llu bytes failed\n", name, static_cast<unsigned long long>(size));
+				return false;
+			}
+			offset += size;
+			// a submission per section, so several are in flight when the ring fills
+			uploader.Flush();
+		}
+		uploader.WaitForIdle();
+		const bool isEqual = dest == data;
+		printf("%-20s %8.1f MB through a %llu MB ring, %u waits for the GPU%s\n", name, data.size() / (1024.0 * 1024.0),
+			static_cast<unsigned long long>(StagingRingSize >> 20), uploader.numWaits, isEqual ? "" : ", destination differs");
+		return isEqual && uploader.IsEmpty();
+	}
+
+	void CheckLargeUploads()
+	{
+		std::mt19937 random(2);
+		// a section of a quarter of the ring, one of 1.5 rings as the indices of the
+		// 1000x1000 grid, one of several rings which is not a multiple of the pieces
+		const size_t ringSize = static_cast<size_t>(StagingRingSize);
+		std::vector<size_t> sizes = { 100, ringSize / 4, ringSize + ringSize / 2, ringSize / 3, 6 * ringSize + 12345, 7 };
+		size_t size = 0;
+		for (size_t s : sizes) {
+			size += s;
+		}
+		std::vector<ubyte> data(size);
+		for (ubyte& b : data) {
+			b = static_cast<ubyte>(random());
+		}
+		Check(CheckUpload("large uploads", data, sizes), "large uploads: destination differs from the source");
+	}
+
+	void CheckFileUpload(const char* fileName)
+	{
+		FILE* f = fopen(fileName, "rb");
+		if (!f) {
+			printf("can't read %s\n", fileName);
+			isValid = false;
+			return;
+		}
+		std::vector<ubyte> data;
+		ubyte buffer[65536];
+		size_t size;
+		while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+			data.insert(data.end(), buffer, buffer + size);
+		}
+		fclose(f);
+		const std::vector<size_t> sizes(1, data.size());
+		Check(CheckUpload(fileName, data, sizes), "file upload: destination differs from the file");
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numAllocations = 1000000;
+	const char* fileName = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		const bool hasValue = i + 1 < argc;
+		if (!strcmp(argv[i], "--allocations") && hasValue) {
+			numAllocations = static_cast<uint>(atoi(argv[++i]));
+		} else if (!strcmp(argv[i], "--file") && hasValue) {
+			fileName = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [--allocations n] [--file name]\n", argv[0]);
+			return 2;
+		}
+	}
+	CheckWraparound();
+	CheckAlignment();
+	CheckFull();
+	CheckRetireOrder();
+	CheckRandom(numAllocations);
+	CheckLargeUploads();
+	if (fileName) {
+		CheckFileUpload(fileName);
+	}
+	printf("%s\n", isValid ? "passed" : "failed");
+	return isValid ? 0 : 1;
+}
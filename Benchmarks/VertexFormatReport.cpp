@@ -0,0 +1,171 @@
+// VertexFormatReport.cpp: round trip errors of the quantized vertex formats.
+//
+//////////////////////////////////////////////////////////////////////
+
+// Standalone executable, it doesn't depend on Direct3D. On Linux:
+//	g++ -std=c++14 -O2 VertexFormatReport.cpp ../MeshGenerator.cpp ../VertexFormat.cpp -o VertexFormatReport
+// Encodes and decodes the scene meshes and random vertices in every quantization as
+// the vertex shader does, prints the stride and the largest position, normal and
+// texture coordinate errors.
+//
+// Usage: VertexFormatReport [--vertices n]
+//	--vertices n	random vertices of every format, 100000 by default
+// Exit code is 1 if an error is above the bound of its format.
+
+#include "../MeshGenerator.h"
+#include "../VertexFormat.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+	struct Errors {
+		// largest distance relative to the half size of the bounds
+		float position;
+		// largest angle in degrees
+		float normal;
+		// largest absolute difference relative to the magnitude
+		float texCoord;
+	};
+
+	// bounds of every quantization, a step of the format with a margin
+	const Errors MaxErrors[VertexFormat::NumQuantizations] = {
+		{ 0.0f, 0.01f, 0.0f },
+		{ 1.0f / 32767.0f, 0.01f, 1.0f / 2048.0f }
+	};
+
+	struct Random {
+		uint seed;
+
+		explicit Random(uint s) : seed(s)
+		{
+		}
+		// [-1, 1]
+		float Next()
+		{
+			seed = seed * 1664525u + 1013904223u;
+			return (seed >> 8) * (2.0f / 16777215.0f) - 1.0f;
+		}
+	};
+
+	void CreateRandomMesh(Mesh& mesh, uint numVertices)
+	{
+		Random random(12345);
+		mesh.stride = sizeof(Vertex);
+		mesh.vertices.resize(static_cast<size_t>(numVertices) * mesh.stride);
+		for (uint v = 0; v < numVertices; ++v) {
+			Vertex& vertex = *reinterpret_cast<Vertex *>(&mesh.vertices[static_cast<size_t>(v) * mesh.stride]);
+			vertex.position = Vector3D(random.Next(), random.Next(), random.Next()) * 1000.0f;
+			do {
+				vertex.normal = Vector3D(random.Next(), random.Next(), random.Next());
+			} while (vertex.normal.Length() < 0.01f);
+			vertex.normal /= vertex.normal.Length();
+			vertex.tvert = Vector2D(random.Next(), random.Next()) * 4.0f;
+		}
+	}
+
+	// every vertex of the mesh starts with its position, Vertex meshes have the other attributes
+	Errors Measure(const Mesh& mesh, VertexFormat::Quantization quantization, uint& stride)
+	{
+		const bool hasVertex = mesh.stride == sizeof(Vertex);
+		VertexFormat format = VertexFormat::Create(hasVertex ? VertexFormat::TexCoord : VertexFormat::Position, quantization);
+		format.SetBounds(mesh);
+		Mesh encoded = mesh;
+		format.Encode(encoded);
+		stride = encoded.stride;
+
+		Vector3D minimum;
+		Vector3D maximum;
+		mesh.GetBounds(minimum, maximum);
+		const Vector3D halfSize = (maximum - minimum) * 0.5f;
+		const float scale = std::max(halfSize.x, std::max(halfSize.y, halfSize.z));
+
+		Errors errors = { 0.0f, 0.0f, 0.0f };
+		for (uint v = 0; v < mesh.GetNumVertices(); ++v) {
+			Vector3D position;
+			Vector3D normal;
+			Vector2D texCoord;
+			format.Decode(&encoded.vertices[static_cast<size_t>(v) * encoded.stride], &position, &normal, &texCoord);
+			const Vector3D& source = mesh.GetPosition(v);
+			// per axis as the quantization
+			const Vector3D difference = position - source;
+			const float error = std::max(fabsf(difference.x), std::max(fabsf(difference.y), fabsf(difference.z)));
+			errors.position = std::max(errors.position, scale > 0.0f ? error / scale : error);
+			if (!hasVertex) {
+				continue;
+			}
+			const Vertex& vertex = *reinterpret_cast<const Vertex *>(&mesh.vertices[static_cast<size_t>(v) * mesh.stride]);
+			const Vector3D sourceNormal = vertex.normal / vertex.normal.Length();
+			// acos loses precision close to 1, the angle of the cross product doesn't
+			const float angle = atan2f(crossProduct(normal, sourceNormal).Length(), dotProduct(normal, sourceNormal));
+			errors.normal = std::max(errors.normal, angle * 180.0f / Pi);
+			for (uint i = 0; i < 2; ++i) {
+				const float magnitude = std::max(fabsf(vertex.tvert[i]), 1.0f);
+				errors.texCoord = std::max(errors.texCoord, fabsf(texCoord[i] - vertex.tvert[i]) / magnitude);
+			}
+		}
+		return errors;
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	uint numRandomVertices = 100000;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--vertices") && i + 1 < argc) {
+			numRandomVertices = static_cast<uint>(atoi(argv[++i]));
+		} else {
+			fprintf(stderr, "Usage: %s [--vertices n]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!numRandomVertices) {
+		fprintf(stderr, "Number of vertices must be above 0\n");
+		return 2;
+	}
+
+	struct NamedMesh {
+		std::string name;
+		Mesh mesh;
+	};
+	std::vector<NamedMesh> meshes(3);
+	meshes[0].name = "plane 500x500 step 20";
+	MeshGenerator::CreatePlane(meshes[0].mesh, 500, 500, 20, 20);
+	meshes[1].name = "light sphere LOD 0";
+	MeshGenerator::CreateSphere(meshes[1].mesh, 250, 20, 1.0f);
+	meshes[2].name = "random vertices";
+	CreateRandomMesh(meshes[2].mesh, numRandomVertices);
+
+	bool passed = true;
+	for (const NamedMesh& namedMesh : meshes) {
+		printf("\n%s, %u vertices\n", namedMesh.name.c_str(), namedMesh.mesh.GetNumVertices());
+		printf("  %-12s %6s %12s %12s %12s\n", "Format", "Stride", "Position", "Normal deg", "TexCoord");
+		for (uint q = 0; q < VertexFormat::NumQuantizations; ++q) {
+			const VertexFormat::Quantization quantization = static_cast<VertexFormat::Quantization>(q);
+			uint stride = 0;
+			const Errors errors = Measure(namedMesh.mesh, quantization, stride);
+			const Errors& maxErrors = MaxErrors[q];
+			const bool valid = errors.position <= maxErrors.position && errors.normal <= maxErrors.normal && errors.texCoord <= maxErrors.texCoord;
+			printf("  %-12s %6u %12.3g %12.3g %12.3g %s\n", VertexFormat::GetName(quantization), stride, errors.position, errors.normal, errors.texCoord, valid ? "" : "FAILED");
+			passed &= valid;
+		}
+	}
+
+	// half floats of all finite values come back unchanged
+	uint halfErrors = 0;
+	for (uint h = 0; h < 0x10000; ++h) {
+		const ushort half = static_cast<ushort>(h);
+		if ((half & 0x7C00) != 0x7C00 && VertexFormat::FloatToHalf(VertexFormat::HalfToFloat(half)) != half) {
+			++halfErrors;
+		}
+	}
+	printf("\nhalf float round trip: %u errors\n", halfErrors);
+	passed &= !halfErrors;
+	return passed ? 0 : 1;
+}
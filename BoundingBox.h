@@ -37,7 +37,7 @@ public:
 		//	|   / |  7
 		//	| /   | /
 		//	0---- 3
-		const uint16_t Indices[] = {
+		static constexpr uint16_t Indices[] = {
 			0, 1, 2, 2, 3, 0,	// front
 			4, 5, 1, 1, 0, 4,	// left
 			7, 6, 5, 5, 4, 7,	// back
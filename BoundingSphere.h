@@ -59,6 +59,7 @@ public:
 	INLINE BoundingSphere(const Vector3D& Center, float Radius) : center(Center), radius(Radius) {}
 	INLINE BoundingSphere(const BoundingSphere& boundingsphere)
 		: center(boundingsphere.center), radius(boundingsphere.radius) {}
+	INLINE BoundingSphere& operator = (const BoundingSphere& boundingsphere) = default;
 	BoundingSphere()
 	{
 	}
@@ -0,0 +1,160 @@
+// CPUFeatures.cpp: implementation of the CPUFeatures class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "CPUFeatures.h"
+#include <cassert>
+
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+#ifdef CPU_X86
+	// eax, ebx, ecx, edx of the leaf
+	void CpuId(uint leaf, uint subLeaf, uint* regs)
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuidex(info, static_cast<int>(leaf), static_cast<int>(subLeaf));
+		for (uint i = 0; i < 4; ++i) {
+			regs[i] = static_cast<uint>(info[i]);
+		}
+#else
+		__cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+	// XCR0, register states saved by the OS
+	uint64 GetXCR0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		uint eax;
+		uint edx;
+		__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<uint64>(edx) << 32) | eax;
+#endif
+	}
+#endif
+
+	bool IsBitSet(uint value, uint bit)
+	{
+		return ((value >> bit) & 1) != 0;
+	}
+
+}
+
+CPUFeatures::CPUFeatures() :
+	sse2(false),
+	sse41(false),
+	avx(false),
+	avx2(false),
+	fma(false),
+	avx512f(false),
+	maxLevel(ScalarLevel),
+	level(ScalarLevel)
+{
+#ifdef CPU_X86
+	uint regs[4];
+	CpuId(0, 0, regs);
+	const uint maxLeaf = regs[0];
+	CpuId(1, 0, regs);
+	sse2 = IsBitSet(regs[3], 26);
+	sse41 = IsBitSet(regs[2], 19);
+	fma = IsBitSet(regs[2], 12);
+	const bool osxsave = IsBitSet(regs[2], 27);
+	// XMM and YMM states
+	const bool osAVX = osxsave && (GetXCR0() & 0x6) == 0x6;
+	// opmask and ZMM states in addition
+	const bool osAVX512 = osxsave && (GetXCR0() & 0xe6) == 0xe6;
+	avx = osAVX && IsBitSet(regs[2], 28);
+	fma = fma && avx;
+	if (maxLeaf >= 7) {
+		CpuId(7, 0, regs);
+		avx2 = avx && IsBitSet(regs[1], 5);
+		avx512f = osAVX512 && IsBitSet(regs[1], 16);
+	}
+	if (sse2) {
+		maxLevel = SSELevel;
+	}
+	if (avx2) {
+		maxLevel = AVX2Level;
+	}
+	if (avx512f) {
+		maxLevel = AVX512Level;
+	}
+#endif
+	level = maxLevel;
+}
+
+CPUFeatures& CPUFeatures::GetInstance()
+{
+	static CPUFeatures features;
+	return features;
+}
+
+bool CPUFeatures::HasSSE2()
+{
+	return GetInstance().sse2;
+}
+
+bool CPUFeatures::HasSSE41()
+{
+	return GetInstance().sse41;
+}
+
+bool CPUFeatures::HasAVX()
+{
+	return GetInstance().avx;
+}
+
+bool CPUFeatures::HasAVX2()
+{
+	return GetInstance().avx2;
+}
+
+bool CPUFeatures::HasFMA()
+{
+	return GetInstance().fma;
+}
+
+bool CPUFeatures::HasAVX512F()
+{
+	return GetInstance().avx512f;
+}
+
+CPUFeatures::SIMDLevel CPUFeatures::GetSIMDLevel()
+{
+	return GetInstance().level;
+}
+
+CPUFeatures::SIMDLevel CPUFeatures::GetMaxSIMDLevel()
+{
+	return GetInstance().maxLevel;
+}
+
+CPUFeatures::SIMDLevel CPUFeatures::SetSIMDLevel(SIMDLevel level)
+{
+	assert(level < NumSIMDLevels && "Out Of Range");
+	CPUFeatures& features = GetInstance();
+	features.level = level < features.maxLevel ? level : features.maxLevel;
+	return features.level;
+}
+
+const char* CPUFeatures::GetName(SIMDLevel level)
+{
+	static const char* names[NumSIMDLevels] = {
+		"Scalar",
+		"SSE2",
+		"AVX2",
+		"AVX-512"
+	};
+	assert(level < NumSIMDLevels && "Out Of Range");
+	return names[level];
+}
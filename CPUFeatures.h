@@ -0,0 +1,74 @@
+// CPUFeatures.h: interface for the CPUFeatures class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __CPUFEATURES_H__
+#define __CPUFEATURES_H__
+
+#include "types.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86
+#endif
+
+// Kernels of a level are compiled for its instruction set. MSVC compiles AVX intrinsics
+// without /arch, GCC and Clang need the target per function.
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+// Instruction sets of the CPU, detected once with cpuid. A set counts only if
+// the OS saves its registers too (xgetbv), AVX-512 is off on Windows 7 without SP1
+// or in VMs which don't expose it.
+class CPUFeatures  {
+public:
+	// SIMD levels of the batch kernels in ascending order
+	enum SIMDLevel {
+		ScalarLevel,
+		// SSE2, base line of x64
+		SSELevel,
+		AVX2Level,
+		// AVX-512 Foundation
+		AVX512Level,
+		NumSIMDLevels
+	};
+private:
+	bool sse2;
+	bool sse41;
+	bool avx;
+	bool avx2;
+	bool fma;
+	bool avx512f;
+	// highest level the CPU and OS support
+	SIMDLevel maxLevel;
+	// level used by the kernels
+	SIMDLevel level;
+
+	CPUFeatures();
+	static CPUFeatures& GetInstance();
+public:
+	static bool HasSSE2();
+	static bool HasSSE41();
+	static bool HasAVX();
+	static bool HasAVX2();
+	static bool HasFMA();
+	static bool HasAVX512F();
+	// Level picked by the kernels, the highest supported one unless limited
+	static SIMDLevel GetSIMDLevel();
+	// Highest level the CPU supports
+	static SIMDLevel GetMaxSIMDLevel();
+	// Limit the level to compare kernels, clamped to GetMaxSIMDLevel(). Returns the level set
+	static SIMDLevel SetSIMDLevel(SIMDLevel level);
+	//
+	static const char* GetName(SIMDLevel level);
+};
+
+#endif // __CPUFEATURES_H__
@@ -0,0 +1,111 @@
+// CullingBenchmark.cpp: implementation of the CullingBenchmark class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "CullingBenchmark.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+CullingBenchmark::CullingBenchmark() :
+	framesPerRun(0),
+	numRuns(0),
+	warmupFrames(0),
+	run(0),
+	frame(0),
+	isRunning(false)
+{
+}
+
+void CullingBenchmark::Start(uint numModes, uint runFrames, uint runs, uint warmup)
+{
+	assert(numModes && "Invalid Value");
+	assert(runFrames && "Invalid Value");
+	assert(runs && "Invalid Value");
+	samples.clear();
+	samples.resize(numModes);
+	for (Samples& s : samples) {
+		s.cpu.reserve(runFrames * runs);
+		s.gpu.reserve(runFrames * runs);
+	}
+	framesPerRun = runFrames;
+	numRuns = runs;
+	warmupFrames = warmup;
+	run = 0;
+	frame = 0;
+	isRunning = true;
+}
+
+void CullingBenchmark::Stop()
+{
+	isRunning = false;
+}
+
+bool CullingBenchmark::AddFrame(double cpuTime, double gpuTime)
+{
+	if (!isRunning) {
+		return false;
+	}
+	if (frame >= warmupFrames) {
+		Samples& s = samples[GetMode()];
+		s.cpu.push_back(cpuTime);
+		s.gpu.push_back(gpuTime);
+	}
+	if (++frame < warmupFrames + framesPerRun) {
+		return true;
+	}
+	frame = 0;
+	if (++run < numRuns * GetNumModes()) {
+		return true;
+	}
+	isRunning = false;
+	return false;
+}
+
+double CullingBenchmark::GetPercentile(std::vector<double>& values, double percentile)
+{
+	if (values.empty()) {
+		return 0.0;
+	}
+	const size_t n = static_cast<size_t>(percentile * (values.size() - 1) + 0.5);
+	std::nth_element(values.begin(), values.begin() + n, values.end());
+	return values[n];
+}
+
+CullingBenchmark::Stats CullingBenchmark::GetStats(uint mode) const
+{
+	assert(mode < samples.size() && "Out Of Range");
+	const Samples& s = samples[mode];
+	Stats stats = {};
+	stats.numFrames = static_cast<uint>(s.cpu.size());
+	if (!stats.numFrames) {
+		return stats;
+	}
+	std::vector<double> cpu = s.cpu;
+	std::vector<double> gpu = s.gpu;
+	for (size_t i = 0; i < cpu.size(); ++i) {
+		stats.cpuMean += cpu[i];
+		stats.gpuMean += gpu[i];
+	}
+	stats.cpuMean /= stats.numFrames;
+	stats.gpuMean /= stats.numFrames;
+	stats.cpuMedian = GetPercentile(cpu, 0.5);
+	stats.cpuP95 = GetPercentile(cpu, 0.95);
+	stats.gpuMedian = GetPercentile(gpu, 0.5);
+	stats.gpuP95 = GetPercentile(gpu, 0.95);
+	return stats;
+}
+
+std::string CullingBenchmark::GetReport(const char* const* modeNames) const
+{
+	assert(modeNames && "NULL Pointer");
+	std::string report = "Strategy        Frames  CPU mean  CPU med  CPU p95  GPU mean  GPU med  GPU p95 (ms)\n";
+	for (uint i = 0; i < GetNumModes(); ++i) {
+		const Stats stats = GetStats(i);
+		char line[256];
+		snprintf(line, sizeof(line), "%-15s %6u %9.3f %8.3f %8.3f %9.3f %8.3f %8.3f\n", modeNames[i], stats.numFrames,
+			stats.cpuMean, stats.cpuMedian, stats.cpuP95, stats.gpuMean, stats.gpuMedian, stats.gpuP95);
+		report += line;
+	}
+	return report;
+}
@@ -0,0 +1,89 @@
+// CullingBenchmark.h: interface for the CullingBenchmark class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __CULLINGBENCHMARK_H__
+#define __CULLINGBENCHMARK_H__
+
+#include <string>
+#include <vector>
+#include "types.h"
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+// A/B benchmark of rendering strategies. Strategies take turns (A B A B ...),
+// every run plays the same fixed camera path, the first frames of a run are
+// not measured to let the switch settle. Frame times are kept per strategy.
+class CullingBenchmark  {
+public:
+	struct Stats {
+		uint numFrames;
+		// milliseconds
+		double cpuMean;
+		double cpuMedian;
+		double cpuP95;
+		double gpuMean;
+		double gpuMedian;
+		double gpuP95;
+	};
+private:
+	struct Samples {
+		std::vector<double> cpu;
+		std::vector<double> gpu;
+	};
+	std::vector<Samples> samples;
+	// frames of a run, warmup frames excluded
+	uint framesPerRun;
+	// runs of every strategy
+	uint numRuns;
+	uint warmupFrames;
+	// current run over all strategies
+	uint run;
+	// frame in the current run, warmup frames included
+	uint frame;
+	bool isRunning;
+
+	static double GetPercentile(std::vector<double>& values, double percentile);
+public:
+	CullingBenchmark();
+	void Start(uint numModes, uint runFrames, uint runs, uint warmup);
+	void Stop();
+	// Record the frame of GetMode() and advance, false when the benchmark is over
+	bool AddFrame(double cpuTime, double gpuTime);
+	Stats GetStats(uint mode) const;
+	// Table of all strategies, modeNames has one name per strategy
+	std::string GetReport(const char* const* modeNames) const;
+	//
+	INLINE bool IsRunning() const
+	{
+		return isRunning;
+	}
+	// Strategy to render the current frame with
+	INLINE uint GetMode() const
+	{
+		return samples.empty() ? 0 : run % static_cast<uint>(samples.size());
+	}
+	// Frame in the current run, warmup frames included
+	INLINE uint GetRunFrame() const
+	{
+		return frame;
+	}
+	// Position on the camera path in [0, 1), 0 during warmup
+	INLINE float GetPathTime() const
+	{
+		return frame < warmupFrames ? 0.0f : static_cast<float>(frame - warmupFrames) / framesPerRun;
+	}
+	//
+	INLINE uint GetNumModes() const
+	{
+		return static_cast<uint>(samples.size());
+	}
+};
+
+#endif // __CULLINGBENCHMARK_H__
@@ -0,0 +1,63 @@
+// D3D12TimestampSource.cpp: implementation of the D3D12TimestampSource class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "DXSampleHelper.h"
+#include "D3D12TimestampSource.h"
+
+void D3D12TimestampSource::Init(ID3D12Device* pDevice, uint numFramesInFlight, uint numSlotQueries)
+{
+	assert(pDevice && "NULL Pointer");
+	assert(numFramesInFlight && numSlotQueries && "Invalid Value");
+	numQueries = numSlotQueries;
+
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = numQueries;
+	queryHeaps.resize(numFramesInFlight);
+	for (Microsoft::WRL::ComPtr<ID3D12QueryHeap>& queryHeap : queryHeaps) {
+		ThrowIfFailed(pDevice->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&queryHeap)));
+	}
+
+	ThrowIfFailed(pDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(numFramesInFlight * numQueries * sizeof(UINT64)),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&readbackBuffer)));
+	readbackBuffer->SetName(L"TimestampReadback");
+}
+
+void D3D12TimestampSource::WriteTimestamp(void* commandList, uint slot, uint query)
+{
+	assert(commandList && "NULL Pointer");
+	assert(slot < queryHeaps.size() && query < numQueries && "Out Of Range");
+	static_cast<ID3D12GraphicsCommandList *>(commandList)->EndQuery(queryHeaps[slot].Get(), D3D12_QUERY_TYPE_TIMESTAMP, query);
+}
+
+void D3D12TimestampSource::Resolve(void* commandList, uint slot, uint firstQuery, uint numResolved)
+{
+	assert(commandList && "NULL Pointer");
+	assert(slot < queryHeaps.size() && firstQuery + numResolved <= numQueries && "Out Of Range");
+	static_cast<ID3D12GraphicsCommandList *>(commandList)->ResolveQueryData(queryHeaps[slot].Get(), D3D12_QUERY_TYPE_TIMESTAMP, firstQuery, numResolved,
+		readbackBuffer.Get(), (slot * numQueries + firstQuery) * sizeof(UINT64));
+}
+
+bool D3D12TimestampSource::Read(uint slot, uint firstQuery, uint numRead, uint64* timestamps)
+{
+	assert(timestamps && "NULL Pointer");
+	assert(slot < queryHeaps.size() && firstQuery + numRead <= numQueries && "Out Of Range");
+	const size_t offset = (slot * numQueries + firstQuery) * sizeof(UINT64);
+	const size_t size = numRead * sizeof(UINT64);
+	CD3DX12_RANGE readRange(offset, offset + size);
+	void* data = nullptr;
+	if (FAILED(readbackBuffer->Map(0, &readRange, &data))) {
+		return false;
+	}
+	memcpy(timestamps, static_cast<const ubyte *>(data) + offset, size);
+	CD3DX12_RANGE writeRange(0, 0);
+	readbackBuffer->Unmap(0, &writeRange);
+	return true;
+}
@@ -0,0 +1,25 @@
+// D3D12TimestampSource.h: interface for the D3D12TimestampSource class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __D3D12TIMESTAMPSOURCE_H__
+#define __D3D12TIMESTAMPSOURCE_H__
+
+#include "GPUTimer.h"
+
+// Timestamp queries of GPUTimer on Direct3D 12: a query heap per frame in flight and
+// a readback buffer with a slot per frame in flight. Command lists are ID3D12GraphicsCommandList
+class D3D12TimestampSource : public GPUTimer::QuerySource  {
+private:
+	std::vector<Microsoft::WRL::ComPtr<ID3D12QueryHeap> > queryHeaps;
+	Microsoft::WRL::ComPtr<ID3D12Resource> readbackBuffer;
+	uint numQueries = 0;
+public:
+	D3D12TimestampSource() {}
+	void Init(ID3D12Device* pDevice, uint numFramesInFlight, uint numSlotQueries);
+	void WriteTimestamp(void* commandList, uint slot, uint query) override;
+	void Resolve(void* commandList, uint slot, uint firstQuery, uint numResolved) override;
+	bool Read(uint slot, uint firstQuery, uint numRead, uint64* timestamps) override;
+};
+
+#endif // __D3D12TIMESTAMPSOURCE_H__
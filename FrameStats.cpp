@@ -0,0 +1,216 @@
+// FrameStats.cpp: implementation of the FrameStats class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "FrameStats.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+	// weight of a frame in the average the stutters are found against
+	const double AverageWeight = 1.0 / 16.0;
+
+	uint64 ToMicroseconds(double time)
+	{
+		return static_cast<uint64>(std::max(time, 0.0) * 1000.0 + 0.5);
+	}
+
+	double ToMilliseconds(uint64 time)
+	{
+		return time * 0.001;
+	}
+
+	void WriteSummary(FILE* f, const char* name, const FrameStats::Summary& summary)
+	{
+		fprintf(f, "\"%s\":{\"frames\":%llu,\"mean\":%.3f,\"min\":%.3f,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f,\"max\":%.3f,\"stutters\":%llu}", name,
+			static_cast<unsigned long long>(summary.numFrames), summary.mean, summary.min, summary.p50, summary.p95, summary.p99, summary.max,
+			static_cast<unsigned long long>(summary.numStutters));
+	}
+
+}
+
+LatencyHistogram::LatencyHistogram() : counts(NumBuckets, 0), numValues(0), minValue(0), maxValue(0)
+{
+}
+
+uint LatencyHistogram::GetBucket(uint64 value)
+{
+	if (value < SubBuckets) {
+		return static_cast<uint>(value);
+	}
+	value = std::min(value, static_cast<uint64>((1ull << MaxValueBits) - 1));
+	// value >> shift is in [SubBuckets / 2, SubBuckets)
+	uint shift = 0;
+	while ((value >> shift) >= SubBuckets) {
+		++shift;
+	}
+	return SubBuckets + (shift - 1) * SubBuckets / 2 + static_cast<uint>(value >> shift) - SubBuckets / 2;
+}
+
+uint64 LatencyHistogram::GetBucketValue(uint bucket)
+{
+	if (bucket < SubBuckets) {
+		return bucket;
+	}
+	const uint shift = (bucket - SubBuckets) / (SubBuckets / 2) + 1;
+	const uint64 subBucket = (bucket - SubBuckets) % (SubBuckets / 2) + SubBuckets / 2;
+	return (subBucket << shift) + (1ull << (shift - 1));
+}
+
+void LatencyHistogram::Reset()
+{
+	std::fill(counts.begin(), counts.end(), 0);
+	numValues = 0;
+	minValue = 0;
+	maxValue = 0;
+}
+
+void LatencyHistogram::Add(uint64 value)
+{
+	++counts[GetBucket(value)];
+	minValue = numValues ? std::min(minValue, value) : value;
+	maxValue = std::max(maxValue, value);
+	++numValues;
+}
+
+uint64 LatencyHistogram::GetPercentile(double percentile) const
+{
+	assert(percentile >= 0.0 && percentile <= 1.0 && "Out Of Range");
+	if (!numValues) {
+		return 0;
+	}
+	// the smallest value with at least percentile of the values at or below it
+	const uint64 rank = std::max(static_cast<uint64>(ceil(percentile * numValues)), static_cast<uint64>(1));
+	uint64 count = 0;
+	for (uint i = 0; i < NumBuckets; ++i) {
+		count += counts[i];
+		if (count >= rank) {
+			return std::min(std::max(GetBucketValue(i), minValue), maxValue);
+		}
+	}
+	return maxValue;
+}
+
+const double FrameStats::StutterFactor = 2.0;
+
+FrameStats::FrameStats(uint ringCapacity) :
+	capacity(ringCapacity),
+	nextFrame(0),
+	numFrames(0)
+{
+	assert(capacity && "Invalid Value");
+	frames.reserve(capacity);
+	Reset();
+}
+
+void FrameStats::Reset()
+{
+	for (SeriesStats& s : series) {
+		s.histogram.Reset();
+		s.sum = 0.0;
+		s.average = 0.0;
+		s.numStutters = 0;
+	}
+	frames.clear();
+	nextFrame = 0;
+	numFrames = 0;
+}
+
+void FrameStats::AddFrame(double cpuTime, double gpuTime)
+{
+	const double times[NumSeries] = { cpuTime, gpuTime };
+	Frame frame;
+	frame.index = numFrames++;
+	for (uint i = 0; i < NumSeries; ++i) {
+		frame.time[i] = static_cast<float>(times[i]);
+		if (times[i] < 0.0) {
+			continue;
+		}
+		SeriesStats& s = series[i];
+		if (!s.histogram.GetNumValues()) {
+			s.average = times[i];
+		}
+		if (times[i] > StutterFactor * s.average) {
+			++s.numStutters;
+		}
+		s.average += (times[i] - s.average) * AverageWeight;
+		s.sum += times[i];
+		s.histogram.Add(ToMicroseconds(times[i]));
+	}
+	if (frames.size() < capacity) {
+		frames.push_back(frame);
+	} else {
+		frames[nextFrame] = frame;
+	}
+	nextFrame = (nextFrame + 1) % capacity;
+}
+
+FrameStats::Summary FrameStats::GetSummary(uint seriesIndex) const
+{
+	assert(seriesIndex < NumSeries && "Out Of Range");
+	const SeriesStats& s = series[seriesIndex];
+	Summary summary = {};
+	summary.numFrames = s.histogram.GetNumValues();
+	if (!summary.numFrames) {
+		return summary;
+	}
+	summary.mean = s.sum / summary.numFrames;
+	summary.min = ToMilliseconds(s.histogram.GetMin());
+	summary.p50 = ToMilliseconds(s.histogram.GetPercentile(0.5));
+	summary.p95 = ToMilliseconds(s.histogram.GetPercentile(0.95));
+	summary.p99 = ToMilliseconds(s.histogram.GetPercentile(0.99));
+	summary.max = ToMilliseconds(s.histogram.GetMax());
+	summary.numStutters = s.numStutters;
+	return summary;
+}
+
+bool FrameStats::WriteCSV(const char* fileName) const
+{
+	assert(fileName && "NULL Pointer");
+	FILE* f = fopen(fileName, "w");
+	if (!f) {
+		return false;
+	}
+	fprintf(f, "frame,cpu_ms,gpu_ms\n");
+	// oldest first
+	const uint first = frames.size() < capacity ? 0 : nextFrame;
+	for (uint i = 0; i < frames.size(); ++i) {
+		const Frame& frame = frames[(first + i) % frames.size()];
+		fprintf(f, "%llu,%.3f,", static_cast<unsigned long long>(frame.index), frame.time[CPUTime]);
+		if (frame.time[GPUTime] >= 0.0f) {
+			fprintf(f, "%.3f", frame.time[GPUTime]);
+		}
+		fputc('\n', f);
+	}
+	const bool res = !ferror(f);
+	return !fclose(f) && res;
+}
+
+bool FrameStats::WriteJSON(const char* fileName) const
+{
+	assert(fileName && "NULL Pointer");
+	FILE* f = fopen(fileName, "w");
+	if (!f) {
+		return false;
+	}
+	fprintf(f, "{\"frames\":%llu,\"stutterFactor\":%.1f,", static_cast<unsigned long long>(numFrames), StutterFactor);
+	WriteSummary(f, "cpu", GetSummary(CPUTime));
+	fputc(',', f);
+	WriteSummary(f, "gpu", GetSummary(GPUTime));
+	fprintf(f, "}\n");
+	const bool res = !ferror(f);
+	return !fclose(f) && res;
+}
+
+std::string FrameStats::GetOverlayText() const
+{
+	const Summary cpu = GetSummary(CPUTime);
+	const Summary gpu = GetSummary(GPUTime);
+	char text[256];
+	snprintf(text, sizeof(text), "CPU p50 %.2f p99 %.2f max %.2f ms, %llu stutters | GPU p50 %.2f p99 %.2f max %.2f ms, %llu stutters", cpu.p50, cpu.p99, cpu.max,
+		static_cast<unsigned long long>(cpu.numStutters), gpu.p50, gpu.p99, gpu.max, static_cast<unsigned long long>(gpu.numStutters));
+	return text;
+}
@@ -0,0 +1,128 @@
+// FrameStats.h: interface for the FrameStats class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __FRAMESTATS_H__
+#define __FRAMESTATS_H__
+
+#include <string>
+#include <vector>
+#include "types.h"
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+// Histogram of durations in microseconds with buckets of a fixed relative width (HDR
+// histogram): values below SubBuckets are exact, above them every power of 2 has
+// SubBuckets / 2 buckets, so a percentile is within 1 / SubBuckets of the real value.
+// Memory and the cost of a value don't depend on the number of values
+class LatencyHistogram  {
+public:
+	static const uint SubBucketBits = 7;
+	static const uint SubBuckets = 1 << SubBucketBits;
+	// values up to 2^MaxValueBits microseconds (12 days), longer ones are clamped
+	static const uint MaxValueBits = 40;
+	static const uint NumBuckets = SubBuckets + (MaxValueBits - SubBucketBits) * SubBuckets / 2;
+private:
+	std::vector<uint64> counts;
+	uint64 numValues;
+	uint64 minValue;
+	uint64 maxValue;
+
+	static uint GetBucket(uint64 value);
+	// middle of the values of a bucket
+	static uint64 GetBucketValue(uint bucket);
+public:
+	LatencyHistogram();
+	void Reset();
+	void Add(uint64 value);
+	// Value of percentile in [0, 1] within the relative error, min and max are exact
+	uint64 GetPercentile(double percentile) const;
+	//
+	INLINE uint64 GetNumValues() const
+	{
+		return numValues;
+	}
+	//
+	INLINE uint64 GetMin() const
+	{
+		return minValue;
+	}
+	//
+	INLINE uint64 GetMax() const
+	{
+		return maxValue;
+	}
+};
+
+// CPU and GPU frame times: percentiles and stutters of all frames from histograms,
+// the last frames in a ring for the CSV export
+class FrameStats  {
+public:
+	enum Series {
+		CPUTime,
+		GPUTime,
+		NumSeries
+	};
+	struct Summary {
+		uint64 numFrames;
+		// milliseconds
+		double mean;
+		double min;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+		// frames longer than StutterFactor times the average of the previous frames
+		uint64 numStutters;
+	};
+	static const uint DefaultCapacity = 4096;
+	static const double StutterFactor;
+private:
+	struct Frame {
+		uint64 index;
+		float time[NumSeries];
+	};
+	struct SeriesStats {
+		LatencyHistogram histogram;
+		double sum;
+		// exponential moving average of the frame times
+		double average;
+		uint64 numStutters;
+	};
+	SeriesStats series[NumSeries];
+	// the last frames, nextFrame is the oldest one when the ring is full
+	std::vector<Frame> frames;
+	uint capacity;
+	uint nextFrame;
+	uint64 numFrames;
+public:
+	explicit FrameStats(uint ringCapacity = DefaultCapacity);
+	void Reset();
+	// Frame times in milliseconds, a negative GPU time if it is unknown
+	void AddFrame(double cpuTime, double gpuTime);
+	Summary GetSummary(uint series) const;
+	// Frame, CPU and GPU time of the frames in the ring, oldest first
+	bool WriteCSV(const char* fileName) const;
+	// Summaries of both series
+	bool WriteJSON(const char* fileName) const;
+	// One line for the window title
+	std::string GetOverlayText() const;
+	//
+	INLINE uint64 GetNumFrames() const
+	{
+		return numFrames;
+	}
+	// Frames kept for WriteCSV
+	INLINE uint GetNumRingFrames() const
+	{
+		return static_cast<uint>(frames.size());
+	}
+};
+
+#endif // __FRAMESTATS_H__
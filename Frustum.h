@@ -7,8 +7,10 @@
 
 #include "Plane.h"
 #include "Matrix4x4.h"
+#include "SIMD.h"
 #include "types.h"
 #include <cstddef>
+#include <cfloat>
 
 // Visibility piramid
 class Frustum  {
@@ -21,11 +23,19 @@ public:
 		NEARPLANE,		// Near clipping plane
 		FARPLANE		// Far Clipping plane
 	};
+	static const uint NumPlanes = 6;
+	// SIMD tests read two vectors of planes, the padding planes (1, 0, 0, FLT_MAX) contain everything
+	static const uint NumPaddedPlanes = 8;
 private:
 	// 6 clippin g planes
-	Plane planes[6];
+	Plane planes[NumPlanes];
 	// 6 masks
-	int nearPointMasks[6];
+	int nearPointMasks[NumPlanes];
+	// planes as structure of arrays in PlaneType order
+	float planeX[NumPaddedPlanes];
+	float planeY[NumPaddedPlanes];
+	float planeZ[NumPaddedPlanes];
+	float planeD[NumPaddedPlanes];
 
 	INLINE float Sqr(float value) const
 	{
@@ -62,6 +72,46 @@ private:
 		isIntersect = true;
 		return Plane::IN_PLANE;
 	}
+	// Signed distances of the farthest and the nearest box corner to planes [first, first + 4).
+	// The corner term of MakeFarPoint is max(n * min, n * max) per axis, so the sums are
+	// the same as ClassifyPoint of the corner and no masks are needed
+	INLINE void BoxDistances(uint first, const Vector3D& minPoint, const Vector3D& maxPoint, SIMD::Float4& farDist, SIMD::Float4& nearDist) const
+	{
+		const SIMD::Float4 x = SIMD::Load(planeX + first);
+		const SIMD::Float4 y = SIMD::Load(planeY + first);
+		const SIMD::Float4 z = SIMD::Load(planeZ + first);
+		const SIMD::Float4 minX = SIMD::Mul(x, SIMD::Splat(minPoint.x));
+		const SIMD::Float4 maxX = SIMD::Mul(x, SIMD::Splat(maxPoint.x));
+		const SIMD::Float4 minY = SIMD::Mul(y, SIMD::Splat(minPoint.y));
+		const SIMD::Float4 maxY = SIMD::Mul(y, SIMD::Splat(maxPoint.y));
+		const SIMD::Float4 minZ = SIMD::Mul(z, SIMD::Splat(minPoint.z));
+		const SIMD::Float4 maxZ = SIMD::Mul(z, SIMD::Splat(maxPoint.z));
+		farDist = SIMD::Add(SIMD::Max(minX, maxX), SIMD::Max(minY, maxY));
+		farDist = SIMD::Add(SIMD::Add(farDist, SIMD::Max(minZ, maxZ)), SIMD::Load(planeD + first));
+		nearDist = SIMD::Add(SIMD::Min(minX, maxX), SIMD::Min(minY, maxY));
+		nearDist = SIMD::Add(SIMD::Add(nearDist, SIMD::Min(minZ, maxZ)), SIMD::Load(planeD + first));
+	}
+	// Bit i is set if the box is behind plane i, bits of frontPlanes if it is in front of plane i
+	INLINE uint ClassifyBox(const Vector3D& minPoint, const Vector3D& maxPoint, uint& frontPlanes) const
+	{
+		const SIMD::Float4 zero = SIMD::Splat(0.0f);
+		uint backPlanes = 0;
+		frontPlanes = 0;
+		for (uint first = 0; first < NumPaddedPlanes; first += 4) {
+			SIMD::Float4 farDist;
+			SIMD::Float4 nearDist;
+			BoxDistances(first, minPoint, maxPoint, farDist, nearDist);
+			backPlanes |= SIMD::MoveMask(SIMD::CmpLT(farDist, zero)) << first;
+			frontPlanes |= SIMD::MoveMask(SIMD::CmpGT(nearDist, zero)) << first;
+		}
+		frontPlanes &= (1 << NumPlanes) - 1;
+		return backPlanes;
+	}
+	// Plane bits in the order of the scalar tests: near, far, right, left, top, bottom
+	INLINE uint ToTestOrder(uint planeBits) const
+	{
+		return ((planeBits >> NEARPLANE) & 3) | ((planeBits & 15) << 2);
+	}
 public:
 	// Get plane by number
 	const Plane& GetPlane(size_t index) const
@@ -69,7 +119,7 @@ public:
 		assert(index < 6 && "Out of Range");
 		return planes[index];
 	}
-	// Get plane by number
+	// Get plane by number, call UpdatePlanes() after changing it
 	Plane& GetPlane(size_t index)
 	{
 		assert(index < 6 && "Out of Range");
@@ -92,8 +142,23 @@ public:
 		planes[4] = Plane(column4 - column3);  // near
 		planes[5] = Plane(column4 + column3);  // far
 
-		for (int p = 0; p < 6; ++p) {
-			planes[p].ComputeNearPointMask(nearPointMasks[p]);
+		UpdatePlanes();
+	}
+	// Refresh masks and the structure of arrays from planes
+	INLINE void UpdatePlanes()
+	{
+		for (uint i = 0; i < NumPlanes; ++i) {
+			planes[i].ComputeNearPointMask(nearPointMasks[i]);
+			planeX[i] = planes[i].normal.x;
+			planeY[i] = planes[i].normal.y;
+			planeZ[i] = planes[i].normal.z;
+			planeD[i] = planes[i].dist;
+		}
+		for (uint i = NumPlanes; i < NumPaddedPlanes; ++i) {
+			planeX[i] = 1.0f;
+			planeY[i] = 0.0f;
+			planeZ[i] = 0.0f;
+			planeD[i] = FLT_MAX;
 		}
 	}
 	// Calculate frustum
@@ -127,102 +192,91 @@ public:
 			clip[5] + clip[4],
 			clip[7] + clip[6]);
 		planes[NEARPLANE].ComputeNearPointMask(nearPointMasks[NEARPLANE]);
-
+		UpdatePlanes();
 	}
 	// Calculate Frustum planes
 	INLINE void ExtractFrustum(const Matrix4x4& clip)
 	{
-		// compute all palnes
-		Plane& right = planes[RIGHTPLANE];
-		//
-		right.ComputePlane(clip[ 3] - clip[ 0], clip[ 7] - clip[ 4],
-			clip[11] - clip[ 8], clip[15] - clip[12]);
-		right.ComputeNearPointMask(nearPointMasks[RIGHTPLANE]);
-		Plane& left = planes[LEFTPLANE];
-		//
-		left.ComputePlane(clip[ 3] + clip[ 0],
-			clip[ 7] + clip[ 4],
-			clip[11] + clip[ 8],
-			clip[15] + clip[12]);
-		left.ComputeNearPointMask(nearPointMasks[LEFTPLANE]);
-		Plane& bottom = planes[BOTTOMPLANE];
-		//
-		bottom.ComputePlane(clip[ 3] + clip[ 1],
-			clip[ 7] + clip[ 5],
-			clip[11] + clip[ 9],
-			clip[15] + clip[13]);
-		bottom.ComputeNearPointMask(nearPointMasks[BOTTOMPLANE]);
-		Plane& top = planes[TOPPLANE];
-		//
-		top.ComputePlane(clip[ 3] - clip[ 1],
-			clip[ 7] - clip[ 5],
-			clip[11] - clip[ 9],
-			clip[15] - clip[13]);
-		top.ComputeNearPointMask(nearPointMasks[TOPPLANE]);
-		Plane& Far = planes[FARPLANE];
-		//
-		Far.ComputePlane( clip[ 3] - clip[ 2],
-			clip[ 7] - clip[ 6],
-			clip[11] - clip[10],
-			clip[15] - clip[14]);
-		Far.ComputeNearPointMask(nearPointMasks[FARPLANE]);
-		Plane& Near = planes[NEARPLANE];
-		//
-		Near.ComputePlane(clip[ 3] + clip[ 2],
-			clip[ 7] + clip[ 6],
-			clip[11] + clip[10],
-			clip[15] + clip[14]);
-		Near.ComputeNearPointMask(nearPointMasks[NEARPLANE]);
-#if 1
-		//if (IsNormalize) {  //
-		float t = InvSqrt(Sqr(right.normal.x) + Sqr(right.normal.y) + Sqr(right.normal.z));
-		right *= t;
-		t = InvSqrt(Sqr(left.normal.x) + Sqr(left.normal.y) + Sqr(left.normal.z));
-		left *= t;
-		t = InvSqrt(Sqr(top.normal.x) + Sqr(top.normal.y) + Sqr(top.normal.z));
-		top *= t;
-		t = InvSqrt(Sqr(bottom.normal.x) + Sqr(bottom.normal.y) + Sqr(bottom.normal.z));
-		bottom *= t;
-		t = InvSqrt(Sqr(Near.normal.x) + Sqr(Near.normal.y) + Sqr(Near.normal.z));
-		Near *= t;
-		t = InvSqrt(Sqr(Far.normal.x) + Sqr(Far.normal.y) + Sqr(Far.normal.z));
-		Far *= t;
-		// }
-#endif
+		// rows of the column major matrix
+		SIMD::Float4 row0 = SIMD::Load(&clip[0]);
+		SIMD::Float4 row1 = SIMD::Load(&clip[4]);
+		SIMD::Float4 row2 = SIMD::Load(&clip[8]);
+		SIMD::Float4 row3 = SIMD::Load(&clip[12]);
+		SIMD::Transpose(row0, row1, row2, row3);
+		// compute all palnes in PlaneType order, padding planes pass everything
+		SIMD::Float4 p[NumPaddedPlanes] = {
+			SIMD::Sub(row3, row0),
+			SIMD::Add(row3, row0),
+			SIMD::Sub(row3, row1),
+			SIMD::Add(row3, row1),
+			SIMD::Add(row3, row2),
+			SIMD::Sub(row3, row2),
+			SIMD::Set(1.0f, 0.0f, 0.0f, FLT_MAX),
+			SIMD::Set(1.0f, 0.0f, 0.0f, FLT_MAX)
+		};
+		// normalize 4 planes at once as structure of arrays
+		for (uint first = 0; first < NumPaddedPlanes; first += 4) {
+			SIMD::Transpose(p[first], p[first + 1], p[first + 2], p[first + 3]);
+			const SIMD::Float4 lengthSq = SIMD::Add(SIMD::Add(SIMD::Mul(p[first], p[first]), SIMD::Mul(p[first + 1], p[first + 1])),
+				SIMD::Mul(p[first + 2], p[first + 2]));
+			const SIMD::Float4 invLength = SIMD::Div(SIMD::Splat(1.0f), SIMD::Sqrt(lengthSq));
+			SIMD::Store(planeX + first, SIMD::Mul(p[first], invLength));
+			SIMD::Store(planeY + first, SIMD::Mul(p[first + 1], invLength));
+			SIMD::Store(planeZ + first, SIMD::Mul(p[first + 2], invLength));
+			SIMD::Store(planeD + first, SIMD::Mul(p[first + 3], invLength));
+		}
+		for (uint i = 0; i < NumPlanes; ++i) {
+			planes[i].ComputePlane(planeX[i], planeY[i], planeZ[i], planeD[i]);
+			planes[i].ComputeNearPointMask(nearPointMasks[i]);
+		}
 	}
 	INLINE void ExtractFrustum(const Matrix4x4& proj, const Matrix4x4& view)
 	{
 		const Matrix4x4 viewProj = proj * view;
 		ExtractFrustum(viewProj);
 	}
-	// Sphere in frustum
+	// Sphere in frustum, all planes in one pass
 	INLINE bool SphereInFrustum(const Vector3D& center, float radius) const
 	{
-		// Check sphere orienation for near plane
-		if (planes[NEARPLANE].SignedDistanceToPoint(center) <= -radius) {
-			return false;
-		}
-		// Check sphere orienation for far plane
-		if (planes[FARPLANE].SignedDistanceToPoint(center) <= -radius) {
-			return false;
-		}
-		// Check sphere orienation for left plane
-		if (planes[LEFTPLANE].SignedDistanceToPoint(center) <= -radius) {
-			return false;
-		}
-		// Check sphere orienation for rigth plane
-		if (planes[RIGHTPLANE].SignedDistanceToPoint(center) <= -radius) {
-			return false;
-		}
-		// Check sphere orienation for top plane
-		if (planes[TOPPLANE].SignedDistanceToPoint(center) <= -radius) {
-			return false;
+		const SIMD::Float4 x = SIMD::Splat(center.x);
+		const SIMD::Float4 y = SIMD::Splat(center.y);
+		const SIMD::Float4 z = SIMD::Splat(center.z);
+		const SIMD::Float4 r = SIMD::Splat(-radius);
+		int outside = 0;
+		for (uint first = 0; first < NumPaddedPlanes; first += 4) {
+			SIMD::Float4 dist = SIMD::Add(SIMD::Mul(x, SIMD::Load(planeX + first)), SIMD::Mul(y, SIMD::Load(planeY + first)));
+			dist = SIMD::Add(SIMD::Add(dist, SIMD::Mul(z, SIMD::Load(planeZ + first))), SIMD::Load(planeD + first));
+			outside |= SIMD::MoveMask(SIMD::CmpLE(dist, r));
+		}
+		return outside == 0;
+	}
+	// Spheres as center and radius, visible[i] is 1 if sphere i is in frustum.
+	// Four spheres per iteration against one plane at a time
+	INLINE void SpheresInFrustum(const Vector4D* spheres, size_t numSpheres, ubyte* visible) const
+	{
+		assert((!numSpheres || (spheres && visible)) && "NULL Pointer");
+		const SIMD::Float4 zero = SIMD::Splat(0.0f);
+		size_t i = 0;
+		for (; i + 4 <= numSpheres; i += 4) {
+			SIMD::Float4 x = spheres[i].Load();
+			SIMD::Float4 y = spheres[i + 1].Load();
+			SIMD::Float4 z = spheres[i + 2].Load();
+			SIMD::Float4 r = spheres[i + 3].Load();
+			SIMD::Transpose(x, y, z, r);
+			r = SIMD::Sub(zero, r);
+			int outside = 0;
+			for (uint p = 0; p < NumPlanes; ++p) {
+				SIMD::Float4 dist = SIMD::Add(SIMD::Mul(x, SIMD::Splat(planeX[p])), SIMD::Mul(y, SIMD::Splat(planeY[p])));
+				dist = SIMD::Add(SIMD::Add(dist, SIMD::Mul(z, SIMD::Splat(planeZ[p]))), SIMD::Splat(planeD[p]));
+				outside |= SIMD::MoveMask(SIMD::CmpLE(dist, r));
+			}
+			for (uint j = 0; j < 4; ++j) {
+				visible[i + j] = (outside >> j) & 1 ? 0 : 1;
+			}
 		}
-		// Check sphere orienation for bottom plane
-		if (planes[BOTTOMPLANE].SignedDistanceToPoint(center) <= -radius) {
-			return false;
+		for (; i < numSpheres; ++i) {
+			visible[i] = SphereInFrustum(Vector3D(spheres[i].x, spheres[i].y, spheres[i].z), spheres[i].w) ? 1 : 0;
 		}
-		return true;
 	}
 	INLINE bool TriangleInFrustum(const Vector3D& A, const Vector3D& B, const Vector3D& C) const
 	{
@@ -398,51 +452,72 @@ public:
 		}
 		return true;
 	}
-	// Check BoundingBox visibility in frustum
+	// Check BoundingBox visibility in frustum, all planes in one pass
 	INLINE bool BoundingBoxInFrustum(const Vector3D& minPoint, const Vector3D& maxPoint) const
 	{
-		if (Classify(planes[NEARPLANE], nearPointMasks[NEARPLANE], minPoint, maxPoint) == Plane::BACK_PLANE) {
-			return false;
-		}
-		if (Classify(planes[FARPLANE], nearPointMasks[FARPLANE], minPoint, maxPoint) == Plane::BACK_PLANE) {
-			return false;
-		}
-		if (Classify(planes[RIGHTPLANE], nearPointMasks[RIGHTPLANE], minPoint, maxPoint) == Plane::BACK_PLANE) {
-			return false;
-		}
-		if (Classify(planes[LEFTPLANE], nearPointMasks[LEFTPLANE], minPoint, maxPoint) == Plane::BACK_PLANE) {
-			 return false;
-		}
-		if (Classify(planes[TOPPLANE], nearPointMasks[TOPPLANE], minPoint, maxPoint) == Plane::BACK_PLANE) {
-			return false;
-		}
-		if (Classify(planes[BOTTOMPLANE], nearPointMasks[BOTTOMPLANE], minPoint, maxPoint) == Plane::BACK_PLANE) {
-			return false;
-		}
-		return true;
+		const SIMD::Float4 zero = SIMD::Splat(0.0f);
+		int outside = 0;
+		for (uint first = 0; first < NumPaddedPlanes; first += 4) {
+			SIMD::Float4 farDist;
+			SIMD::Float4 nearDist;
+			BoxDistances(first, minPoint, maxPoint, farDist, nearDist);
+			outside |= SIMD::MoveMask(SIMD::CmpLT(farDist, zero));
+		}
+		return outside == 0;
 	}
 	// Check BoundingBox visibility in frustum
 	INLINE bool BoundingBoxInFrustum(const Vector3D& minPoint, const Vector3D& maxPoint, bool& isIntersect) const
 	{
-		if (Classify(planes[NEARPLANE], nearPointMasks[NEARPLANE], minPoint, maxPoint, isIntersect) == Plane::BACK_PLANE) {
-			return false;
-		}
-		if (Classify(planes[FARPLANE], nearPointMasks[FARPLANE], minPoint, maxPoint, isIntersect) == Plane::BACK_PLANE) {
-			return false;
-		}
-		if (Classify(planes[RIGHTPLANE], nearPointMasks[RIGHTPLANE], minPoint, maxPoint, isIntersect) == Plane::BACK_PLANE) {
-			return false;
-		}
-		if (Classify(planes[LEFTPLANE], nearPointMasks[LEFTPLANE], minPoint, maxPoint, isIntersect) == Plane::BACK_PLANE) {
-			return false;
+		uint frontPlanes;
+		const uint backPlanes = ClassifyBox(minPoint, maxPoint, frontPlanes);
+		const uint intersectPlanes = ~(frontPlanes | backPlanes) & ((1 << NumPlanes) - 1);
+		// like the scalar tests, only planes before the first plane the box is behind set isIntersect
+		const uint backOrder = ToTestOrder(backPlanes);
+		const uint tested = backOrder ? (backOrder & (0u - backOrder)) - 1 : ~0u;
+		if (ToTestOrder(intersectPlanes) & tested) {
+			isIntersect = true;
+		}
+		return backPlanes == 0;
+	}
+	// Boxes as structure of arrays, visible[i] is 1 if box i is in frustum.
+	// Four boxes per iteration against one plane at a time
+	INLINE void BoundingBoxesInFrustum(const float* minX, const float* minY, const float* minZ,
+		const float* maxX, const float* maxY, const float* maxZ, size_t numBoxes, ubyte* visible) const
+	{
+		assert((!numBoxes || (minX && minY && minZ && maxX && maxY && maxZ && visible)) && "NULL Pointer");
+		const SIMD::Float4 zero = SIMD::Splat(0.0f);
+		size_t i = 0;
+		for (; i + 4 <= numBoxes; i += 4) {
+			const SIMD::Float4 x0 = SIMD::Load(minX + i);
+			const SIMD::Float4 y0 = SIMD::Load(minY + i);
+			const SIMD::Float4 z0 = SIMD::Load(minZ + i);
+			const SIMD::Float4 x1 = SIMD::Load(maxX + i);
+			const SIMD::Float4 y1 = SIMD::Load(maxY + i);
+			const SIMD::Float4 z1 = SIMD::Load(maxZ + i);
+			int outside = 0;
+			for (uint p = 0; p < NumPlanes; ++p) {
+				const SIMD::Float4 x = SIMD::Splat(planeX[p]);
+				const SIMD::Float4 y = SIMD::Splat(planeY[p]);
+				const SIMD::Float4 z = SIMD::Splat(planeZ[p]);
+				SIMD::Float4 dist = SIMD::Add(SIMD::Max(SIMD::Mul(x0, x), SIMD::Mul(x1, x)), SIMD::Max(SIMD::Mul(y0, y), SIMD::Mul(y1, y)));
+				dist = SIMD::Add(SIMD::Add(dist, SIMD::Max(SIMD::Mul(z0, z), SIMD::Mul(z1, z))), SIMD::Splat(planeD[p]));
+				outside |= SIMD::MoveMask(SIMD::CmpLT(dist, zero));
+			}
+			for (uint j = 0; j < 4; ++j) {
+				visible[i + j] = (outside >> j) & 1 ? 0 : 1;
+			}
 		}
-		if (Classify(planes[TOPPLANE], nearPointMasks[TOPPLANE], minPoint, maxPoint, isIntersect) == Plane::BACK_PLANE) {
-			return false;
+		for (; i < numBoxes; ++i) {
+			visible[i] = BoundingBoxInFrustum(Vector3D(minX[i], minY[i], minZ[i]), Vector3D(maxX[i], maxY[i], maxZ[i])) ? 1 : 0;
 		}
-		if (Classify(planes[BOTTOMPLANE], nearPointMasks[BOTTOMPLANE], minPoint, maxPoint, isIntersect) == Plane::BACK_PLANE) {
-			return false;
+	}
+	// Boxes as min and max points, visible[i] is 1 if box i is in frustum
+	INLINE void BoundingBoxesInFrustum(const Vector3D* minPoints, const Vector3D* maxPoints, size_t numBoxes, ubyte* visible) const
+	{
+		assert((!numBoxes || (minPoints && maxPoints && visible)) && "NULL Pointer");
+		for (size_t i = 0; i < numBoxes; ++i) {
+			visible[i] = BoundingBoxInFrustum(minPoints[i], maxPoints[i]) ? 1 : 0;
 		}
-		return true;
 	}
 	// Calculate points for frustum
 	INLINE void CalculatePoints(Vector3D* points) const
@@ -0,0 +1,223 @@
+// GPUTimer.cpp: implementation of the GPUTimer class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "GPUTimer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+GPUTimer::GPUTimer() :
+	source(nullptr),
+	currentSlot(0),
+	window(DefaultWindow),
+	lastFrame(0),
+	numDroppedFrames(0),
+	numInvalidSamples(0)
+{
+}
+
+void GPUTimer::Init(QuerySource* pSource, uint numPasses, uint numFramesInFlight, uint windowSize)
+{
+	assert(pSource && "NULL Pointer");
+	assert(numPasses && numPasses <= MaxPasses && "Out Of Range");
+	assert(numFramesInFlight && "Invalid Value");
+	assert(windowSize && "Invalid Value");
+	source = pSource;
+	window = windowSize;
+	passes.assign(numPasses, Pass());
+	for (Pass& pass : passes) {
+		pass.frequency = 0;
+		pass.nextSample = 0;
+		pass.last = -1.0;
+		pass.samples.reserve(window);
+	}
+	const Slot slot = { 0, 0, 0, false };
+	slots.assign(numFramesInFlight, slot);
+	currentSlot = numFramesInFlight;
+	lastFrame = 0;
+	numDroppedFrames = 0;
+	numInvalidSamples = 0;
+}
+
+void GPUTimer::SetPass(uint pass, const char* name, uint64 frequency)
+{
+	assert(pass < passes.size() && "Out Of Range");
+	assert(name && "NULL Pointer");
+	passes[pass].name = name;
+	passes[pass].frequency = frequency;
+}
+
+bool GPUTimer::BeginFrame(uint64 frame)
+{
+	assert(currentSlot == slots.size() && "EndFrame is required");
+	const uint index = static_cast<uint>(frame % slots.size());
+	Slot& slot = slots[index];
+	if (slot.isPending) {
+		++numDroppedFrames;
+		return false;
+	}
+	slot.frame = frame;
+	slot.beginMask = 0;
+	slot.endMask = 0;
+	currentSlot = index;
+	return true;
+}
+
+void GPUTimer::BeginPass(void* commandList, uint pass)
+{
+	assert(pass < passes.size() && "Out Of Range");
+	if (currentSlot == slots.size()) {
+		return;
+	}
+	Slot& slot = slots[currentSlot];
+	assert(!(slot.beginMask & (1u << pass)) && "a pass is timed once a frame");
+	source->WriteTimestamp(commandList, currentSlot, pass * 2);
+	slot.beginMask |= 1u << pass;
+}
+
+void GPUTimer::EndPass(void* commandList, uint pass)
+{
+	assert(pass < passes.size() && "Out Of Range");
+	if (currentSlot == slots.size() || !(slots[currentSlot].beginMask & (1u << pass))) {
+		return;
+	}
+	Slot& slot = slots[currentSlot];
+	source->WriteTimestamp(commandList, currentSlot, pass * 2 + 1);
+	source->Resolve(commandList, currentSlot, pass * 2, 2);
+	slot.endMask |= 1u << pass;
+}
+
+void GPUTimer::EndFrame()
+{
+	if (currentSlot == slots.size()) {
+		return;
+	}
+	Slot& slot = slots[currentSlot];
+	slot.isPending = slot.endMask != 0;
+	currentSlot = static_cast<uint>(slots.size());
+}
+
+void GPUTimer::ReadSlot(Slot& slot)
+{
+	const uint index = static_cast<uint>(&slot - slots.data());
+	uint64 timestamps[MaxPasses * 2];
+	const bool isRead = source->Read(index, 0, GetNumQueries(), timestamps);
+	for (uint i = 0; i < passes.size(); ++i) {
+		Pass& pass = passes[i];
+		pass.last = -1.0;
+		if (!isRead || !(slot.endMask & (1u << i)) || !pass.frequency) {
+			continue;
+		}
+		const uint64 begin = timestamps[i * 2];
+		const uint64 end = timestamps[i * 2 + 1];
+		// a disjoint timestamp, e.g. after the GPU changed its clock
+		if (end < begin) {
+			++numInvalidSamples;
+			continue;
+		}
+		pass.last = static_cast<double>(end - begin) * 1000.0 / pass.frequency;
+		if (pass.samples.size() < window) {
+			pass.samples.push_back(pass.last);
+		} else {
+			pass.samples[pass.nextSample] = pass.last;
+		}
+		pass.nextSample = (pass.nextSample + 1) % window;
+	}
+	lastFrame = slot.frame;
+	slot.isPending = false;
+}
+
+void GPUTimer::Collect(uint64 completedFrame)
+{
+	// oldest first, the last durations are of the newest frame
+	for (;;) {
+		Slot* oldest = nullptr;
+		for (Slot& slot : slots) {
+			if (slot.isPending && slot.frame <= completedFrame && (!oldest || slot.frame < oldest->frame)) {
+				oldest = &slot;
+			}
+		}
+		if (!oldest) {
+			break;
+		}
+		ReadSlot(*oldest);
+	}
+}
+
+void GPUTimer::ResetStats()
+{
+	for (Pass& pass : passes) {
+		pass.samples.clear();
+		pass.nextSample = 0;
+		pass.last = -1.0;
+	}
+	numInvalidSamples = 0;
+}
+
+double GPUTimer::GetPercentile(std::vector<double>& values, double percentile)
+{
+	if (values.empty()) {
+		return 0.0;
+	}
+	const size_t n = static_cast<size_t>(percentile * (values.size() - 1) + 0.5);
+	std::nth_element(values.begin(), values.begin() + n, values.end());
+	return values[n];
+}
+
+GPUTimer::Stats GPUTimer::GetStats(uint pass) const
+{
+	assert(pass < passes.size() && "Out Of Range");
+	const Pass& p = passes[pass];
+	Stats stats = {};
+	stats.numSamples = static_cast<uint>(p.samples.size());
+	if (!stats.numSamples) {
+		return stats;
+	}
+	// the newest sample is before nextSample
+	stats.last = p.samples[(p.nextSample + window - 1) % window];
+	stats.min = p.samples[0];
+	stats.max = p.samples[0];
+	for (double sample : p.samples) {
+		stats.mean += sample;
+		stats.min = std::min(stats.min, sample);
+		stats.max = std::max(stats.max, sample);
+	}
+	stats.mean /= stats.numSamples;
+	std::vector<double> samples = p.samples;
+	stats.median = GetPercentile(samples, 0.5);
+	stats.p95 = GetPercentile(samples, 0.95);
+	return stats;
+}
+
+double GPUTimer::GetLastTime(uint pass) const
+{
+	assert(pass < passes.size() && "Out Of Range");
+	return passes[pass].last;
+}
+
+double GPUTimer::GetLastFrameTime() const
+{
+	double time = 0.0;
+	for (const Pass& pass : passes) {
+		time += std::max(pass.last, 0.0);
+	}
+	return time;
+}
+
+std::string GPUTimer::GetReport() const
+{
+	double total = 0.0;
+	for (uint i = 0; i < passes.size(); ++i) {
+		total += GetStats(i).mean;
+	}
+	std::string report = "Pass            Samples     mean      med      p95      max  share (ms)\n";
+	for (uint i = 0; i < passes.size(); ++i) {
+		const Stats stats = GetStats(i);
+		char line[256];
+		snprintf(line, sizeof(line), "%-15s %7u %8.3f %8.3f %8.3f %8.3f %5.1f%%\n", passes[i].name.c_str(), stats.numSamples,
+			stats.mean, stats.median, stats.p95, stats.max, total > 0.0 ? stats.mean * 100.0 / total : 0.0);
+		report += line;
+	}
+	return report;
+}
@@ -0,0 +1,135 @@
+// GPUTimer.h: interface for the GPUTimer class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __GPUTIMER_H__
+#define __GPUTIMER_H__
+
+#include <string>
+#include <vector>
+#include "types.h"
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+// GPU time of the passes of a frame. A pass is bracketed by two timestamp queries
+// which are resolved right after it; every frame in flight has its own queries and
+// readback slot, a slot is read once its frame is complete and reused after that.
+// Durations go into a rolling window of statistics per pass
+class GPUTimer  {
+public:
+	// Timestamps of the GPU API, the mock of GPUTimerReport runs the ring without a GPU
+	class QuerySource  {
+	public:
+		virtual ~QuerySource() {}
+		// Timestamp query of the frame slot written when the GPU gets to it in commandList
+		virtual void WriteTimestamp(void* commandList, uint slot, uint query) = 0;
+		// Copy of the queries of the frame slot to its readback slot
+		virtual void Resolve(void* commandList, uint slot, uint firstQuery, uint numQueries) = 0;
+		// Resolved queries of the frame slot, false if they can't be read
+		virtual bool Read(uint slot, uint firstQuery, uint numQueries, uint64* timestamps) = 0;
+	};
+	struct Stats {
+		uint numSamples;
+		// milliseconds
+		double last;
+		double mean;
+		double min;
+		double max;
+		double median;
+		double p95;
+	};
+	static const uint MaxPasses = 16;
+	static const uint DefaultWindow = 256;
+private:
+	struct Pass {
+		std::string name;
+		// ticks per second of the queue of the pass
+		uint64 frequency;
+		// rolling window of durations in milliseconds
+		std::vector<double> samples;
+		uint nextSample;
+		// of the last collected frame, negative if the pass wasn't timed
+		double last;
+	};
+	struct Slot {
+		uint64 frame;
+		// passes of the frame with a begin query and with both queries resolved
+		uint beginMask;
+		uint endMask;
+		// resolved and waiting for its frame to complete
+		bool isPending;
+	};
+	QuerySource* source;
+	std::vector<Pass> passes;
+	std::vector<Slot> slots;
+	// slot of the recorded frame, slots.size() if its passes aren't timed
+	uint currentSlot;
+	uint window;
+	uint64 lastFrame;
+	uint numDroppedFrames;
+	uint numInvalidSamples;
+
+	static double GetPercentile(std::vector<double>& values, double percentile);
+	void ReadSlot(Slot& slot);
+public:
+	GPUTimer();
+	// numFramesInFlight slots of 2 queries per pass, window durations of every pass
+	void Init(QuerySource* pSource, uint numPasses, uint numFramesInFlight, uint windowSize = DefaultWindow);
+	// Name and timestamp frequency of the queue of a pass
+	void SetPass(uint pass, const char* name, uint64 frequency);
+	// Starts recording the frame, false if the slot of the frame is still read by the GPU:
+	// the passes of the frame are not timed then
+	bool BeginFrame(uint64 frame);
+	void BeginPass(void* commandList, uint pass);
+	void EndPass(void* commandList, uint pass);
+	void EndFrame();
+	// Reads the frames up to completedFrame, they have finished on the GPU
+	void Collect(uint64 completedFrame);
+	// Drops the durations of all passes
+	void ResetStats();
+	Stats GetStats(uint pass) const;
+	// Milliseconds of the pass in the last collected frame, negative if it wasn't timed
+	double GetLastTime(uint pass) const;
+	// Sum of the passes of the last collected frame in milliseconds
+	double GetLastFrameTime() const;
+	// Table of the passes and their share of the GPU time
+	std::string GetReport() const;
+	// Queries of a frame slot
+	INLINE uint GetNumQueries() const
+	{
+		return static_cast<uint>(passes.size()) * 2;
+	}
+	//
+	INLINE uint GetNumPasses() const
+	{
+		return static_cast<uint>(passes.size());
+	}
+	//
+	INLINE uint GetNumFramesInFlight() const
+	{
+		return static_cast<uint>(slots.size());
+	}
+	// Frame of the last collected durations
+	INLINE uint64 GetLastFrame() const
+	{
+		return lastFrame;
+	}
+	// Frames which found their slot busy
+	INLINE uint GetNumDroppedFrames() const
+	{
+		return numDroppedFrames;
+	}
+	// Durations dropped since their end was before their begin
+	INLINE uint GetNumInvalidSamples() const
+	{
+		return numInvalidSamples;
+	}
+};
+
+#endif // __GPUTIMER_H__
@@ -0,0 +1,172 @@
+// GridGenerator.cpp: implementation of the GridGenerator class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "GridGenerator.h"
+#include <algorithm>
+#include <cfloat>
+#include <thread>
+
+namespace {
+
+	// fewer rows per worker cost more to start than to generate
+	const uint MinRowsPerThread = 32;
+
+	// x and z from -1 to numCells + 1 if the heights have a border
+	INLINE float GetHeight(const GridGenerator::Desc& desc, int x, int z)
+	{
+		if (!desc.heights) {
+			return 0.0f;
+		}
+		const int border = desc.hasHeightBorder ? 1 : 0;
+		return desc.heights[static_cast<size_t>(z + border) * (desc.numCellsX + 1 + 2 * border) + x + border];
+	}
+
+	// central differences, one-sided on the border without a height border
+	INLINE Vector3D GetNormal(const GridGenerator::Desc& desc, int x, int z)
+	{
+		if (!desc.heights) {
+			return Vector3D::Y();
+		}
+		const int border = desc.hasHeightBorder ? 1 : 0;
+		const int x0 = std::max(x - 1, -border);
+		const int x1 = std::min(x + 1, static_cast<int>(desc.numCellsX) + border);
+		const int z0 = std::max(z - 1, -border);
+		const int z1 = std::min(z + 1, static_cast<int>(desc.numCellsZ) + border);
+		const float dx = (GetHeight(desc, x1, z) - GetHeight(desc, x0, z)) / ((x1 - x0) * desc.cellSize.x);
+		const float dz = (GetHeight(desc, x, z1) - GetHeight(desc, x, z0)) / ((z1 - z0) * desc.cellSize.y);
+		const Vector3D normal(-dx, 1.0f, -dz);
+		return normal / normal.Length();
+	}
+
+	// vertex rows first to last - 1 and the cells above them
+	template<class IndexType>
+	void CreateRows(const GridGenerator::Desc& desc, const VertexFormat& format, ubyte* vertices, IndexType* indices, uint first, uint last)
+	{
+		const uint numColumns = desc.numCellsX + 1;
+		const uint stride = format.GetStride();
+		const Vector2D texCoordStep((desc.texCoordMax.x - desc.texCoordMin.x) / desc.numCellsX, (desc.texCoordMax.y - desc.texCoordMin.y) / desc.numCellsZ);
+		std::vector<Vertex> row(numColumns);
+		for (uint z = first; z < last; ++z) {
+			for (uint x = 0; x < numColumns; ++x) {
+				Vertex& v = row[x];
+				v.position = Vector3D(desc.origin.x + x * desc.cellSize.x, desc.origin.y + GetHeight(desc, x, z), desc.origin.z + z * desc.cellSize.y);
+				v.normal = GetNormal(desc, x, z);
+				v.tvert = Vector2D(desc.texCoordMin.x + x * texCoordStep.x, desc.texCoordMin.y + z * texCoordStep.y);
+			}
+			format.Encode(row.data(), numColumns, vertices + static_cast<size_t>(z) * numColumns * stride);
+			if (z == desc.numCellsZ) {
+				continue;
+			}
+			// (a, d, c) and (a, b, d) of the cell a b / c d face +Y
+			IndexType* cell = indices + static_cast<size_t>(z) * desc.numCellsX * 6;
+			for (uint x = 0; x < desc.numCellsX; ++x, cell += 6) {
+				const IndexType a = static_cast<IndexType>(z * numColumns + x);
+				const IndexType b = static_cast<IndexType>(a + 1);
+				const IndexType c = static_cast<IndexType>(a + numColumns);
+				const IndexType d = static_cast<IndexType>(c + 1);
+				cell[0] = a;
+				cell[1] = d;
+				cell[2] = c;
+				cell[3] = a;
+				cell[4] = b;
+				cell[5] = d;
+			}
+		}
+	}
+
+	template<class IndexType>
+	void CreateGrid(const GridGenerator::Desc& desc, const VertexFormat& format, void* vertices, IndexType* indices, uint numThreads)
+	{
+		const uint numRows = desc.numCellsZ + 1;
+		numThreads = std::max(1u, std::min(numThreads, (numRows + MinRowsPerThread - 1) / MinRowsPerThread));
+		ubyte* destination = static_cast<ubyte *>(vertices);
+		// the caller takes the first rows
+		std::vector<std::future<void> > tasks;
+		tasks.reserve(numThreads - 1);
+		for (uint i = 1; i < numThreads; ++i) {
+			const uint first = static_cast<uint>(static_cast<uint64>(numRows) * i / numThreads);
+			const uint last = static_cast<uint>(static_cast<uint64>(numRows) * (i + 1) / numThreads);
+			tasks.push_back(std::async(std::launch::async, [&desc, &format, destination, indices, first, last]()
+			{
+				CreateRows(desc, format, destination, indices, first, last);
+			}));
+		}
+		CreateRows(desc, format, destination, indices, 0, numRows / numThreads);
+		for (std::future<void>& task : tasks) {
+			task.get();
+		}
+	}
+
+}
+
+uint GridGenerator::GetNumVertices(const Desc& desc)
+{
+	return (desc.numCellsX + 1) * (desc.numCellsZ + 1);
+}
+
+uint GridGenerator::GetNumIndices(const Desc& desc)
+{
+	return desc.numCellsX * desc.numCellsZ * 6;
+}
+
+void GridGenerator::GetBounds(const Desc& desc, Vector3D& minimum, Vector3D& maximum)
+{
+	float minHeight = 0.0f;
+	float maxHeight = 0.0f;
+	if (desc.heights) {
+		// the height border isn't part of the grid
+		minHeight = FLT_MAX;
+		maxHeight = -FLT_MAX;
+		for (uint z = 0; z <= desc.numCellsZ; ++z) {
+			for (uint x = 0; x <= desc.numCellsX; ++x) {
+				const float height = GetHeight(desc, x, z);
+				minHeight = std::min(minHeight, height);
+				maxHeight = std::max(maxHeight, height);
+			}
+		}
+	}
+	minimum = Vector3D(desc.origin.x, desc.origin.y + minHeight, desc.origin.z);
+	maximum = Vector3D(desc.origin.x + desc.numCellsX * desc.cellSize.x, desc.origin.y + maxHeight, desc.origin.z + desc.numCellsZ * desc.cellSize.y);
+}
+
+uint GridGenerator::GetDefaultNumThreads()
+{
+	// 0 if unknown
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void GridGenerator::Create(const Desc& desc, const VertexFormat& format, void* vertices, void* indices, uint indexSize, uint numThreads)
+{
+	assert(desc.numCellsX && desc.numCellsZ && "Invalid Value");
+	assert(desc.cellSize.x > 0.0f && desc.cellSize.y > 0.0f && "Invalid Value");
+	assert(vertices && indices && "NULL Pointer");
+	assert(format.GetSourceFormat().GetStride() == sizeof(Vertex) && "Invalid Value");
+	assert((indexSize == sizeof(uint) || (indexSize == sizeof(ushort) && GetNumVertices(desc) <= 0x10000)) && "Invalid Value");
+	if (!numThreads) {
+		numThreads = GetDefaultNumThreads();
+	}
+	if (indexSize == sizeof(ushort)) {
+		CreateGrid(desc, format, vertices, static_cast<ushort *>(indices), numThreads);
+	} else {
+		CreateGrid(desc, format, vertices, static_cast<uint *>(indices), numThreads);
+	}
+}
+
+void GridGenerator::Create(Mesh& mesh, const Desc& desc, uint numThreads)
+{
+	const VertexFormat format = VertexFormat::Create(VertexFormat::TexCoord, VertexFormat::NoQuantization);
+	mesh.stride = format.GetStride();
+	mesh.vertices.resize(static_cast<size_t>(GetNumVertices(desc)) * mesh.stride);
+	mesh.indices.resize(GetNumIndices(desc));
+	Create(desc, format, mesh.vertices.data(), mesh.indices.data(), sizeof(uint), numThreads);
+}
+
+std::future<void> GridGenerator::CreateAsync(const Desc& desc, const VertexFormat& format, void* vertices, void* indices, uint indexSize, uint numThreads)
+{
+	// desc and format are copied, the task outlives the arguments
+	return std::async(std::launch::async, [desc, format, vertices, indices, indexSize, numThreads]()
+	{
+		Create(desc, format, vertices, indices, indexSize, numThreads);
+	});
+}
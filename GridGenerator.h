@@ -0,0 +1,61 @@
+// GridGenerator.h: interface for the GridGenerator class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __GRIDGENERATOR_H__
+#define __GRIDGENERATOR_H__
+
+#include "VertexFormat.h"
+#include <future>
+
+// Regular grids in the XZ plane generated by rows on worker threads. Every worker
+// writes its rows of encoded vertices and indices straight into the destination, so
+// it can be mapped upload memory. Normals of heightfields are the central differences
+// of the heights, computed with the vertices, one-sided on the border unless the
+// heights have a border.
+class GridGenerator  {
+public:
+	struct Desc {
+		// cells along X and Z, there is one more vertex per row and column
+		uint numCellsX;
+		uint numCellsZ;
+		// size of a cell along X and Z
+		Vector2D cellSize;
+		// position of the first vertex, the grid goes to +X and +Z
+		Vector3D origin;
+		// (numCellsX + 1) * (numCellsZ + 1) heights added to origin.y, rows along X.
+		// The grid is flat if it is nullptr
+		const float* heights;
+		// heights have one more row and column on every side, (numCellsX + 3) * (numCellsZ + 3)
+		// of them, so the normals on the border match the ones of a neighbour grid
+		bool hasHeightBorder;
+		// texture coordinates of the first and the last vertex
+		Vector2D texCoordMin;
+		Vector2D texCoordMax;
+
+		Desc() : numCellsX(1), numCellsZ(1), cellSize(1.0f, 1.0f), origin(0.0f, 0.0f, 0.0f), heights(nullptr), hasHeightBorder(false), texCoordMin(0.0f, 0.0f), texCoordMax(1.0f, 1.0f)
+		{
+		}
+	};
+
+	//
+	static uint GetNumVertices(const Desc& desc);
+	//
+	static uint GetNumIndices(const Desc& desc);
+	// Bounds of the positions, for the bounds of the vertex format
+	static void GetBounds(const Desc& desc, Vector3D& minimum, Vector3D& maximum);
+	// Workers used when numThreads is 0
+	static uint GetDefaultNumThreads();
+
+	// Writes GetNumVertices vertices of format and GetNumIndices indices of indexSize
+	// (2 or 4) bytes. The source format of format must be Vertex and its bounds set.
+	// Front faces are counter-clockwise from +Y as in the scene pipelines
+	static void Create(const Desc& desc, const VertexFormat& format, void* vertices, void* indices, uint indexSize, uint numThreads = 0);
+	// Grid of Vertex with 32 bit indices
+	static void Create(Mesh& mesh, const Desc& desc, uint numThreads = 0);
+	// Create on a task, so a frame doesn't wait for large grids. The heights and
+	// the destination must stay valid until the future is ready
+	static std::future<void> CreateAsync(const Desc& desc, const VertexFormat& format, void* vertices, void* indices, uint indexSize, uint numThreads = 0);
+};
+
+#endif // __GRIDGENERATOR_H__
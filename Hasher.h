@@ -0,0 +1,58 @@
+// Hasher.h: interface for the Hasher class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __HASHER_H__
+#define __HASHER_H__
+
+#include <cstddef>
+#include <cstring>
+#include "types.h"
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+// 64-bit FNV-1a hash
+class Hasher  {
+private:
+	uint64 value;
+public:
+	static const uint64 OffsetBasis = 14695981039346656037ull;
+	static const uint64 Prime = 1099511628211ull;
+	Hasher(uint64 seed = OffsetBasis) : value(seed)
+	{
+	}
+	INLINE void Add(const void* data, size_t size)
+	{
+		const ubyte* bytes = static_cast<const ubyte *>(data);
+		for (size_t i = 0; i < size; ++i) {
+			value = (value ^ bytes[i]) * Prime;
+		}
+	}
+	// string with terminator, so "ab" + "c" and "a" + "bc" hash differently
+	INLINE void Add(const char* str)
+	{
+		Add(str ? str : "", (str ? strlen(str) : 0) + 1);
+	}
+	INLINE void Add(uint64 v)
+	{
+		Add(&v, sizeof(v));
+	}
+	INLINE uint64 Get() const
+	{
+		return value;
+	}
+	static uint64 Hash(const void* data, size_t size)
+	{
+		Hasher hasher;
+		hasher.Add(data, size);
+		return hasher.Get();
+	}
+};
+
+#endif // __HASHER_H__
@@ -0,0 +1,139 @@
+// IndirectLightCommands.h: interface for the IndirectLightCommands class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __INDIRECTLIGHTCOMMANDS_H__
+#define __INDIRECTLIGHTCOMMANDS_H__
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include "types.h"
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+// Layout of indirect commands of the light passes, the commands are built by
+// the BuildCommands compute shader and executed with a count buffer.
+// Every pass owns NumLods commands in the argument buffer followed by the
+// other pass, only non empty LOD buckets are written and counted.
+// The count buffer holds the number of commands of every pass followed by
+// the instance count of every bucket.
+class IndirectLightCommands  {
+public:
+	enum Pass {
+		// light volumes into the light buffer
+		VolumePass,
+		// light sources into the scene
+		SourcePass,
+		NumPasses
+	};
+	static const uint NumLods = 3;
+	static const uint NumCommands = NumPasses * NumLods;
+	// root constants of a command
+	static const uint NumConstants = 4;
+	static const uint NumVertexBuffers = 2;
+	// D3D12_VERTEX_BUFFER_VIEW
+	struct VertexBufferView {
+		uint64 bufferLocation;
+		uint sizeInBytes;
+		uint strideInBytes;
+	};
+	// D3D12_INDEX_BUFFER_VIEW
+	struct IndexBufferView {
+		uint64 bufferLocation;
+		uint sizeInBytes;
+		// DXGI_FORMAT
+		uint format;
+	};
+	// D3D12_DRAW_INDEXED_ARGUMENTS
+	struct DrawIndexedArguments {
+		uint indexCountPerInstance;
+		uint instanceCount;
+		uint startIndexLocation;
+		int baseVertexLocation;
+		uint startInstanceLocation;
+	};
+	// arguments in order of the command signature
+	struct Command {
+		// x: radius of the light geometry, 0 is range of the light, y: LOD
+		float constants[NumConstants];
+		// light geometry and light instances
+		VertexBufferView vertexBuffers[NumVertexBuffers];
+		IndexBufferView indexBuffer;
+		DrawIndexedArguments draw;
+		uint padding;
+	};
+	// offset of instance count written by the shader
+	static const uint InstanceCountOffset = offsetof(Command, draw) + offsetof(DrawIndexedArguments, instanceCount);
+	//
+	INLINE static uint GetCommandIndex(uint pass, uint lod)
+	{
+		assert(pass < NumPasses && "Out Of Range");
+		assert(lod < NumLods && "Out Of Range");
+		return pass * NumLods + lod;
+	}
+	// Offset of the first command of the pass in the argument buffer
+	INLINE static uint GetArgumentOffset(uint pass)
+	{
+		return GetCommandIndex(pass, 0) * sizeof(Command);
+	}
+	// Offset of the command count of the pass in the count buffer
+	INLINE static uint GetCountOffset(uint pass)
+	{
+		assert(pass < NumPasses && "Out Of Range");
+		return pass * sizeof(uint);
+	}
+	// Offset of the instance count of the bucket in the count buffer
+	INLINE static uint GetBucketCountOffset(uint command)
+	{
+		assert(command < NumCommands && "Out Of Range");
+		return (NumPasses + command) * sizeof(uint);
+	}
+	//
+	INLINE static uint GetCountBufferSize()
+	{
+		return (NumPasses + NumCommands) * sizeof(uint);
+	}
+	// CPU model of the BuildCommands shader: copy templates of non empty buckets,
+	// set their instance count and count the commands of every pass.
+	// counts is the count buffer, the bucket counts are read, the command counts written.
+	static void Build(const Command* templates, uint* counts, Command* commands)
+	{
+		assert(templates && "NULL Pointer");
+		assert(counts && "NULL Pointer");
+		assert(commands && "NULL Pointer");
+		for (uint pass = 0; pass < NumPasses; ++pass) {
+			uint numCommands = 0;
+			for (uint lod = 0; lod < NumLods; ++lod) {
+				const uint command = GetCommandIndex(pass, lod);
+				const uint count = counts[GetBucketCountOffset(command) / sizeof(uint)];
+				if (!count) {
+					continue;
+				}
+				Command& dst = commands[GetCommandIndex(pass, numCommands++)];
+				dst = templates[command];
+				dst.draw.instanceCount = count;
+			}
+			counts[GetCountOffset(pass) / sizeof(uint)] = numCommands;
+		}
+	}
+};
+
+// The argument buffer is read by the command processor, layout has to match D3D12 exactly
+static_assert(sizeof(IndirectLightCommands::VertexBufferView) == 16, "VertexBufferView must match D3D12_VERTEX_BUFFER_VIEW");
+static_assert(sizeof(IndirectLightCommands::IndexBufferView) == 16, "IndexBufferView must match D3D12_INDEX_BUFFER_VIEW");
+static_assert(sizeof(IndirectLightCommands::DrawIndexedArguments) == 20, "DrawIndexedArguments must match D3D12_DRAW_INDEXED_ARGUMENTS");
+static_assert(offsetof(IndirectLightCommands::Command, vertexBuffers) == 16, "root constants must come first");
+static_assert(offsetof(IndirectLightCommands::Command, indexBuffer) == 48, "index buffer view must follow the vertex buffer views");
+static_assert(offsetof(IndirectLightCommands::Command, draw) == 64, "draw arguments must be last");
+static_assert(IndirectLightCommands::InstanceCountOffset == 68, "instance count is patched by the shader");
+static_assert(sizeof(IndirectLightCommands::Command) == 88, "command stride must keep buffer locations 8 byte aligned");
+static_assert(!(sizeof(IndirectLightCommands::Command) % 8), "command stride must keep buffer locations 8 byte aligned");
+
+#endif // __INDIRECTLIGHTCOMMANDS_H__
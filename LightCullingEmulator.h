@@ -0,0 +1,207 @@
+// LightCullingEmulator.h: interface for the LightCullingEmulator class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __LIGHTCULLINGEMULATOR_H__
+#define __LIGHTCULLINGEMULATOR_H__
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include "types.h"
+#include "IndirectLightCommands.h"
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+// Data shared with the CullLights compute shader, plain floats keep the layout
+// independent from alignment of the math classes.
+
+// light instance written by the culling (per-instance vertex data)
+struct LightInstanceData {
+	// position and radius
+	float posRange[4];
+	// light index packed into a color
+	uint lightIndex;
+};
+static_assert(sizeof(LightInstanceData) == 20, "LightInstanceData must match InstanceGPUDataSize of the shader");
+
+// light read by the culling (StructuredBuffer element)
+struct CullingLightInfo {
+	LightInstanceData instanceData;
+	uint padding[3];
+};
+static_assert(sizeof(CullingLightInfo) == 32, "CullingLightInfo must match the shader struct");
+
+// constant buffer of the culling
+struct CullingConstants {
+	static const uint NumPlanes = 6;
+	// normal and distance of the frustum planes
+	float planes[NumPlanes][4];
+	// xyz: camera position
+	float cameraPosition[4];
+	// LOD i + 1 is used when squared radius / squared distance is below lodThresholds[i]
+	float lodThresholds[4];
+	// radius culled and drawn by every pass, 0 is range of the light
+	float passRadius[4];
+	uint numLights;
+	uint padding[3];
+};
+static_assert(sizeof(CullingConstants) == 160, "CullingConstants must match the shader cbuffer");
+static_assert(IndirectLightCommands::NumLods - 1 <= 4, "LOD thresholds don't fit to CullingConstants");
+static_assert(IndirectLightCommands::NumPasses <= 4, "pass radiuses don't fit to CullingConstants");
+
+// CPU implementation of the CullLights compute shader.
+// Every light is classified by every pass into a LOD bucket or culled, every
+// bucket has an own region of numLights instances in the instance buffer.
+// The shader runs GroupSize threads per group; visible lights of a group are
+// compacted per bucket in thread order and the group appends them with one
+// atomic per bucket, so a bucket is a sequence of per-group chunks. The order
+// of the chunks depends on the order the groups reach the atomic, the emulator
+// appends them in dispatch order.
+// Results are bit exact as long as the CPU code is built without contraction
+// into fused multiply-add (/fp:precise, -ffp-contract=off).
+class LightCullingEmulator  {
+public:
+	// must match GROUP_SIZE of the shader
+	static const uint GroupSize = 64;
+	// culled light
+	static const uint InvalidLod = ~0u;
+	//
+	INLINE static uint GetNumGroups(uint numLights)
+	{
+		return (numLights + GroupSize - 1) / GroupSize;
+	}
+	// Same evaluation order as the shader, where the distance is precise (no mad contraction)
+	INLINE static bool SphereInFrustum(const CullingConstants& constants, const float* center, float radius)
+	{
+		bool res = true;
+		for (uint i = 0; i < CullingConstants::NumPlanes; ++i) {
+			const float* plane = constants.planes[i];
+			float d = plane[0] * center[0] + plane[1] * center[1];
+			d = d + plane[2] * center[2];
+			d = d + plane[3];
+			res = res && d > -radius;
+		}
+		return res;
+	}
+	// LOD bucket of the light in the pass, or InvalidLod if the light is culled
+	INLINE static uint Classify(const CullingConstants& constants, uint pass, const float* posRange)
+	{
+		assert(pass < IndirectLightCommands::NumPasses && "Out Of Range");
+		const float radius = constants.passRadius[pass] > 0.0f ? constants.passRadius[pass] : posRange[3];
+		if (!SphereInFrustum(constants, posRange, radius)) {
+			return InvalidLod;
+		}
+		const float x = posRange[0] - constants.cameraPosition[0];
+		const float y = posRange[1] - constants.cameraPosition[1];
+		const float z = posRange[2] - constants.cameraPosition[2];
+		float d2 = x * x + y * y;
+		d2 = d2 + z * z;
+		const float r2 = radius * radius;
+		uint lod = 0;
+		for (uint i = 0; i < IndirectLightCommands::NumLods - 1; ++i) {
+			const float t = constants.lodThresholds[i] * d2;
+			lod += r2 < t ? 1 : 0;
+		}
+		return lod;
+	}
+	// Cull lights of one group, output has a region of numLights instances per bucket,
+	// counts is incremented by number of lights the group wrote to every bucket.
+	static void RunGroup(const CullingConstants& constants, const CullingLightInfo* lights, uint group, LightInstanceData* output, uint* counts)
+	{
+		assert(lights && "NULL Pointer");
+		assert(output && "NULL Pointer");
+		assert(counts && "NULL Pointer");
+		const uint first = group * GroupSize;
+		for (uint pass = 0; pass < IndirectLightCommands::NumPasses; ++pass) {
+			for (uint i = first; i < first + GroupSize && i < constants.numLights; ++i) {
+				const LightInstanceData& light = lights[i].instanceData;
+				const uint lod = Classify(constants, pass, light.posRange);
+				if (lod == InvalidLod) {
+					continue;
+				}
+				// offset of a visible thread is the number of threads of the bucket before it
+				const uint command = IndirectLightCommands::GetCommandIndex(pass, lod);
+				output[command * constants.numLights + counts[command]++] = light;
+			}
+		}
+	}
+	// Cull all lights, output needs room for NumCommands * numLights instances.
+	// counts receives the instance count of every bucket.
+	static void Run(const CullingConstants& constants, const CullingLightInfo* lights, LightInstanceData* output, uint* counts)
+	{
+		assert(counts && "NULL Pointer");
+		memset(counts, 0, IndirectLightCommands::NumCommands * sizeof(uint));
+		const uint numGroups = GetNumGroups(constants.numLights);
+		for (uint group = 0; group < numGroups; ++group) {
+			RunGroup(constants, lights, group, output, counts);
+		}
+	}
+	// Compare output of the shader with the emulation. Chunks of a group have to match
+	// bit for bit, their order in a bucket is free. chunkSize is the number of threads
+	// sharing one atomic: GroupSize, or the wave size if the shader is compiled with wave intrinsics.
+	// gpuCounts are the bucket counts of the count buffer.
+	static bool Validate(const CullingConstants& constants, const CullingLightInfo* lights, const LightInstanceData* gpuOutput, const uint* gpuCounts, uint chunkSize = GroupSize)
+	{
+		assert(chunkSize && !(GroupSize % chunkSize) && "Invalid Value");
+		struct Chunk {
+			uint offset;
+			uint count;
+			bool isMatched;
+		};
+		const uint numLights = constants.numLights;
+		std::vector<LightInstanceData> expected(numLights);
+		std::vector<Chunk> chunks;
+		for (uint command = 0; command < IndirectLightCommands::NumCommands; ++command) {
+			const uint pass = command / IndirectLightCommands::NumLods;
+			const uint lod = command % IndirectLightCommands::NumLods;
+			chunks.clear();
+			uint count = 0;
+			for (uint first = 0; first < numLights; first += chunkSize) {
+				Chunk chunk = { count, 0, false };
+				for (uint i = first; i < first + chunkSize && i < numLights; ++i) {
+					if (Classify(constants, pass, lights[i].instanceData.posRange) == lod) {
+						expected[count + chunk.count++] = lights[i].instanceData;
+					}
+				}
+				count += chunk.count;
+				// groups without lights of the bucket don't touch it
+				if (chunk.count) {
+					chunks.push_back(chunk);
+				}
+			}
+			if (count != gpuCounts[command]) {
+				return false;
+			}
+			// walk the bucket, every position has to start a chunk which wasn't matched yet
+			const LightInstanceData* bucket = gpuOutput + command * numLights;
+			uint pos = 0;
+			while (pos < count) {
+				bool isFound = false;
+				for (Chunk& chunk : chunks) {
+					if (chunk.isMatched || pos + chunk.count > count) {
+						continue;
+					}
+					if (!memcmp(&expected[chunk.offset], &bucket[pos], chunk.count * sizeof(LightInstanceData))) {
+						chunk.isMatched = true;
+						pos += chunk.count;
+						isFound = true;
+						break;
+					}
+				}
+				if (!isFound) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+};
+
+#endif // __LIGHTCULLINGEMULATOR_H__
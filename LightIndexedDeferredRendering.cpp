@@ -11,9 +11,12 @@
 
 #include "stdafx.h"
 #include "LightIndexedDeferredRendering.h"
+#include "Hasher.h"
 #include "Timer.h"
-
-//#define GPU_CULLING
+#include "MeshOptimizer.h"
+#include "GridGenerator.h"
+#include <future>
+#include <utility>
 
 //#define USE_PERSPECTIVE_RIGHT_HANDLED
 
@@ -43,24 +46,37 @@ namespace {
 	static const UINT compileFlags = 0;
 #endif
 
-	// Standart vertex(textured vertex with Normal)
-	struct Vertex {
-		//
-		static const uint NormalOffset = sizeof(Vector3D);
-		//
-		static const uint TexCoordOffset = 2 * sizeof(Vector3D);
-		// vertex position
-		Vector3D position;
-		// normal
-		Vector3D normal;
-		// tex coords
-		Vector2D tvert;
-	};
 	Timer timer;
 	float emulationTime = 0.1f;
 
 	static const uint numLights = LightIndexedDeferredRendering::maxLights;
 
+	// Light index is written to the light buffer as color, 2 bits per channel
+	constexpr Vector4D LightIndexColor(uint lightIndex)
+	{
+		return Vector4D(((lightIndex & (0x3 << 0)) << 6) / 255.0f,
+			((lightIndex & (0x3 << 2)) << 4) / 255.0f,
+			((lightIndex & (0x3 << 4)) << 2) / 255.0f,
+			((lightIndex & (0x3 << 6)) << 0) / 255.0f);
+	}
+	template <size_t... Indices>
+	constexpr std::array<Vector4D, sizeof...(Indices)> MakeLightIndexColors(std::index_sequence<Indices...>)
+	{
+		return {{ LightIndexColor(Indices)... }};
+	}
+	// colors of all light indices are built at compile time
+	constexpr std::array<Vector4D, numLights> LightIndexColors = MakeLightIndexColors(std::make_index_sequence<numLights>());
+	static_assert(LightIndexColors[0].IsZero(), "light index 0 must be black");
+	static_assert(LightIndexColors[0x1B] == Vector4D(192.0f / 255.0f, 128.0f / 255.0f, 64.0f / 255.0f, 0.0f), "invalid bits of the light index color");
+
+	// radius of lights drawn by every light pass, 0 is range of the light
+	const float LightPassRadius[IndirectLightCommands::NumPasses] = { 0.0f, 1.0f };
+	// rings and sectors of the light sphere of every LOD
+	const uint LightLodRings[IndirectLightCommands::NumLods] = { 250, 40, 12 };
+	const uint LightLodSectors[IndirectLightCommands::NumLods] = { 20, 20, 12 };
+	// next LOD is used when radius / distance of the light is below
+	const float LightLodRatios[IndirectLightCommands::NumLods - 1] = { 0.25f, 0.05f };
+
 	void outError(ID3DBlob* ppErrorMsgs)
 	{
 		if (!ppErrorMsgs) {
@@ -71,11 +87,6 @@ namespace {
 		OutputDebugStringA("\n");
 		ppErrorMsgs->Release();
 	}
-	INLINE static void TransformCoord(Vector3D& v, const Matrix4x4& mat)
-	{
-		v = v * mat;
-		v += mat.GetPosition();
-	}
 	void UpdateBuffer(ID3D12Resource* buffer, const void* data, size_t size)
 	{
 		void* pData = nullptr;
@@ -84,33 +95,20 @@ namespace {
 		memcpy(pData, data, size);
 		buffer->Unmap(0, nullptr);
 	}
-	void InitMeshData(ID3D12Device* pDevice, MeshData& meshData, const void* vertices, size_t vertexSize, const void* indices, size_t indicesSize, uint stride = static_cast<uint>(sizeof(Vector3D)))
+	void InitMeshData(StagingUploader& uploader, MeshData& meshData, const void* vertices, size_t vertexSize, const void* indices, size_t indicesSize, uint stride = static_cast<uint>(sizeof(Vector3D)), DXGI_FORMAT indexFormat = DXGI_FORMAT_R16_UINT)
 	{
-		ThrowIfFailed(pDevice->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(vertexSize),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&meshData.vb)));
-		UpdateBuffer(meshData.vb.Get(), vertices, vertexSize);
+		// static geometry lives in the default heap, the copy is done on the copy queue
+		meshData.vb.Attach(uploader.CreateBuffer(vertices, vertexSize, L"VertexBuffer"));
 
 		meshData.vbView.BufferLocation = meshData.vb->GetGPUVirtualAddress();
 		meshData.vbView.StrideInBytes = stride;
 		meshData.vbView.SizeInBytes = static_cast<UINT>(vertexSize);
 
-		ThrowIfFailed(pDevice->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-			D3D12_HEAP_FLAG_NONE,
-			&CD3DX12_RESOURCE_DESC::Buffer(indicesSize),
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&meshData.ib)));
-		UpdateBuffer(meshData.ib.Get(), indices, indicesSize);
+		meshData.ib.Attach(uploader.CreateBuffer(indices, indicesSize, L"IndexBuffer"));
 
 		meshData.ibView.BufferLocation = meshData.ib->GetGPUVirtualAddress();
 		meshData.ibView.SizeInBytes = static_cast<UINT>(indicesSize);
-		meshData.ibView.Format = DXGI_FORMAT_R16_UINT;
+		meshData.ibView.Format = indexFormat;
 	}
 	void ResetCommandList(ID3D12GraphicsCommandList* commandList, ID3D12CommandAllocator* commandAllocator)
 	{
@@ -125,213 +123,64 @@ namespace {
 		// re-recording.
 		ThrowIfFailed(commandList->Reset(commandAllocator, NULL));
 	}
-	//
-	void CreateSphere(ID3D12Device* pDevice, MeshData& meshData, uint numRings, uint numSectors, float Radius)
+	// Uploads a mesh, indices are 16 bit unless there are more vertices than they address
+	void InitMeshData(StagingUploader& uploader, MeshData& meshData, const Mesh& mesh)
 	{
-		uint numTriangles = (numRings + 1) * numSectors * 2;
-		//
-		uint numVertex = (numRings + 1) * numSectors + 2;
-		uint numVertices = numVertex;
-		meshData.numFaces = numTriangles;
-
-		assert(numVertex < USHRT_MAX && "Out Of Range");
-		const uint indicesSize = numTriangles * 3 * sizeof(ushort);
-
-		uint vertexFormatSize = sizeof(Vector3D);
-		size_t vertexSize = numVertices * vertexFormatSize;
-		size_t totalSize = vertexSize + indicesSize;
-		std::vector<ubyte> bufferData;
-		bufferData.resize(totalSize);
-		ubyte* data = bufferData.data();
-
-		Vector3D& pos = *reinterpret_cast<Vector3D *>(data);
-		//
-		// last index of last vertex
-		uint last = numVertex - 1; // Soutch 
-		const Vector3D firstPosition = Vector3D(0.0f, Radius, 0.0f);
-		const Vector3D lastPosition = Vector3D(0.0f, -Radius, 0.0f);
-		// North
-		pos = firstPosition;
-		Vector3D& lastPos = reinterpret_cast<Vector3D *>(data)[last];
-		lastPos = lastPosition;
-		const float PI = static_cast<float>(Pi);
-		//
-		float da = PI / (numRings + 2.0f);
-		float db = 2.0f * PI / numSectors;
-		float af = PI - da / 2.0f;
-		float bf = 2.0f * PI - db / 2.0f;
-		//
-		uint n = 1;
-		//
-		for (float a = da; a < af; a += da) {
-			// 
-			float y = Radius * cosf(a);
-			// 
-			float xz = Radius * sinf(a);
-			//
-			float rRadius = 1.0f / Radius;
-			// 
-			for (float b = 0.0; b < bf; n++, b += db) {
-				//
-				float x = xz * sinf(b);
-				float z = xz * cosf(b);
-				size_t Index = n * vertexFormatSize;
-				Vector3D& position = *reinterpret_cast<Vector3D *>(&data[Index]);
-				assert(Index + vertexFormatSize < bufferData.size() && "Out Of Range");
-				position = Vector3D(x, y, z);
-			}
-		}
-		//
-		struct Face {
-			ushort i1;
-			ushort i2;
-			ushort i3;
-		};
-		Face* t = reinterpret_cast<Face *>(&bufferData[vertexSize]);
-		memset(t, 0, indicesSize);
-		// num sectors
-		for (n = 0; n < numSectors; n += 3) {
-			//
-			t[n].i1 = 0;
-			//
-			t[n].i2 = n + 1;
-			//
-			t[n].i3 = n == numSectors - 1 ? 1 : n + 2;
-			//
-			t[numTriangles - numSectors + n].i1 = numVertex - 1;
-			t[numTriangles - numSectors + n].i2 = numVertex - 2 - n;
-			t[numTriangles - numSectors + n].i3 = numVertex - 2 - ((1 + n) % numSectors);
-		}
-		//
-		int k = 1;
-		// numSectors
-		//S' n = numSectors;
-		for (uint i = 0; i < numRings; i++, k += numSectors) {
-			for (uint j = 0; j < numSectors; j++, n += 2) {
-				//
-				t[n].i1 = k + j;
-				//
-				t[n].i2 = k + numSectors + j;
-				//
-				t[n].i3 = k + numSectors + ((j + 1) % numSectors);
-				//
-				t[n + 1].i1 = t[n].i1;
-				t[n + 1].i2 = t[n].i3;
-				t[n + 1].i3 = k + ((j + 1) % numSectors);
-			}
+		meshData.numFaces = mesh.GetNumFaces();
+		if (mesh.Needs32BitIndices()) {
+			InitMeshData(uploader, meshData, mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size() * sizeof(uint), mesh.stride, DXGI_FORMAT_R32_UINT);
+			return;
 		}
-
-		InitMeshData(pDevice, meshData, bufferData.data(), vertexSize, t, indicesSize);
+		const std::vector<ushort> indices(mesh.indices.begin(), mesh.indices.end());
+		InitMeshData(uploader, meshData, mesh.vertices.data(), mesh.vertices.size(), indices.data(), indices.size() * sizeof(ushort), mesh.stride);
 	}
-	//
-	void CreatePlane(ID3D12Device* pDevice, MeshData& meshData, uint width, uint height, uint stepX, uint stepZ, const Vector3D& normal, float d)
+	// generated meshes are drawn in every pass, they are reordered for the vertex cache
+	void CreateSphere(StagingUploader& uploader, MeshData& meshData, const VertexFormat& format, uint numRings, uint numSectors, float Radius)
 	{
-		assert(width && "Invalid Value");
-		assert(height && "Invalid Value");
-		//
-		float tu = 1.0f / width;
-		float tv = 1.0f / height;
-		assert(stepX && "Invalid Value");
-		assert(stepZ && "Invalid Value");
-
-		assert(!(width % stepX) && "Invalid Value");
-		assert(!(height % stepZ) && "Invalid Value");
-
-		uint StepWidth = width / stepX + 1;
-		uint StepHeight = height / stepZ + 1;
-		// total vertexs
-		uint numVertexs = StepWidth * StepHeight;
-		// size of vertex data
-		uint VertexDataSize = sizeof(Vertex) * numVertexs;
-		uint numPolygons = 2 * (StepWidth - 1) * (StepHeight - 1);
-		meshData.numFaces = numPolygons;
-		uint NumIndices = numPolygons * 3;
-		// size of index data
-		uint IndexDataSize = NumIndices * sizeof(short);
-		std::vector<ubyte> bufferData;
-		size_t totalSize = IndexDataSize + VertexDataSize;
-		bufferData.resize(totalSize);
-		ubyte* data = bufferData.data();
-		Vertex* vertexs = reinterpret_cast<Vertex *>(data);
-		memset(vertexs, 0, VertexDataSize);
-		ushort* indices = reinterpret_cast<ushort *>(data + VertexDataSize);
-		assert(vertexs && "NULL Pointer");
-		assert(indices && "NULL Pointer");
-		uint vertexIndex = 0;
-		uint numIndices = 0;
-		// Fill Vertex and indices
-		int halfHeight = height >> 1;
-		int halfWidth = width >> 1;
-		for (int i = -halfHeight; i <= halfHeight; i += stepX) {
-			for (int j = -halfWidth; j <= halfWidth; j += stepZ) {
-				assert(vertexIndex < numVertexs && "Out Of Range");
-				Vertex& v = vertexs[vertexIndex];
-				v.position = Vector3D(static_cast<float>(i), 0.0f, static_cast<float>(j));
-				v.tvert.x = tv * (i + halfHeight);
-				v.tvert.y = tu * (j + halfWidth);
-				vertexIndex++;
-			}
-		}
-		uint vertexHOffset = 0;
-		uint kOffset = height / stepZ + 1;
-		vertexIndex = 0;
-		//uint Step = (stepZ % 2) ? 0 : 1;
-		for (uint i = 0; i < height; i += stepZ) {
-			vertexIndex = vertexHOffset;
-			for (uint j = 0; j < width; j += stepX) {
-
-				assert(numIndices < NumIndices && "Out Of Range");
-				indices[numIndices] = vertexIndex;
-
-				assert(numIndices + 1 < NumIndices && "Out Of Range");
-				indices[numIndices + 1] = vertexIndex + StepHeight;
-
-				assert(numIndices + 2 < NumIndices && "Out Of Range");
-				indices[numIndices + 2] = vertexIndex + StepHeight + 1;
-
-				assert(numIndices + 3 < NumIndices && "Out Of Range");
-				indices[numIndices + 3] = vertexIndex + StepHeight + 1;
-
-				assert(numIndices + 4 < NumIndices && "Out Of Range");
-				indices[numIndices + 4] = vertexIndex + 1;
-
-				assert(numIndices + 5 < NumIndices && "Out Of Range");
-				indices[numIndices + 5] = vertexIndex;
-
-				numIndices += 6;
-				vertexIndex++;
-			}
-			vertexHOffset += kOffset;
-		}
-		//MemoryUtils::CheckMemory();
-		numIndices = 3 * numPolygons;
-		for (uint i = 0; i < numIndices; i += 3) {
-			// 1 index
-			ushort index0 = indices[i + 0];
-			// 2 index
-			ushort index1 = indices[i + 1];
-			// 3 index
-			ushort index2 = indices[i + 2];
-			assert(index0 < numVertexs && "Out Of Range");
-			Vertex& V0 = vertexs[index0];
-			assert(index1 < numVertexs && "Out Of Range");
-			Vertex& V1 = vertexs[index1];
-			assert(index2 < numVertexs && "Out Of Range");
-			Vertex& V2 = vertexs[index2];
-			const Vector3D& normal = Vector3D::Y();
-			V0.normal = normal;
-			V1.normal = normal;
-			V2.normal = normal;
+		Mesh mesh;
+		MeshGenerator::CreateSphere(mesh, numRings, numSectors, Radius);
+		MeshOptimizer::Optimize(mesh);
+		format.Encode(mesh);
+		InitMeshData(uploader, meshData, mesh);
+	}
+	// sections of the mapped file are copied to upload memory as they are
+	void InitMeshData(StagingUploader& uploader, MeshData& meshData, const MeshFile& file)
+	{
+		const MeshFile::Header& header = file.GetHeader();
+		meshData.numFaces = header.numIndices / 3;
+		InitMeshData(uploader, meshData, file.GetSection(MeshFile::Vertices), file.GetSectionSize(MeshFile::Vertices), file.GetSection(MeshFile::Indices), file.GetSectionSize(MeshFile::Indices),
+			header.stride, header.indexSize == sizeof(uint) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT);
+	}
+	// the ground is split in meshlets culled on the CPU, vertices stay in floats
+	// until the bounds of the vertex format are set
+	void CreatePlane(Mesh& mesh, std::vector<Meshlet>& meshlets, uint width, uint height, uint stepX, uint stepZ, const Vector3D& normal, float d)
+	{
+		assert(!(width % stepX) && !(height % stepZ) && "Invalid Value");
+		GridGenerator::Desc desc;
+		desc.numCellsX = width / stepX;
+		desc.numCellsZ = height / stepZ;
+		desc.cellSize = Vector2D(static_cast<float>(stepX), static_cast<float>(stepZ));
+		desc.origin = Vector3D(-0.5f * width, 0.0f, -0.5f * height);
+		GridGenerator::Create(mesh, desc);
+		MeshOptimizer::Optimize(mesh);
+		std::vector<uint> meshletVertices;
+		MeshOptimizer::BuildMeshlets(mesh, meshlets, meshletVertices);
+		assert(MeshOptimizer::ValidateMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.stride, meshlets, meshletVertices) && "Invalid Value");
+	}
+	// input elements of the first vertex stream
+	void GetInputElements(const VertexFormat& format, std::vector<D3D12_INPUT_ELEMENT_DESC>& elements)
+	{
+		static const DXGI_FORMAT Formats[VertexFormat::NumElementFormats] = {
+			DXGI_FORMAT_R32G32_FLOAT,
+			DXGI_FORMAT_R32G32B32_FLOAT,
+			DXGI_FORMAT_R16G16B16A16_SNORM,
+			DXGI_FORMAT_R16G16_SNORM,
+			DXGI_FORMAT_R16G16_FLOAT
+		};
+		for (uint i = 0; i < format.GetNumElements(); ++i) {
+			const VertexFormat::Element& element = format.GetElement(i);
+			elements.push_back({ VertexFormat::GetSemanticName(element.attribute), 0, Formats[element.format], 0, element.offset, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
 		}
-		InitMeshData(pDevice, meshData, bufferData.data(), VertexDataSize, indices, IndexDataSize, sizeof(Vertex));
-		//for(size_t i = 0; i < numVertexs; ++i) {
-		//	Vector3D& normal = vertexs[i].normal;
-		//	if (normal.y < 0.0f) {
-		//		normal.y = - normal.y;
-		//	}
-		//	//assert(vertices[i].normal.y >= 0.0f);
-		//	normal.Normalize();
-		//}
 	}
 
 }
@@ -376,6 +225,7 @@ void PerspectiveMatrix(float* Matrix, float fov, float aspect, float zNear, floa
 
 void LightIndexedDeferredRendering::InitCamera()
 {
+	PROFILE_FUNCTION();
 	camera.SetAspect(m_viewport.Width / m_viewport.Height);
 	Matrix4x4& m = camera.GetProjectionMatrix();
 #ifndef USE_PERSPECTIVE_RIGHT_HANDLED
@@ -389,13 +239,26 @@ void LightIndexedDeferredRendering::InitCamera()
 
 void LightIndexedDeferredRendering::OnInit()
 {
+#ifdef USE_PROFILER
+	Profiler::SetThreadName("Main");
+	// init is recorded until the settings tell whether it is kept
+	Profiler::StartCapture(0, nullptr);
+#endif
 	timer.Init();
 	InitCamera();
     LoadPipeline();
     LoadAssets();
+#ifdef USE_PROFILER
+	if (m_isStartupProfiled) {
+		Profiler::StartCapture(m_profileFrames, m_profileFileName.c_str());
+	}
+	else {
+		Profiler::CancelCapture();
+	}
+#endif
 }
 
-ID3D12Resource* LightIndexedDeferredRendering::CreateConstantBuffer(size_t size)
+ID3D12Resource* LightIndexedDeferredRendering::CreateConstantBuffer(size_t size, bool createView)
 {
 	ID3D12Resource* constantBuffer = nullptr;
 	// CB size is required to be 256-byte aligned.
@@ -407,6 +270,10 @@ ID3D12Resource* LightIndexedDeferredRendering::CreateConstantBuffer(size_t size)
 		D3D12_RESOURCE_STATE_GENERIC_READ,
 		nullptr,
 		IID_PPV_ARGS(&constantBuffer)));
+	if (!createView) {
+		// bound as root descriptor
+		return constantBuffer;
+	}
 
 	// Describe and create a constant buffer view.
 	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
@@ -418,6 +285,451 @@ ID3D12Resource* LightIndexedDeferredRendering::CreateConstantBuffer(size_t size)
 	return constantBuffer;
 }
 
+ComPtr<ID3DBlob> LightIndexedDeferredRendering::LoadShader(const char* source, size_t sourceSize, const char* sourceName, const D3D_SHADER_MACRO* defines, const char* entryPoint, const char* target)
+{
+	assert(source && "NULL Pointer");
+	ShaderCache::Defines cacheDefines;
+	for (const D3D_SHADER_MACRO* define = defines; define && define->Name; ++define) {
+		cacheDefines.emplace_back(define->Name, define->Definition ? define->Definition : "");
+	}
+	// FXC is linked, its version is the salt of the cache; DXC is loaded at run time
+	const bool isDXIL = target[3] >= '6';
+	const uint64 key = m_shaderCache.MakeKey(source, sourceSize, cacheDefines, entryPoint, target, compileFlags, isDXIL ? m_dxcVersion : 0);
+
+	ComPtr<ID3DBlob> shader;
+	ShaderCache::Blob data;
+	if (m_shaderCache.Load(key, data)) {
+		ThrowIfFailed(D3DCreateBlob(data.size(), &shader));
+		memcpy(shader->GetBufferPointer(), data.data(), data.size());
+		return shader;
+	}
+	// FXC compiles up to shader model 5.1
+	if (isDXIL) {
+		shader = CompileDXIL(source, sourceSize, sourceName, defines, entryPoint, target);
+	}
+	else {
+		ID3DBlob* ppErrorMsgs = nullptr;
+		HRESULT hr = D3DCompile(source, sourceSize, sourceName, defines, nullptr, entryPoint, target, compileFlags, 0, &shader, &ppErrorMsgs);
+		outError(ppErrorMsgs);
+		ThrowIfFailed(hr);
+	}
+	m_shaderCache.Store(key, shader->GetBufferPointer(), shader->GetBufferSize());
+	return shader;
+}
+
+ComPtr<ID3DBlob> LightIndexedDeferredRendering::CompileDXIL(const char* source, size_t sourceSize, const char* sourceName, const D3D_SHADER_MACRO* defines, const char* entryPoint, const char* target)
+{
+	assert(m_dxcCreateInstance && "NULL Pointer");
+	// a compiler per call, the variants are compiled by several threads
+	ComPtr<IDxcCompiler3> compiler;
+	ThrowIfFailed(m_dxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler)));
+	// the dxc command line
+	const auto toWide = [](const char* text) { return std::wstring(text, text + strlen(text)); };
+	std::vector<std::wstring> args = { toWide(sourceName), L"-E", toWide(entryPoint), L"-T", toWide(target) };
+	for (const D3D_SHADER_MACRO* define = defines; define && define->Name; ++define) {
+		args.push_back(L"-D");
+		args.push_back(toWide(define->Name) + L"=" + toWide(define->Definition ? define->Definition : ""));
+	}
+#if defined(_DEBUG)
+	args.push_back(L"-Zi");
+	args.push_back(L"-Od");
+#endif
+	std::vector<LPCWSTR> argPointers;
+	for (const std::wstring& arg : args) {
+		argPointers.push_back(arg.c_str());
+	}
+	const DxcBuffer buffer = { source, sourceSize, DXC_CP_ACP };
+	ComPtr<IDxcResult> result;
+	ThrowIfFailed(compiler->Compile(&buffer, argPointers.data(), static_cast<UINT32>(argPointers.size()), nullptr, IID_PPV_ARGS(&result)));
+	ComPtr<IDxcBlobUtf8> errors;
+	if (SUCCEEDED(result->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&errors), nullptr)) && errors && errors->GetStringLength()) {
+		OutputDebugStringA("Compilation error\n");
+		OutputDebugStringA(errors->GetStringPointer());
+		OutputDebugStringA("\n");
+	}
+	HRESULT hr = S_OK;
+	ThrowIfFailed(result->GetStatus(&hr));
+	ThrowIfFailed(hr);
+	ComPtr<IDxcBlob> object;
+	ThrowIfFailed(result->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&object), nullptr));
+	ComPtr<ID3DBlob> shader;
+	ThrowIfFailed(D3DCreateBlob(object->GetBufferSize(), &shader));
+	memcpy(shader->GetBufferPointer(), object->GetBufferPointer(), object->GetBufferSize());
+	return shader;
+}
+
+bool LightIndexedDeferredRendering::IsWaveCullingSupported()
+{
+	// the DLLs come with the Windows SDK and have to be next to the executable,
+	// they stay loaded for the lifetime of the process
+	if (!m_dxcCreateInstance) {
+		const HMODULE dxil = LoadLibraryA("dxil.dll");
+		const HMODULE dxcompiler = dxil ? LoadLibraryA("dxcompiler.dll") : nullptr;
+		if (!dxcompiler) {
+			return false;
+		}
+		m_dxcCreateInstance = reinterpret_cast<DxcCreateInstanceProc>(GetProcAddress(dxcompiler, "DxcCreateInstance"));
+		if (!m_dxcCreateInstance) {
+			return false;
+		}
+		// another DLL next to the executable must not pick up the DXIL of this one
+		ComPtr<IDxcCompiler3> compiler;
+		ComPtr<IDxcVersionInfo> versionInfo;
+		if (SUCCEEDED(m_dxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&compiler))) && SUCCEEDED(compiler.As(&versionInfo))) {
+			UINT32 major = 0;
+			UINT32 minor = 0;
+			ThrowIfFailed(versionInfo->GetVersion(&major, &minor));
+			Hasher hasher;
+			hasher.Add(static_cast<uint64>(major) << 32 | minor);
+			// builds of the same version differ by the commit
+			ComPtr<IDxcVersionInfo2> versionInfo2;
+			UINT32 commitCount = 0;
+			char* commitHash = nullptr;
+			if (SUCCEEDED(compiler.As(&versionInfo2)) && SUCCEEDED(versionInfo2->GetCommitInfo(&commitCount, &commitHash))) {
+				hasher.Add(static_cast<uint64>(commitCount));
+				hasher.Add(commitHash);
+				CoTaskMemFree(commitHash);
+			}
+			m_dxcVersion = hasher.Get();
+		}
+	}
+	D3D12_FEATURE_DATA_SHADER_MODEL shaderModel = { D3D_SHADER_MODEL_6_0 };
+	D3D12_FEATURE_DATA_D3D12_OPTIONS1 options = {};
+	return SUCCEEDED(m_device->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &shaderModel, sizeof(shaderModel))) && shaderModel.HighestShaderModel >= D3D_SHADER_MODEL_6_0 &&
+		SUCCEEDED(m_device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS1, &options, sizeof(options))) && options.WaveOps;
+}
+
+std::string LightIndexedDeferredRendering::ReadShaderSource(const wchar_t* fileName)
+{
+	// shader source is a part of the cache key, so the file is always read
+	byte* data = nullptr;
+	UINT size = 0;
+	ThrowIfFailed(ReadDataFromFile(GetAssetFullPath(fileName).c_str(), &data, &size));
+	const std::string source(reinterpret_cast<const char *>(data), size);
+	free(data);
+	return source;
+}
+
+ComPtr<ID3DBlob> LightIndexedDeferredRendering::LoadShaderFromFile(const wchar_t* fileName, const D3D_SHADER_MACRO* defines, const char* entryPoint, const char* target, const std::string& header)
+{
+	// generated code of the header goes before the file
+	const std::string source = header + ReadShaderSource(fileName);
+	const std::string sourceName(fileName, fileName + wcslen(fileName));
+	return LoadShader(source.c_str(), source.size(), sourceName.c_str(), defines, entryPoint, target);
+}
+
+void LightIndexedDeferredRendering::LoadShaderVariants(ShaderVariants& shaders, const ShaderPermutation& permutation, const std::string& source, const char* sourceName, const char* entryPoint, const char* target)
+{
+	PROFILE_FUNCTION();
+	// D3DCompile and the shader cache are thread safe, every variant is compiled
+	// (or loaded from the cache) by its own task
+	const uint numVariants = permutation.GetNumVariants();
+	std::vector<std::future<ComPtr<ID3DBlob> > > tasks;
+	tasks.reserve(numVariants);
+	for (uint i = 0; i < numVariants; ++i) {
+		const ShaderPermutation::VariantKey key = permutation.GetVariant(i);
+		tasks.push_back(std::async(std::launch::async, [this, &permutation, &source, sourceName, entryPoint, target, key]()
+		{
+			PROFILE_SCOPE("LoadShaderVariant");
+			std::vector<D3D_SHADER_MACRO> macros;
+			permutation.GetMacros(key, macros);
+			return LoadShader(source.c_str(), source.size(), sourceName, macros.data(), entryPoint, target);
+		}));
+	}
+	for (uint i = 0; i < numVariants; ++i) {
+		// rethrows compilation errors of the task
+		shaders[permutation.GetVariant(i)] = tasks[i].get();
+	}
+}
+
+ID3D12PipelineState* LightIndexedDeferredRendering::GetScenePipeline() const
+{
+	PipelineVariants::const_iterator it = m_scenePipelines.find(m_sceneVariants[m_lightingMode]);
+	assert(it != m_scenePipelines.end() && "Invalid Value");
+	return it->second.Get();
+}
+
+void LightIndexedDeferredRendering::InitPipelineLibrary()
+{
+	m_pipelineLibraryData.clear();
+	m_isPipelineLibraryDirty = false;
+	HRESULT hr = E_FAIL;
+	if (m_shaderCache.Load(m_shaderCache.MakeKey(PipelineLibraryName), m_pipelineLibraryData)) {
+		// library keeps pointer to the data, m_pipelineLibraryData must outlive it
+		hr = m_device->CreatePipelineLibrary(m_pipelineLibraryData.data(), m_pipelineLibraryData.size(), IID_PPV_ARGS(&m_pipelineLibrary));
+		if (FAILED(hr)) {
+			// D3D12_ERROR_DRIVER_VERSION_MISMATCH, D3D12_ERROR_ADAPTER_NOT_FOUND or corrupted blob
+			LogMsg("Pipeline library is invalid (0x%08X), rebuilding\n", static_cast<uint>(hr));
+			m_pipelineLibraryData.clear();
+		}
+	}
+	if (FAILED(hr)) {
+		hr = m_device->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&m_pipelineLibrary));
+		if (FAILED(hr)) {
+			// e.g. not supported under graphics debugging tools, PSOs are created directly
+			m_pipelineLibrary.Reset();
+		}
+	}
+}
+
+void LightIndexedDeferredRendering::SavePipelineLibrary()
+{
+	if (!m_pipelineLibrary || !m_isPipelineLibraryDirty) {
+		return;
+	}
+	ShaderCache::Blob data(m_pipelineLibrary->GetSerializedSize());
+	if (SUCCEEDED(m_pipelineLibrary->Serialize(data.data(), data.size()))) {
+		m_shaderCache.Store(m_shaderCache.MakeKey(PipelineLibraryName), data.data(), data.size());
+		m_isPipelineLibraryDirty = false;
+	}
+}
+
+void LightIndexedDeferredRendering::StorePipeline(const std::wstring& name, ID3D12PipelineState* pipelineState)
+{
+	if (!m_pipelineLibrary) {
+		return;
+	}
+	m_libraryPipelines[name] = pipelineState;
+	if (SUCCEEDED(m_pipelineLibrary->StorePipeline(name.c_str(), pipelineState))) {
+		m_isPipelineLibraryDirty = true;
+		return;
+	}
+	// the name is in the library with another description (root signature, states or
+	// formats changed), names can't be replaced, so the library is built again from the
+	// pipelines of this run; the others are stored again when they are created
+	LogMsg("Pipeline %ls changed, rebuilding the pipeline library\n", name.c_str());
+	m_pipelineLibrary.Reset();
+	m_pipelineLibraryData.clear();
+	if (FAILED(m_device->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&m_pipelineLibrary)))) {
+		m_pipelineLibrary.Reset();
+		return;
+	}
+	for (const auto& it : m_libraryPipelines) {
+		m_pipelineLibrary->StorePipeline(it.first.c_str(), it.second.Get());
+	}
+	m_isPipelineLibraryDirty = true;
+}
+
+std::wstring LightIndexedDeferredRendering::GetPipelineName(const wchar_t* name, const D3D12_SHADER_BYTECODE* shaders, size_t numShaders) const
+{
+	// Bytecode hash in the name makes changed shaders miss the library instead of failing
+	// the description check. Other changes of the description fail LoadPipeline, the PSO
+	// is created directly and StorePipeline rebuilds the library.
+	Hasher hasher;
+	for (size_t i = 0; i < numShaders; ++i) {
+		hasher.Add(shaders[i].pShaderBytecode, shaders[i].BytecodeLength);
+	}
+	wchar_t hash[20];
+	swprintf_s(hash, L"_%016llx", static_cast<unsigned long long>(hasher.Get()));
+	return std::wstring(name) + hash;
+}
+
+ComPtr<ID3D12PipelineState> LightIndexedDeferredRendering::CreatePipeline(const wchar_t* name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	ComPtr<ID3D12PipelineState> pipelineState;
+	const D3D12_SHADER_BYTECODE shaders[] = { desc.VS, desc.PS };
+	const std::wstring pipelineName = GetPipelineName(name, shaders, _countof(shaders));
+	if (m_pipelineLibrary && SUCCEEDED(m_pipelineLibrary->LoadGraphicsPipeline(pipelineName.c_str(), &desc, IID_PPV_ARGS(&pipelineState)))) {
+		m_libraryPipelines[pipelineName] = pipelineState;
+		return pipelineState;
+	}
+	ThrowIfFailed(m_device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pipelineState)));
+	StorePipeline(pipelineName, pipelineState.Get());
+	return pipelineState;
+}
+
+ComPtr<ID3D12PipelineState> LightIndexedDeferredRendering::CreatePipeline(const wchar_t* name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+	ComPtr<ID3D12PipelineState> pipelineState;
+	const std::wstring pipelineName = GetPipelineName(name, &desc.CS, 1);
+	if (m_pipelineLibrary && SUCCEEDED(m_pipelineLibrary->LoadComputePipeline(pipelineName.c_str(), &desc, IID_PPV_ARGS(&pipelineState)))) {
+		m_libraryPipelines[pipelineName] = pipelineState;
+		return pipelineState;
+	}
+	ThrowIfFailed(m_device->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pipelineState)));
+	StorePipeline(pipelineName, pipelineState.Get());
+	return pipelineState;
+}
+
+ComPtr<ID3D12PipelineState> LightIndexedDeferredRendering::CreatePipeline(const wchar_t* name, const D3D12_PIPELINE_STATE_STREAM_DESC& desc, const D3D12_SHADER_BYTECODE& vs, const D3D12_SHADER_BYTECODE& ps)
+{
+	ComPtr<ID3D12PipelineState> pipelineState;
+	const D3D12_SHADER_BYTECODE shaders[] = { vs, ps };
+	const std::wstring pipelineName = GetPipelineName(name, shaders, _countof(shaders));
+	if (m_pipelineLibrary && SUCCEEDED(m_pipelineLibrary->LoadPipeline(pipelineName.c_str(), &desc, IID_PPV_ARGS(&pipelineState)))) {
+		m_libraryPipelines[pipelineName] = pipelineState;
+		return pipelineState;
+	}
+	ThrowIfFailed(m_device->CreatePipelineState(&desc, IID_PPV_ARGS(&pipelineState)));
+	StorePipeline(pipelineName, pipelineState.Get());
+	return pipelineState;
+}
+
+void LightIndexedDeferredRendering::LoadSettings(const char* fileName)
+{
+	FILE* f = fopen(fileName, "r");
+	if (!f) {
+		return;
+	}
+	// "Name values" per line, unknown and invalid settings are reported and skipped
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		char name[64];
+		int offset = 0;
+		if (sscanf(line, "%63s%n", name, &offset) != 1 || name[0] == '#') {
+			continue;
+		}
+		const char* value = line + offset;
+		bool isValid = true;
+		if (!strcmp(name, "LightSourceRadiusRange")) {
+			float minR = 0.0f;
+			float maxR = 0.0f;
+			isValid = sscanf(value, "%f %f", &minR, &maxR) == 2 && minR > 0.0f && minR <= maxR;
+			if (isValid) {
+				m_lightingData.radiuseRange.x = minR;
+				m_lightingData.radiuseRange.y = maxR;
+			}
+		}
+		else if (!strcmp(name, "NumLightSources")) {
+			uint numLightSources = 0;
+			isValid = sscanf(value, "%u", &numLightSources) == 1 && numLightSources && numLightSources <= maxLights;
+			if (isValid) {
+				m_lightingData.numLights = numLightSources;
+			}
+		}
+		else if (!strcmp(name, "CullingMode")) {
+			char mode[16];
+			isValid = sscanf(value, "%15s", mode) == 1 && (!strcmp(mode, "CPU") || !strcmp(mode, "GPU"));
+			if (isValid) {
+				m_cullingMode = !strcmp(mode, "GPU") ? GPUCulling : CPUCulling;
+			}
+		}
+		else if (!strcmp(name, "VertexFormat")) {
+			char format[16];
+			isValid = sscanf(value, "%15s", format) == 1;
+			uint quantization = 0;
+			while (isValid && quantization < VertexFormat::NumQuantizations && strcmp(format, VertexFormat::GetName(static_cast<VertexFormat::Quantization>(quantization)))) {
+				++quantization;
+			}
+			isValid = isValid && quantization < VertexFormat::NumQuantizations;
+			if (isValid) {
+				m_vertexQuantization = static_cast<VertexFormat::Quantization>(quantization);
+			}
+		}
+		else if (!strcmp(name, "SceneMesh")) {
+			char sceneMesh[200];
+			isValid = sscanf(value, "%199s", sceneMesh) == 1;
+			if (isValid) {
+				m_sceneMeshFileName = sceneMesh;
+			}
+		}
+		else if (!strcmp(name, "GroundCellSize")) {
+			uint cellSize = 0;
+			isValid = sscanf(value, "%u", &cellSize) == 1 && cellSize && !(GroundSize % cellSize);
+			if (isValid) {
+				m_groundCellSize = cellSize;
+			}
+		}
+		else if (!strcmp(name, "Profile")) {
+			uint frames = 0;
+			char profileFileName[200];
+			isValid = sscanf(value, "%u %199s", &frames, profileFileName) == 2 && frames;
+			if (isValid) {
+				m_profileFrames = frames;
+				m_profileFileName = profileFileName;
+				m_isStartupProfiled = true;
+			}
+		}
+		else if (!strcmp(name, "Terrain")) {
+			int terrain = 0;
+			isValid = sscanf(value, "%d", &terrain) == 1;
+			m_isTerrainEnabled = isValid && terrain;
+		}
+		else if (!strcmp(name, "FrameStats")) {
+			char frameStatsFileName[200];
+			isValid = sscanf(value, "%199s", frameStatsFileName) == 1;
+			if (isValid) {
+				m_frameStatsFileName = frameStatsFileName;
+			}
+		}
+		else if (!strcmp(name, "FrameStatsOverlay")) {
+			int overlay = 0;
+			isValid = sscanf(value, "%d", &overlay) == 1;
+			m_isFrameStatsOverlay = isValid && overlay;
+		}
+		else if (!strcmp(name, "Benchmark")) {
+			int benchmark = 0;
+			isValid = sscanf(value, "%d", &benchmark) == 1;
+			m_isBenchmarkRequested = isValid && benchmark;
+		}
+		else {
+			LogMsg("%s: unknown setting %s\n", fileName, name);
+			continue;
+		}
+		if (!isValid) {
+			LogMsg("%s: invalid value of %s\n", fileName, name);
+		}
+	}
+	fclose(f);
+}
+
+void LightIndexedDeferredRendering::InitTimestamps()
+{
+	m_timestampSource.Init(m_device.Get(), FrameCount, NumGPUPasses * 2);
+	m_gpuTimer.Init(&m_timestampSource, NumGPUPasses, FrameCount);
+
+	// queues may tick with different frequencies
+	UINT64 frequency = 0;
+	UINT64 computeFrequency = 0;
+	ThrowIfFailed(m_commandQueue->GetTimestampFrequency(&frequency));
+	ThrowIfFailed(m_lightingData.computeCommandQueue->GetTimestampFrequency(&computeFrequency));
+	m_gpuTimer.SetPass(CullingPass, "Light culling", computeFrequency);
+	m_gpuTimer.SetPass(DepthPass, "Depth prepass", frequency);
+	m_gpuTimer.SetPass(LightVolumePass, "Light volumes", frequency);
+	m_gpuTimer.SetPass(ShadingPass, "Shading", frequency);
+	m_gpuTimer.SetPass(LightSourcePass, "Light sources", frequency);
+}
+
+double LightIndexedDeferredRendering::GetGPUFrameTime()
+{
+	// passes of the frame, the ones not rendered in its modes are not counted
+	return m_gpuTimer.GetLastFrameTime();
+}
+
+void LightIndexedDeferredRendering::StartBenchmark()
+{
+	if (m_benchmark.IsRunning()) {
+		return;
+	}
+	m_benchmarkLightsPositions = m_lightingData.lightsPositions;
+	m_benchmarkDirPosOffsets = m_lightingData.dirPosOffsets;
+	m_cullingModeBeforeBenchmark = m_cullingMode;
+	m_benchmark.Start(NumCullingModes, BenchmarkRunFrames, BenchmarkRuns, BenchmarkWarmupFrames);
+	m_cullingMode = static_cast<CullingMode>(m_benchmark.GetMode());
+	LogMsg("Culling benchmark started\n");
+}
+
+void LightIndexedDeferredRendering::UpdateBenchmark()
+{
+	if (!m_benchmark.GetRunFrame()) {
+		// every run starts from the same light positions
+		m_lightingData.lightsPositions = m_benchmarkLightsPositions;
+		m_lightingData.dirPosOffsets = m_benchmarkDirPosOffsets;
+	}
+	// fixed camera path: circle around the scene looking at its center
+	const float angle = 2.0f * Pi * m_benchmark.GetPathTime();
+	const float radius = 0.75f * coord;
+	const float height = 100.0f;
+	const Vector3D position(radius * cosf(angle), height, radius * sinf(angle));
+	Vector3D direction = -position;
+	direction.Normalize();
+	Vector3D right = crossProduct(Vector3D::Y(), direction);
+	right.Normalize();
+	camera.SetPosition(position);
+	camera.SetDirection(direction);
+	camera.SetRight(right);
+}
+
 void LightIndexedDeferredRendering::GeneratePointLights(const Vector3D& start, const Vector3D& end, const Vector2D& RadiusRange)
 {
 	srand(static_cast<uint>(time(nullptr)));
@@ -468,18 +780,20 @@ void LightIndexedDeferredRendering::GeneratePointLights(const Vector3D& start, c
 
 void LightIndexedDeferredRendering::InitLightCullingData(LightCullingData& lightCullingData)
 {
-	uint instanceLightSize = sizeof(LightInstanceData) * m_lightingData.numLights;
+	PROFILE_FUNCTION();
+	const uint instanceLightSize = sizeof(LightInstanceData) * m_lightingData.numLights;
+	const uint instanceBufferSize = instanceLightSize * IndirectLightCommands::NumCommands;
 	ThrowIfFailed(m_device->CreateCommittedResource(
 		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
 		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(instanceLightSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		&CD3DX12_RESOURCE_DESC::Buffer(instanceBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
 		nullptr,
 		IID_PPV_ARGS(&lightCullingData.lightCullingInstanceBuffer)));
 
 	lightCullingData.instanceVBView.BufferLocation = lightCullingData.lightCullingInstanceBuffer->GetGPUVirtualAddress();
 	lightCullingData.instanceVBView.StrideInBytes = static_cast<UINT>(sizeof(LightInstanceData));
-	lightCullingData.instanceVBView.SizeInBytes = instanceLightSize;
+	lightCullingData.instanceVBView.SizeInBytes = instanceBufferSize;
 
 	UINT descriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
@@ -492,17 +806,18 @@ void LightIndexedDeferredRendering::InitLightCullingData(LightCullingData& light
 	uavDesc.Buffer.FirstElement = 0;
 	uavDesc.Buffer.CounterOffsetInBytes = 0;
 	uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-	uavDesc.Buffer.NumElements = instanceLightSize / 4;
+	uavDesc.Buffer.NumElements = instanceBufferSize / 4;
 	uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
 	uavDesc.Buffer.StructureByteStride = 0;
 
 	m_device->CreateUnorderedAccessView(lightCullingData.lightCullingInstanceBuffer.Get(), nullptr, &uavDesc, m_srv_cbv_uav_descriptor);
 	m_srv_cbv_uav_descriptor.ptr += descriptorSize;
 
+	const uint indirectBufferSize = sizeof(IndirectLightCommands::Command) * IndirectLightCommands::NumCommands;
 	ThrowIfFailed(m_device->CreateCommittedResource(
 		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
 		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(sizeof(D3D12_DRAW_INDEXED_ARGUMENTS), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		&CD3DX12_RESOURCE_DESC::Buffer(indirectBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
 		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
 		nullptr,
 		IID_PPV_ARGS(&lightCullingData.lightCullingIndirectBuffer)));
@@ -510,18 +825,27 @@ void LightIndexedDeferredRendering::InitLightCullingData(LightCullingData& light
 	lightCullingData.lightCullingDescriptors[1] = m_GPUDescriptor; // Indirect Buffer
 	m_GPUDescriptor.ptr += descriptorSize;
 
-	uavDesc.Buffer.NumElements = sizeof(D3D12_DRAW_INDEXED_ARGUMENTS) / 4;
+	uavDesc.Buffer.NumElements = indirectBufferSize / 4;
 
 	m_device->CreateUnorderedAccessView(lightCullingData.lightCullingIndirectBuffer.Get(), nullptr, &uavDesc, m_srv_cbv_uav_descriptor);
 	m_srv_cbv_uav_descriptor.ptr += descriptorSize;
 
+	const uint countBufferSize = IndirectLightCommands::GetCountBufferSize();
 	ThrowIfFailed(m_device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
 		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(sizeof(D3D12_DRAW_INDEXED_ARGUMENTS)),
-		D3D12_RESOURCE_STATE_GENERIC_READ,
+		&CD3DX12_RESOURCE_DESC::Buffer(countBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
 		nullptr,
-		IID_PPV_ARGS(&lightCullingData.lightCullingUpdateIndirectBuffer)));
+		IID_PPV_ARGS(&lightCullingData.lightCullingCountBuffer)));
+
+	lightCullingData.lightCullingDescriptors[2] = m_GPUDescriptor; // Count Buffer
+	m_GPUDescriptor.ptr += descriptorSize;
+
+	uavDesc.Buffer.NumElements = countBufferSize / 4;
+
+	m_device->CreateUnorderedAccessView(lightCullingData.lightCullingCountBuffer.Get(), nullptr, &uavDesc, m_srv_cbv_uav_descriptor);
+	m_srv_cbv_uav_descriptor.ptr += descriptorSize;
 
 	ThrowIfFailed(m_device->CreateCommittedResource(
 		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
@@ -531,7 +855,7 @@ void LightIndexedDeferredRendering::InitLightCullingData(LightCullingData& light
 		nullptr,
 		IID_PPV_ARGS(&lightCullingData.lightCullingDataBuffer)));
 
-	lightCullingData.lightCullingDescriptors[2] = m_GPUDescriptor; // InstanceData Buffers
+	lightCullingData.lightCullingDescriptors[3] = m_GPUDescriptor; // InstanceData Buffers
 	m_GPUDescriptor.ptr += descriptorSize;
 
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
@@ -540,110 +864,285 @@ void LightIndexedDeferredRendering::InitLightCullingData(LightCullingData& light
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
 	srvDesc.Buffer.FirstElement = 0;
 
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+	srvDesc.Buffer.NumElements = m_lightingData.numLights;
+	srvDesc.Buffer.StructureByteStride = sizeof(CullingLightInfo);
+
+	m_device->CreateShaderResourceView(lightCullingData.lightCullingDataBuffer.Get(), &srvDesc, m_srv_cbv_uav_descriptor);
+	m_srv_cbv_uav_descriptor.ptr += descriptorSize;
+
+	// argument layout is written by the GPU, it has to match D3D12 structures
+	static_assert(sizeof(IndirectLightCommands::VertexBufferView) == sizeof(D3D12_VERTEX_BUFFER_VIEW), "VertexBufferView must match D3D12_VERTEX_BUFFER_VIEW");
+	static_assert(offsetof(IndirectLightCommands::VertexBufferView, strideInBytes) == offsetof(D3D12_VERTEX_BUFFER_VIEW, StrideInBytes), "VertexBufferView must match D3D12_VERTEX_BUFFER_VIEW");
+	static_assert(sizeof(IndirectLightCommands::IndexBufferView) == sizeof(D3D12_INDEX_BUFFER_VIEW), "IndexBufferView must match D3D12_INDEX_BUFFER_VIEW");
+	static_assert(offsetof(IndirectLightCommands::IndexBufferView, format) == offsetof(D3D12_INDEX_BUFFER_VIEW, Format), "IndexBufferView must match D3D12_INDEX_BUFFER_VIEW");
+	static_assert(sizeof(IndirectLightCommands::DrawIndexedArguments) == sizeof(D3D12_DRAW_INDEXED_ARGUMENTS), "DrawIndexedArguments must match D3D12_DRAW_INDEXED_ARGUMENTS");
+	static_assert(offsetof(IndirectLightCommands::DrawIndexedArguments, instanceCount) == offsetof(D3D12_DRAW_INDEXED_ARGUMENTS, InstanceCount), "DrawIndexedArguments must match D3D12_DRAW_INDEXED_ARGUMENTS");
+	static_assert(IndirectLightCommands::NumConstants <= LightConstantsNum32Bit, "command constants don't fit to the light pass root constants");
+
+	// every command draws the light sphere of its LOD with instances of its own region
+	IndirectLightCommands::Command templates[IndirectLightCommands::NumCommands] = {};
+	for (uint pass = 0; pass < IndirectLightCommands::NumPasses; ++pass) {
+		for (uint lod = 0; lod < IndirectLightCommands::NumLods; ++lod) {
+			const uint command = IndirectLightCommands::GetCommandIndex(pass, lod);
+			const MeshData& geometry = m_lightingData.lightGeometryData[lod];
+			const D3D12_VERTEX_BUFFER_VIEW instanceVBView = {
+				lightCullingData.instanceVBView.BufferLocation + command * instanceLightSize,
+				instanceLightSize,
+				lightCullingData.instanceVBView.StrideInBytes
+			};
+			IndirectLightCommands::Command& commandTemplate = templates[command];
+			commandTemplate.constants[0] = LightPassRadius[pass];
+			commandTemplate.constants[1] = static_cast<float>(lod);
+			memcpy(&commandTemplate.vertexBuffers[0], &geometry.vbView, sizeof(commandTemplate.vertexBuffers[0]));
+			memcpy(&commandTemplate.vertexBuffers[1], &instanceVBView, sizeof(commandTemplate.vertexBuffers[1]));
+			memcpy(&commandTemplate.indexBuffer, &geometry.ibView, sizeof(commandTemplate.indexBuffer));
+			commandTemplate.draw.indexCountPerInstance = geometry.numFaces * 3;
+		}
+	}
+	ThrowIfFailed(m_device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(sizeof(templates)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&lightCullingData.lightCullingCommandTemplates)));
+	UpdateBuffer(lightCullingData.lightCullingCommandTemplates.Get(), templates, sizeof(templates));
+
+	lightCullingData.lightCullingDescriptors[4] = m_GPUDescriptor; // Command Templates
+	m_GPUDescriptor.ptr += descriptorSize;
+
 	srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
 	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
-	srvDesc.Buffer.NumElements = instanceLightSize / 4;
+	srvDesc.Buffer.NumElements = sizeof(templates) / 4;
 	srvDesc.Buffer.StructureByteStride = 0;
 
-	m_device->CreateShaderResourceView(lightCullingData.lightCullingDataBuffer.Get(), &srvDesc, m_srv_cbv_uav_descriptor);
+	m_device->CreateShaderResourceView(lightCullingData.lightCullingCommandTemplates.Get(), &srvDesc, m_srv_cbv_uav_descriptor);
 	m_srv_cbv_uav_descriptor.ptr += descriptorSize;
 
-	lightCullingData.lightCullingDescriptors[3] = m_GPUDescriptor; // CB
-	lightCullingData.lightCullingConstantBuffer.Attach(CreateConstantBuffer(sizeof(Frustum)));
+	lightCullingData.lightCullingDescriptors[5] = m_GPUDescriptor; // CB
+	lightCullingData.lightCullingConstantBuffer.Attach(CreateConstantBuffer(sizeof(CullingConstants)));
 	m_GPUDescriptor.ptr += descriptorSize;
 }
 
 void LightIndexedDeferredRendering::InitGPULightCullng()
 {
+	PROFILE_FUNCTION();
 	ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&m_computeCommandAllocator)));
 	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, m_computeCommandAllocator.Get(), nullptr, IID_PPV_ARGS(&m_lightingData.computeCommandList)));
 	ThrowIfFailed(m_lightingData.computeCommandList->Close());
 
-	ThrowIfFailed(m_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&m_copyCommandAllocator)));
-	ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, m_copyCommandAllocator.Get(), nullptr, IID_PPV_ARGS(&m_lightingData.copyCommandList)));
-	ThrowIfFailed(m_lightingData.copyCommandList->Close());
-
 	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
 	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
 	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
 	ThrowIfFailed(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_lightingData.computeCommandQueue)));
 
+	// ClearCounts, CullLights and BuildCommands run back to back on the compute queue.
+	// One thread per light, every pass sorts the light into a LOD bucket, visible lights of
+	// a group are compacted in thread order and appended with one atomic per bucket and
+	// wave (SM 6.0) or group. LightCullingEmulator.h reproduces the output, keep them in sync.
 	const char* lightCullingShaderCodeHLSL = R"(
-		struct LightInstanceData {
-			float4 InstanceData;
-			uint lightIndex;
-		};
+		#define NUM_COMMANDS (NUM_PASSES * NUM_LODS)
+		#define MASK_WORDS (GROUP_SIZE / 32)
 		struct CullingLightInfo {
 			float4 InstanceData;
 			uint lightIndex;
 			uint padding[3];
 		};
-		struct DrawIndexedIndirectCommand {
-			uint indexCount;
-			uint instanceCount;
-			uint firstIndex;
-			int  vertexOffset;
-			uint firstInstance;
-		};
 		static const uint numPlanes = 6;
-		struct Frustum {
-			float4 planes[numPlanes];
-		};
 		RWByteAddressBuffer instanceVB : register(u0);
-		RWByteAddressBuffer numObjects : register(u1);
+		RWByteAddressBuffer commands : register(u1);
+		// command count of every pass followed by instance count of every command
+		RWByteAddressBuffer counts : register(u2);
 		StructuredBuffer<CullingLightInfo> cullingLightInfo : register(t0);
+		ByteAddressBuffer commandTemplates : register(t1);
 		cbuffer CBuffer : register(b0) {
-			Frustum frustum;
+			float4 planes[numPlanes];
+			float4 cameraPosition;
+			float4 lodThresholds;
+			float4 passRadius;
+			uint numLights;
 		};
 
-		inline float SignedDistanceToPoint(const float4 plane, const float3 p) {
-			return dot(plane.xyz, p) + plane.w;
+		inline bool SphereInFrustum(const float3 center, const float radius) {
+			bool res = true;
+			[unroll]
+			for (uint i = 0; i < numPlanes; ++i) {
+				// precise keeps the evaluation order of the CPU emulation
+				precise float d = planes[i].x * center.x + planes[i].y * center.y;
+				d = d + planes[i].z * center.z;
+				d = d + planes[i].w;
+				res = res && d > -radius;
+			}
+			return res;
 		}
 
-		inline bool SphereInFrustum(const float4 boundingSphere) {
-		[unroll]
-		bool res = true;
-		for (uint i = 0; i < numPlanes; ++i) {
-			res = SignedDistanceToPoint(frustum.planes[i], boundingSphere.xyz) > -boundingSphere.w;
-			if (!res) {
-				break;
+		// command of the light in the pass, NUM_COMMANDS if the light is culled
+		inline uint Classify(const uint pass, const float4 posRange) {
+			const float radius = passRadius[pass] > 0.0f ? passRadius[pass] : posRange.w;
+			if (!SphereInFrustum(posRange.xyz, radius)) {
+				return NUM_COMMANDS;
 			}
+			precise float3 v = posRange.xyz - cameraPosition.xyz;
+			precise float d2 = v.x * v.x + v.y * v.y;
+			d2 = d2 + v.z * v.z;
+			precise float r2 = radius * radius;
+			uint lod = 0;
+			[unroll]
+			for (uint i = 0; i < NUM_LODS - 1; ++i) {
+				precise float t = lodThresholds[i] * d2;
+				lod += r2 < t ? 1 : 0;
+			}
+			return pass * NUM_LODS + lod;
 		}
-		return res;
+
+		static const uint float4Size = 16;
+		static const uint InstanceGPUDataSize = float4Size + 4;
+
+		// every command owns numLights instances
+		inline void StoreInstance(const uint command, const uint index, const uint light) {
+			const uint bufferIndex = (command * numLights + index) * InstanceGPUDataSize;
+			instanceVB.Store4(bufferIndex, asuint(cullingLightInfo[light].InstanceData));
+			instanceVB.Store(bufferIndex + float4Size, cullingLightInfo[light].lightIndex);
 		}
 
-		[numthreads(1, 1, 1)]
+		[numthreads(GROUP_SIZE, 1, 1)]
+		void ClearCounts(uint GI : SV_GroupIndex) {
+			if (GI < NUM_PASSES + NUM_COMMANDS) {
+				counts.Store(GI * 4, 0);
+			}
+		}
+
+	#if __SHADER_TARGET_MAJOR >= 6
+		[numthreads(GROUP_SIZE, 1, 1)]
 		void CullLights(uint3 DTid : SV_DispatchThreadID) {
-			static const uint float4Size = 16;
-			static const uint InstanceGPUDataSize = float4Size + 4;
-			if (!SphereInFrustum(cullingLightInfo[DTid.x].InstanceData)) {
-				return;
+			uint lightCommands[NUM_PASSES];
+			[unroll]
+			for (uint i = 0; i < NUM_PASSES; ++i) {
+				lightCommands[i] = DTid.x < numLights ? Classify(i, cullingLightInfo[DTid.x].InstanceData) : NUM_COMMANDS;
+			}
+			[unroll]
+			for (uint command = 0; command < NUM_COMMANDS; ++command) {
+				const bool isVisible = lightCommands[command / NUM_LODS] == command;
+				const uint count = WaveActiveCountBits(isVisible);
+				if (!count) {
+					continue;
+				}
+				uint base = 0;
+				if (WaveIsFirstLane()) {
+					counts.InterlockedAdd((NUM_PASSES + command) * 4, count, base);
+				}
+				base = WaveReadLaneFirst(base);
+				if (isVisible) {
+					StoreInstance(command, base + WavePrefixCountBits(isVisible), DTid.x);
+				}
+			}
+		}
+	#else
+		groupshared uint visibleMask[NUM_COMMANDS * MASK_WORDS];
+		groupshared uint groupBase[NUM_COMMANDS];
+
+		[numthreads(GROUP_SIZE, 1, 1)]
+		void CullLights(uint3 DTid : SV_DispatchThreadID, uint GI : SV_GroupIndex) {
+			for (uint i = GI; i < NUM_COMMANDS * MASK_WORDS; i += GROUP_SIZE) {
+				visibleMask[i] = 0;
+			}
+			GroupMemoryBarrierWithGroupSync();
+			const uint word = GI / 32;
+			const uint bit = 1u << (GI % 32);
+			uint lightCommands[NUM_PASSES];
+			[unroll]
+			for (uint j = 0; j < NUM_PASSES; ++j) {
+				lightCommands[j] = DTid.x < numLights ? Classify(j, cullingLightInfo[DTid.x].InstanceData) : NUM_COMMANDS;
+				if (lightCommands[j] < NUM_COMMANDS) {
+					InterlockedOr(visibleMask[lightCommands[j] * MASK_WORDS + word], bit);
+				}
+			}
+			GroupMemoryBarrierWithGroupSync();
+			if (GI < NUM_COMMANDS) {
+				uint count = 0;
+				[unroll]
+				for (uint k = 0; k < MASK_WORDS; ++k) {
+					count += countbits(visibleMask[GI * MASK_WORDS + k]);
+				}
+				uint base = 0;
+				if (count) {
+					counts.InterlockedAdd((NUM_PASSES + GI) * 4, count, base);
+				}
+				groupBase[GI] = base;
 			}
-			uint bufferIndex = 0;
-			numObjects.InterlockedAdd(4u, 1u, bufferIndex);
-			bufferIndex *= InstanceGPUDataSize;
-			instanceVB.Store4(bufferIndex, asuint(cullingLightInfo[DTid.x].InstanceData));
-			instanceVB.Store(bufferIndex + float4Size, cullingLightInfo[DTid.x].lightIndex);
+			GroupMemoryBarrierWithGroupSync();
+			[unroll]
+			for (uint pass = 0; pass < NUM_PASSES; ++pass) {
+				const uint command = lightCommands[pass];
+				if (command < NUM_COMMANDS) {
+					const uint mask = command * MASK_WORDS;
+					uint offset = countbits(visibleMask[mask + word] & (bit - 1));
+					for (uint w = 0; w < word; ++w) {
+						offset += countbits(visibleMask[mask + w]);
+					}
+					StoreInstance(command, groupBase[command] + offset, DTid.x);
+				}
+			}
+		}
+	#endif
+
+		// commands of non empty buckets of the pass, followed by the command count
+		[numthreads(NUM_PASSES, 1, 1)]
+		void BuildCommands(uint GI : SV_GroupIndex) {
+			uint numCommands = 0;
+			for (uint lod = 0; lod < NUM_LODS; ++lod) {
+				const uint command = GI * NUM_LODS + lod;
+				const uint count = counts.Load((NUM_PASSES + command) * 4);
+				if (!count) {
+					continue;
+				}
+				const uint src = command * COMMAND_SIZE;
+				const uint dst = (GI * NUM_LODS + numCommands) * COMMAND_SIZE;
+				for (uint i = 0; i < COMMAND_SIZE; i += 4) {
+					commands.Store(dst + i, commandTemplates.Load(src + i));
+				}
+				commands.Store(dst + INSTANCE_COUNT_OFFSET, count);
+				++numCommands;
+			}
+			counts.Store(GI * 4, numCommands);
 		}
 	)";
-	ID3DBlob* ppErrorMsgs = nullptr;
-	ID3DBlob* computeShader = nullptr;
-	HRESULT hr = D3DCompile(lightCullingShaderCodeHLSL, strlen(lightCullingShaderCodeHLSL), nullptr, nullptr, nullptr, "CullLights", "cs_5_0", compileFlags, 0, &computeShader, &ppErrorMsgs);
+	// sizes of LightCullingEmulator.h and IndirectLightCommands.h
+	const std::string cullingDefines[][2] = {
+		{ "GROUP_SIZE", std::to_string(LightCullingEmulator::GroupSize) },
+		{ "NUM_PASSES", std::to_string(IndirectLightCommands::NumPasses) },
+		{ "NUM_LODS", std::to_string(IndirectLightCommands::NumLods) },
+		{ "COMMAND_SIZE", std::to_string(sizeof(IndirectLightCommands::Command)) },
+		{ "INSTANCE_COUNT_OFFSET", std::to_string(IndirectLightCommands::InstanceCountOffset) }
+	};
+	std::vector<D3D_SHADER_MACRO> macros;
+	for (const auto& define : cullingDefines) {
+		macros.push_back({ define[0].c_str(), define[1].c_str() });
+	}
+	macros.push_back({ nullptr, nullptr });
+	const size_t sourceSize = strlen(lightCullingShaderCodeHLSL);
+	// CullLights compacts the visible lights with wave intrinsics at shader model 6.0,
+	// with group shared bit masks at cs_5_0 (FXC) otherwise
+	const char* cullingTarget = IsWaveCullingSupported() ? "cs_6_0" : "cs_5_0";
+	LogMsg("Light culling: %s\n", cullingTarget);
+	ComPtr<ID3DBlob> clearShader = LoadShader(lightCullingShaderCodeHLSL, sourceSize, "CullLights.hlsl", macros.data(), "ClearCounts", cullingTarget);
+	ComPtr<ID3DBlob> computeShader = LoadShader(lightCullingShaderCodeHLSL, sourceSize, "CullLights.hlsl", macros.data(), "CullLights", cullingTarget);
+	ComPtr<ID3DBlob> buildShader = LoadShader(lightCullingShaderCodeHLSL, sourceSize, "CullLights.hlsl", macros.data(), "BuildCommands", cullingTarget);
 
 	InitLightCullingData(m_lightingData.lightCullingData);
-	InitLightCullingData(m_lightingData.lightCullingDataDebug);
 
 	CD3DX12_ROOT_PARAMETER1 rootParameters[3];
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[4];
-	ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
-	ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 1, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
-	rootParameters[0].InitAsDescriptorTable(2, &ranges[0], D3D12_SHADER_VISIBILITY_ALL);
+	CD3DX12_DESCRIPTOR_RANGE1 ranges[3];
+	ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 3, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
+	rootParameters[0].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_ALL);
 
-	ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
-	rootParameters[1].InitAsDescriptorTable(1, &ranges[2], D3D12_SHADER_VISIBILITY_ALL);
+	ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 2, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
+	rootParameters[1].InitAsDescriptorTable(1, &ranges[1], D3D12_SHADER_VISIBILITY_ALL);
 
-	ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
-	rootParameters[2].InitAsDescriptorTable(1, &ranges[3], D3D12_SHADER_VISIBILITY_ALL);
+	ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
+	rootParameters[2].InitAsDescriptorTable(1, &ranges[2], D3D12_SHADER_VISIBILITY_ALL);
 
 	D3D12_ROOT_SIGNATURE_FLAGS flags = 	D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS | D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS | 
 		D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS | D3D12_ROOT_SIGNATURE_FLAG_DENY_PIXEL_SHADER_ROOT_ACCESS;
@@ -657,33 +1156,37 @@ void LightIndexedDeferredRendering::InitGPULightCullng()
 	ThrowIfFailed(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_lightingData.lightCullingRootSignature)));
 
 	D3D12_COMPUTE_PIPELINE_STATE_DESC desc = {};
-	desc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize()};
 	desc.pRootSignature = m_lightingData.lightCullingRootSignature.Get();
-	ThrowIfFailed(m_device->CreateComputePipelineState(&desc, IID_PPV_ARGS(&m_lightingData.lightCullingPipeline)));
-
-	D3D12_INDIRECT_ARGUMENT_DESC indirectArgDesc = {};
-	indirectArgDesc.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+	desc.CS = { clearShader->GetBufferPointer(), clearShader->GetBufferSize() };
+	m_lightingData.lightCullingClearPipeline = CreatePipeline(L"LightCullingClear", desc);
+	desc.CS = { computeShader->GetBufferPointer(), computeShader->GetBufferSize()};
+	m_lightingData.lightCullingPipeline = CreatePipeline(L"LightCulling", desc);
+	desc.CS = { buildShader->GetBufferPointer(), buildShader->GetBufferSize() };
+	m_lightingData.lightCullingBuildPipeline = CreatePipeline(L"LightCullingBuild", desc);
+
+	// arguments of IndirectLightCommands::Command: root constants of the light passes,
+	// light geometry and instance vertex buffers, index buffer of the LOD and the draw
+	D3D12_INDIRECT_ARGUMENT_DESC indirectArgDescs[5] = {};
+	indirectArgDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+	indirectArgDescs[0].Constant.RootParameterIndex = 1;
+	indirectArgDescs[0].Constant.DestOffsetIn32BitValues = 0;
+	indirectArgDescs[0].Constant.Num32BitValuesToSet = IndirectLightCommands::NumConstants;
+	indirectArgDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+	indirectArgDescs[1].VertexBuffer.Slot = 0;
+	indirectArgDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+	indirectArgDescs[2].VertexBuffer.Slot = 1;
+	indirectArgDescs[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+	indirectArgDescs[4].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
 	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc;
 	commandSignatureDesc.NodeMask = 0;
-	commandSignatureDesc.pArgumentDescs = &indirectArgDesc;
-	commandSignatureDesc.ByteStride = sizeof(D3D12_DRAW_INDEXED_ARGUMENTS);
-	commandSignatureDesc.NumArgumentDescs = 1;
-	ThrowIfFailed(m_device->CreateCommandSignature(&commandSignatureDesc, nullptr, IID_PPV_ARGS(&m_lightingData.commandSignature)));
-
-	// Describe and create the command queue.
-	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	commandSignatureDesc.pArgumentDescs = indirectArgDescs;
+	commandSignatureDesc.ByteStride = sizeof(IndirectLightCommands::Command);
+	commandSignatureDesc.NumArgumentDescs = _countof(indirectArgDescs);
+	// root constants change the root arguments, the signature is bound to the light pass root signature
+	ThrowIfFailed(m_device->CreateCommandSignature(&commandSignatureDesc, m_lightingData.lightBufferRootSignature.Get(), IID_PPV_ARGS(&m_lightingData.commandSignature)));
 
-	ThrowIfFailed(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_lightingData.copyCommandQueue)));
-	
 	ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_lightingData.computeFence)));
 	m_lightingData.fence = 1;
-	// Create an event handle to use for frame synchronization.
-	m_lightingData.computeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-
-	ThrowIfFailed(m_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_lightingData.copyFence)));
-	//m_lightingData.fence = 1;
-	// Create an event handle to use for frame synchronization.
-	m_lightingData.copyEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 }
 
 template <typename InnerStructType, D3D12_PIPELINE_STATE_SUBOBJECT_TYPE Type, typename DefaultArg = InnerStructType>
@@ -708,6 +1211,7 @@ public:
 
 void LightIndexedDeferredRendering::InitLightingSystem()
 {
+	PROFILE_FUNCTION();
 	UINT descriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
 	const D3D12_HEAP_PROPERTIES heapProperties = { D3D12_HEAP_TYPE_DEFAULT, D3D12_CPU_PAGE_PROPERTY_UNKNOWN, D3D12_MEMORY_POOL_UNKNOWN, 1, 1 };
@@ -749,104 +1253,107 @@ void LightIndexedDeferredRendering::InitLightingSystem()
 	// Close the command list and execute it to begin the initial GPU setup.
 	ThrowIfFailed(m_lightingData.rtCommandList->Close());
 
-#ifdef	GPU_CULLING
-
-	const char* hlslVS = R"(
+	// light volumes are unit spheres, positions are quantized in [-1, 1]
+	VertexFormat lightFormat = VertexFormat::Create(VertexFormat::Position, m_vertexQuantization);
+	lightFormat.SetBounds(-Vector3D(1.0f, 1.0f, 1.0f), Vector3D(1.0f, 1.0f, 1.0f));
+	const std::string hlslVS = lightFormat.GetShaderCode() + R"(
 	cbuffer CBuffer : register(b0) {
 		row_major float4x4 ViewProjMatrix;
 	};
+	#ifdef GPU_CULLING
+	// root constants of the indirect command
+	cbuffer CommandConstants : register(b1) {
+		// x: radius, 0 is range of the light, y: LOD
+		float4 CommandData;
+	};
 	struct PS {
 		float4 position : SV_POSITION;
 		float4 color : TEXCOORD0;
 	};
-	PS vsMain(in float4 position : POSITION, in float4 v0 : TRANSFORM0, in float4 v1 : TRANSFORM1) {
+	PS vsMain(in VertexInput vertex, in float4 v0 : TRANSFORM0, in float4 v1 : TRANSFORM1) {
 		PS Out;
-		Out.position = mul(float4(v0.xyz + position.xyz * v0.w, 1.0f), ViewProjMatrix);
+		const float radius = CommandData.x > 0.0f ? CommandData.x : v0.w;
+		Out.position = mul(float4(v0.xyz + DecodePosition(vertex) * radius, 1.0f), ViewProjMatrix);
 		Out.color = v1;
 		return Out;
-	};)";
+	}
+	#else
+	cbuffer LightConstants : register(b1) {
+		float4 LightData;
+		float4 LightIndex;
+	};
+	struct PS {
+		float4 position : SV_POSITION;
+	};
+	PS vsMain(in VertexInput vertex) {
+		PS Out;
+		Out.position = mul(float4(LightData.xyz + DecodePosition(vertex) * LightData.w, 1.0f), ViewProjMatrix);
+		return Out;
+	}
+	#endif
+	)";
 
+	//
 	const char* hlslPS = R"(
+	#ifdef GPU_CULLING
 	struct PS {
 		float4 position : SV_POSITION;
 		float4 color : TEXCOORD0;
 	};
 	float4 psMain(in PS ps) : SV_TARGET {
 		return ps.color;
-	})";
-
-#else
-	const char* hlslVS =
-		"cbuffer CBuffer : register(b0) {"
-		"	row_major float4x4 ViewProjMatrix;"
-		"	float4 LightData;"
-		"};"
-		"struct PS {"
-		"	float4 position : SV_POSITION;"
-		"};"
-		"PS vsMain(in float4 position : POSITION) {"
-		"PS Out;"
-		"Out.position = mul(float4(LightData.xyz + position.xyz * LightData.w, 1.0f), ViewProjMatrix);"
-		"return Out;"
-		"}";
-
-	//
-	const char* hlslPS =
-		"cbuffer CBuffer : register(b0) {"
-		"	float4 LightIndex;"
-		"};"
-		"struct PS {"
-		"	float4 position : SV_POSITION;"
-		"};"
-		"float4 psMain(in PS ps) : SV_TARGET {"
-		"	return LightIndex;"
-		"}";
-
-#endif
-
-	ID3DBlob* ppErrorMsgs = nullptr;
-	ID3DBlob* vertexShader = nullptr;
-	hr = D3DCompile(hlslVS, strlen(hlslVS), nullptr, nullptr, nullptr, "vsMain", "vs_5_0", compileFlags, 0, &vertexShader, &ppErrorMsgs);
-	outError(ppErrorMsgs);
-	ID3DBlob* pixelShader = nullptr;
-	hr = D3DCompile(hlslPS, strlen(hlslPS), nullptr, nullptr, nullptr, "psMain", "ps_5_0", compileFlags, 0, &pixelShader, &ppErrorMsgs);
-	outError(ppErrorMsgs);
+	}
+	#else
+	cbuffer LightConstants : register(b1) {
+		float4 LightData;
+		float4 LightIndex;
+	};
+	struct PS {
+		float4 position : SV_POSITION;
+	};
+	float4 psMain(in PS ps) : SV_TARGET {
+		return LightIndex;
+	}
+	#endif
+	)";
 
+	// per-light root constants or instances culled on the GPU
+	ShaderPermutation& permutation = m_lightingData.lightPassPermutation;
+	const uint gpuCullingSet = permutation.AddKeywordSet("Culling", { "", "GPU_CULLING" });
+	m_lightingData.lightPassVariants[CPUCulling] = permutation.SetKeyword(0, gpuCullingSet, 0);
+	m_lightingData.lightPassVariants[GPUCulling] = permutation.SetKeyword(0, gpuCullingSet, 1);
+	ShaderVariants vertexShaders;
+	ShaderVariants pixelShaders;
+	LoadShaderVariants(vertexShaders, permutation, hlslVS, "LightVS.hlsl", "vsMain", "vs_5_0");
+	LoadShaderVariants(pixelShaders, permutation, hlslPS, "LightPS.hlsl", "psMain", "ps_5_0");
+
+	// view projection matrix is set once per pass as root CBV,
+	// per-light position, radius and index are root constants
 	CD3DX12_ROOT_PARAMETER1 rootParameters[2];
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[2];
-	ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
-	rootParameters[0].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_VERTEX);
+	rootParameters[0].InitAsConstantBufferView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, D3D12_SHADER_VISIBILITY_VERTEX);
+	rootParameters[1].InitAsConstants(LightConstantsNum32Bit, 1, 0, D3D12_SHADER_VISIBILITY_ALL);
 
 	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
-#ifdef	GPU_CULLING
-	rootSignatureDesc.Init_1_1(1, rootParameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
-#else
-	ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
-	rootParameters[1].InitAsDescriptorTable(1, &ranges[1], D3D12_SHADER_VISIBILITY_PIXEL);
-
 	rootSignatureDesc.Init_1_1(_countof(rootParameters), rootParameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
-#endif
 	ComPtr<ID3DBlob> signature;
 	ComPtr<ID3DBlob> error;
 	ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1_1, &signature, &error));
 	ThrowIfFailed(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_lightingData.lightBufferRootSignature)));
 	
-	// Define the vertex input layout.
-	D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
+	// Define the vertex input layout, GPU_CULLING variants read light instances from the second stream.
+	std::vector<D3D12_INPUT_ELEMENT_DESC> inputElementDescs;
+	GetInputElements(lightFormat, inputElementDescs);
+	inputElementDescs.push_back({ "TRANSFORM", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 });
+	inputElementDescs.push_back({ "TRANSFORM", 1, DXGI_FORMAT_R8G8B8A8_UNORM, 1, sizeof(float) * 4, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 });
+	auto GetInputLayout = [&](ShaderPermutation::VariantKey key) -> D3D12_INPUT_LAYOUT_DESC
 	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-#ifdef	GPU_CULLING
-		{ "TRANSFORM", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
-		{ "TRANSFORM", 1, DXGI_FORMAT_R8G8B8A8_UNORM, 1, sizeof(float) * 4, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 }
-#endif
+		const UINT numElements = permutation.GetKeyword(key, gpuCullingSet) ? static_cast<UINT>(inputElementDescs.size()) : lightFormat.GetNumElements();
+		return { inputElementDescs.data(), numElements };
 	};
 
 	// Describe and create the graphics pipeline state object (PSO).
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-	psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
 	psoDesc.pRootSignature = m_lightingData.lightBufferRootSignature.Get();
-	psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader);
-	psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader);
 	psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 	psoDesc.DepthStencilState.DepthEnable = TRUE;
@@ -857,7 +1364,12 @@ void LightIndexedDeferredRendering::InitLightingSystem()
 	psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
 	psoDesc.DSVFormat = depthStencilFormat;
 	psoDesc.SampleDesc.Count = 1;
-	ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_lightingData.lightSourcePipeline)));
+	for (const auto& shader : vertexShaders) {
+		psoDesc.InputLayout = GetInputLayout(shader.first);
+		psoDesc.VS = CD3DX12_SHADER_BYTECODE(shader.second.Get());
+		psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShaders[shader.first].Get());
+		m_lightingData.lightSourcePipelines[shader.first] = CreatePipeline(L"LightSource", psoDesc);
+	}
 
 	#define USE_PSO_STREAM
 
@@ -905,10 +1417,7 @@ void LightIndexedDeferredRendering::InitLightingSystem()
 		PipelineStateSubObjectRtFormats RTVFormats;
 	};
 	RtDBTPSOStreamDesc desc = {};
-	desc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
 	desc.RootSignature = m_lightingData.lightBufferRootSignature.Get();
-	desc.VS = CD3DX12_SHADER_BYTECODE(vertexShader);
-	desc.PS = CD3DX12_SHADER_BYTECODE(pixelShader);
 	desc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	desc.RasterizerState.second.FrontCounterClockwise = TRUE;
 	desc.RasterizerState.second.DepthClipEnable = FALSE;
@@ -926,55 +1435,47 @@ void LightIndexedDeferredRendering::InitLightingSystem()
 	desc.RTVFormats.second.RTFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
 	desc.DSVFormat = depthStencilFormat;
 	desc.SampleDesc.second.Count = 1;
-#ifdef USE_PSO_STREAM
-	D3D12_PIPELINE_STATE_STREAM_DESC psoStreamDesc = { sizeof(desc),   &desc };
-	ThrowIfFailed(m_device->CreatePipelineState(&psoStreamDesc, IID_PPV_ARGS(&m_lightingData.lightBufferPipeline)));
-#else
+#ifndef USE_PSO_STREAM
 	SetBlend(psoDesc.BlendState.RenderTarget[0]);
 	psoDesc.RasterizerState.FrontCounterClockwise = TRUE;
 	psoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_GREATER_EQUAL;
-	ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_lightingData.lightBufferPipeline)));
 #endif
+	for (const auto& shader : vertexShaders) {
+		const ShaderPermutation::VariantKey key = shader.first;
+#ifdef USE_PSO_STREAM
+		desc.InputLayout = GetInputLayout(key);
+		desc.VS = CD3DX12_SHADER_BYTECODE(shader.second.Get());
+		desc.PS = CD3DX12_SHADER_BYTECODE(pixelShaders[key].Get());
+		D3D12_PIPELINE_STATE_STREAM_DESC psoStreamDesc = { sizeof(desc),   &desc };
+		m_lightingData.lightBufferPipelines[key] = CreatePipeline(L"LightBuffer", psoStreamDesc, desc.VS, desc.PS);
+#else
+		psoDesc.InputLayout = GetInputLayout(key);
+		psoDesc.VS = CD3DX12_SHADER_BYTECODE(shader.second.Get());
+		psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShaders[key].Get());
+		m_lightingData.lightBufferPipelines[key] = CreatePipeline(L"LightBuffer", psoDesc);
+#endif
+	}
 	const float lCoords = 0.9f * coord;
 	const float minR = m_lightingData.radiuseRange.x;
 	const float maxR = m_lightingData.radiuseRange.y;
 	GeneratePointLights(Vector3D(-lCoords, minR, -lCoords), Vector3D(lCoords, maxR / 2, lCoords), Vector2D(minR, maxR));
 
-	for (int lightIndex = m_lightingData.numLights - 1; lightIndex >= 0; --lightIndex) {
-		Vector4D& outColor = m_lightingData.lightVector4Indices[lightIndex];
-		// Set the light index color 
-		ubyte convertColor = static_cast<ubyte>(lightIndex);
-		ubyte redBit = (convertColor & (0x3 << 0)) << 6;
-		ubyte greenBit = (convertColor & (0x3 << 2)) << 4;
-		ubyte blueBit = (convertColor & (0x3 << 4)) << 2;
-		ubyte alphaBit = (convertColor & (0x3 << 6)) << 0;
-		outColor = Vector4D(redBit, greenBit, blueBit, alphaBit);
-
-		const float divisor = 255.0f;
-		outColor /= divisor;
-
-		m_lightingData.lBufferCBVS[lightIndex].Attach(CreateConstantBuffer(sizeof(Matrix4x4) + sizeof(Vector4D)));
-		m_lightingData.lBufferCBPS[lightIndex].Attach(CreateConstantBuffer(sizeof(Vector4D)));
-
-		m_lightingData.lBufferCBVSDescriptors[lightIndex] = m_GPUDescriptor;
-		m_GPUDescriptor.ptr += descriptorSize;
+	m_lightingData.lightVector4Indices = LightIndexColors;
+	static_assert(sizeof(LightConstants) == LightConstantsNum32Bit * sizeof(uint), "LightConstants must be packed into 32-bit root constants");
+	m_lightingData.lightPassConstantBuffer.Attach(CreateConstantBuffer(sizeof(Matrix4x4), false));
+	m_lightingData.lightPassConstantBuffer->SetName(L"LightPassConstantBuffer");
 
-		m_lightingData.lBufferCBPSDescriptors[lightIndex] = m_GPUDescriptor;
-		m_GPUDescriptor.ptr += descriptorSize;
-
-		m_lightingData.lSourceBufferCBVS[lightIndex].Attach(CreateConstantBuffer(sizeof(Matrix4x4) + sizeof(Vector4D)));
-		m_lightingData.lSourceCBVSDescriptors[lightIndex] = m_GPUDescriptor;
-		m_GPUDescriptor.ptr += descriptorSize;
+	for (uint lod = 0; lod < IndirectLightCommands::NumLods; ++lod) {
+		CreateSphere(m_uploader, m_lightingData.lightGeometryData[lod], lightFormat, LightLodRings[lod], LightLodSectors[lod], 1.0f);
 	}
 
-	CreateSphere(m_device.Get(), m_lightingData.lightGeometryData, 250, 20, 1.0f);
-
 	InitGPULightCullng();
 }
 
 // Load the rendering pipeline dependencies.
 void LightIndexedDeferredRendering::LoadPipeline()
 {
+	PROFILE_FUNCTION();
     UINT dxgiFactoryFlags = 0;
 
 	InitDebug();
@@ -1018,6 +1519,11 @@ void LightIndexedDeferredRendering::LoadPipeline()
 
     ThrowIfFailed(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_commandQueue)));
 
+	// Copy queue is used for static geometry uploads.
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	ThrowIfFailed(m_device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&m_lightingData.copyCommandQueue)));
+	m_uploader.Init(m_device.Get(), m_lightingData.copyCommandQueue.Get(), StagingRingSize);
+
     // Describe and create the swap chain.
     DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
     swapChainDesc.BufferCount = FrameCount;
@@ -1122,23 +1628,22 @@ void LightIndexedDeferredRendering::LoadPipeline()
 // Load the sample assets.
 void LightIndexedDeferredRendering::LoadAssets()
 {
+	PROFILE_FUNCTION();
 	const float minR = 20.0f;
 	const float maxR = 30.0f;
 
 	m_lightingData.numLights = numLights;
 	m_lightingData.radiuseRange.x = minR;
 	m_lightingData.radiuseRange.y = maxR;
-	FILE* f = fopen("setup.cfg", "r");
-	if (f) {
-		int res = fscanf(f, "LightSourceRadiusRange %f %f\r\n", &m_lightingData.radiuseRange.x, &m_lightingData.radiuseRange.y);
-		assert(res > 0 && "fscanf failed");
-		//res = fscanf(f, "NumLightSources %u", &m_lightingData.numLights);
-		//assert(res > 0 && "fscanf failed");
-		fclose(f);
-	}
+	LoadSettings("setup.cfg");
 	m_srv_cbv_uav_descriptor = m_srvHeap->GetCPUDescriptorHandleForHeapStart();
 	m_GPUDescriptor = m_srvHeap->GetGPUDescriptorHandleForHeapStart();
 
+	// compiler version is a part of the key, so a new compiler doesn't pick up old bytecode;
+	// this is the version of FXC, LoadShader adds the one of dxcompiler.dll to DXIL keys
+	m_shaderCache.Init(ShaderCacheDirectory, ShaderCacheSize, D3D_COMPILER_VERSION);
+	InitPipelineLibrary();
+
 	UINT descriptorSize = m_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     // Create the root signature.
     {
@@ -1207,33 +1712,56 @@ void LightIndexedDeferredRendering::LoadAssets()
 		ThrowIfFailed(m_device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&m_depthRootSignature)));
     }
 
+	// the ground from the mesh file, or generated and quantized to its bounds,
+	// or the terrain streamed in while running. The scene shader needs every attribute
+	MeshFile sceneFile;
+	Mesh sceneMesh;
+	VertexFormat sceneFormat;
+	if (m_isTerrainEnabled) {
+		sceneFormat = Terrain::CreateVertexFormat(m_vertexQuantization);
+		m_terrain.reset(new Terrain(Terrain::Settings(), sceneFormat));
+	}
+	else if (!m_sceneMeshFileName.empty() && sceneFile.Open(m_sceneMeshFileName.c_str()) && sceneFile.GetHeader().numElements == VertexFormat::NumAttributes) {
+		sceneFormat = sceneFile.GetVertexFormat();
+		sceneFile.GetMeshlets(m_sceneMeshlets);
+	}
+	else {
+		if (!m_sceneMeshFileName.empty()) {
+			LogMsg("%s: invalid mesh file, the ground is generated\n", m_sceneMeshFileName.c_str());
+			sceneFile.Close();
+		}
+		CreatePlane(sceneMesh, m_sceneMeshlets, GroundSize, GroundSize, m_groundCellSize, m_groundCellSize, Vector3D::Y(), 0);
+		LogMsg("ground: %u vertices, %u triangles, %u bit indices\n", sceneMesh.GetNumVertices(), sceneMesh.GetNumFaces(), sceneMesh.Needs32BitIndices() ? 32 : 16);
+		sceneFormat = VertexFormat::Create(VertexFormat::TexCoord, m_vertexQuantization);
+		sceneFormat.SetBounds(sceneMesh);
+	}
+
     // Create the pipeline state, which includes compiling and loading shaders.
     {
         ComPtr<ID3DBlob> vertexShader;
-        ComPtr<ID3DBlob> pixelShader;
+		ShaderVariants pixelShaders;
 
-		ID3DBlob* ppErrorMsgs = nullptr;
 		const wchar_t* psShaderFileName = L"PixelShader.hlsl";
 		const wchar_t* vsShaderFileName = L"VertexShader.hlsl";
 
-		HRESULT hr = D3DCompileFromFile(GetAssetFullPath(vsShaderFileName).c_str(), nullptr, nullptr, "VSmain", "vs_5_0", compileFlags, 0, &vertexShader, &ppErrorMsgs);
-		outError(ppErrorMsgs);
-		hr = D3DCompileFromFile(GetAssetFullPath(psShaderFileName).c_str(), nullptr, nullptr, "psMain", "ps_5_0", compileFlags, 0, &pixelShader, &ppErrorMsgs);
-		outError(ppErrorMsgs);
+		vertexShader = LoadShaderFromFile(vsShaderFileName, nullptr, "VSmain", "vs_5_0", sceneFormat.GetShaderCode());
+
+		// forward and light indexed lighting, size of the lights array
+		const std::string numLightsKeyword = "NUM_LIGHTS=" + std::to_string(m_lightingData.numLights);
+		const uint lightBufferSet = m_scenePermutation.AddKeywordSet("LightBuffer", { "NO_LIGHT_BUFFER", "" });
+		m_scenePermutation.AddKeywordSet("NumLights", { numLightsKeyword.c_str() });
+		m_sceneVariants[Forward] = m_scenePermutation.SetKeyword(0, lightBufferSet, 0);
+		m_sceneVariants[LightIndexed] = m_scenePermutation.SetKeyword(0, lightBufferSet, 1);
+		LoadShaderVariants(pixelShaders, m_scenePermutation, ReadShaderSource(psShaderFileName), "PixelShader.hlsl", "psMain", "ps_5_0");
         // Define the vertex input layout.
-        D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
-        {
-            { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-        };
+		std::vector<D3D12_INPUT_ELEMENT_DESC> inputElementDescs;
+		GetInputElements(sceneFormat, inputElementDescs);
 
         // Describe and create the graphics pipeline state object (PSO).
         D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
-        psoDesc.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
+        psoDesc.InputLayout = { inputElementDescs.data(), static_cast<UINT>(inputElementDescs.size()) };
         psoDesc.pRootSignature = m_rootSignature.Get();
         psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.Get());
-        psoDesc.PS = CD3DX12_SHADER_BYTECODE(pixelShader.Get());
         psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 #ifdef USE_PLANE
 		psoDesc.RasterizerState.FrontCounterClockwise = TRUE;
@@ -1249,17 +1777,20 @@ void LightIndexedDeferredRendering::LoadAssets()
         psoDesc.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
 		psoDesc.DSVFormat = depthStencilFormat;
         psoDesc.SampleDesc.Count = 1;
-        ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_pipelineState)));
+		for (const auto& shader : pixelShaders) {
+			psoDesc.PS = CD3DX12_SHADER_BYTECODE(shader.second.Get());
+			m_scenePipelines[shader.first] = CreatePipeline(L"Scene", psoDesc);
+		}
 
 		psoDesc.pRootSignature = m_depthRootSignature.Get();
 		psoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
 		psoDesc.PS = CD3DX12_SHADER_BYTECODE();
 		psoDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = 0;
-		ThrowIfFailed(m_device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&m_depthPipelineState)));
+		m_depthPipelineState = CreatePipeline(L"Depth", psoDesc);
     }
 
     // Create the command list.
-    ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList)));
+    ThrowIfFailed(m_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get(), GetScenePipeline(), IID_PPV_ARGS(&m_commandList)));
 
     // Create the vertex buffer.
     {
@@ -1274,19 +1805,23 @@ void LightIndexedDeferredRendering::LoadAssets()
 			{ { -coord, 0.0f, -coord }, { 0.0f, 1.0f, 0.0f },  { 0.0f, 1.0f } }
 
         };
-        // Note: using upload heaps to transfer static data like vert buffers is not 
-        // recommended. Every time the GPU needs it, the upload heap will be marshalled 
-        // over. Please read up on Default Heap usage. An upload heap is used here for 
-        // code simplicity and because there are very few verts to actually transfer.
-
 		MeshData meshData;
-		CreatePlane(m_device.Get(), meshData, 500, 500, 20, 20, Vector3D::Y(), 0);
+		if (m_terrain) {
+			// tiles have their own buffers
+		}
+		else if (sceneFile.IsOpen()) {
+			InitMeshData(m_uploader, meshData, sceneFile);
+			sceneFile.Close();
+		}
+		else {
+			sceneFormat.Encode(sceneMesh);
+			InitMeshData(m_uploader, meshData, sceneMesh);
+		}
 
 		m_vertexBuffer.Attach(meshData.vb.Detach());
 		m_indexBuffer.Attach(meshData.ib.Detach());
 		ibView = meshData.ibView;
 		m_vertexBufferView = meshData.vbView;
-		nFaces = meshData.numFaces;
     }
     // Note: ComPtr's are CPU objects but this resource needs to stay in scope until
     // the command list that references it has finished executing on the GPU.
@@ -1372,6 +1907,18 @@ void LightIndexedDeferredRendering::LoadAssets()
         WaitForPreviousFrame();
     }
 	InitLightingSystem();
+	InitTimestamps();
+	// shaders and pipelines of the startup survive a crash before OnDestroy
+	SavePipelineLibrary();
+	m_shaderCache.SaveIndex();
+
+	// Geometry of the scene and of the lights goes to the GPU as one copy queue
+	// submission, the direct queue waits for it before the first frame.
+	m_uploader.QueueWait(m_commandQueue.Get(), m_uploader.Flush());
+
+	if (m_isBenchmarkRequested) {
+		StartBenchmark();
+	}
 }
 
 // Generate a simple black and white checkerboard texture.
@@ -1411,102 +1958,89 @@ std::vector<UINT8> LightIndexedDeferredRendering::GenerateTextureData()
     return data;
 }
 
-void LightIndexedDeferredRendering::CullLights(LightCullingData& lightCullingData, float R)
+void LightIndexedDeferredRendering::CullLights(LightCullingData& lightCullingData)
 {
+	PROFILE_FUNCTION();
 	CullingLightInfo instanceGPUCullData[numLights];
 
 	for (int lightIndex = m_lightingData.numLights - 1; lightIndex >= 0; --lightIndex) {
-		const Light& light = m_lightingData.lights[lightIndex];
 		CullingLightInfo& cullingLightInfo = instanceGPUCullData[lightIndex];
 		LightInstanceData& lightData = cullingLightInfo.instanceData;
-		memcpy(&lightData.posRange, light.Position, sizeof(Vector4D));
-		lightData.posRange.w = R ? R : m_lightingData.lightsRanges[lightIndex];
+		// frustum planes are in world space
+		memcpy(lightData.posRange, m_lightingData.lightsPositions[lightIndex], sizeof(lightData.posRange));
+		lightData.posRange[3] = m_lightingData.lightsRanges[lightIndex];
 		//lightData.lightIndex = Vector4D(light.color.x, light.color.y, light.color.z, 1.0f);
 		lightData.lightIndex = m_lightingData.lightVector4Indices[lightIndex];
 	}
 	UpdateBuffer(lightCullingData.lightCullingDataBuffer.Get(), instanceGPUCullData, m_lightingData.numLights * sizeof(CullingLightInfo));
 
-	const D3D12_DRAW_INDEXED_ARGUMENTS drawIndexedIndirectCommand = {
-		3 * m_lightingData.lightGeometryData.numFaces,
-		0,
-		0,
-		0,
-		0
-	};
-	UpdateBuffer(lightCullingData.lightCullingUpdateIndirectBuffer.Get(), &drawIndexedIndirectCommand, sizeof(drawIndexedIndirectCommand));
-
-	D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(lightCullingData.lightCullingIndirectBuffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
-	{
-		ResetCommandList(m_commandList.Get(), m_commandAllocator.Get());
-		m_commandList->ResourceBarrier(1, &barrier);
-		ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-		ThrowIfFailed(m_commandList->Close());
-		m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
-		WaitForPreviousFrame();
+	CullingConstants cullingConstants = {};
+	const Frustum& frustum = camera.GetFrustum();
+	for (uint i = 0; i < CullingConstants::NumPlanes; ++i) {
+		const Plane& plane = frustum.GetPlane(i);
+		cullingConstants.planes[i][0] = plane.normal.x;
+		cullingConstants.planes[i][1] = plane.normal.y;
+		cullingConstants.planes[i][2] = plane.normal.z;
+		cullingConstants.planes[i][3] = plane.dist;
 	}
-
-	ResetCommandList(m_lightingData.copyCommandList.Get(), m_copyCommandAllocator.Get());
-
-	m_lightingData.copyCommandList->CopyResource(lightCullingData.lightCullingIndirectBuffer.Get(), lightCullingData.lightCullingUpdateIndirectBuffer.Get());
-	ID3D12CommandList* ppCopyCommandLists[] = { m_lightingData.copyCommandList.Get() };
-	ThrowIfFailed(m_lightingData.copyCommandList->Close());
-	m_lightingData.copyCommandQueue ->ExecuteCommandLists(1, ppCopyCommandLists);
-
-	UINT64 fence = m_lightingData.fence;
-	ThrowIfFailed(m_lightingData.copyCommandQueue->Signal(m_lightingData.copyFence.Get(), m_lightingData.fence++));
-
-	// Wait
-	if (m_lightingData.copyFence->GetCompletedValue() < fence) {
-		ThrowIfFailed(m_lightingData.copyFence->SetEventOnCompletion(fence, m_lightingData.copyEvent));
-		WaitForSingleObject(m_lightingData.copyEvent, INFINITE);
-	}
-
-	std::swap(barrier.Transition.StateAfter, barrier.Transition.StateBefore);
-
-	{
-		ResetCommandList(m_commandList.Get(), m_commandAllocator.Get());
-		ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-		ThrowIfFailed(m_commandList->Close());
-		m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
-		WaitForPreviousFrame();
+	memcpy(cullingConstants.cameraPosition, camera.GetPosition(), sizeof(Vector3D));
+	for (uint i = 0; i < IndirectLightCommands::NumLods - 1; ++i) {
+		cullingConstants.lodThresholds[i] = LightLodRatios[i] * LightLodRatios[i];
 	}
-
-	UpdateBuffer(lightCullingData.lightCullingConstantBuffer.Get(), &camera.GetFrustum(), sizeof(Frustum));
+	memcpy(cullingConstants.passRadius, LightPassRadius, sizeof(LightPassRadius));
+	cullingConstants.numLights = m_lightingData.numLights;
+	UpdateBuffer(lightCullingData.lightCullingConstantBuffer.Get(), &cullingConstants, sizeof(cullingConstants));
 
 	ResetCommandList(m_lightingData.computeCommandList.Get(), m_computeCommandAllocator.Get());
+	ID3D12GraphicsCommandList* cmdList = m_lightingData.computeCommandList.Get();
 
 	ID3D12DescriptorHeap* ppHeaps[] = { m_srvHeap.Get() };
-	m_lightingData.computeCommandList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
-
-	m_lightingData.computeCommandList->SetPipelineState(m_lightingData.lightCullingPipeline.Get());
-	m_lightingData.computeCommandList->SetComputeRootSignature(m_lightingData.lightCullingRootSignature.Get());
-
-	m_lightingData.computeCommandList->SetComputeRootDescriptorTable(0, lightCullingData.lightCullingDescriptors[0]);
-
-	m_lightingData.computeCommandList->SetComputeRootDescriptorTable(1, lightCullingData.lightCullingDescriptors[2]);
-	m_lightingData.computeCommandList->SetComputeRootDescriptorTable(2, lightCullingData.lightCullingDescriptors[3]);
+	cmdList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
 
-	m_lightingData.computeCommandList->Dispatch(m_lightingData.numLights, 1, 1);
+	cmdList->SetComputeRootSignature(m_lightingData.lightCullingRootSignature.Get());
+	cmdList->SetComputeRootDescriptorTable(0, lightCullingData.lightCullingDescriptors[0]);
+	cmdList->SetComputeRootDescriptorTable(1, lightCullingData.lightCullingDescriptors[3]);
+	cmdList->SetComputeRootDescriptorTable(2, lightCullingData.lightCullingDescriptors[5]);
+
+	// counts are reset on the GPU, every dispatch reads results of the previous one
+	const CD3DX12_RESOURCE_BARRIER uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
+	m_gpuTimer.BeginPass(cmdList, CullingPass);
+	cmdList->SetPipelineState(m_lightingData.lightCullingClearPipeline.Get());
+	cmdList->Dispatch(1, 1, 1);
+	cmdList->ResourceBarrier(1, &uavBarrier);
+	cmdList->SetPipelineState(m_lightingData.lightCullingPipeline.Get());
+	cmdList->Dispatch(LightCullingEmulator::GetNumGroups(m_lightingData.numLights), 1, 1);
+	cmdList->ResourceBarrier(1, &uavBarrier);
+	cmdList->SetPipelineState(m_lightingData.lightCullingBuildPipeline.Get());
+	cmdList->Dispatch(1, 1, 1);
+	m_gpuTimer.EndPass(cmdList, CullingPass);
 
-	ThrowIfFailed(m_lightingData.computeCommandList->Close());
+	ThrowIfFailed(cmdList->Close());
 
 	// Execute the command list.
-	ID3D12CommandList* ppCommandLists[] = { m_lightingData.computeCommandList.Get() };
+	ID3D12CommandList* ppCommandLists[] = { cmdList };
 	m_lightingData.computeCommandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
 
-	fence = m_lightingData.fence;
+	// light passes wait for the culling on the GPU
+	const UINT64 fence = m_lightingData.fence;
 	ThrowIfFailed(m_lightingData.computeCommandQueue->Signal(m_lightingData.computeFence.Get(), m_lightingData.fence++));
-
-	// Wait
-	if (m_lightingData.computeFence->GetCompletedValue() < fence) {
-		ThrowIfFailed(m_lightingData.computeFence->SetEventOnCompletion(fence, m_lightingData.computeEvent));
-		WaitForSingleObject(m_lightingData.computeEvent, INFINITE);
-	}
+	ThrowIfFailed(m_commandQueue->Wait(m_lightingData.computeFence.Get(), fence));
 }
 
 // Update frame-based values.
 void LightIndexedDeferredRendering::OnUpdate()
 {
+#ifdef USE_PROFILER
+	const bool isProfiling = Profiler::IsCapturing();
+	const bool isProfileWritten = Profiler::BeginFrame();
+	if (isProfiling && !Profiler::IsCapturing()) {
+		LogMsg(isProfileWritten ? "Profile written to %s\n" : "Can't write profile %s\n", Profiler::GetFileName().c_str());
+	}
+#endif
+	PROFILE_FUNCTION();
+	m_frameTimer.RestartTimer();
+	m_fenceWaitTicks = 0;
+	m_gpuTimer.BeginFrame(m_gpuFrame);
 	POINT pt;
 	GetCursorPos(&pt);
 	float x = static_cast<float>(pt.x);
@@ -1515,13 +2049,24 @@ void LightIndexedDeferredRendering::OnUpdate()
 	DMousePosition.y = MousePosition.y - y;
 	MousePosition.x = x;
 	MousePosition.y = y;
-	camera.Rotate(-DMousePosition * 0.1f);
+	if (m_benchmark.IsRunning()) {
+		UpdateBenchmark();
+	}
+	else {
+		camera.Rotate(-DMousePosition * 0.1f);
+	}
 #ifndef USE_PERSPECTIVE_RIGHT_HANDLED
 	camera.UpdateCamera();
 #else
 	camera.UpdateCamera(-1);
 #endif
 	camera.ExtractFrustum();
+	if (m_terrain) {
+		UpdateTerrain();
+	}
+	else {
+		CullSceneMeshlets();
+	}
 
 	const Matrix4x4& viewMatrix = camera.GetViewMatrix();
 
@@ -1529,14 +2074,16 @@ void LightIndexedDeferredRendering::OnUpdate()
 	cbData.m[1] = viewMatrix;
 	memcpy(cbData.camPos, camera.GetPosition(), sizeof(Vector3D));
 	UpdateBuffer(m_constantBuffer.Get(), &cbData, sizeof(cbData));
+	UpdateBuffer(m_lightingData.lightPassConstantBuffer.Get(), cbData.m[0], sizeof(cbData.m[0]));
 
 	const Vector3D off(1.0f, 0.0f, 1.0f);
 	const Vector3D Xdir = off;
 	const Vector3D Zdir = -off;
 	const float moveTime = 0.01f;
-	float dt = timer.DiffTime();
+	const float dt = static_cast<float>(timer.DiffTime());
 	emulationTime += dt;
-	if (emulationTime < moveTime) {
+	// lights move every frame during benchmark, so every run sees the same scene
+	if (emulationTime < moveTime && !m_benchmark.IsRunning()) {
 		return;
 	}
 	emulationTime = 0.0f;
@@ -1562,66 +2109,104 @@ void LightIndexedDeferredRendering::OnUpdate()
 	};
 
 	for (uint lightIndex = 0; lightIndex < m_lightingData.numLights; ++lightIndex) {
-		Light& light = m_lightingData.lights[lightIndex];
 		Vector4D& LightPos = m_lightingData.lightsPositions[lightIndex];
 		Vector3D& dirOffset = m_lightingData.dirPosOffsets[lightIndex];
 		Vector3D& pos = reinterpret_cast<Vector3D &>(LightPos);
 		RotatePos(pos, lightIndex, dirOffset);
-		memcpy(light.Position, LightPos, sizeof(light.Position));
-		// move light to View space, to do GPU Side
-		TransformCoord(light.Position, viewMatrix);
 		//light.Range = 1.0f / LightPos.w;
 	}
+	// move lights to View space, to do GPU Side
+	viewMatrix.TransformPoints(reinterpret_cast<const Vector3D *>(m_lightingData.lightsPositions.data()), sizeof(Vector4D),
+		&m_lightingData.lights[0].Position, sizeof(Light), m_lightingData.numLights);
 	UpdateBuffer(m_lightingData.lightBufferConstantBuffer.Get(), m_lightingData.lights.data(), sizeof(m_lightingData.lights));
-#ifdef GPU_CULLING
-	// TO DO
-	CullLights(m_lightingData.lightCullingData);
-	CullLights(m_lightingData.lightCullingDataDebug, 1.0f);
-#endif
+	if (m_cullingMode == GPUCulling) {
+		CullLights(m_lightingData.lightCullingData);
+	}
 }
 
 // Render the scene.
 void LightIndexedDeferredRendering::OnRender()
 {
+	PROFILE_FUNCTION();
     // Record all the commands we need to render the scene into the command list.
     PopulateCommandList();
+	m_gpuTimer.EndFrame();
 
     // Execute the command list.
     ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
     m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+	// update, recording and submission; Present may block on the swap chain and the fence
+	// waits are GPU time (drawToLightBuffer waits for the light buffer), all are left out
+	const double cpuTime = (m_frameTimer.DiffTime() - Timer::TicksToSeconds(m_fenceWaitTicks)) * 1000.0;
 
     // Present the frame.
-    ThrowIfFailed(m_swapChain->Present(0, 0));
+	{
+		PROFILE_SCOPE("Present");
+		ThrowIfFailed(m_swapChain->Present(0, 0));
+	}
 
     WaitForPreviousFrame();
+	m_uploader.Retire();
+	// the frame has been waited for, all its timestamps are resolved
+	m_gpuTimer.Collect(m_gpuFrame++);
+
+	const double gpuTime = GetGPUFrameTime();
+	m_frameStats.AddFrame(cpuTime, gpuTime);
+	if (m_isFrameStatsOverlay && m_frameStats.GetNumFrames() % FrameStatsOverlayFrames == 0) {
+		const std::string text = m_frameStats.GetOverlayText();
+		SetCustomWindowText(std::wstring(text.begin(), text.end()).c_str());
+	}
+
+	if (m_benchmark.IsRunning()) {
+		if (!m_benchmark.AddFrame(cpuTime, gpuTime)) {
+			const char* modeNames[] = { "CPU culling", "GPU culling" };
+			static_assert(_countof(modeNames) == NumCullingModes, "name of every culling mode is required");
+			LogMsg("Culling benchmark, %u lights, %u frames per run\n%s", m_lightingData.numLights, BenchmarkRunFrames, m_benchmark.GetReport(modeNames).c_str());
+		}
+		m_cullingMode = m_benchmark.IsRunning() ? static_cast<CullingMode>(m_benchmark.GetMode()) : m_cullingModeBeforeBenchmark;
+	}
 }
 
 void LightIndexedDeferredRendering::OnDestroy()
 {
+	PROFILE_FUNCTION();
     // Ensure that the GPU is no longer referencing resources that are about to be
     // cleaned up by the destructor.
     WaitForPreviousFrame();
+	m_uploader.WaitForIdle();
+	SavePipelineLibrary();
+	m_shaderCache.SaveIndex();
+
+	LogMsg("Frame times, %llu frames: %s\n", static_cast<unsigned long long>(m_frameStats.GetNumFrames()), m_frameStats.GetOverlayText().c_str());
+	if (!m_frameStatsFileName.empty()) {
+		const std::string csvFileName = m_frameStatsFileName + ".csv";
+		const std::string jsonFileName = m_frameStatsFileName + ".json";
+		if (!m_frameStats.WriteCSV(csvFileName.c_str()) || !m_frameStats.WriteJSON(jsonFileName.c_str())) {
+			LogMsg("Can't write frame statistics %s\n", m_frameStatsFileName.c_str());
+		}
+	}
 
     CloseHandle(m_fenceEvent);
 }
 
 void LightIndexedDeferredRendering::drawToLightBuffer()
 {
+	PROFILE_FUNCTION();
 	// However, when ExecuteCommandList() is called on a particular command 
 	// list, that command list can then be reset at any time and must be before 
 	// re-recording.
 	ID3D12GraphicsCommandList1* cmdList = m_lightingData.rtCommandList.Get();
 
 	ThrowIfFailed(cmdList->Reset(m_commandAllocator.Get(), nullptr));
-#ifdef GPU_CULLING
-
-	std::array<CD3DX12_RESOURCE_BARRIER, 2> barriers;
+	if (m_cullingMode == GPUCulling) {
+		std::array<CD3DX12_RESOURCE_BARRIER, 3> barriers;
 
-	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingInstanceBuffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingIndirectBuffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+		barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingInstanceBuffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+		barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingIndirectBuffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+		barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingCountBuffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
 
-	cmdList->ResourceBarrier(2, barriers.data());
-#endif
+		cmdList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+	}
 
 	ID3D12DescriptorHeap* ppHeaps[] = { m_srvHeap.Get() };
 	cmdList->SetDescriptorHeaps(_countof(ppHeaps), ppHeaps);
@@ -1645,49 +2230,117 @@ void LightIndexedDeferredRendering::drawToLightBuffer()
 	cmdList->SetGraphicsRootSignature(m_depthRootSignature.Get());
 	cmdList->SetGraphicsRootDescriptorTable(0, m_cBDescriptor);
 	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	cmdList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
-	cmdList->IASetIndexBuffer(&ibView);
 
 	// draw scene
 
-	cmdList->DrawIndexedInstanced(nFaces * 3, 1, 0, 0, 0);
+	m_gpuTimer.BeginPass(cmdList, DepthPass);
+	drawScene(cmdList);
+	m_gpuTimer.EndPass(cmdList, DepthPass);
+
+	// forward lighting doesn't read the light buffer, only depth of the scene is needed
+	if (m_lightingMode == LightIndexed) {
+		m_gpuTimer.BeginPass(cmdList, LightVolumePass);
+		drawLightVolumes(cmdList);
+		m_gpuTimer.EndPass(cmdList, LightVolumePass);
+	}
+	// Indicate that the back buffer will now be used to present.
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightBufferRT.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+	ThrowIfFailed(cmdList->Close());
+
+	// Execute the command list.
+	ID3D12CommandList* ppCommandLists[] = { cmdList };
+	m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+	WaitForPreviousFrame();
+}
+
+void LightIndexedDeferredRendering::CullSceneMeshlets()
+{
+	PROFILE_FUNCTION();
+	const Frustum& frustum = camera.GetFrustum();
+	const Vector3D& position = camera.GetPosition();
+	m_sceneDraws.clear();
+	for (const Meshlet& meshlet : m_sceneMeshlets) {
+		if (meshlet.IsBackFacing(position) || !frustum.SphereInFrustum(meshlet.center, meshlet.radius)) {
+			continue;
+		}
+		const uint startIndex = meshlet.triangleOffset * 3;
+		const uint indexCount = meshlet.triangleCount * 3;
+		// visible neighbours in the index buffer are drawn at once
+		if (!m_sceneDraws.empty() && m_sceneDraws.back().StartIndexLocation + m_sceneDraws.back().IndexCountPerInstance == startIndex) {
+			m_sceneDraws.back().IndexCountPerInstance += indexCount;
+			continue;
+		}
+		const D3D12_DRAW_INDEXED_ARGUMENTS draw = { indexCount, 1, startIndex, 0, 0 };
+		m_sceneDraws.push_back(draw);
+	}
+}
 
+void LightIndexedDeferredRendering::UpdateTerrain()
+{
+	PROFILE_FUNCTION();
+	assert(m_terrain && "NULL Pointer");
+	std::vector<Terrain::TileMesh> loadedTiles;
+	std::vector<Terrain::TileKey> evictedTiles;
+	m_terrain->Update(camera.GetPosition(), loadedTiles, evictedTiles);
+	// the previous frame is finished, its buffers can go
+	for (const Terrain::TileKey& key : evictedTiles) {
+		m_terrainBuffers.erase(key);
+	}
+	// tiles are generated on tasks, the copies are recorded here as the uploader isn't thread safe
+	for (const Terrain::TileMesh& mesh : loadedTiles) {
+		MeshData& meshData = m_terrainBuffers[mesh.key];
+		meshData.numFaces = static_cast<uint>(mesh.indices.size() / 3);
+		InitMeshData(m_uploader, meshData, mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size() * sizeof(ushort), m_terrain->GetVertexFormat().GetStride());
+	}
+	if (!loadedTiles.empty()) {
+		m_uploader.QueueWait(m_commandQueue.Get(), m_uploader.Flush());
+	}
+	m_terrainDraws.clear();
+	for (const Terrain::Tiles::value_type& tile : m_terrain->GetTiles()) {
+		if (!camera.IsVisible(tile.second.bounds)) {
+			continue;
+		}
+		const TerrainDraw draw = { &m_terrainBuffers[tile.first], tile.second.lods[tile.second.lod] };
+		m_terrainDraws.push_back(draw);
+	}
+}
+
+void LightIndexedDeferredRendering::drawScene(ID3D12GraphicsCommandList* cmdList)
+{
+	if (m_terrain) {
+		for (const TerrainDraw& draw : m_terrainDraws) {
+			cmdList->IASetVertexBuffers(0, 1, &draw.meshData->vbView);
+			cmdList->IASetIndexBuffer(&draw.meshData->ibView);
+			cmdList->DrawIndexedInstanced(draw.lod.indexCount, 1, draw.lod.startIndex, draw.lod.baseVertex, 0);
+		}
+		return;
+	}
+	cmdList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
+	cmdList->IASetIndexBuffer(&ibView);
+	for (const D3D12_DRAW_INDEXED_ARGUMENTS& draw : m_sceneDraws) {
+		cmdList->DrawIndexedInstanced(draw.IndexCountPerInstance, draw.InstanceCount, draw.StartIndexLocation, draw.BaseVertexLocation, draw.StartInstanceLocation);
+	}
+}
+
+void LightIndexedDeferredRendering::drawLightVolumes(ID3D12GraphicsCommandList1* cmdList)
+{
 	// Set necessary state.
-	cmdList->SetPipelineState(m_lightingData.lightBufferPipeline.Get());
+	cmdList->SetPipelineState(m_lightingData.lightBufferPipelines[m_lightingData.lightPassVariants[m_cullingMode]].Get());
 	cmdList->SetGraphicsRootSignature(m_lightingData.lightBufferRootSignature.Get());
-	cmdList->IASetIndexBuffer(&m_lightingData.lightGeometryData.ibView);
 	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	const float blendconstants[] = {
 		0.251f, 0.251f, 0.251f, 0.251f
 	};
 	cmdList->OMSetBlendFactor(blendconstants);
-	
-#ifdef GPU_CULLING
+	cmdList->SetGraphicsRootConstantBufferView(0, m_lightingData.lightPassConstantBuffer->GetGPUVirtualAddress());
 
-	UpdateBuffer(m_lightingData.lBufferCBVS[0].Get(), cbData.m[0], sizeof(cbData.m[0]));
-
-	cmdList->SetGraphicsRootDescriptorTable(0, m_lightingData.lBufferCBVSDescriptors[0]);
-	//cmdList->SetGraphicsRootDescriptorTable(1, m_lightingData.lBufferCBPSDescriptors[0]);
-	const D3D12_VERTEX_BUFFER_VIEW pViews[] = {
-		m_lightingData.lightGeometryData.vbView,
-		m_lightingData.lightCullingData.instanceVBView
-	};
-	cmdList->IASetVertexBuffers(0, static_cast<UINT>(std::size(pViews)), pViews);
-	cmdList->IASetVertexBuffers(0, static_cast<UINT>(std::size(pViews)), pViews);
-
-	//cmdList->IASetVertexBuffers(0, 1, &m_lightingData.lightGeometryData.vbView);
-	//for (int lightIndex = m_lightingData.numLights - 1; lightIndex >= 0; --lightIndex) {
-	//	const Light& light = m_lightingData.lights[lightIndex];
-	//	const Vector4D& lightPosRange = m_lightingData.lightsPositions[lightIndex];
-	//	if (!camera.IsVisible(reinterpret_cast<const BoundingSphere &>(lightPosRange))) {
-	//		continue;
-	//	}
-	//	UpdateBuffer(m_lightingData.lBufferCBPS[lightIndex].Get(), m_lightingData.lightVector4Indices[lightIndex], sizeof(Vector4D));
-	//}
-	cmdList->ExecuteIndirect(m_lightingData.commandSignature.Get(), 1, m_lightingData.lightCullingData.lightCullingIndirectBuffer.Get(), 0, nullptr, 0);
+	if (m_cullingMode == GPUCulling) {
+		ExecuteLightCommands(cmdList, IndirectLightCommands::VolumePass);
+		return;
+	}
 
-#else
-	auto CalculateDepthBounds = [](float& nearVal, float& farVal, float lightSize, const Matrix4x4& modelViewMatrix, const Matrix4x4& projectionMatrix, const Vector3D& lightPosition)
+	auto CalculateDepthBounds = [](float& nearVal, float& farVal, float lightSize, const Matrix4x4& projectionMatrix, const Vector3D& viewSpacePosition)
 	{
 		auto clamp = [](float v, float c0, float c1)
 		{
@@ -1696,7 +2349,7 @@ void LightIndexedDeferredRendering::drawToLightBuffer()
 
 		Vector4D diffVector = Vector4D(0.0f, 0.0f, lightSize, 0.0f);
 
-		Vector4D viewSpaceLightPos = modelViewMatrix * Vector4D(lightPosition.x, lightPosition.y, lightPosition.z, 1.0f);
+		Vector4D viewSpaceLightPos = Vector4D(viewSpacePosition.x, viewSpacePosition.y, viewSpacePosition.z, 1.0f);
 		Vector4D nearVec = projectionMatrix * (viewSpaceLightPos - diffVector);
 		Vector4D farVec = projectionMatrix * (viewSpaceLightPos + diffVector);
 
@@ -1713,92 +2366,76 @@ void LightIndexedDeferredRendering::drawToLightBuffer()
 			nearVal = farVal;
 		}
 	};
-	cmdList->IASetVertexBuffers(0, 1, &m_lightingData.lightGeometryData.vbView);
+	// the view matrix is affine, w of view space positions stays 1
+	const Matrix4x4& proj = camera.GetProjectionMatrix();
+	const Matrix4x4& view = camera.GetViewMatrix();
+	view.TransformPoints(reinterpret_cast<const Vector3D *>(m_lightingData.lightsPositions.data()), sizeof(Vector4D),
+		m_lightingData.lightsViewPositions.data(), sizeof(Vector3D), m_lightingData.numLights);
+	camera.GetFrustum().SpheresInFrustum(m_lightingData.lightsPositions.data(), m_lightingData.numLights, m_lightingData.lightsVisibility.data());
+	const MeshData& lightGeometry = m_lightingData.lightGeometryData[0];
+	cmdList->IASetIndexBuffer(&lightGeometry.ibView);
+	cmdList->IASetVertexBuffers(0, 1, &lightGeometry.vbView);
 	for (int lightIndex = m_lightingData.numLights - 1; lightIndex >= 0; --lightIndex) {
-		const Light& light = m_lightingData.lights[lightIndex];
-		const Vector4D& lightPosRange = m_lightingData.lightsPositions[lightIndex];
-		if (!camera.IsVisible(reinterpret_cast<const BoundingSphere &>(lightPosRange))) {
+		if (!m_lightingData.lightsVisibility[lightIndex]) {
 			continue;
 		}
-		UpdateBuffer(m_lightingData.lBufferCBPS[lightIndex].Get(), m_lightingData.lightVector4Indices[lightIndex], sizeof(Vector4D));
-
-		const LightData lightData = { cbData.m[0],  m_lightingData.lightsPositions[lightIndex] };
-		UpdateBuffer(m_lightingData.lBufferCBVS[lightIndex].Get(), &lightData, sizeof(lightData));
-
-		cmdList->SetGraphicsRootDescriptorTable(0, m_lightingData.lBufferCBVSDescriptors[lightIndex]);
-		cmdList->SetGraphicsRootDescriptorTable(1, m_lightingData.lBufferCBPSDescriptors[lightIndex]);
+		const Vector4D& lightPosRange = m_lightingData.lightsPositions[lightIndex];
+		const LightConstants lightConstants = { lightPosRange, m_lightingData.lightVector4Indices[lightIndex] };
+		cmdList->SetGraphicsRoot32BitConstants(1, LightConstantsNum32Bit, &lightConstants, 0);
 
 		float nearVal;
 		float farVal;
-		const Matrix4x4& proj = camera.GetProjectionMatrix();
-		const Matrix4x4& view = camera.GetViewMatrix();
-		CalculateDepthBounds(nearVal, farVal, lightPosRange.w, view, proj, lightPosRange.xyz());
+		CalculateDepthBounds(nearVal, farVal, lightPosRange.w, proj, m_lightingData.lightsViewPositions[lightIndex]);
 		cmdList->OMSetDepthBounds(nearVal, farVal); 		//nearVal = min(0.5f, nearVal); // ??
-		cmdList->DrawIndexedInstanced(m_lightingData.lightGeometryData.numFaces * 3, 1, 0, 0, 0);
+		cmdList->DrawIndexedInstanced(lightGeometry.numFaces * 3, 1, 0, 0, 0);
 		cmdList->OMSetDepthBounds(0.0f, 1.0f);
 	}
-#endif
-	// Indicate that the back buffer will now be used to present.
-	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightBufferRT.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
-
-	ThrowIfFailed(cmdList->Close());
-
-	// Execute the command list.
-	ID3D12CommandList* ppCommandLists[] = { cmdList };
-	m_commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
-	WaitForPreviousFrame();
 }
 
 void LightIndexedDeferredRendering::drawLightsSources()
 {
 	ID3D12GraphicsCommandList* cmdList = m_commandList.Get();
 	cmdList->SetGraphicsRootSignature(m_lightingData.lightBufferRootSignature.Get());
-	cmdList->SetPipelineState(m_lightingData.lightSourcePipeline.Get());
-	cmdList->IASetIndexBuffer(&m_lightingData.lightGeometryData.ibView);
+	cmdList->SetPipelineState(m_lightingData.lightSourcePipelines[m_lightingData.lightPassVariants[m_cullingMode]].Get());
 	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-#ifdef GPU_CULLING
-
-	const Matrix4x4 m = camera.GetProjectionMatrix() * camera.GetViewMatrix();
-	UpdateBuffer(m_lightingData.lBufferCBVS[0].Get(), m, sizeof(m));
-
-	cmdList->SetGraphicsRootDescriptorTable(0, m_lightingData.lBufferCBVSDescriptors[0]);
-	const D3D12_VERTEX_BUFFER_VIEW pViews[] = {
-		m_lightingData.lightGeometryData.vbView,
-		m_lightingData.lightCullingDataDebug.instanceVBView
-	};
-	cmdList->IASetVertexBuffers(0, static_cast<UINT>(std::size(pViews)), pViews);
-	cmdList->ExecuteIndirect(m_lightingData.commandSignature.Get(), 1, m_lightingData.lightCullingDataDebug.lightCullingIndirectBuffer.Get(), 0, nullptr, 0);
-#else
-	cmdList->IASetVertexBuffers(0, 1, &m_lightingData.lightGeometryData.vbView);
+	cmdList->SetGraphicsRootConstantBufferView(0, m_lightingData.lightPassConstantBuffer->GetGPUVirtualAddress());
+	if (m_cullingMode == GPUCulling) {
+		ExecuteLightCommands(cmdList, IndirectLightCommands::SourcePass);
+		return;
+	}
+	camera.GetFrustum().SpheresInFrustum(m_lightingData.lightsPositions.data(), m_lightingData.numLights, m_lightingData.lightsVisibility.data());
+	const MeshData& lightGeometry = m_lightingData.lightGeometryData[0];
+	cmdList->IASetIndexBuffer(&lightGeometry.ibView);
+	cmdList->IASetVertexBuffers(0, 1, &lightGeometry.vbView);
 	for (int lightIndex = m_lightingData.numLights - 1; lightIndex >= 0; --lightIndex) {
-		const Light& light = m_lightingData.lights[lightIndex];
-		const Vector4D& lightPosRange = m_lightingData.lightsPositions[lightIndex];
-		if (!camera.IsVisible(reinterpret_cast<const BoundingSphere &>(lightPosRange))) {
+		if (!m_lightingData.lightsVisibility[lightIndex]) {
 			continue;
 		}
+		const Light& light = m_lightingData.lights[lightIndex];
+		const Vector4D& lightPosRange = m_lightingData.lightsPositions[lightIndex];
 
-		UpdateBuffer(m_lightingData.lBufferCBPS[lightIndex].Get(), m_lightingData.lights[lightIndex].color, sizeof(Vector4D));
-
-		struct LightData {
-			Matrix4x4 m;
-			Vector4D lightData;
-		};
-		const Vector3D& lpos = m_lightingData.lightsPositions[lightIndex].xyz();
-		const LightData lightData = { camera.GetProjectionMatrix() * camera.GetViewMatrix(),  Vector4D(lpos.x, lpos.y, lpos.z, 1.0f) };
-		//UpdateBuffer(m_lightingData.lBufferCBVS[lightIndex].Get(), &lightData, sizeof(lightData));
-		UpdateBuffer(m_lightingData.lSourceBufferCBVS[lightIndex].Get(), &lightData, sizeof(lightData));
-
-		//cmdList->SetGraphicsRootDescriptorTable(0, m_lightingData.lBufferCBVSDescriptors[lightIndex]);
-		cmdList->SetGraphicsRootDescriptorTable(0, m_lightingData.lSourceCBVSDescriptors[lightIndex]);
-		cmdList->SetGraphicsRootDescriptorTable(1, m_lightingData.lBufferCBPSDescriptors[lightIndex]);
+		const Vector3D& lpos = lightPosRange.xyz();
+		const Vector3D& color = m_lightingData.lights[lightIndex].color;
+		const LightConstants lightConstants = { Vector4D(lpos.x, lpos.y, lpos.z, 1.0f), Vector4D(color.x, color.y, color.z, 1.0f) };
+		cmdList->SetGraphicsRoot32BitConstants(1, LightConstantsNum32Bit, &lightConstants, 0);
 
-		cmdList->DrawIndexedInstanced(m_lightingData.lightGeometryData.numFaces * 3, 1, 0, 0, 0);
+		cmdList->DrawIndexedInstanced(lightGeometry.numFaces * 3, 1, 0, 0, 0);
 	}
-#endif
+}
+
+void LightIndexedDeferredRendering::ExecuteLightCommands(ID3D12GraphicsCommandList* cmdList, uint pass)
+{
+	// vertex and index buffers of the LOD and instances of the bucket are set by every command,
+	// commands of empty buckets are skipped by the count written by BuildCommands
+	const LightCullingData& lightCullingData = m_lightingData.lightCullingData;
+	cmdList->ExecuteIndirect(m_lightingData.commandSignature.Get(), IndirectLightCommands::NumLods,
+		lightCullingData.lightCullingIndirectBuffer.Get(), IndirectLightCommands::GetArgumentOffset(pass),
+		lightCullingData.lightCullingCountBuffer.Get(), IndirectLightCommands::GetCountOffset(pass));
 }
 
 void LightIndexedDeferredRendering::PopulateCommandList()
 {
+	PROFILE_FUNCTION();
     // Command list allocators can only be reset when the associated 
     // command lists have finished execution on the GPU; apps should use 
     // fences to determine GPU execution progress.
@@ -1809,7 +2446,7 @@ void LightIndexedDeferredRendering::PopulateCommandList()
     // However, when ExecuteCommandList() is called on a particular command 
     // list, that command list can then be reset at any time and must be before 
     // re-recording.
-    ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
+    ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), GetScenePipeline()));
 
 
     // Set necessary state.
@@ -1836,34 +2473,36 @@ void LightIndexedDeferredRendering::PopulateCommandList()
     const float clearColor[] = { 0.0f, 0.2f, 0.4f, 1.0f };
     m_commandList->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
     m_commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    m_commandList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
 
+	m_gpuTimer.BeginPass(m_commandList.Get(), ShadingPass);
 #ifdef USE_PLANE
-	m_commandList->IASetIndexBuffer(&ibView);
-	m_commandList->DrawIndexedInstanced(nFaces * 3, 1, 0, 0, 0);
+	drawScene(m_commandList.Get());
 #else
+    m_commandList->IASetVertexBuffers(0, 1, &m_vertexBufferView);
     m_commandList->DrawInstanced(3, 1, 0, 0);
 #endif
+	m_gpuTimer.EndPass(m_commandList.Get(), ShadingPass);
 
+	m_gpuTimer.BeginPass(m_commandList.Get(), LightSourcePass);
 	drawLightsSources();
-#ifdef GPU_CULLING
-	std::array<CD3DX12_RESOURCE_BARRIER, 3> barriers;
-#else
-	std::array<CD3DX12_RESOURCE_BARRIER, 1> barriers;
-#endif
+	m_gpuTimer.EndPass(m_commandList.Get(), LightSourcePass);
+	std::array<CD3DX12_RESOURCE_BARRIER, 4> barriers;
     // Indicate that the back buffer will now be used to present.
     //m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_renderTargets[m_frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
-#ifdef GPU_CULLING
-	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingInstanceBuffer.Get(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-	barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingIndirectBuffer.Get(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-#endif
-	m_commandList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+	UINT numBarriers = 1;
+	if (m_cullingMode == GPUCulling) {
+		barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingInstanceBuffer.Get(), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingIndirectBuffer.Get(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		barriers[numBarriers++] = CD3DX12_RESOURCE_BARRIER::Transition(m_lightingData.lightCullingData.lightCullingCountBuffer.Get(), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	}
+	m_commandList->ResourceBarrier(numBarriers, barriers.data());
     ThrowIfFailed(m_commandList->Close());
 }
 
 void LightIndexedDeferredRendering::WaitForPreviousFrame()
 {
+	PROFILE_FUNCTION();
     // WAITING FOR THE FRAME TO COMPLETE BEFORE CONTINUING IS NOT BEST PRACTICE.
     // This is code implemented as such for simplicity. The D3D12HelloFrameBuffering
     // sample illustrates how to use fences for efficient resource usage and to
@@ -1877,8 +2516,11 @@ void LightIndexedDeferredRendering::WaitForPreviousFrame()
     // Wait until the previous frame is finished.
     if (m_fence->GetCompletedValue() < fence)
     {
+		PROFILE_SCOPE("WaitForFence");
         ThrowIfFailed(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
+		const uint64 waitStart = Timer::GetTicks();
         WaitForSingleObject(m_fenceEvent, INFINITE);
+		m_fenceWaitTicks += Timer::GetTicks() - waitStart;
     }
 
     m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
@@ -1903,4 +2545,27 @@ void LightIndexedDeferredRendering::OnKeyDown(UINT8 key)
 	else if (DIK_D == key || 'D' == key || 'd' == key) {
 		camera.Move(Camera::MOVE_RIGHT, speed);
 	}
+	else if (('C' == key || 'c' == key) && !m_benchmark.IsRunning()) {
+		m_cullingMode = static_cast<CullingMode>((m_cullingMode + 1) % NumCullingModes);
+		m_gpuTimer.ResetStats();
+		LogMsg("Culling mode: %s\n", m_cullingMode == CPUCulling ? "CPU" : "GPU");
+	}
+	else if ('B' == key || 'b' == key) {
+		StartBenchmark();
+	}
+#ifdef USE_PROFILER
+	else if (('P' == key || 'p' == key) && !Profiler::IsCapturing()) {
+		Profiler::StartCapture(m_profileFrames, m_profileFileName.c_str());
+		LogMsg("Profiling %u frames\n", m_profileFrames);
+	}
+#endif
+	else if ('L' == key || 'l' == key) {
+		m_lightingMode = static_cast<LightingMode>((m_lightingMode + 1) % NumLightingModes);
+		m_gpuTimer.ResetStats();
+		LogMsg("Lighting mode: %s\n", m_lightingMode == Forward ? "Forward" : "Light Indexed");
+	}
+	else if ('G' == key || 'g' == key) {
+		LogMsg("GPU passes, %s lighting, %s culling\n%s", m_lightingMode == Forward ? "Forward" : "Light Indexed", m_cullingMode == CPUCulling ? "CPU" : "GPU",
+			m_gpuTimer.GetReport().c_str());
+	}
 }
@@ -13,7 +13,21 @@
 
 #include "DXSample.h"
 #include "Camera.h"
+#include "StagingUploader.h"
+#include "ShaderCache.h"
+#include "ShaderPermutation.h"
+#include "CullingBenchmark.h"
+#include "D3D12TimestampSource.h"
+#include "FrameStats.h"
+#include "IndirectLightCommands.h"
+#include "LightCullingEmulator.h"
+#include "MeshFile.h"
+#include "Profiler.h"
+#include "Terrain.h"
+#include "Timer.h"
 #include <array>
+#include <map>
+#include <memory>
 
 #define USE_PLANE
 
@@ -56,6 +70,46 @@ private:
     static const UINT TextureWidth = 256;
     static const UINT TextureHeight = 256;
     static const UINT TexturePixelSize = 4;    // The number of bytes used to represent a pixel in the texture.
+	static const UINT StagingRingSize = 4 * 1024 * 1024;
+	// width and depth of the generated ground
+	static const UINT GroundSize = 500;
+	static const uint64 ShaderCacheSize = 64 * 1024 * 1024;
+	static constexpr const char* ShaderCacheDirectory = "ShaderCache";
+	static constexpr const char* PipelineLibraryName = "PipelineLibrary";
+
+	// Lighting of the scene pass, switched at runtime
+	enum LightingMode {
+		// all lights in the pixel shader (NO_LIGHT_BUFFER)
+		Forward,
+		// lights indices from the light buffer
+		LightIndexed,
+		NumLightingModes
+	};
+	// Light culling strategy, switched at runtime
+	enum CullingMode {
+		// per-light draws of lights visible on the CPU
+		CPUCulling,
+		// ExecuteIndirect of lights culled by the compute shader
+		GPUCulling,
+		NumCullingModes
+	};
+	// passes timed on the GPU
+	enum GPUPass {
+		CullingPass,
+		DepthPass,
+		LightVolumePass,
+		ShadingPass,
+		LightSourcePass,
+		NumGPUPasses
+	};
+	// benchmark: frames of one run over the camera path, runs of every strategy, frames before measuring
+	static const uint BenchmarkRunFrames = 600;
+	static const uint BenchmarkRuns = 3;
+	static const uint BenchmarkWarmupFrames = 30;
+	// frames between updates of the frame statistics in the window title
+	static const uint FrameStatsOverlayFrames = 30;
+	typedef std::map<ShaderPermutation::VariantKey, ComPtr<ID3DBlob> > ShaderVariants;
+	typedef std::map<ShaderPermutation::VariantKey, ComPtr<ID3D12PipelineState> > PipelineVariants;
 
     struct Vertex  {
         XMFLOAT3 position;
@@ -91,30 +145,28 @@ private:
 	typedef std::array<Vector3D, maxLights> Vector3D_t;
 	typedef lightVector4Indices_t lightPos_t;
 	typedef std::array<float, maxLights> Float_t;
+	typedef std::array<ubyte, maxLights> Visibility_t;
 
-	struct LightInstanceData {
+	// per-light data of light passes, bound as root constants
+	struct LightConstants {
+		// position and radius
 		Vector4D posRange;
-		uint lightIndex;
-	};
-	struct CullingLightInfo {
-		LightInstanceData instanceData;
-		uint padding[3];
-	};
-
-	struct LightData {
-		Matrix4x4 m;
-		Vector4D lightData;
+		// index color for light buffer pass or light color for light sources pass
+		Vector4D index;
 	};
+	static const UINT LightConstantsNum32Bit = sizeof(LightConstants) / sizeof(uint);
 
 	struct LightCullingData {
-		// for lBufferCBVS
+		// descriptors of culling resources
 		D3D12_GPU_DESCRIPTOR_HANDLE_t lightCullingDescriptors;
-		// output instance buffer
+		// output instance buffer, numLights instances of every command
 		ComPtr<ID3D12Resource> lightCullingInstanceBuffer;
-		// output indirect buffer
+		// output indirect buffer, IndirectLightCommands::Command of every pass and LOD
 		ComPtr<ID3D12Resource> lightCullingIndirectBuffer;
-		//
-		ComPtr<ID3D12Resource> lightCullingUpdateIndirectBuffer;
+		// command count of every pass and instance count of every command
+		ComPtr<ID3D12Resource> lightCullingCountBuffer;
+		// commands without instance count, copied by BuildCommands
+		ComPtr<ID3D12Resource> lightCullingCommandTemplates;
 		// buffer with instance data
 		ComPtr<ID3D12Resource> lightCullingDataBuffer;
 		// ConstantBuffer for GPU Culling
@@ -125,21 +177,25 @@ private:
 
 	// 
 	struct LightingData {
+		// GPU_CULLING keyword of light passes
+		ShaderPermutation lightPassPermutation;
+		// variant of light passes of every culling mode
+		std::array<ShaderPermutation::VariantKey, NumCullingModes> lightPassVariants;
 		//
-		ComPtr<ID3D12PipelineState> lightSourcePipeline;
-		ComPtr<ID3D12PipelineState> lightBufferPipeline;
+		PipelineVariants lightSourcePipelines;
+		PipelineVariants lightBufferPipelines;
 
-		// GPU light culling
+		// GPU light culling: clear counts, cull lights, build indirect commands
+		ComPtr<ID3D12PipelineState> lightCullingClearPipeline;
 		ComPtr<ID3D12PipelineState> lightCullingPipeline;
+		ComPtr<ID3D12PipelineState> lightCullingBuildPipeline;
 		// RootSignature for GPU Clight culling
 		ComPtr<ID3D12RootSignature> lightCullingRootSignature;
-		// for execute indirect
+		// for execute indirect: root constants, vertex and index buffers, draw of every light pass command
 		ComPtr<ID3D12CommandSignature> commandSignature;
 		
 		LightCullingData lightCullingData;
 
-		LightCullingData lightCullingDataDebug;
-
 		//
 		ComPtr<ID3D12CommandQueue> computeCommandQueue;
 		//
@@ -147,16 +203,8 @@ private:
 		//
 		ComPtr<ID3D12CommandQueue> copyCommandQueue;
 		//
-		ComPtr<ID3D12GraphicsCommandList> copyCommandList;
-		//
 		ComPtr<ID3D12Fence> computeFence;
 		//
-		ComPtr<ID3D12Fence> copyFence;
-		//
-		HANDLE computeEvent;
-		//
-		HANDLE copyEvent;
-		//
 		UINT64 fence = 0;
 
 
@@ -168,18 +216,8 @@ private:
 		//
 		CD3DX12_CPU_DESCRIPTOR_HANDLE lBRTVHandle;
 		//
-		// constant buffer list of LightData 
-		std::array<ComPtr<ID3D12Resource>, maxLights> lBufferCBVS;
-		// constant buffer list of float4 light index
-		std::array<ComPtr<ID3D12Resource>, maxLights> lBufferCBPS;
-		// // constant buffer list of float4 light color
-		std::array<ComPtr<ID3D12Resource>, maxLights> lSourceBufferCBVS;
-		// for lBufferCBVS
-		D3D12_GPU_DESCRIPTOR_HANDLE_t lBufferCBVSDescriptors;
-		// for lBufferCBPS
-		D3D12_GPU_DESCRIPTOR_HANDLE_t lBufferCBPSDescriptors;
-		// for lSourceBufferCBVS
-		D3D12_GPU_DESCRIPTOR_HANDLE_t lSourceCBVSDescriptors;
+		// view projection matrix of light passes, bound as root CBV
+		ComPtr<ID3D12Resource> lightPassConstantBuffer;
 		// RootSignature for Light buffer pass
 		ComPtr<ID3D12RootSignature> lightBufferRootSignature;
 		// ConstantBuffer for all lights
@@ -194,12 +232,16 @@ private:
 		Float_t lightsRanges;
 		//
 		lightPos_t lightsPositions;
+		// lightsPositions in view space for depth bounds of the light volumes
+		Vector3D_t lightsViewPositions;
+		// 1 for lights in the frustum, CPU culling
+		Visibility_t lightsVisibility;
 		//
 		Vector3D_t dirPosOffsets;
 		//
 		lightVector4Indices_t lightVector4Indices;
-		//
-		MeshData lightGeometryData;
+		// light sphere of every LOD
+		std::array<MeshData, IndirectLightCommands::NumLods> lightGeometryData;
 		//
 		uint numLights;
 		//
@@ -216,13 +258,55 @@ private:
     ComPtr<ID3D12CommandAllocator> m_commandAllocator;
     ComPtr<ID3D12CommandQueue> m_commandQueue;
 	ComPtr<ID3D12CommandAllocator> m_computeCommandAllocator;
-	ComPtr<ID3D12CommandAllocator> m_copyCommandAllocator;
     ComPtr<ID3D12RootSignature> m_rootSignature;
 	ComPtr<ID3D12RootSignature> m_depthRootSignature;
     ComPtr<ID3D12DescriptorHeap> m_rtvHeap;
 	ComPtr<ID3D12DescriptorHeap> m_dsvHeap;
     ComPtr<ID3D12DescriptorHeap> m_srvHeap;
-    ComPtr<ID3D12PipelineState> m_pipelineState;
+	// NO_LIGHT_BUFFER and NUM_LIGHTS keywords of the scene pixel shader
+	ShaderPermutation m_scenePermutation;
+	// scene variant of every lighting mode
+	std::array<ShaderPermutation::VariantKey, NumLightingModes> m_sceneVariants;
+	PipelineVariants m_scenePipelines;
+	LightingMode m_lightingMode = LightIndexed;
+	CullingMode m_cullingMode = CPUCulling;
+	// A/B benchmark of culling modes
+	CullingBenchmark m_benchmark;
+	CullingMode m_cullingModeBeforeBenchmark = CPUCulling;
+	// start benchmark after loading (Benchmark setting)
+	bool m_isBenchmarkRequested = false;
+	// vertex format of the scene and light geometry (VertexFormat setting)
+	VertexFormat::Quantization m_vertexQuantization = VertexFormat::Quantization16;
+	// mesh file of the ground, generated if empty (SceneMesh setting)
+	std::string m_sceneMeshFileName;
+	// cell size of the generated ground (GroundCellSize setting), a size below 2
+	// has more than 65536 vertices and 32 bit indices
+	uint m_groundCellSize = 20;
+	// streamed terrain instead of the ground (Terrain setting)
+	bool m_isTerrainEnabled = false;
+	// frames and file of a profile capture (P key), the startup is captured
+	// if the Profile setting is given
+	uint m_profileFrames = 300;
+	std::string m_profileFileName = "profile.json";
+	bool m_isStartupProfiled = false;
+	// CSV and JSON of the frame statistics written at exit (FrameStats setting),
+	// nothing is written if empty
+	std::string m_frameStatsFileName;
+	// frame statistics in the window title (FrameStatsOverlay setting)
+	bool m_isFrameStatsOverlay = false;
+	// light positions restored at the start of every benchmark run
+	lightPos_t m_benchmarkLightsPositions;
+	Vector3D_t m_benchmarkDirPosOffsets;
+	// CPU time of the frame, from the update to the submission of the command list
+	// without the fence waits
+	Timer m_frameTimer;
+	// ticks spent in WaitForPreviousFrame since the start of the frame, GPU time
+	uint64 m_fenceWaitTicks = 0;
+	FrameStats m_frameStats;
+	D3D12TimestampSource m_timestampSource;
+	GPUTimer m_gpuTimer;
+	// number of the recorded frame in m_gpuTimer
+	uint64 m_gpuFrame = 0;
 	ComPtr<ID3D12PipelineState> m_depthPipelineState;
     ComPtr<ID3D12GraphicsCommandList> m_commandList;
 	D3D12_CPU_DESCRIPTOR_HANDLE m_cbDescriptors;
@@ -233,7 +317,6 @@ private:
 	D3D12_GPU_DESCRIPTOR_HANDLE m_GPUDescriptor;
 	D3D12_GPU_DESCRIPTOR_HANDLE m_textureDescriptor;
 	D3D12_GPU_DESCRIPTOR_HANDLE m_cBDescriptor;
-	uint nFaces;
     UINT m_rtvDescriptorSize;
 
     // App resources.
@@ -241,7 +324,33 @@ private:
 	ComPtr<ID3D12Resource> m_indexBuffer;
 	D3D12_INDEX_BUFFER_VIEW ibView;
     D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
+	// meshlets of the ground, draws of the visible ones in this frame
+	std::vector<Meshlet> m_sceneMeshlets;
+	std::vector<D3D12_DRAW_INDEXED_ARGUMENTS> m_sceneDraws;
+	// buffers of the resident terrain tiles, draws of the visible ones in this frame
+	struct TerrainDraw {
+		const MeshData* meshData;
+		Terrain::Lod lod;
+	};
+	std::unique_ptr<Terrain> m_terrain;
+	std::map<Terrain::TileKey, MeshData> m_terrainBuffers;
+	std::vector<TerrainDraw> m_terrainDraws;
     ComPtr<ID3D12Resource> m_texture;
+	// uploads static geometry to the default heap
+	StagingUploader m_uploader;
+	// shader bytecode and serialized pipelines
+	ShaderCache m_shaderCache;
+	ComPtr<ID3D12PipelineLibrary1> m_pipelineLibrary;
+	// serialized library m_pipelineLibrary was created from
+	ShaderCache::Blob m_pipelineLibraryData;
+	bool m_isPipelineLibraryDirty = false;
+	// pipelines of this run by library name, stored again when the library is rebuilt
+	std::map<std::wstring, ComPtr<ID3D12PipelineState> > m_libraryPipelines;
+	// DxcCreateInstance of dxcompiler.dll, shader model 6 targets are compiled with it
+	// (LoadShader), null if the DLL or dxil.dll which signs the DXIL is missing
+	DxcCreateInstanceProc m_dxcCreateInstance = nullptr;
+	// hash of the version and commit of dxcompiler.dll, a part of the keys of its shaders
+	uint64 m_dxcVersion = 0;
 
     // Synchronization objects.
     UINT m_frameIndex;
@@ -256,7 +365,26 @@ private:
 	LightingData m_lightingData;
 	
 	void InitLightCullingData(LightCullingData& lightCullingData);
-	ID3D12Resource* CreateConstantBuffer(size_t size);
+	ID3D12Resource* CreateConstantBuffer(size_t size, bool createView = true);
+	ComPtr<ID3DBlob> LoadShader(const char* source, size_t sourceSize, const char* sourceName, const D3D_SHADER_MACRO* defines, const char* entryPoint, const char* target);
+	ComPtr<ID3DBlob> CompileDXIL(const char* source, size_t sourceSize, const char* sourceName, const D3D_SHADER_MACRO* defines, const char* entryPoint, const char* target);
+	bool IsWaveCullingSupported();
+	ComPtr<ID3DBlob> LoadShaderFromFile(const wchar_t* fileName, const D3D_SHADER_MACRO* defines, const char* entryPoint, const char* target, const std::string& header = std::string());
+	std::string ReadShaderSource(const wchar_t* fileName);
+	void LoadShaderVariants(ShaderVariants& shaders, const ShaderPermutation& permutation, const std::string& source, const char* sourceName, const char* entryPoint, const char* target);
+	ID3D12PipelineState* GetScenePipeline() const;
+	void LoadSettings(const char* fileName);
+	void InitTimestamps();
+	double GetGPUFrameTime();
+	void StartBenchmark();
+	void UpdateBenchmark();
+	void InitPipelineLibrary();
+	void SavePipelineLibrary();
+	void StorePipeline(const std::wstring& name, ID3D12PipelineState* pipelineState);
+	std::wstring GetPipelineName(const wchar_t* name, const D3D12_SHADER_BYTECODE* shaders, size_t numShaders) const;
+	ComPtr<ID3D12PipelineState> CreatePipeline(const wchar_t* name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	ComPtr<ID3D12PipelineState> CreatePipeline(const wchar_t* name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+	ComPtr<ID3D12PipelineState> CreatePipeline(const wchar_t* name, const D3D12_PIPELINE_STATE_STREAM_DESC& desc, const D3D12_SHADER_BYTECODE& vs, const D3D12_SHADER_BYTECODE& ps);
 	void GeneratePointLights(const Vector3D& start, const Vector3D& end, const Vector2D& RadiusRange);
 	void InitGPULightCullng();
 	void InitLightingSystem();
@@ -265,8 +393,15 @@ private:
     void LoadAssets();
     std::vector<UINT8> GenerateTextureData();
 	void drawToLightBuffer();
+	void CullSceneMeshlets();
+	// uploads the generated tiles and culls the resident ones
+	void UpdateTerrain();
+	void drawScene(ID3D12GraphicsCommandList* cmdList);
+	void drawLightVolumes(ID3D12GraphicsCommandList1* cmdList);
 	void drawLightsSources();
-	void CullLights(LightCullingData& lightCullingData, float R = 0.0f);
+	// ExecuteIndirect of commands built by the GPU culling for the light pass
+	void ExecuteLightCommands(ID3D12GraphicsCommandList* cmdList, uint pass);
+	void CullLights(LightCullingData& lightCullingData);
     void PopulateCommandList();
     void WaitForPreviousFrame();
 	virtual void OnKeyDown(UINT8 /*key*/);
@@ -0,0 +1,214 @@
+// Matrix4x4.cpp: implementation of the Matrix4x4 class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Matrix4x4.h"
+#include "CPUFeatures.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Kernels of the batch transforms. Every kernel evaluates the scalar operators
+// term by term, ((m0 * x + m4 * y) + m8 * z) + m12, multiply and add stay separate
+// instructions (no FMA), so all levels return the same bits.
+
+namespace {
+
+	// points of the array of structures kernel gathered per block
+	const size_t BlockSize = 64;
+
+	template <bool Translate>
+	void TransformScalar(const float* m, const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n)
+	{
+		for (size_t i = 0; i < n; ++i) {
+			const float x = xs[i];
+			const float y = ys[i];
+			const float z = zs[i];
+			float rx = m[0] * x + m[4] * y + m[8] * z;
+			float ry = m[1] * x + m[5] * y + m[9] * z;
+			float rz = m[2] * x + m[6] * y + m[10] * z;
+			if (Translate) {
+				rx += m[12];
+				ry += m[13];
+				rz += m[14];
+			}
+			outX[i] = rx;
+			outY[i] = ry;
+			outZ[i] = rz;
+		}
+	}
+
+#ifdef CPU_X86
+	// c holds columns 0, 1, 2 and the position, 3 floats each
+	template <bool Translate>
+	TARGET_SSE2 void TransformSSE2(const float* m, const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n)
+	{
+		__m128 c[12];
+		for (uint i = 0; i < 12; ++i) {
+			c[i] = _mm_set1_ps(m[(i / 3) * 4 + i % 3]);
+		}
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			const __m128 x = _mm_loadu_ps(xs + i);
+			const __m128 y = _mm_loadu_ps(ys + i);
+			const __m128 z = _mm_loadu_ps(zs + i);
+			__m128 r[3];
+			for (uint j = 0; j < 3; ++j) {
+				r[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[j], x), _mm_mul_ps(c[3 + j], y)), _mm_mul_ps(c[6 + j], z));
+				if (Translate) {
+					r[j] = _mm_add_ps(r[j], c[9 + j]);
+				}
+			}
+			_mm_storeu_ps(outX + i, r[0]);
+			_mm_storeu_ps(outY + i, r[1]);
+			_mm_storeu_ps(outZ + i, r[2]);
+		}
+		TransformScalar<Translate>(m, xs + i, ys + i, zs + i, outX + i, outY + i, outZ + i, n - i);
+	}
+
+	template <bool Translate>
+	TARGET_AVX2 void TransformAVX2(const float* m, const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n)
+	{
+		__m256 c[12];
+		for (uint i = 0; i < 12; ++i) {
+			c[i] = _mm256_set1_ps(m[(i / 3) * 4 + i % 3]);
+		}
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256 x = _mm256_loadu_ps(xs + i);
+			const __m256 y = _mm256_loadu_ps(ys + i);
+			const __m256 z = _mm256_loadu_ps(zs + i);
+			__m256 r[3];
+			for (uint j = 0; j < 3; ++j) {
+				r[j] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c[j], x), _mm256_mul_ps(c[3 + j], y)), _mm256_mul_ps(c[6 + j], z));
+				if (Translate) {
+					r[j] = _mm256_add_ps(r[j], c[9 + j]);
+				}
+			}
+			_mm256_storeu_ps(outX + i, r[0]);
+			_mm256_storeu_ps(outY + i, r[1]);
+			_mm256_storeu_ps(outZ + i, r[2]);
+		}
+		// avoid AVX-SSE transition penalty in the tail
+		_mm256_zeroupper();
+		TransformScalar<Translate>(m, xs + i, ys + i, zs + i, outX + i, outY + i, outZ + i, n - i);
+	}
+
+	template <bool Translate>
+	TARGET_AVX512 void TransformAVX512(const float* m, const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n)
+	{
+		__m512 c[12];
+		for (uint i = 0; i < 12; ++i) {
+			c[i] = _mm512_set1_ps(m[(i / 3) * 4 + i % 3]);
+		}
+		// the tail is a masked iteration
+		for (size_t i = 0; i < n; i += 16) {
+			const __mmask16 mask = n - i >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << (n - i)) - 1);
+			const __m512 x = _mm512_maskz_loadu_ps(mask, xs + i);
+			const __m512 y = _mm512_maskz_loadu_ps(mask, ys + i);
+			const __m512 z = _mm512_maskz_loadu_ps(mask, zs + i);
+			__m512 r[3];
+			for (uint j = 0; j < 3; ++j) {
+				r[j] = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(c[j], x), _mm512_mul_ps(c[3 + j], y)), _mm512_mul_ps(c[6 + j], z));
+				if (Translate) {
+					r[j] = _mm512_add_ps(r[j], c[9 + j]);
+				}
+			}
+			_mm512_mask_storeu_ps(outX + i, mask, r[0]);
+			_mm512_mask_storeu_ps(outY + i, mask, r[1]);
+			_mm512_mask_storeu_ps(outZ + i, mask, r[2]);
+		}
+		_mm256_zeroupper();
+	}
+#endif
+
+	template <bool Translate>
+	void Transform(const float* m, const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n)
+	{
+		assert(m && "NULL Pointer");
+		assert((!n || (xs && ys && zs && outX && outY && outZ)) && "NULL Pointer");
+		switch (CPUFeatures::GetSIMDLevel()) {
+#ifdef CPU_X86
+		case CPUFeatures::AVX512Level:
+			TransformAVX512<Translate>(m, xs, ys, zs, outX, outY, outZ, n);
+			break;
+		case CPUFeatures::AVX2Level:
+			TransformAVX2<Translate>(m, xs, ys, zs, outX, outY, outZ, n);
+			break;
+		case CPUFeatures::SSELevel:
+			TransformSSE2<Translate>(m, xs, ys, zs, outX, outY, outZ, n);
+			break;
+#endif
+		default:
+			TransformScalar<Translate>(m, xs, ys, zs, outX, outY, outZ, n);
+			break;
+		}
+	}
+
+	// Gather blocks of strided vectors into arrays, transform and scatter them back
+	template <bool Translate>
+	void Transform(const float* m, const Vector3D* in, size_t stride, Vector3D* out, size_t outStride, size_t n)
+	{
+		assert((!n || (in && out)) && "NULL Pointer");
+		float x[BlockSize];
+		float y[BlockSize];
+		float z[BlockSize];
+		const char* src = reinterpret_cast<const char *>(in);
+		char* dst = reinterpret_cast<char *>(out);
+		for (size_t first = 0; first < n; first += BlockSize) {
+			const size_t count = n - first < BlockSize ? n - first : BlockSize;
+			for (size_t i = 0; i < count; ++i) {
+				const Vector3D& v = *reinterpret_cast<const Vector3D *>(src + (first + i) * stride);
+				x[i] = v.x;
+				y[i] = v.y;
+				z[i] = v.z;
+			}
+			Transform<Translate>(m, x, y, z, x, y, z, count);
+			for (size_t i = 0; i < count; ++i) {
+				Vector3D& v = *reinterpret_cast<Vector3D *>(dst + (first + i) * outStride);
+				v.x = x[i];
+				v.y = y[i];
+				v.z = z[i];
+			}
+		}
+	}
+
+}
+
+void Matrix4x4::TransformPoints(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n) const
+{
+	Transform<true>(Matrix, xs, ys, zs, outX, outY, outZ, n);
+}
+
+void Matrix4x4::TransformVectors(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n) const
+{
+	Transform<false>(Matrix, xs, ys, zs, outX, outY, outZ, n);
+}
+
+void Matrix4x4::TransformPoints(const Vector3D* points, size_t stride, Vector3D* out, size_t outStride, size_t n) const
+{
+	Transform<true>(Matrix, points, stride, out, outStride, n);
+}
+
+void Matrix4x4::TransformVectors(const Vector3D* vectors, size_t stride, Vector3D* out, size_t outStride, size_t n) const
+{
+	Transform<false>(Matrix, vectors, stride, out, outStride, n);
+}
+
+void Matrix4x4::InvertMany(const Matrix4x4* matrices, Matrix4x4* out, size_t n)
+{
+	assert((!n || (matrices && out)) && "NULL Pointer");
+	// iterations are independent, so the out of order core overlaps the latency of the divisions
+	for (size_t i = 0; i < n; ++i) {
+		SIMD::InvertMatrix(matrices[i].Matrix, out[i].Matrix);
+	}
+}
+
+void Matrix4x4::InvertAffineMany(const Matrix4x4* matrices, Matrix4x4* out, size_t n)
+{
+	assert((!n || (matrices && out)) && "NULL Pointer");
+	for (size_t i = 0; i < n; ++i) {
+		SIMD::InvertAffineMatrix(matrices[i].Matrix, out[i].Matrix);
+	}
+}
@@ -37,31 +37,8 @@ struct D3DXMATRIX;
 
 */
 class ALIGN16 Matrix4x4 {
-private:
-	//
-	INLINE float det2x2(float a1, float a2, float b1, float b2)
-	{
-		return a1 * b2 - b1 * a2;
-	}
-	//
-	INLINE float det3x3(float a1, float a2, float a3,
-								float b1, float b2, float b3,
-								float c1, float c2, float c3)
-	{
-		return a1 * det2x2(b2, b3, c2, c3) - b1 * det2x2(a2, a3, c2, c3) + c1 * det2x2(a2, a3, b2, b3);
-	}
 	public:
-#ifdef SSE
 	union {
-		struct {
-			__m128 m0;
-			__m128 m1;
-			__m128 m2;
-			__m128 m3;
-		};
-#else
-	union {
-#endif
 		float Matrix[16];
 		struct {
 			float x[3];
@@ -86,13 +63,11 @@ private:
 		assert(mat && "NULL Pointer");
 		memcpy(Matrix, mat, sizeof(Matrix4x4));
 	}
-	INLINE Matrix4x4(float a)
+	INLINE constexpr Matrix4x4(float a) : Matrix{a, 0.0f, 0.0f, 0.0f,
+											0.0f, a, 0.0f, 0.0f,
+											0.0f, 0.0f, a, 0.0f,
+											0.0f, 0.0f, 0.0f, a}
 	{
-		Matrix[4] = Matrix[8] = Matrix[12] =
-		Matrix[1] = Matrix[9] = Matrix[13] = Matrix[2] =
-		Matrix[6] = Matrix[14] = Matrix[3] = Matrix[7] =
-		Matrix[11] = 0;
-		Matrix[0] = Matrix[5] = Matrix[10] = Matrix[15] = a;
 	}
 	INLINE D3DXMATRIX* D3D()
 	{
@@ -118,17 +93,17 @@ private:
 	{
 		return Matrix[0];
 	}
-	INLINE float& operator[](int i)
+	INLINE constexpr float& operator[](int i)
 	{
 		assert(i >= 0 && i < 16 && "Out of Range");
 		return Matrix[i];
 	}
-	INLINE const float& operator[](int i) const
+	INLINE constexpr const float& operator[](int i) const
 	{
 		assert(i >= 0 && i < 16 && "Out of Range");
 		return Matrix[i];
 	}
-	INLINE bool IsIdentity() const
+	INLINE constexpr bool IsIdentity() const
 	{
 		if (!Matrix[0] || !Matrix[5] || !Matrix[10] || !Matrix[15]) {
 			return false;
@@ -145,19 +120,19 @@ private:
 		return true;
 	}
 	// 
-	INLINE Matrix4x4 Identity()
+	INLINE static constexpr Matrix4x4 Identity()
 	{
 		return Matrix4x4(1.f);
 	}
 	// 
-	INLINE Matrix4x4& Scale(float x, float y, float z)
+	INLINE constexpr Matrix4x4& Scale(float x, float y, float z)
 	{
 		Matrix[0] = x;
 		Matrix[5] = y;
 		Matrix[10] = z;
 		return *this;
 	}
-	INLINE Matrix4x4& Scale(float scale)
+	INLINE constexpr Matrix4x4& Scale(float scale)
 	{
 		return Scale(scale, scale, scale);
 	}
@@ -343,7 +318,7 @@ private:
 		return a;
 	}
 	//
-	INLINE void Translate(float x, float y, float z)
+	INLINE constexpr void Translate(float x, float y, float z)
 	{
 		Matrix[12] = x;
 		Matrix[13] = y;
@@ -401,10 +376,8 @@ private:
 			1.0f
 		);
 	}
-	INLINE Matrix4x4(const Matrix4x4& a)
-	{
-		*this = a;
-	}
+	// trivial copy keeps the class a literal type
+	Matrix4x4(const Matrix4x4& a) = default;
 	//
 	INLINE Matrix4x4& operator = (const Matrix4x4& a)
 	{
@@ -423,62 +396,7 @@ private:
 	INLINE friend Matrix4x4 operator * (const Matrix4x4& A, const Matrix4x4& B)
 	{
 		Matrix4x4 C;
-#ifdef SSE
-		assert(!(reinterpret_cast<size_t>(&C) & 15) && "Not Aligned memory");
-		assert(!(reinterpret_cast<size_t>(&A) & 15) && "Not Aligned memory");
-		assert(!(reinterpret_cast<size_t>(&B) & 15) && "Not Aligned memory");
-
-		C.m0 = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m0, B.m0, 0x00), A.m0),
-
-		_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m0, B.m0, 0x55), A.m1),
-
-		_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m0, B.m0, 0xAA), A.m2),
-
-		_mm_mul_ps(_mm_shuffle_ps(B.m0, B.m0, 0xFF), A.m3))));
-
-		C.m1 = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m1, B.m1, 0x00), A.m0),
-
-		_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m1, B.m1, 0x55), A.m1),
-
-		_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m1, B.m1, 0xAA), A.m2),
-
-		_mm_mul_ps(_mm_shuffle_ps(B.m1, B.m1,0xFF), A.m3))));
-
-
-		C.m2 = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m2, B.m2, 0x00), A.m0),
-
-		_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m2, B.m2, 0x55), A.m1),
-
-		_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m2, B.m2, 0xAA), A.m2),
-
-		_mm_mul_ps(_mm_shuffle_ps(B.m2, B.m2, 0xFF), A.m3))));
-
-
-		C.m3 = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m3, B.m3, 0x00), A.m0),
-
-		_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m3, B.m3, 0x55), A.m1),
-
-		_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(B.m3, B.m3,0xAA), A.m2),
-
-		_mm_mul_ps(_mm_shuffle_ps(B.m3, B.m3, 0xFF), A.m3))));
-#else
-		C[0] = A[0] * B[0] + A[4] * B[1] + A[8] * B[2] + A[12] * B[3];
-		C[1] = A[1] * B[0] + A[5] * B[1] + A[9] * B[2] + A[13] * B[3];
-		C[2] = A[2] * B[0] + A[6] * B[1] + A[10] * B[2] + A[14] * B[3];
-		C[3] = A[3] * B[0] + A[7] * B[1] + A[11] * B[2] + A[15] * B[3];
-		C[4] = A[0] * B[4] + A[4] * B[5] + A[8] * B[6] + A[12] * B[7];
-		C[5] = A[1] * B[4] + A[5] * B[5] + A[9] * B[6] + A[13] * B[7];
-		C[6] = A[2] * B[4] + A[6] * B[5] + A[10] * B[6] + A[14] * B[7];
-		C[7] = A[3] * B[4] + A[7] * B[5] + A[11] * B[6] + A[15] * B[7];
-		C[8] = A[0] * B[8] + A[4] * B[9] + A[8] * B[10] + A[12] * B[11];
-		C[9] = A[1] * B[8] + A[5] * B[9] + A[9] * B[10] + A[13] * B[11];
-		C[10] = A[2] * B[8] + A[6] * B[9] + A[10] * B[10] + A[14] * B[11];
-		C[11] = A[3] * B[8] + A[7] * B[9] + A[11] * B[10] + A[15] * B[11];
-		C[12] = A[0] * B[12] + A[4] * B[13] + A[8] * B[14] + A[12] * B[15];
-		C[13] = A[1] * B[12] + A[5] * B[13] + A[9] * B[14] + A[13] * B[15];
-		C[14] = A[2] * B[12] + A[6] * B[13] + A[10] * B[14] + A[14] * B[15];
-		C[15] = A[3] * B[12] + A[7] * B[13] + A[11] * B[14] + A[15] * B[15];
-#endif
+		SIMD::MultiplyMatrix(A.Matrix, B.Matrix, C.Matrix);
 		return C;
 	}
 	//
@@ -609,10 +527,7 @@ private:
 	}
 	INLINE friend Vector4D operator * (const Vector4D& b, const Matrix4x4& a)
 	{
-		return Vector4D(a[0] * b.x + a[4] * b.y + a[8] * b.z + a[12] * b.w,
-				a[1] * b.x + a[5] * b.y + a[9] * b.z + a[13] * b.w,
-				a[2] * b.x + a[6] * b.y + a[10] * b.z + a[14] * b.w,
-				a[3] * b.x + a[7] * b.y + a[11] * b.z + a[15] * b.w);
+		return Vector4D(SIMD::MultiplyVector(a.Matrix, b.Load()));
 	}
 	INLINE friend Vector4D operator * (const Matrix4x4& a, const Vector4D& b)
 	{
@@ -622,6 +537,15 @@ private:
 	{
 		return a * b;
 	}
+	// Batch transforms, kernel (SSE2, AVX2, AVX-512) is picked at runtime by CPUFeatures.
+	// Points are transformed as v * mat + GetPosition(), vectors as mat * v, results are
+	// bit identical to the scalar operators. Outputs may be the inputs, but no other overlap.
+	// Structure of arrays
+	void TransformPoints(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n) const;
+	void TransformVectors(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n) const;
+	// Array of structures, strides in bytes allow vectors inside of larger structs
+	void TransformPoints(const Vector3D* points, size_t stride, Vector3D* out, size_t outStride, size_t n) const;
+	void TransformVectors(const Vector3D* vectors, size_t stride, Vector3D* out, size_t outStride, size_t n) const;
 	//
 	INLINE friend Matrix4x4 operator + (const Matrix4x4& a, const Matrix4x4& b)
 	{
@@ -638,56 +562,21 @@ private:
 		c -= b;
 		return c;
 	}
-	//
+	// General inverse, see SIMD::InvertMatrix
 	INLINE Matrix4x4& Invert(const Matrix4x4& A)
 	{
-		Matrix[0] =  det3x3(A[5], A[6], A[7], A[9], A[10], A[11], A[13], A[14], A[15]);
-		Matrix[1] = -det3x3(A[1], A[2], A[3], A[9], A[10], A[11], A[13], A[14], A[15]);
-		Matrix[2] =  det3x3(A[1], A[2], A[3], A[5], A[6], A[7], A[13], A[14], A[15]);
-		Matrix[3] = -det3x3(A[1], A[2], A[3], A[5], A[6], A[7], A[9], A[10], A[11]);
-
-		Matrix[4] = -det3x3(A[4], A[6], A[7], A[8], A[10], A[11], A[12], A[14], A[15]);
-		Matrix[5] =  det3x3(A[0], A[2], A[3], A[8], A[10], A[11], A[12], A[14], A[15]);
-		Matrix[6] = -det3x3(A[0], A[2], A[3], A[4], A[6], A[7], A[12], A[14], A[15]);
-		Matrix[7] =  det3x3(A[0], A[2], A[3], A[4], A[6], A[7], A[8], A[10], A[11]);
-
-		Matrix[8] =  det3x3(A[4], A[5], A[7], A[8], A[9], A[11], A[12], A[13], A[15]);
-		Matrix[9] = -det3x3(A[0], A[1], A[3], A[8], A[9], A[11], A[12], A[13], A[15]);
-		Matrix[10] =  det3x3(A[0], A[1], A[3], A[4], A[5], A[7], A[12], A[13], A[15]);
-		Matrix[11] = -det3x3(A[0], A[1], A[3], A[4], A[5], A[7], A[8], A[9], A[11]);
-
-		Matrix[12] = -det3x3(A[4], A[5], A[6], A[8], A[9], A[10], A[12], A[13], A[14]);
-		Matrix[13] =  det3x3(A[0], A[1], A[2], A[8], A[9], A[10], A[12], A[13], A[14]);
-		Matrix[14] = -det3x3(A[0], A[1], A[2], A[4], A[5], A[6], A[12], A[13], A[14]);
-		Matrix[15] =  det3x3(A[0], A[1], A[2], A[4], A[5], A[6], A[8], A[9], A[10]);
-
-		float det = (A[0] * Matrix[0]) + (A[4] * Matrix[1]) + (A[8] * Matrix[2]) + (A[12] * Matrix[3]);
-									// The following divions goes unchecked for division
-									// by zero. We should consider throwing Matrixn exception
-									// if det < eps.
-		float oodet = 1 / det;
-		Matrix[0] *= oodet;
-		Matrix[1] *= oodet;
-		Matrix[2] *= oodet;
-		Matrix[3] *= oodet;
-
-		Matrix[4] *= oodet;
-		Matrix[5] *= oodet;
-		Matrix[6] *= oodet;
-		Matrix[7] *= oodet;
-
-		Matrix[8] *= oodet;
-		Matrix[9] *= oodet;
-		Matrix[10] *= oodet;
-		Matrix[11] *= oodet;
-
-		Matrix[12] *= oodet;
-		Matrix[13] *= oodet;
-		Matrix[14] *= oodet;
-		Matrix[15] *= oodet;
-
+		SIMD::InvertMatrix(A.Matrix, Matrix);
+		return *this;
+	}
+	// Inverse of a matrix with last row 0, 0, 0, 1, rotation may have scale and shear
+	INLINE Matrix4x4& InvertAffine(const Matrix4x4& A)
+	{
+		SIMD::InvertAffineMatrix(A.Matrix, Matrix);
 		return *this;
 	}
+	// Invert n matrices, out may be matrices
+	static void InvertMany(const Matrix4x4* matrices, Matrix4x4* out, size_t n);
+	static void InvertAffineMany(const Matrix4x4* matrices, Matrix4x4* out, size_t n);
 	INLINE friend Matrix4x4 Invert(const Matrix4x4& A)
 	{
 		Matrix4x4 invertA;
@@ -757,7 +646,7 @@ private:
 		Matrix[14] = 2.0f * zNear * zFar / (zNear - zFar);
 		Matrix[15] = 0.0f;
 	}
-	INLINE void PerspectiveOpenGL(float width, float height, float zNear, float zFar)
+	INLINE constexpr void PerspectiveOpenGL(float width, float height, float zNear, float zFar)
 	{
 		assert(width > 0 && "Invalid Value");
 		assert(height > 0 && "Invalid Value");
@@ -814,7 +703,7 @@ private:
 		Matrix[14] = zNear * zFar / (zNear - zFar);
 		Matrix[15] = 0.0f;
 	}
-	INLINE void PerspectiveDirect3D(float width, float height, float zNear, float zFar)
+	INLINE constexpr void PerspectiveDirect3D(float width, float height, float zNear, float zFar)
 	{
 		assert(width > 0 && "Invalid Value");
 		assert(height > 0 && "Invalid Value");
@@ -841,7 +730,7 @@ private:
 		Matrix[14] = zNear * zFar / (zNear - zFar);
 		Matrix[15] = 0.0f;
 	}
-	INLINE void PerspectiveDirect3D(float left, float right, float top, float bottom, float zNear, float zFar)
+	INLINE constexpr void PerspectiveDirect3D(float left, float right, float top, float bottom, float zNear, float zFar)
 	{
 		float w = right - left;
 		float h = top - bottom;
@@ -877,7 +766,7 @@ private:
 		Matrix[14] *= 0.5f;
 	}
 	// Ortho Matrix for OpenGL
-	INLINE void OrthoOpenGL(float left, float right, float top, float bottom, float zNear, float zFar)
+	INLINE constexpr void OrthoOpenGL(float left, float right, float top, float bottom, float zNear, float zFar)
 	{
 		assert(right != left && "Invalid Value");
 		assert(top != bottom && "Invalid Value");
@@ -910,7 +799,7 @@ private:
 		Matrix[15] = 1.0f;
 	}
 	// Ortho Matrix for OpenGL
-	INLINE void OrthoOpenGL(float width, float height, float zNear, float zFar)
+	INLINE constexpr void OrthoOpenGL(float width, float height, float zNear, float zFar)
 	{
 		assert(width > 0.0f && "Invalid Value");
 		assert(height > 0.0f && "Invalid Value");
@@ -940,7 +829,7 @@ private:
 		Matrix[15] = 1.0f;
 	}
 	// Ortho Matrix for Direct3D
-	INLINE void OrthoDirect3D(float left, float right, float top, float bottom, float zNear, float zFar)
+	INLINE constexpr void OrthoDirect3D(float left, float right, float top, float bottom, float zNear, float zFar)
 	{
 		assert(right != left && "Invalid Value");
 		assert(top != bottom && "Invalid Value");
@@ -973,7 +862,7 @@ private:
 		Matrix[15] = 1.0f;
 	}
 	// Ortho Matrix for Direct3D
-	INLINE void OrthoDirect3D(float width, float height, float zNear, float zFar)
+	INLINE constexpr void OrthoDirect3D(float width, float height, float zNear, float zFar)
 	{
 		assert(width > 0.0f && "Invalid Value");
 		assert(height > 0.0f && "Invalid Value");
@@ -1003,7 +892,7 @@ private:
 		Matrix[15] = 1.0f;
 	}
 	// Ortho Matrix for Vulkan
-	INLINE void OrthoVulkan(float width, float height, float zNear, float zFar)
+	INLINE constexpr void OrthoVulkan(float width, float height, float zNear, float zFar)
 	{
 		assert(width > 0.0f && "Invalid Value");
 		assert(height > 0.0f && "Invalid Value");
@@ -1033,7 +922,7 @@ private:
 		Matrix[15] = 1.0f;
 	}
 	// Ortho Matrix for Vulkan
-	INLINE void OrthoVulkan(float left, float right, float top, float bottom, float zNear, float zFar)
+	INLINE constexpr void OrthoVulkan(float left, float right, float top, float bottom, float zNear, float zFar)
 	{
 		assert(right != left && "Invalid Value");
 		assert(top != bottom && "Invalid Value");
@@ -1065,6 +954,61 @@ private:
 		Matrix[14] = zNear / dnf;
 		Matrix[15] = 1.0f;
 	}
+	// Projections with fixed parameters can be built at compile time
+	INLINE static constexpr Matrix4x4 MakePerspectiveOpenGL(float width, float height, float zNear, float zFar)
+	{
+		Matrix4x4 m(0.0f);
+		m.PerspectiveOpenGL(width, height, zNear, zFar);
+		return m;
+	}
+	INLINE static constexpr Matrix4x4 MakePerspectiveDirect3D(float width, float height, float zNear, float zFar)
+	{
+		Matrix4x4 m(0.0f);
+		m.PerspectiveDirect3D(width, height, zNear, zFar);
+		return m;
+	}
+	INLINE static constexpr Matrix4x4 MakeOrthoOpenGL(float width, float height, float zNear, float zFar)
+	{
+		Matrix4x4 m(0.0f);
+		m.OrthoOpenGL(width, height, zNear, zFar);
+		return m;
+	}
+	INLINE static constexpr Matrix4x4 MakeOrthoOpenGL(float left, float right, float top, float bottom, float zNear, float zFar)
+	{
+		Matrix4x4 m(0.0f);
+		m.OrthoOpenGL(left, right, top, bottom, zNear, zFar);
+		return m;
+	}
+	INLINE static constexpr Matrix4x4 MakeOrthoDirect3D(float width, float height, float zNear, float zFar)
+	{
+		Matrix4x4 m(0.0f);
+		m.OrthoDirect3D(width, height, zNear, zFar);
+		return m;
+	}
+	INLINE static constexpr Matrix4x4 MakeOrthoDirect3D(float left, float right, float top, float bottom, float zNear, float zFar)
+	{
+		Matrix4x4 m(0.0f);
+		m.OrthoDirect3D(left, right, top, bottom, zNear, zFar);
+		return m;
+	}
+	INLINE static constexpr Matrix4x4 MakeOrthoVulkan(float width, float height, float zNear, float zFar)
+	{
+		Matrix4x4 m(0.0f);
+		m.OrthoVulkan(width, height, zNear, zFar);
+		return m;
+	}
+	INLINE static constexpr Matrix4x4 MakeTranslation(float x, float y, float z)
+	{
+		Matrix4x4 m(1.0f);
+		m.Translate(x, y, z);
+		return m;
+	}
+	INLINE static constexpr Matrix4x4 MakeScale(float x, float y, float z)
+	{
+		Matrix4x4 m(1.0f);
+		m.Scale(x, y, z);
+		return m;
+	}
 	//
 	INLINE void LookAtDirect3D(const Vector3D& eye, const Vector3D& lookat, const Vector3D& up)
 	{
@@ -1152,15 +1096,14 @@ private:
 		Matrix[15] = 1.0f;
 	}
 
-	INLINE Matrix4x4(float a, float d, float h, float l,
+	INLINE constexpr Matrix4x4(float a, float d, float h, float l,
 					float b, float e, float i, float m,
 					float c, float f, float j, float n,
-					float p, float q, float r, float s)
+					float p, float q, float r, float s) : Matrix{a, b, c, p,
+																d, e, f, q,
+																h, i, j, r,
+																l, m, n, s}
 	{
-		Matrix[0] = a;Matrix[4] = d; Matrix[8] = h; Matrix[12] =l;
-		Matrix[1] = b;Matrix[5] = e; Matrix[9] = i; Matrix[13] = m;
-		Matrix[2] = c;Matrix[6] = f; Matrix[10] = j; Matrix[14] = n;
-		Matrix[3] = p;Matrix[7] = q; Matrix[11] = r; Matrix[15] = s;
 	}
 	//
 	INLINE void LoadIdentity()
@@ -1220,4 +1163,9 @@ private:
 	}
 };
 
+static_assert(Matrix4x4::Identity().IsIdentity(), "Identity must be usable in constant expressions");
+static_assert(Matrix4x4::MakeOrthoDirect3D(2.0f, 2.0f, 0.0f, 1.0f).IsIdentity(), "unit ortho projection of Direct3D must be identity");
+static_assert(Matrix4x4::MakePerspectiveDirect3D(2.0f, 2.0f, 1.0f, 2.0f)[11] == 1.0f, "Direct3D perspective must copy z to w");
+static_assert(Matrix4x4::MakeTranslation(1.0f, 2.0f, 3.0f)[13] == 2.0f, "translation must be stored in the last column");
+
 #endif
@@ -0,0 +1,273 @@
+// MeshFile.cpp: implementation of the MeshFile class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MeshFile.h"
+#include "Hasher.h"
+#include <cmath>
+#include <cstdio>
+#ifdef _WIN32
+#include "Platform.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	// meshlets are stored as they are in memory
+	static_assert(sizeof(Meshlet) == 48, "Meshlet layout is a part of the file format");
+	static_assert(sizeof(MeshFile::Header) % 8 == 0, "Header must keep 64-bit fields aligned");
+
+	INLINE uint64 AlignSection(uint64 offset)
+	{
+		return (offset + MeshFile::SectionAlignment - 1) & ~static_cast<uint64>(MeshFile::SectionAlignment - 1);
+	}
+
+	// format of the header elements, fails on invalid values instead of asserting
+	bool CreateVertexFormat(const MeshFile::Header& header, VertexFormat& format)
+	{
+		if (!header.numElements || header.numElements > VertexFormat::NumAttributes || header.elements[0].attribute != VertexFormat::Position) {
+			return false;
+		}
+		uint attributes = 0;
+		for (uint i = 0; i < header.numElements; ++i) {
+			const MeshFile::ElementDesc& element = header.elements[i];
+			if (element.attribute >= VertexFormat::NumAttributes || element.format >= VertexFormat::NumElementFormats || (attributes & (1u << element.attribute))) {
+				return false;
+			}
+			attributes |= 1u << element.attribute;
+			format.Add(static_cast<VertexFormat::Attribute>(element.attribute), static_cast<VertexFormat::ElementFormat>(element.format));
+			if (format.GetElement(i).offset != element.offset) {
+				return false;
+			}
+		}
+		for (uint i = 0; i < 3; ++i) {
+			if (!std::isfinite(header.boundsMin[i]) || !std::isfinite(header.boundsMax[i]) || header.boundsMin[i] > header.boundsMax[i]) {
+				return false;
+			}
+		}
+		format.SetBounds(Vector3D(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]), Vector3D(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]));
+		return format.GetStride() == header.stride;
+	}
+
+}
+
+MeshFile::MeshFile() : data(nullptr), size(0)
+#ifdef _WIN32
+	, file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#endif
+{
+}
+
+MeshFile::~MeshFile()
+{
+	Close();
+}
+
+bool MeshFile::Open(const char* fileName)
+{
+	assert(fileName && "NULL Pointer");
+	Close();
+#ifdef _WIN32
+	file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(Header))) {
+		Close();
+		return false;
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view) {
+		Close();
+		return false;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	const int fd = open(fileName, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) || fileStat.st_size < static_cast<off_t>(sizeof(Header))) {
+		close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps the file
+	close(fd);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	size = static_cast<size_t>(fileStat.st_size);
+	// sections are read once from start to end
+	madvise(view, size, MADV_SEQUENTIAL);
+#endif
+	data = static_cast<const ubyte *>(view);
+	if (!IsValid()) {
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MeshFile::Close()
+{
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (data) {
+		munmap(const_cast<ubyte *>(data), size);
+	}
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+bool MeshFile::IsValid() const
+{
+	const Header& header = GetHeader();
+	if (header.magic != Magic || header.version != Version || (header.indexSize != 2 && header.indexSize != 4) || header.numIndices % 3) {
+		return false;
+	}
+	VertexFormat format;
+	if (!CreateVertexFormat(header, format)) {
+		return false;
+	}
+	const uint64 sectionSizes[NumSections] = {
+		static_cast<uint64>(header.numVertices) * header.stride,
+		static_cast<uint64>(header.numIndices) * header.indexSize,
+		static_cast<uint64>(header.numMeshlets) * sizeof(Meshlet),
+		static_cast<uint64>(header.numMeshletVertices) * sizeof(uint)
+	};
+	for (uint i = 0; i < NumSections; ++i) {
+		const uint64 offset = header.sectionOffsets[i];
+		if (header.sectionSizes[i] != sectionSizes[i] || offset % SectionAlignment || offset < sizeof(Header) || offset > size || sectionSizes[i] > size - offset) {
+			return false;
+		}
+	}
+	// meshlets address the draws, their vertices are only informative
+	const Meshlet* meshlets = reinterpret_cast<const Meshlet *>(data + header.sectionOffsets[Meshlets]);
+	const uint numFaces = header.numIndices / 3;
+	for (uint i = 0; i < header.numMeshlets; ++i) {
+		const Meshlet& meshlet = meshlets[i];
+		if (meshlet.triangleOffset > numFaces || meshlet.triangleCount > numFaces - meshlet.triangleOffset ||
+			meshlet.vertexOffset > header.numMeshletVertices || meshlet.vertexCount > header.numMeshletVertices - meshlet.vertexOffset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+VertexFormat MeshFile::GetVertexFormat() const
+{
+	VertexFormat format;
+	const bool isValid = CreateVertexFormat(GetHeader(), format);
+	assert(isValid && "Invalid Value");
+	(void)isValid;
+	return format;
+}
+
+void MeshFile::GetMeshlets(std::vector<Meshlet>& meshlets) const
+{
+	const Meshlet* first = static_cast<const Meshlet *>(GetSection(Meshlets));
+	meshlets.assign(first, first + GetHeader().numMeshlets);
+}
+
+bool MeshFile::VerifyChecksum() const
+{
+	Hasher hasher;
+	for (uint i = 0; i < NumSections; ++i) {
+		hasher.Add(GetSection(static_cast<Section>(i)), GetSectionSize(static_cast<Section>(i)));
+	}
+	return hasher.Get() == GetHeader().checksum;
+}
+
+bool MeshFile::Write(const char* fileName, const Mesh& mesh, const VertexFormat& format, const std::vector<Meshlet>& meshlets, const std::vector<uint>& meshletVertices)
+{
+	assert(fileName && "NULL Pointer");
+	assert(mesh.stride == format.GetSourceFormat().GetStride() && "Invalid Value");
+	assert(mesh.GetNumVertices() && "Invalid Value");
+	Header header = {};
+	header.magic = Magic;
+	header.version = Version;
+	Vector3D minimum;
+	Vector3D maximum;
+	mesh.GetBounds(minimum, maximum);
+	for (uint i = 0; i < 3; ++i) {
+		header.boundsMin[i] = minimum[i];
+		header.boundsMax[i] = maximum[i];
+	}
+	VertexFormat fileFormat = format;
+	fileFormat.SetBounds(minimum, maximum);
+	header.numElements = fileFormat.GetNumElements();
+	for (uint i = 0; i < header.numElements; ++i) {
+		const VertexFormat::Element& element = fileFormat.GetElement(i);
+		header.elements[i].attribute = element.attribute;
+		header.elements[i].format = element.format;
+		header.elements[i].offset = element.offset;
+	}
+	header.numVertices = mesh.GetNumVertices();
+	header.stride = fileFormat.GetStride();
+	header.numIndices = static_cast<uint>(mesh.indices.size());
+	header.indexSize = mesh.Needs32BitIndices() ? sizeof(uint) : sizeof(ushort);
+	header.numMeshlets = static_cast<uint>(meshlets.size());
+	header.numMeshletVertices = static_cast<uint>(meshletVertices.size());
+
+	std::vector<ubyte> vertices(static_cast<size_t>(header.numVertices) * header.stride);
+	fileFormat.Encode(mesh.vertices.data(), header.numVertices, vertices.data());
+	std::vector<ushort> shortIndices;
+	const void* indices = mesh.indices.data();
+	if (header.indexSize == sizeof(ushort)) {
+		shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+		indices = shortIndices.data();
+	}
+	const void* sections[NumSections] = { vertices.data(), indices, meshlets.data(), meshletVertices.data() };
+	header.sectionSizes[Vertices] = vertices.size();
+	header.sectionSizes[Indices] = static_cast<uint64>(header.numIndices) * header.indexSize;
+	header.sectionSizes[Meshlets] = meshlets.size() * sizeof(Meshlet);
+	header.sectionSizes[MeshletVertices] = meshletVertices.size() * sizeof(uint);
+	Hasher hasher;
+	uint64 offset = sizeof(Header);
+	for (uint i = 0; i < NumSections; ++i) {
+		offset = AlignSection(offset);
+		header.sectionOffsets[i] = offset;
+		offset += header.sectionSizes[i];
+		hasher.Add(sections[i], static_cast<size_t>(header.sectionSizes[i]));
+	}
+	header.checksum = hasher.Get();
+
+	FILE* f = fopen(fileName, "wb");
+	if (!f) {
+		return false;
+	}
+	static const ubyte Padding[SectionAlignment] = {};
+	bool res = fwrite(&header, sizeof(header), 1, f) == 1;
+	uint64 position = sizeof(Header);
+	for (uint i = 0; i < NumSections && res; ++i) {
+		const size_t paddingSize = static_cast<size_t>(header.sectionOffsets[i] - position);
+		const size_t sectionSize = static_cast<size_t>(header.sectionSizes[i]);
+		res = (!paddingSize || fwrite(Padding, 1, paddingSize, f) == paddingSize) && (!sectionSize || fwrite(sections[i], 1, sectionSize, f) == sectionSize);
+		position = header.sectionOffsets[i] + sectionSize;
+	}
+	res = !fclose(f) && res;
+	if (!res) {
+		remove(fileName);
+	}
+	return res;
+}
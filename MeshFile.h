@@ -0,0 +1,110 @@
+// MeshFile.h: interface for the MeshFile class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __MESHFILE_H__
+#define __MESHFILE_H__
+
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+
+// Binary mesh container: a header followed by the vertex, index, meshlet and meshlet
+// vertex sections. Vertices are stored in their vertex format and indices in their
+// final width, every section starts at a multiple of SectionAlignment, so sections of
+// the mapped file are copied to upload memory as they are.
+class MeshFile  {
+public:
+	static const uint Magic = 0x48534D4C; // LMSH
+	// Bump when the layout changes, older files are rejected
+	static const uint Version = 2;
+	static const uint SectionAlignment = 256;
+	enum Section {
+		Vertices,
+		Indices,
+		Meshlets,
+		MeshletVertices,
+		NumSections
+	};
+	// VertexFormat::Element with fixed size fields
+	struct ElementDesc {
+		uint attribute;
+		uint format;
+		uint offset;
+	};
+	struct Header {
+		uint magic;
+		uint version;
+		uint numVertices;
+		uint stride;
+		uint numIndices;
+		// 2 or 4 bytes
+		uint indexSize;
+		uint numMeshlets;
+		uint numMeshletVertices;
+		uint numElements;
+		ElementDesc elements[VertexFormat::NumAttributes];
+		// bounds of the positions, quantized positions are relative to them
+		float boundsMin[3];
+		float boundsMax[3];
+		// from the start of the file
+		uint64 sectionOffsets[NumSections];
+		uint64 sectionSizes[NumSections];
+		// 64-bit FNV-1a of the sections
+		uint64 checksum;
+	};
+private:
+	const ubyte* data;
+	size_t size;
+#ifdef _WIN32
+	// file and mapping handles
+	void* file;
+	void* mapping;
+#endif
+
+	MeshFile(const MeshFile&);
+	MeshFile& operator = (const MeshFile&);
+	bool IsValid() const;
+public:
+	MeshFile();
+	~MeshFile();
+	// Maps the file and checks the header, sections and meshlet ranges.
+	// The checksum is not computed, it would read every page of the file
+	bool Open(const char* fileName);
+	//
+	void Close();
+	//
+	INLINE bool IsOpen() const
+	{
+		return data != nullptr;
+	}
+	//
+	INLINE const Header& GetHeader() const
+	{
+		assert(data && "NULL Pointer");
+		return *reinterpret_cast<const Header *>(data);
+	}
+	// Section in the mapped file, valid until Close
+	INLINE const void* GetSection(Section section) const
+	{
+		assert(section < NumSections && "Out Of Range");
+		return data + GetHeader().sectionOffsets[section];
+	}
+	//
+	INLINE size_t GetSectionSize(Section section) const
+	{
+		assert(section < NumSections && "Out Of Range");
+		return static_cast<size_t>(GetHeader().sectionSizes[section]);
+	}
+	// Vertex format of the vertex section with the bounds of the header
+	VertexFormat GetVertexFormat() const;
+	//
+	void GetMeshlets(std::vector<Meshlet>& meshlets) const;
+	// Checksum of the sections matches the header
+	bool VerifyChecksum() const;
+
+	// Encodes a mesh in the source format of format, quantized to the bounds of its
+	// positions. Indices are 16 bit if they address all vertices.
+	static bool Write(const char* fileName, const Mesh& mesh, const VertexFormat& format, const std::vector<Meshlet>& meshlets, const std::vector<uint>& meshletVertices);
+};
+
+#endif // __MESHFILE_H__
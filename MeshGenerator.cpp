@@ -0,0 +1,144 @@
+// MeshGenerator.cpp: implementation of the MeshGenerator class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MeshGenerator.h"
+#include "Matrix4x4.h"
+#include <cmath>
+
+void MeshGenerator::CreateSphere(Mesh& mesh, uint numRings, uint numSectors, float Radius)
+{
+	uint numTriangles = (numRings + 1) * numSectors * 2;
+	//
+	uint numVertex = (numRings + 1) * numSectors + 2;
+
+	mesh.stride = sizeof(Vector3D);
+	mesh.vertices.assign(numVertex * sizeof(Vector3D), 0);
+	mesh.indices.assign(numTriangles * 3, 0);
+	Vector3D* positions = reinterpret_cast<Vector3D *>(mesh.vertices.data());
+	//
+	// last index of last vertex
+	uint last = numVertex - 1; // Soutch
+	// North
+	positions[0] = Vector3D(0.0f, Radius, 0.0f);
+	positions[last] = Vector3D(0.0f, -Radius, 0.0f);
+	const float PI = static_cast<float>(Pi);
+	//
+	float da = PI / (numRings + 2.0f);
+	float db = 2.0f * PI / numSectors;
+	float af = PI - da / 2.0f;
+	float bf = 2.0f * PI - db / 2.0f;
+	//
+	uint n = 1;
+	//
+	for (float a = da; a < af; a += da) {
+		//
+		float y = Radius * cosf(a);
+		//
+		float xz = Radius * sinf(a);
+		//
+		for (float b = 0.0; b < bf; n++, b += db) {
+			//
+			float x = xz * sinf(b);
+			float z = xz * cosf(b);
+			assert(n < last && "Out Of Range");
+			positions[n] = Vector3D(x, y, z);
+		}
+	}
+	//
+	struct Face {
+		uint i1;
+		uint i2;
+		uint i3;
+	};
+	Face* t = reinterpret_cast<Face *>(mesh.indices.data());
+	// num sectors
+	for (n = 0; n < numSectors; n += 3) {
+		//
+		t[n].i1 = 0;
+		//
+		t[n].i2 = n + 1;
+		//
+		t[n].i3 = n == numSectors - 1 ? 1 : n + 2;
+		//
+		t[numTriangles - numSectors + n].i1 = numVertex - 1;
+		t[numTriangles - numSectors + n].i2 = numVertex - 2 - n;
+		t[numTriangles - numSectors + n].i3 = numVertex - 2 - ((1 + n) % numSectors);
+	}
+	//
+	int k = 1;
+	// numSectors
+	for (uint i = 0; i < numRings; i++, k += numSectors) {
+		for (uint j = 0; j < numSectors; j++, n += 2) {
+			//
+			t[n].i1 = k + j;
+			//
+			t[n].i2 = k + numSectors + j;
+			//
+			t[n].i3 = k + numSectors + ((j + 1) % numSectors);
+			//
+			t[n + 1].i1 = t[n].i1;
+			t[n + 1].i2 = t[n].i3;
+			t[n + 1].i3 = k + ((j + 1) % numSectors);
+		}
+	}
+}
+
+void MeshGenerator::CreatePlane(Mesh& mesh, uint width, uint height, uint stepX, uint stepZ)
+{
+	assert(width && "Invalid Value");
+	assert(height && "Invalid Value");
+	//
+	float tu = 1.0f / width;
+	float tv = 1.0f / height;
+	assert(stepX && "Invalid Value");
+	assert(stepZ && "Invalid Value");
+
+	assert(!(width % stepX) && "Invalid Value");
+	assert(!(height % stepZ) && "Invalid Value");
+
+	uint StepWidth = width / stepX + 1;
+	uint StepHeight = height / stepZ + 1;
+	// total vertexs
+	uint numVertexs = StepWidth * StepHeight;
+	uint numPolygons = 2 * (StepWidth - 1) * (StepHeight - 1);
+	uint NumIndices = numPolygons * 3;
+	mesh.stride = sizeof(Vertex);
+	mesh.vertices.assign(numVertexs * sizeof(Vertex), 0);
+	mesh.indices.resize(NumIndices);
+	Vertex* vertexs = reinterpret_cast<Vertex *>(mesh.vertices.data());
+	uint* indices = mesh.indices.data();
+	uint vertexIndex = 0;
+	uint numIndices = 0;
+	// Fill Vertex and indices
+	int halfHeight = height >> 1;
+	int halfWidth = width >> 1;
+	for (int i = -halfHeight; i <= halfHeight; i += stepX) {
+		for (int j = -halfWidth; j <= halfWidth; j += stepZ) {
+			assert(vertexIndex < numVertexs && "Out Of Range");
+			Vertex& v = vertexs[vertexIndex];
+			v.position = Vector3D(static_cast<float>(i), 0.0f, static_cast<float>(j));
+			v.normal = Vector3D::Y();
+			v.tvert.x = tv * (i + halfHeight);
+			v.tvert.y = tu * (j + halfWidth);
+			vertexIndex++;
+		}
+	}
+	uint vertexHOffset = 0;
+	uint kOffset = height / stepZ + 1;
+	for (uint i = 0; i < height; i += stepZ) {
+		vertexIndex = vertexHOffset;
+		for (uint j = 0; j < width; j += stepX) {
+			assert(numIndices + 5 < NumIndices && "Out Of Range");
+			indices[numIndices] = vertexIndex;
+			indices[numIndices + 1] = vertexIndex + StepHeight;
+			indices[numIndices + 2] = vertexIndex + StepHeight + 1;
+			indices[numIndices + 3] = vertexIndex + StepHeight + 1;
+			indices[numIndices + 4] = vertexIndex + 1;
+			indices[numIndices + 5] = vertexIndex;
+			numIndices += 6;
+			vertexIndex++;
+		}
+		vertexHOffset += kOffset;
+	}
+}
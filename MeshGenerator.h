@@ -0,0 +1,82 @@
+// MeshGenerator.h: interface for the MeshGenerator class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __MESHGENERATOR_H__
+#define __MESHGENERATOR_H__
+
+#include "types.h"
+#include "Vector2D.h"
+#include "Vector3D.h"
+#include <algorithm>
+#include <vector>
+
+// Standart vertex(textured vertex with Normal)
+struct Vertex {
+	//
+	static const uint NormalOffset = sizeof(Vector3D);
+	//
+	static const uint TexCoordOffset = 2 * sizeof(Vector3D);
+	// vertex position
+	Vector3D position;
+	// normal
+	Vector3D normal;
+	// tex coords
+	Vector2D tvert;
+};
+
+// Geometry on the CPU, every vertex starts with its position
+struct Mesh {
+	// stride bytes per vertex
+	std::vector<ubyte> vertices;
+	// triangle list
+	std::vector<uint> indices;
+	// size of vertex
+	uint stride;
+
+	Mesh() : stride(0)
+	{
+	}
+	INLINE uint GetNumVertices() const
+	{
+		return stride ? static_cast<uint>(vertices.size() / stride) : 0;
+	}
+	INLINE uint GetNumFaces() const
+	{
+		return static_cast<uint>(indices.size() / 3);
+	}
+	// 16 bit indices address 65536 vertices
+	INLINE bool Needs32BitIndices() const
+	{
+		return GetNumVertices() > 0x10000;
+	}
+	INLINE const Vector3D& GetPosition(uint index) const
+	{
+		assert(index < GetNumVertices() && "Out Of Range");
+		return *reinterpret_cast<const Vector3D *>(&vertices[index * stride]);
+	}
+	// bounding box of the positions, the mesh has vertices
+	void GetBounds(Vector3D& minimum, Vector3D& maximum) const
+	{
+		const uint numVertices = GetNumVertices();
+		assert(numVertices && "Invalid Value");
+		minimum = GetPosition(0);
+		maximum = minimum;
+		for (uint v = 1; v < numVertices; ++v) {
+			const Vector3D& p = GetPosition(v);
+			minimum = Vector3D(std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z));
+			maximum = Vector3D(std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z));
+		}
+	}
+};
+
+// Geometry of the scene meshes
+class MeshGenerator  {
+public:
+	// Sphere of Vector3D positions, the poles are the first and last vertices
+	static void CreateSphere(Mesh& mesh, uint numRings, uint numSectors, float radius);
+	// Grid of Vertex in the XZ plane, centered at the origin, normals are Y
+	static void CreatePlane(Mesh& mesh, uint width, uint height, uint stepX, uint stepZ);
+};
+
+#endif // __MESHGENERATOR_H__
@@ -0,0 +1,759 @@
+// MeshOptimizer.cpp: implementation of the MeshOptimizer class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+	const uint InvalidIndex = ~0u;
+
+	// triangles of every vertex, offsets[v]..offsets[v + 1] index triangles,
+	// a degenerate triangle is listed once per corner
+	struct Adjacency {
+		std::vector<uint> counts;
+		std::vector<uint> offsets;
+		std::vector<uint> triangles;
+
+		Adjacency(const uint* indices, size_t numIndices, uint numVertices) : counts(numVertices, 0), offsets(numVertices + 1, 0), triangles(numIndices)
+		{
+			for (size_t i = 0; i < numIndices; ++i) {
+				assert(indices[i] < numVertices && "Out Of Range");
+				++counts[indices[i]];
+			}
+			for (uint v = 0; v < numVertices; ++v) {
+				offsets[v + 1] = offsets[v] + counts[v];
+			}
+			std::vector<uint> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < numIndices; ++i) {
+				triangles[fill[indices[i]]++] = static_cast<uint>(i / 3);
+			}
+		}
+	};
+
+	INLINE const Vector3D& GetPosition(const void* vertices, uint stride, uint index)
+	{
+		return *reinterpret_cast<const Vector3D *>(static_cast<const ubyte *>(vertices) + static_cast<size_t>(index) * stride);
+	}
+
+	// Forsyth scores, the LRU cache is simulated with ForsythCacheSize entries
+	const uint ForsythCacheSize = 32;
+	const float CacheDecayPower = 1.5f;
+	const float LastTriangleScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	// valences of the score table, higher ones are computed
+	const uint ForsythMaxValence = 32;
+
+	// scores of cache positions and triangle counts
+	struct ForsythScores {
+		float cache[ForsythCacheSize];
+		float valence[ForsythMaxValence];
+
+		ForsythScores()
+		{
+			for (uint i = 0; i < ForsythCacheSize; ++i) {
+				if (i < 3) {
+					// vertices of the last triangle get a fixed score, any of its
+					// neighbours is as good as another one
+					cache[i] = LastTriangleScore;
+				} else {
+					const float scale = 1.0f / (ForsythCacheSize - 3);
+					cache[i] = powf(1.0f - (i - 3) * scale, CacheDecayPower);
+				}
+			}
+			for (uint i = 1; i < ForsythMaxValence; ++i) {
+				valence[i] = ValenceBoostScale * powf(static_cast<float>(i), -ValenceBoostPower);
+			}
+		}
+		INLINE float Score(int cachePosition, uint remaining) const
+		{
+			if (!remaining) {
+				// no triangles left, the vertex doesn't matter
+				return -1.0f;
+			}
+			const float score = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+			// vertices with few triangles left are finished first
+			return score + (remaining < ForsythMaxValence ? valence[remaining] : ValenceBoostScale * powf(static_cast<float>(remaining), -ValenceBoostPower));
+		}
+	};
+
+	void OptimizeForsyth(uint* indices, size_t numIndices, uint numVertices)
+	{
+		const size_t numTriangles = numIndices / 3;
+		Adjacency adjacency(indices, numIndices, numVertices);
+		// live triangles of a vertex are kept at the front of its list
+		std::vector<uint>& remaining = adjacency.counts;
+		std::vector<int> cachePosition(numVertices, -1);
+		const ForsythScores scores;
+		std::vector<float> vertexScore(numVertices);
+		for (uint v = 0; v < numVertices; ++v) {
+			vertexScore[v] = scores.Score(-1, remaining[v]);
+		}
+		std::vector<float> triangleScore(numTriangles);
+		std::vector<bool> emitted(numTriangles, false);
+		uint best = InvalidIndex;
+		float bestScore = -FLT_MAX;
+		for (size_t t = 0; t < numTriangles; ++t) {
+			const uint* tri = indices + t * 3;
+			triangleScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+			if (triangleScore[t] > bestScore) {
+				bestScore = triangleScore[t];
+				best = static_cast<uint>(t);
+			}
+		}
+		std::vector<uint> result(numIndices);
+		uint cache[ForsythCacheSize + 3];
+		uint newCache[ForsythCacheSize + 3];
+		uint cacheSize = 0;
+		size_t cursor = 0;
+		for (size_t count = 0; count < numTriangles; ++count) {
+			if (best == InvalidIndex) {
+				// dead end, continue with the next triangle in input order
+				while (emitted[cursor]) {
+					++cursor;
+				}
+				best = static_cast<uint>(cursor);
+			}
+			const uint* tri = indices + best * 3;
+			memcpy(&result[count * 3], tri, 3 * sizeof(uint));
+			emitted[best] = true;
+			// vertices of the triangle go to the front of the cache
+			uint newSize = 0;
+			for (uint i = 0; i < 3; ++i) {
+				const uint v = tri[i];
+				uint* live = &adjacency.triangles[adjacency.offsets[v]];
+				uint* last = live + remaining[v] - 1;
+				*std::find(live, last, best) = *last;
+				--remaining[v];
+				if (std::find(newCache, newCache + newSize, v) == newCache + newSize) {
+					newCache[newSize++] = v;
+				}
+			}
+			for (uint i = 0; i < cacheSize; ++i) {
+				const uint v = cache[i];
+				if (std::find(newCache, newCache + newSize, v) == newCache + newSize) {
+					newCache[newSize++] = v;
+				}
+			}
+			// vertices pushed out of the cache lose the cache score
+			for (uint i = ForsythCacheSize; i < newSize; ++i) {
+				cachePosition[newCache[i]] = -1;
+			}
+			cacheSize = std::min(newSize, ForsythCacheSize);
+			memcpy(cache, newCache, cacheSize * sizeof(uint));
+			for (uint i = 0; i < newSize; ++i) {
+				const uint v = newCache[i];
+				if (i < ForsythCacheSize) {
+					cachePosition[v] = i;
+				}
+				const float score = scores.Score(cachePosition[v], remaining[v]);
+				const float delta = score - vertexScore[v];
+				vertexScore[v] = score;
+				const uint* live = &adjacency.triangles[adjacency.offsets[v]];
+				for (uint j = 0; j < remaining[v]; ++j) {
+					triangleScore[live[j]] += delta;
+				}
+			}
+			// next triangle is the best one using a cached vertex
+			best = InvalidIndex;
+			bestScore = -FLT_MAX;
+			for (uint i = 0; i < cacheSize; ++i) {
+				const uint v = cache[i];
+				const uint* live = &adjacency.triangles[adjacency.offsets[v]];
+				for (uint j = 0; j < remaining[v]; ++j) {
+					if (triangleScore[live[j]] > bestScore) {
+						bestScore = triangleScore[live[j]];
+						best = live[j];
+					}
+				}
+			}
+		}
+		memcpy(indices, result.data(), numIndices * sizeof(uint));
+	}
+
+	// Tipsify dead end, the last used vertex with triangles left or the next one in input order
+	uint SkipDeadEnd(const std::vector<uint>& remaining, std::vector<uint>& deadEnds, uint& cursor)
+	{
+		while (!deadEnds.empty()) {
+			const uint v = deadEnds.back();
+			deadEnds.pop_back();
+			if (remaining[v]) {
+				return v;
+			}
+		}
+		for (; cursor < remaining.size(); ++cursor) {
+			if (remaining[cursor]) {
+				return cursor;
+			}
+		}
+		return InvalidIndex;
+	}
+
+	void OptimizeTipsify(uint* indices, size_t numIndices, uint numVertices, uint cacheSize)
+	{
+		const size_t numTriangles = numIndices / 3;
+		Adjacency adjacency(indices, numIndices, numVertices);
+		std::vector<uint>& remaining = adjacency.counts;
+		std::vector<uint> timeStamps(numVertices, 0);
+		std::vector<bool> emitted(numTriangles, false);
+		std::vector<uint> deadEnds;
+		std::vector<uint> candidates;
+		std::vector<uint> result;
+		result.reserve(numIndices);
+		uint time = cacheSize + 1;
+		uint cursor = 0;
+		uint fan = SkipDeadEnd(remaining, deadEnds, cursor);
+		while (fan != InvalidIndex) {
+			candidates.clear();
+			// all triangles around the fanning vertex
+			for (uint i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; ++i) {
+				const uint t = adjacency.triangles[i];
+				if (emitted[t]) {
+					continue;
+				}
+				emitted[t] = true;
+				for (uint j = 0; j < 3; ++j) {
+					const uint v = indices[t * 3 + j];
+					result.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					--remaining[v];
+					if (time - timeStamps[v] > cacheSize) {
+						timeStamps[v] = time++;
+					}
+				}
+			}
+			// next fan is the oldest candidate staying in the cache while its triangles are emitted
+			fan = InvalidIndex;
+			int bestPriority = -1;
+			for (uint v : candidates) {
+				if (!remaining[v]) {
+					continue;
+				}
+				int priority = 0;
+				if (time - timeStamps[v] + 2 * remaining[v] <= cacheSize) {
+					priority = static_cast<int>(time - timeStamps[v]);
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					fan = v;
+				}
+			}
+			if (fan == InvalidIndex) {
+				fan = SkipDeadEnd(remaining, deadEnds, cursor);
+			}
+		}
+		assert(result.size() == numIndices && "Invalid Value");
+		memcpy(indices, result.data(), numIndices * sizeof(uint));
+	}
+
+	// FIFO cache, a vertex hits when it was loaded less than cacheSize misses ago
+	struct FIFOCache {
+		std::vector<uint> timeStamps;
+		uint time;
+		uint size;
+
+		FIFOCache(uint numVertices, uint cacheSize) : timeStamps(numVertices, 0), time(cacheSize + 1), size(cacheSize)
+		{
+		}
+		INLINE void Reset()
+		{
+			// every vertex is older than the cache
+			time += size + 1;
+		}
+		INLINE uint Misses(const uint* tri)
+		{
+			uint misses = 0;
+			for (uint i = 0; i < 3; ++i) {
+				if (time - timeStamps[tri[i]] > size) {
+					timeStamps[tri[i]] = time++;
+					++misses;
+				}
+			}
+			return misses;
+		}
+	};
+
+	// consecutive triangles of the overdraw optimization
+	struct Cluster {
+		uint first;
+		uint count;
+		float sortKey;
+	};
+
+	// side of the CPU rasterizer views
+	const int OverdrawViewSize = 256;
+
+	// normal of the front face, front faces are counter-clockwise
+	INLINE Vector3D FrontNormal(const Vector3D& p0, const Vector3D& p1, const Vector3D& p2)
+	{
+		return crossProduct(p2 - p0, p1 - p0);
+	}
+
+	// Rasterizes at pixel centers with depth test less, counts fragments passing the test
+	void RasterizeTriangle(const Vector3D& v0, const Vector3D& v1, const Vector3D& v2, std::vector<float>& depth, size_t& shaded)
+	{
+		// x, y in pixels, z is depth
+		const float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (area == 0.0f) {
+			return;
+		}
+		const float invArea = 1.0f / area;
+		const int minX = std::max(static_cast<int>(floorf(std::min(v0.x, std::min(v1.x, v2.x)))), 0);
+		const int minY = std::max(static_cast<int>(floorf(std::min(v0.y, std::min(v1.y, v2.y)))), 0);
+		const int maxX = std::min(static_cast<int>(ceilf(std::max(v0.x, std::max(v1.x, v2.x)))), OverdrawViewSize - 1);
+		const int maxY = std::min(static_cast<int>(ceilf(std::max(v0.y, std::max(v1.y, v2.y)))), OverdrawViewSize - 1);
+		for (int y = minY; y <= maxY; ++y) {
+			const float py = y + 0.5f;
+			for (int x = minX; x <= maxX; ++x) {
+				const float px = x + 0.5f;
+				// barycentrics, positive for either winding
+				const float w0 = ((v2.x - v1.x) * (py - v1.y) - (v2.y - v1.y) * (px - v1.x)) * invArea;
+				const float w1 = ((v0.x - v2.x) * (py - v2.y) - (v0.y - v2.y) * (px - v2.x)) * invArea;
+				const float w2 = 1.0f - w0 - w1;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+					continue;
+				}
+				const float z = w0 * v0.z + w1 * v1.z + w2 * v2.z;
+				float& stored = depth[y * OverdrawViewSize + x];
+				if (z < stored) {
+					stored = z;
+					++shaded;
+				}
+			}
+		}
+	}
+
+	// normal cones narrower than this are used for culling
+	const float MinConeDotProduct = 0.1f;
+
+	// bounding sphere around the center of the box, normal cone around the average normal
+	void ComputeMeshletBounds(Meshlet& meshlet, const uint* indices, const void* vertices, uint stride, const uint* meshletVertices)
+	{
+		Vector3D minimum(FLT_MAX, FLT_MAX, FLT_MAX);
+		Vector3D maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (uint i = 0; i < meshlet.vertexCount; ++i) {
+			const Vector3D& p = GetPosition(vertices, stride, meshletVertices[i]);
+			minimum = Vector3D(std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z));
+			maximum = Vector3D(std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z));
+		}
+		meshlet.center = (minimum + maximum) * 0.5f;
+		float radiusSq = 0.0f;
+		for (uint i = 0; i < meshlet.vertexCount; ++i) {
+			radiusSq = std::max(radiusSq, GetPosition(vertices, stride, meshletVertices[i]).GetDistanceSqFrom(meshlet.center));
+		}
+		meshlet.radius = sqrtf(radiusSq);
+
+		const uint* tri = indices + meshlet.triangleOffset * 3;
+		Vector3D axis(0.0f, 0.0f, 0.0f);
+		for (uint t = 0; t < meshlet.triangleCount * 3; t += 3) {
+			const Vector3D normal = FrontNormal(GetPosition(vertices, stride, tri[t]), GetPosition(vertices, stride, tri[t + 1]), GetPosition(vertices, stride, tri[t + 2]));
+			if (!normal.IsZero()) {
+				axis += normal / normal.Length();
+			}
+		}
+		meshlet.coneAxis = Vector3D(0.0f, 0.0f, 0.0f);
+		meshlet.coneCutoff = 1.0f;
+		if (axis.IsZero()) {
+			return;
+		}
+		axis /= axis.Length();
+		float minDot = 1.0f;
+		for (uint t = 0; t < meshlet.triangleCount * 3; t += 3) {
+			const Vector3D normal = FrontNormal(GetPosition(vertices, stride, tri[t]), GetPosition(vertices, stride, tri[t + 1]), GetPosition(vertices, stride, tri[t + 2]));
+			if (!normal.IsZero()) {
+				minDot = std::min(minDot, dotProduct(normal, axis) / normal.Length());
+			}
+		}
+		if (minDot > MinConeDotProduct) {
+			// sine of the cone angle, the cutoff of the back facing test
+			meshlet.coneAxis = axis;
+			meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+		}
+	}
+
+	// new vertices a triangle adds to a meshlet
+	INLINE uint NewVertices(const uint* tri, const std::vector<uint>& localIndices)
+	{
+		return (localIndices[tri[0]] == InvalidIndex) +
+			(localIndices[tri[1]] == InvalidIndex && tri[1] != tri[0]) +
+			(localIndices[tri[2]] == InvalidIndex && tri[2] != tri[0] && tri[2] != tri[1]);
+	}
+
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint* indices, size_t numIndices, uint numVertices, VertexCacheMethod method, uint cacheSize)
+{
+	assert((!numIndices || indices) && "NULL Pointer");
+	assert(!(numIndices % 3) && "Invalid Value");
+	assert(cacheSize > 3 && "Invalid Value");
+	if (method == Tipsify) {
+		OptimizeTipsify(indices, numIndices, numVertices, cacheSize);
+	} else {
+		OptimizeForsyth(indices, numIndices, numVertices);
+	}
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint* indices, size_t numIndices, const void* vertices, uint stride, uint numVertices, float threshold, uint cacheSize)
+{
+	assert((!numIndices || (indices && vertices)) && "NULL Pointer");
+	assert(!(numIndices % 3) && "Invalid Value");
+	assert(threshold >= 1.0f && "Invalid Value");
+	const uint numTriangles = static_cast<uint>(numIndices / 3);
+	if (!numTriangles) {
+		return;
+	}
+	// hard boundaries where all vertices of a triangle miss, the cache starts over there
+	FIFOCache cache(numVertices, cacheSize);
+	std::vector<uint> hardBoundaries;
+	for (uint t = 0; t < numTriangles; ++t) {
+		if (cache.Misses(indices + t * 3) == 3) {
+			hardBoundaries.push_back(t);
+		}
+	}
+	hardBoundaries.push_back(numTriangles);
+	// soft boundaries split hard clusters while the ACMR of the part is within threshold
+	std::vector<Cluster> clusters;
+	for (size_t h = 0; h + 1 < hardBoundaries.size(); ++h) {
+		const uint start = hardBoundaries[h];
+		const uint end = hardBoundaries[h + 1];
+		cache.Reset();
+		uint misses = 0;
+		for (uint t = start; t < end; ++t) {
+			misses += cache.Misses(indices + t * 3);
+		}
+		const float clusterThreshold = threshold * misses / (end - start);
+		cache.Reset();
+		uint first = start;
+		misses = 0;
+		for (uint t = start; t < end; ++t) {
+			misses += cache.Misses(indices + t * 3);
+			if (t + 1 == end || static_cast<float>(misses) / (t + 1 - first) <= clusterThreshold) {
+				const Cluster cluster = { first, t + 1 - first, 0.0f };
+				clusters.push_back(cluster);
+				cache.Reset();
+				first = t + 1;
+				misses = 0;
+			}
+		}
+	}
+	// clusters facing away from the center are drawn first, they occlude the inner ones
+	Vector3D meshCentroid(0.0f, 0.0f, 0.0f);
+	float meshArea = 0.0f;
+	std::vector<Vector3D> centroids(clusters.size());
+	std::vector<Vector3D> normals(clusters.size());
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		Vector3D centroid(0.0f, 0.0f, 0.0f);
+		Vector3D normal(0.0f, 0.0f, 0.0f);
+		float clusterArea = 0.0f;
+		for (uint t = clusters[c].first; t < clusters[c].first + clusters[c].count; ++t) {
+			const Vector3D& p0 = GetPosition(vertices, stride, indices[t * 3]);
+			const Vector3D& p1 = GetPosition(vertices, stride, indices[t * 3 + 1]);
+			const Vector3D& p2 = GetPosition(vertices, stride, indices[t * 3 + 2]);
+			const Vector3D n = FrontNormal(p0, p1, p2);
+			const float area = n.Length();
+			centroid += (p0 + p1 + p2) * (area / 3.0f);
+			normal += n;
+			clusterArea += area;
+		}
+		meshCentroid += centroid;
+		meshArea += clusterArea;
+		centroids[c] = clusterArea > 0.0f ? centroid / clusterArea : centroid;
+		const float length = normal.Length();
+		normals[c] = length > 0.0f ? normal / length : normal;
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		clusters[c].sortKey = dotProduct(centroids[c] - meshCentroid, normals[c]);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+	std::vector<uint> result;
+	result.reserve(numIndices);
+	for (const Cluster& cluster : clusters) {
+		result.insert(result.end(), indices + cluster.first * 3, indices + (cluster.first + cluster.count) * 3);
+	}
+	memcpy(indices, result.data(), numIndices * sizeof(uint));
+}
+
+uint MeshOptimizer::OptimizeVertexFetch(void* vertices, uint stride, uint numVertices, uint* indices, size_t numIndices)
+{
+	assert((!numIndices || (indices && vertices)) && "NULL Pointer");
+	std::vector<uint> remap(numVertices, InvalidIndex);
+	uint count = 0;
+	for (size_t i = 0; i < numIndices; ++i) {
+		assert(indices[i] < numVertices && "Out Of Range");
+		uint& index = remap[indices[i]];
+		if (index == InvalidIndex) {
+			index = count++;
+		}
+		indices[i] = index;
+	}
+	ubyte* data = static_cast<ubyte *>(vertices);
+	const std::vector<ubyte> source(data, data + static_cast<size_t>(numVertices) * stride);
+	for (uint v = 0; v < numVertices; ++v) {
+		if (remap[v] != InvalidIndex) {
+			memcpy(data + static_cast<size_t>(remap[v]) * stride, &source[static_cast<size_t>(v) * stride], stride);
+		}
+	}
+	return count;
+}
+
+void MeshOptimizer::BuildMeshlets(uint* indices, size_t numIndices, const void* vertices, uint stride, uint numVertices, std::vector<Meshlet>& meshlets, std::vector<uint>& meshletVertices, uint maxVertices, uint maxTriangles)
+{
+	assert((!numIndices || (indices && vertices)) && "NULL Pointer");
+	assert(!(numIndices % 3) && "Invalid Value");
+	assert(maxVertices >= 3 && maxTriangles && "Invalid Value");
+	const size_t numTriangles = numIndices / 3;
+	Adjacency adjacency(indices, numIndices, numVertices);
+	std::vector<bool> emitted(numTriangles, false);
+	// slot of a vertex in the current meshlet
+	std::vector<uint> localIndices(numVertices, InvalidIndex);
+	std::vector<uint> candidates;
+	std::vector<uint> localTriangles;
+	std::vector<uint> result;
+	result.reserve(numIndices);
+	meshlets.clear();
+	meshletVertices.clear();
+	std::vector<uint>& remaining = adjacency.counts;
+	size_t cursor = 0;
+	uint seed = InvalidIndex;
+	while (result.size() < numIndices) {
+		if (seed == InvalidIndex) {
+			while (emitted[cursor]) {
+				++cursor;
+			}
+			seed = static_cast<uint>(cursor);
+		}
+		Meshlet meshlet = {};
+		meshlet.vertexOffset = static_cast<uint>(meshletVertices.size());
+		meshlet.triangleOffset = static_cast<uint>(result.size() / 3);
+		Vector3D centroidSum(0.0f, 0.0f, 0.0f);
+		candidates.clear();
+		localTriangles.clear();
+		uint next = seed;
+		while (next != InvalidIndex) {
+			const uint* tri = indices + next * 3;
+			emitted[next] = true;
+			for (uint i = 0; i < 3; ++i) {
+				const uint v = tri[i];
+				--remaining[v];
+				if (localIndices[v] == InvalidIndex) {
+					localIndices[v] = meshlet.vertexCount++;
+					meshletVertices.push_back(v);
+					candidates.insert(candidates.end(), adjacency.triangles.begin() + adjacency.offsets[v], adjacency.triangles.begin() + adjacency.offsets[v + 1]);
+				}
+				localTriangles.push_back(localIndices[v]);
+			}
+			centroidSum += GetPosition(vertices, stride, tri[0]) + GetPosition(vertices, stride, tri[1]) + GetPosition(vertices, stride, tri[2]);
+			if (++meshlet.triangleCount == maxTriangles) {
+				break;
+			}
+			// neighbour adding the fewest vertices, on ties the one with the fewest triangles
+			// left around, then the closest one to the centroid
+			const Vector3D centroid = centroidSum / (3.0f * meshlet.triangleCount);
+			next = InvalidIndex;
+			uint bestNew = 4;
+			uint bestValence = ~0u;
+			float bestDistance = FLT_MAX;
+			for (size_t i = 0; i < candidates.size();) {
+				const uint t = candidates[i];
+				if (emitted[t]) {
+					candidates[i] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				++i;
+				const uint* candidate = indices + t * 3;
+				const uint newVertices = NewVertices(candidate, localIndices);
+				if (meshlet.vertexCount + newVertices > maxVertices || newVertices > bestNew) {
+					continue;
+				}
+				const uint valence = remaining[candidate[0]] + remaining[candidate[1]] + remaining[candidate[2]];
+				if (newVertices == bestNew && valence > bestValence) {
+					continue;
+				}
+				const Vector3D& p0 = GetPosition(vertices, stride, candidate[0]);
+				const Vector3D& p1 = GetPosition(vertices, stride, candidate[1]);
+				const Vector3D& p2 = GetPosition(vertices, stride, candidate[2]);
+				const float distance = ((p0 + p1 + p2) / 3.0f).GetDistanceSqFrom(centroid);
+				if (newVertices < bestNew || valence < bestValence || distance < bestDistance) {
+					bestNew = newVertices;
+					bestValence = valence;
+					bestDistance = distance;
+					next = t;
+				}
+			}
+		}
+		// next meshlet starts at the border of this one, where fewest triangles are left,
+		// so that meshlets sweep the mesh instead of leaving holes
+		seed = InvalidIndex;
+		uint seedValence = ~0u;
+		for (uint t : candidates) {
+			if (emitted[t]) {
+				continue;
+			}
+			const uint* tri = indices + t * 3;
+			const uint valence = remaining[tri[0]] + remaining[tri[1]] + remaining[tri[2]];
+			if (valence < seedValence) {
+				seedValence = valence;
+				seed = t;
+			}
+		}
+		// vertex cache order inside the meshlet
+		OptimizeTipsify(localTriangles.data(), localTriangles.size(), meshlet.vertexCount, DefaultCacheSize);
+		const uint* localVertices = &meshletVertices[meshlet.vertexOffset];
+		for (uint index : localTriangles) {
+			result.push_back(localVertices[index]);
+		}
+		for (uint i = 0; i < meshlet.vertexCount; ++i) {
+			localIndices[localVertices[i]] = InvalidIndex;
+		}
+		ComputeMeshletBounds(meshlet, result.data(), vertices, stride, localVertices);
+		meshlets.push_back(meshlet);
+	}
+	memcpy(indices, result.data(), numIndices * sizeof(uint));
+}
+
+bool MeshOptimizer::ValidateMeshlets(const uint* indices, size_t numIndices, const void* vertices, uint stride, const std::vector<Meshlet>& meshlets, const std::vector<uint>& meshletVertices, uint maxVertices, uint maxTriangles)
+{
+	assert((!numIndices || (indices && vertices)) && "NULL Pointer");
+	const float Epsilon = 1e-4f;
+	uint nextTriangle = 0;
+	for (const Meshlet& meshlet : meshlets) {
+		if (meshlet.triangleOffset != nextTriangle || !meshlet.triangleCount || meshlet.triangleCount > maxTriangles) {
+			return false;
+		}
+		if (meshlet.vertexCount > maxVertices || meshlet.vertexOffset + meshlet.vertexCount > meshletVertices.size()) {
+			return false;
+		}
+		nextTriangle += meshlet.triangleCount;
+		if (nextTriangle * 3 > numIndices) {
+			return false;
+		}
+		const uint* localVertices = &meshletVertices[meshlet.vertexOffset];
+		const float radius = meshlet.radius * (1.0f + Epsilon) + Epsilon;
+		for (uint i = 0; i < meshlet.vertexCount; ++i) {
+			if (GetPosition(vertices, stride, localVertices[i]).GetDistanceSqFrom(meshlet.center) > radius * radius) {
+				return false;
+			}
+		}
+		// cosine of the cone angle
+		const float minDot = meshlet.coneCutoff < 1.0f ? sqrtf(1.0f - meshlet.coneCutoff * meshlet.coneCutoff) : -1.0f;
+		const uint* tri = indices + meshlet.triangleOffset * 3;
+		for (uint t = 0; t < meshlet.triangleCount * 3; t += 3) {
+			for (uint i = 0; i < 3; ++i) {
+				if (std::find(localVertices, localVertices + meshlet.vertexCount, tri[t + i]) == localVertices + meshlet.vertexCount) {
+					return false;
+				}
+			}
+			const Vector3D normal = FrontNormal(GetPosition(vertices, stride, tri[t]), GetPosition(vertices, stride, tri[t + 1]), GetPosition(vertices, stride, tri[t + 2]));
+			if (!normal.IsZero() && dotProduct(normal, meshlet.coneAxis) / normal.Length() < minDot - Epsilon) {
+				return false;
+			}
+		}
+	}
+	return nextTriangle * 3 == numIndices;
+}
+
+void MeshOptimizer::AnalyzeVertexCache(const uint* indices, size_t numIndices, uint numVertices, uint cacheSize, float& acmr, float& atvr)
+{
+	assert((!numIndices || indices) && "NULL Pointer");
+	FIFOCache cache(numVertices, cacheSize);
+	std::vector<bool> used(numVertices, false);
+	uint misses = 0;
+	uint numUsed = 0;
+	for (size_t i = 0; i + 3 <= numIndices; i += 3) {
+		misses += cache.Misses(indices + i);
+		for (uint j = 0; j < 3; ++j) {
+			if (!used[indices[i + j]]) {
+				used[indices[i + j]] = true;
+				++numUsed;
+			}
+		}
+	}
+	acmr = numIndices ? static_cast<float>(misses) / (numIndices / 3) : 0.0f;
+	atvr = numUsed ? static_cast<float>(misses) / numUsed : 0.0f;
+}
+
+float MeshOptimizer::AnalyzeOverdraw(const uint* indices, size_t numIndices, const void* vertices, uint stride, uint numVertices)
+{
+	assert((!numIndices || (indices && vertices)) && "NULL Pointer");
+	if (!numVertices) {
+		return 0.0f;
+	}
+	Vector3D minimum(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3D maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (uint v = 0; v < numVertices; ++v) {
+		const Vector3D& p = GetPosition(vertices, stride, v);
+		minimum = Vector3D(std::min(minimum.x, p.x), std::min(minimum.y, p.y), std::min(minimum.z, p.z));
+		maximum = Vector3D(std::max(maximum.x, p.x), std::max(maximum.y, p.y), std::max(maximum.z, p.z));
+	}
+	const Vector3D extent = maximum - minimum;
+	const float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+	const float scale = maxExtent > 0.0f ? (OverdrawViewSize - 1) / maxExtent : 0.0f;
+	std::vector<float> depth(OverdrawViewSize * OverdrawViewSize);
+	size_t shaded = 0;
+	size_t covered = 0;
+	// orthographic views along +-X, +-Y, +-Z, depth grows along the view direction
+	for (uint axis = 0; axis < 3; ++axis) {
+		for (int sign = -1; sign <= 1; sign += 2) {
+			float direction[3] = { 0.0f, 0.0f, 0.0f };
+			direction[axis] = static_cast<float>(sign);
+			const Vector3D viewDirection(direction[0], direction[1], direction[2]);
+			std::fill(depth.begin(), depth.end(), FLT_MAX);
+			for (size_t i = 0; i + 3 <= numIndices; i += 3) {
+				const Vector3D& p0 = GetPosition(vertices, stride, indices[i]);
+				const Vector3D& p1 = GetPosition(vertices, stride, indices[i + 1]);
+				const Vector3D& p2 = GetPosition(vertices, stride, indices[i + 2]);
+				// back faces and edge-on triangles are culled as in the pipelines
+				if (dotProduct(FrontNormal(p0, p1, p2), viewDirection) >= 0.0f) {
+					continue;
+				}
+				Vector3D screen[3];
+				for (uint j = 0; j < 3; ++j) {
+					const Vector3D p = (GetPosition(vertices, stride, indices[i + j]) - minimum) * scale;
+					const float coords[3] = { p.x, p.y, p.z };
+					screen[j] = Vector3D(coords[(axis + 1) % 3], coords[(axis + 2) % 3], sign * coords[axis]);
+				}
+				RasterizeTriangle(screen[0], screen[1], screen[2], depth, shaded);
+			}
+			covered += std::count_if(depth.begin(), depth.end(), [](float z) {
+				return z != FLT_MAX;
+			});
+		}
+	}
+	return covered ? static_cast<float>(shaded) / covered : 0.0f;
+}
+
+void MeshOptimizer::Optimize(Mesh& mesh, VertexCacheMethod method)
+{
+	const uint numVertices = mesh.GetNumVertices();
+	OptimizeVertexCache(mesh.indices.data(), mesh.indices.size(), numVertices, method);
+	OptimizeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.stride, numVertices);
+	const uint numUsed = OptimizeVertexFetch(mesh.vertices.data(), mesh.stride, numVertices, mesh.indices.data(), mesh.indices.size());
+	mesh.vertices.resize(static_cast<size_t>(numUsed) * mesh.stride);
+}
+
+void MeshOptimizer::BuildMeshlets(Mesh& mesh, std::vector<Meshlet>& meshlets, std::vector<uint>& meshletVertices)
+{
+	BuildMeshlets(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.stride, mesh.GetNumVertices(), meshlets, meshletVertices);
+}
+
+MeshOptimizer::Statistics MeshOptimizer::Analyze(const Mesh& mesh, uint cacheSize)
+{
+	Statistics statistics;
+	const uint numVertices = mesh.GetNumVertices();
+	AnalyzeVertexCache(mesh.indices.data(), mesh.indices.size(), numVertices, cacheSize, statistics.acmr, statistics.atvr);
+	statistics.overdraw = AnalyzeOverdraw(mesh.indices.data(), mesh.indices.size(), mesh.vertices.data(), mesh.stride, numVertices);
+	return statistics;
+}
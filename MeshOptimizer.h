@@ -0,0 +1,93 @@
+// MeshOptimizer.h: interface for the MeshOptimizer class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __MESHOPTIMIZER_H__
+#define __MESHOPTIMIZER_H__
+
+#include "MeshGenerator.h"
+#include <cstddef>
+
+// Cluster of consecutive triangles for per-cluster culling
+struct Meshlet {
+	// first vertex of the meshlet in the meshlet vertex list
+	uint vertexOffset;
+	uint vertexCount;
+	// first triangle of the meshlet in the index buffer
+	uint triangleOffset;
+	uint triangleCount;
+	// bounding sphere
+	Vector3D center;
+	float radius;
+	// normal cone of the front faces, cutoff is 1 if the cone is too wide to cull
+	Vector3D coneAxis;
+	float coneCutoff;
+
+	// All triangles face away from the point
+	INLINE bool IsBackFacing(const Vector3D& position) const
+	{
+		const Vector3D direction = center - position;
+		return dotProduct(direction, coneAxis) >= coneCutoff * direction.Length() + radius;
+	}
+};
+
+// Reordering of triangle lists for the post-transform vertex cache, overdraw and
+// vertex fetch. Vertices are addressed by stride, every vertex starts with its position.
+class MeshOptimizer  {
+public:
+	// triangle order of the vertex cache optimization
+	enum VertexCacheMethod {
+		// Forsyth, linear-speed vertex cache optimisation, LRU scores
+		Forsyth,
+		// Sander et al., Tipsify, fans around vertices kept in a FIFO cache
+		Tipsify
+	};
+	// FIFO post-transform cache of the metrics and Tipsify
+	static const uint DefaultCacheSize = 16;
+	// limits of a meshlet, 126 triangles leave room for a 4 byte count in 128 * 3 bytes of indices
+	static const uint MaxMeshletVertices = 64;
+	static const uint MaxMeshletTriangles = 126;
+	// ACMR of an overdraw cluster may grow by this factor
+	static constexpr float DefaultOverdrawThreshold = 1.05f;
+
+	struct Statistics {
+		// average cache miss ratio, transformed vertices per triangle, 0.5 is optimal for grids
+		float acmr;
+		// average transform to vertex ratio, 1 is optimal
+		float atvr;
+		// shaded / covered pixels of the CPU rasterizer over 6 axis views, back faces
+		// culled, 1 is optimal and convex meshes always have it
+		float overdraw;
+	};
+
+	// Reorders triangles for a post-transform cache of cacheSize vertices
+	static void OptimizeVertexCache(uint* indices, size_t numIndices, uint numVertices, VertexCacheMethod method = Tipsify, uint cacheSize = DefaultCacheSize);
+	// Splits the cache optimized triangles in clusters and sorts them outside first by
+	// their front normals, the ACMR grows by threshold at most
+	static void OptimizeOverdraw(uint* indices, size_t numIndices, const void* vertices, uint stride, uint numVertices, float threshold = DefaultOverdrawThreshold, uint cacheSize = DefaultCacheSize);
+	// Sorts vertices in order of first use and remaps indices. Unused vertices are
+	// removed, returns the number of vertices left
+	static uint OptimizeVertexFetch(void* vertices, uint stride, uint numVertices, uint* indices, size_t numIndices);
+
+	// Groups neighbour triangles in meshlets, the triangles of a meshlet become consecutive
+	// in indices, in vertex cache order. Front faces are counter-clockwise as in the scene
+	// pipelines. meshletVertices gets the vertices of every meshlet
+	static void BuildMeshlets(uint* indices, size_t numIndices, const void* vertices, uint stride, uint numVertices, std::vector<Meshlet>& meshlets, std::vector<uint>& meshletVertices, uint maxVertices = MaxMeshletVertices, uint maxTriangles = MaxMeshletTriangles);
+	// Checks that meshlets cover all triangles within the limits, and that their bounding
+	// spheres and normal cones contain the vertices and normals of their triangles
+	static bool ValidateMeshlets(const uint* indices, size_t numIndices, const void* vertices, uint stride, const std::vector<Meshlet>& meshlets, const std::vector<uint>& meshletVertices, uint maxVertices = MaxMeshletVertices, uint maxTriangles = MaxMeshletTriangles);
+
+	// ACMR and ATVR of a FIFO cache
+	static void AnalyzeVertexCache(const uint* indices, size_t numIndices, uint numVertices, uint cacheSize, float& acmr, float& atvr);
+	// Overdraw ratio, back faces are culled as in the scene and light volume pipelines
+	static float AnalyzeOverdraw(const uint* indices, size_t numIndices, const void* vertices, uint stride, uint numVertices);
+
+	// Vertex cache, overdraw and vertex fetch optimization of a mesh
+	static void Optimize(Mesh& mesh, VertexCacheMethod method = Tipsify);
+	//
+	static void BuildMeshlets(Mesh& mesh, std::vector<Meshlet>& meshlets, std::vector<uint>& meshletVertices);
+	//
+	static Statistics Analyze(const Mesh& mesh, uint cacheSize = DefaultCacheSize);
+};
+
+#endif // __MESHOPTIMIZER_H__
@@ -6,8 +6,18 @@
 #define __PLANE_H__
 
 #include "Vector3D.h"
+#include "SIMD.h"
+#include <cstring>
 
-#define FLT_AS_DW(F) (*reinterpret_cast<unsigned int *>(&(F)))
+// Bits of a float, memcpy doesn't break strict aliasing and compiles to a move
+INLINE unsigned int FloatAsBits(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+#define FLT_AS_DW(F) FloatAsBits(F)
 #define ALMOST_ZERO(F) ((FLT_AS_DW(F) & 0x7f800000L)==0)
 #define IS_SPECIAL(F)  ((FLT_AS_DW(F) & 0x7f800000L)==0x7f800000L)
 
@@ -36,6 +46,16 @@ public:
 		IN_PLANE = 2, 
 		INTERSECT_PLANE = 0
 	};
+	// normal and distance
+	INLINE SIMD::Float4 Load() const
+	{
+		return SIMD::Load(&normal.x);
+	}
+	//
+	INLINE void Store(SIMD::Float4 v)
+	{
+		SIMD::Store(&normal.x, v);
+	}
 	//
 	INLINE float GetD() const
 	{
@@ -119,8 +139,7 @@ public:
 	//
 	INLINE void Flip()
 	{
-		normal = -normal;
-		dist = -dist;
+		Store(SIMD::Mul(Load(), SIMD::Splat(-1.0f)));
 	}
 	//
 	INLINE float ClosestPoint(const Vector3D& p, Vector3D& res)
@@ -284,8 +303,7 @@ public:
 	//
 	INLINE Plane& operator *= (float value)
 	{
-		dist *= value;
-		normal *= value;
+		Store(SIMD::Mul(Load(), SIMD::Splat(value)));
 		return *this;
 	}
 	//
@@ -322,4 +340,7 @@ public:
 	}
 };
 
+// normal and distance are loaded as one vector
+static_assert(sizeof(Plane) == 4 * sizeof(float), "Plane must be tightly packed");
+
 #endif
@@ -0,0 +1,272 @@
+// Profiler.cpp: implementation of the Profiler class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Profiler.h"
+
+#ifdef USE_PROFILER
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+	enum EventType {
+		ZoneEvent,
+		FrameEvent
+	};
+
+	struct Event {
+		const char* name;
+		uint64 begin;
+		uint64 end;
+		uint type;
+	};
+
+	// written by its thread only, events below numEvents don't change until the next capture
+	struct ThreadBuffer {
+		std::vector<Event> events;
+		std::atomic<uint> numEvents;
+		// capture of the events
+		std::atomic<uint> capture;
+		// index in the trace
+		uint id;
+		const char* name;
+
+		ThreadBuffer() : numEvents(0), capture(0), id(0), name(nullptr)
+		{
+		}
+	};
+
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<ThreadBuffer> > threadBuffers;
+	// buffers of the exited threads, the next threads go on writing them
+	std::vector<ThreadBuffer *> freeThreadBuffers;
+
+	// the capture is controlled from the thread of the frames
+	std::atomic<uint> captureIndex(0);
+	uint64 captureStart = 0;
+	uint captureFrames = 0;
+	uint numCapturedFrames = 0;
+	std::string captureFileName;
+
+	// buffer of a thread, released when the thread exits
+	struct ThreadBufferOwner {
+		ThreadBuffer* buffer;
+
+		ThreadBufferOwner() : buffer(nullptr)
+		{
+		}
+		~ThreadBufferOwner()
+		{
+			if (buffer) {
+				std::lock_guard<std::mutex> lock(registryMutex);
+				buffer->name = nullptr;
+				freeThreadBuffers.push_back(buffer);
+			}
+		}
+	};
+	thread_local ThreadBufferOwner threadBuffer;
+
+	ThreadBuffer& GetThreadBuffer()
+	{
+		if (threadBuffer.buffer) {
+			return *threadBuffer.buffer;
+		}
+		std::lock_guard<std::mutex> lock(registryMutex);
+		if (!freeThreadBuffers.empty()) {
+			threadBuffer.buffer = freeThreadBuffers.back();
+			freeThreadBuffers.pop_back();
+			return *threadBuffer.buffer;
+		}
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+		// the buffer never grows, the events are read while it is written
+		buffer->events.resize(Profiler::MaxThreadEvents);
+		buffer->id = static_cast<uint>(threadBuffers.size());
+		threadBuffer.buffer = buffer.get();
+		threadBuffers.push_back(std::move(buffer));
+		return *threadBuffer.buffer;
+	}
+
+	void AddEvent(const char* name, uint64 begin, uint64 end, EventType type)
+	{
+		ThreadBuffer& buffer = GetThreadBuffer();
+		const uint capture = captureIndex.load(std::memory_order_acquire);
+		uint numEvents = buffer.numEvents.load(std::memory_order_relaxed);
+		// the first event of a capture drops the ones of the previous capture
+		if (buffer.capture.load(std::memory_order_relaxed) != capture) {
+			numEvents = 0;
+			buffer.numEvents.store(0, std::memory_order_relaxed);
+			buffer.capture.store(capture, std::memory_order_release);
+		}
+		if (numEvents >= Profiler::MaxThreadEvents) {
+			return;
+		}
+		Event& event = buffer.events[numEvents];
+		event.name = name;
+		event.begin = begin;
+		event.end = end;
+		event.type = type;
+		buffer.numEvents.store(numEvents + 1, std::memory_order_release);
+	}
+
+	// events of the running or last capture
+	uint GetEvents(const ThreadBuffer& buffer, const Event*& events)
+	{
+		events = buffer.events.data();
+		if (buffer.capture.load(std::memory_order_acquire) != captureIndex.load()) {
+			return 0;
+		}
+		return buffer.numEvents.load(std::memory_order_acquire);
+	}
+
+	void WriteString(FILE* f, const char* text)
+	{
+		fputc('"', f);
+		for (const char* c = text; *c; ++c) {
+			if (*c == '"' || *c == '\\') {
+				fputc('\\', f);
+				fputc(*c, f);
+			} else if (static_cast<unsigned char>(*c) < 0x20) {
+				fprintf(f, "\\u%04x", static_cast<unsigned char>(*c));
+			} else {
+				fputc(*c, f);
+			}
+		}
+		fputc('"', f);
+	}
+
+	// microseconds of the trace from the start of the capture
+	double GetTraceTime(uint64 ticks)
+	{
+		return Timer::TicksToNanoseconds(ticks - captureStart) * 0.001;
+	}
+
+}
+
+std::atomic<bool> Profiler::capturing(false);
+
+uint64 Profiler::BeginZone()
+{
+	// a buffer given to a thread has no zones open on another one
+	GetThreadBuffer();
+	return Timer::GetTicks();
+}
+
+void Profiler::StartCapture(uint numFrames, const char* fileName)
+{
+	if (!IsCapturing()) {
+		captureStart = Timer::GetTicks();
+		++captureIndex;
+		capturing = true;
+	}
+	captureFrames = numFrames;
+	numCapturedFrames = 0;
+	captureFileName = fileName ? fileName : "";
+}
+
+bool Profiler::StopCapture()
+{
+	capturing = false;
+	return !captureFileName.empty() && WriteTrace(captureFileName.c_str());
+}
+
+void Profiler::CancelCapture()
+{
+	capturing = false;
+}
+
+bool Profiler::BeginFrame()
+{
+	if (!IsCapturing()) {
+		return true;
+	}
+	if (captureFrames && numCapturedFrames == captureFrames) {
+		return StopCapture();
+	}
+	++numCapturedFrames;
+	const uint64 time = Timer::GetTicks();
+	AddEvent("Frame", time, time, FrameEvent);
+	return true;
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	assert(name && "NULL Pointer");
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	buffer.name = name;
+}
+
+void Profiler::AddZone(const char* name, uint64 begin, uint64 end)
+{
+	assert(name && "NULL Pointer");
+	AddEvent(name, begin, end, ZoneEvent);
+}
+
+uint Profiler::GetNumEvents()
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	uint numEvents = 0;
+	for (const std::unique_ptr<ThreadBuffer>& buffer : threadBuffers) {
+		const Event* events;
+		numEvents += GetEvents(*buffer, events);
+	}
+	return numEvents;
+}
+
+bool Profiler::WriteTrace(const char* fileName)
+{
+	assert(fileName && "NULL Pointer");
+	FILE* f = fopen(fileName, "w");
+	if (!f) {
+		return false;
+	}
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"LightIndexedDeferredRendering\"}}");
+	std::lock_guard<std::mutex> lock(registryMutex);
+	std::vector<Event> threadEvents;
+	uint frame = 0;
+	for (const std::unique_ptr<ThreadBuffer>& buffer : threadBuffers) {
+		const Event* events;
+		const uint numEvents = GetEvents(*buffer, events);
+		if (buffer->name) {
+			fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", buffer->id);
+			WriteString(f, buffer->name);
+			fprintf(f, "}}");
+		}
+		// zones begun before the capture are dropped, parents go before their children
+		threadEvents.assign(events, events + numEvents);
+		threadEvents.erase(std::remove_if(threadEvents.begin(), threadEvents.end(), [](const Event& event)
+		{
+			return event.begin < captureStart;
+		}), threadEvents.end());
+		std::sort(threadEvents.begin(), threadEvents.end(), [](const Event& a, const Event& b)
+		{
+			return a.begin < b.begin || (a.begin == b.begin && a.end > b.end);
+		});
+		for (const Event& event : threadEvents) {
+			fprintf(f, ",\n{\"name\":");
+			WriteString(f, event.name);
+			if (event.type == FrameEvent) {
+				fprintf(f, ",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"frame\":%u}}", buffer->id, GetTraceTime(event.begin), frame++);
+			} else {
+				fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buffer->id, GetTraceTime(event.begin), Timer::TicksToNanoseconds(event.end - event.begin) * 0.001);
+			}
+		}
+	}
+	fprintf(f, "\n]}\n");
+	const bool res = !ferror(f);
+	return !fclose(f) && res;
+}
+
+std::string Profiler::GetFileName()
+{
+	return captureFileName;
+}
+
+#endif // USE_PROFILER
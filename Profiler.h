@@ -0,0 +1,90 @@
+// Profiler.h: interface for the Profiler class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+// zones and frame markers are compiled out with NO_PROFILER
+#ifndef NO_PROFILER
+#define USE_PROFILER
+#endif
+
+#ifdef USE_PROFILER
+
+#include "Timer.h"
+#include <atomic>
+#include <string>
+
+// CPU profiler of nested scoped zones and frame markers. Every thread writes its events
+// to its own buffer without locks, the buffers are read when the capture is written as
+// Chrome trace JSON (chrome://tracing, ui.perfetto.dev). A zone costs a flag test when
+// nothing is captured and two tick readings when it is
+class Profiler  {
+public:
+	// events of a thread in a capture, the next ones are dropped
+	static const uint MaxThreadEvents = 1 << 16;
+	// zone of a scope, the name must outlive the capture (a literal)
+	class Zone  {
+	private:
+		const char* name;
+		uint64 begin;
+	public:
+		INLINE Zone(const char* zoneName) : name(zoneName), begin(IsCapturing() ? BeginZone() : 0)
+		{
+		}
+		INLINE ~Zone()
+		{
+			if (begin) {
+				AddZone(name, begin, Timer::GetTicks());
+			}
+		}
+	};
+private:
+	static std::atomic<bool> capturing;
+	// ticks of a zone begin, the thread takes its buffer before it
+	static uint64 BeginZone();
+public:
+	//
+	static INLINE bool IsCapturing()
+	{
+		return capturing.load(std::memory_order_relaxed);
+	}
+	// Starts a capture that BeginFrame writes to fileName after numFrames frames,
+	// 0 frames capture until StopCapture. A running capture goes on with the new
+	// length and file, its frames are counted from now
+	static void StartCapture(uint numFrames, const char* fileName);
+	// Ends the capture and writes it, false if it can't be written
+	static bool StopCapture();
+	// Ends the capture and drops it
+	static void CancelCapture();
+	// Frame marker, ends and writes the capture after its frames.
+	// False if the capture can't be written
+	static bool BeginFrame();
+	// Name of the calling thread in the trace, a literal
+	static void SetThreadName(const char* name);
+	// Zone of ticks begin to end on the calling thread
+	static void AddZone(const char* name, uint64 begin, uint64 end);
+	// Events of the capture, dropped ones are not counted
+	static uint GetNumEvents();
+	// Writes the events of the capture as Chrome trace JSON
+	static bool WriteTrace(const char* fileName);
+	//
+	static std::string GetFileName();
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// zone of the enclosing scope
+#define PROFILE_SCOPE(name) const Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+// zone of the enclosing function
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+
+#endif // USE_PROFILER
+
+#endif // __PROFILER_H__
@@ -0,0 +1,395 @@
+// Quaternion.cpp: implementation of the Quaternion class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Quaternion.h"
+#include "Matrix4x4.h"
+#include "CPUFeatures.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Kernels of the batch operations. Lanes are quaternions, every kernel evaluates the
+// scalar operations term by term without FMA, so all levels return the same bits.
+// The SIMD.h kernels handle blocks of 4, the AVX2 ones blocks of 8, tails are scalar.
+
+namespace {
+
+	using namespace SIMD;
+
+	INLINE Quaternion GetQuaternion(const QuaternionArrays& q, size_t i)
+	{
+		return Quaternion(q.x[i], q.y[i], q.z[i], q.w[i]);
+	}
+
+	INLINE void SetQuaternion(const QuaternionArrays& q, size_t i, const Quaternion& value)
+	{
+		q.x[i] = value.x;
+		q.y[i] = value.y;
+		q.z[i] = value.z;
+		q.w[i] = value.w;
+	}
+
+	// Four quaternions
+	struct Block {
+		Float4 x;
+		Float4 y;
+		Float4 z;
+		Float4 w;
+	};
+
+	INLINE Block LoadBlock(const QuaternionArrays& q, size_t i)
+	{
+		const Block b = { Load(q.x + i), Load(q.y + i), Load(q.z + i), Load(q.w + i) };
+		return b;
+	}
+
+	INLINE void StoreBlock(const QuaternionArrays& q, size_t i, const Block& b)
+	{
+		Store(q.x + i, b.x);
+		Store(q.y + i, b.y);
+		Store(q.z + i, b.z);
+		Store(q.w + i, b.w);
+	}
+
+	INLINE Block NormalizeBlock(const Block& q)
+	{
+		const Float4 lengthSq = Add(Add(Add(Mul(q.x, q.x), Mul(q.y, q.y)), Mul(q.z, q.z)), Mul(q.w, q.w));
+		const Float4 oneOverMag = Div(Splat(1.0f), Sqrt(lengthSq));
+		const Block r = { Mul(q.x, oneOverMag), Mul(q.y, oneOverMag), Mul(q.z, oneOverMag), Mul(q.w, oneOverMag) };
+		return r;
+	}
+
+	size_t NormalizeSIMD(const QuaternionArrays& q, const QuaternionArrays& out, size_t first, size_t n)
+	{
+		size_t i = first;
+		for (; i + 4 <= n; i += 4) {
+			StoreBlock(out, i, NormalizeBlock(LoadBlock(q, i)));
+		}
+		return i;
+	}
+
+	// operator * term by term, a subtracted term is the added negated product of the AoS version
+	size_t MulSIMD(const QuaternionArrays& a, const QuaternionArrays& b, const QuaternionArrays& out, size_t first, size_t n)
+	{
+		size_t i = first;
+		for (; i + 4 <= n; i += 4) {
+			const Block p = LoadBlock(a, i);
+			const Block q = LoadBlock(b, i);
+			Block r;
+			r.x = Sub(Add(Add(Mul(q.w, p.x), Mul(q.x, p.w)), Mul(q.y, p.z)), Mul(q.z, p.y));
+			r.y = Add(Add(Sub(Mul(q.w, p.y), Mul(q.x, p.z)), Mul(q.y, p.w)), Mul(q.z, p.x));
+			r.z = Add(Sub(Add(Mul(q.w, p.z), Mul(q.x, p.y)), Mul(q.y, p.x)), Mul(q.z, p.w));
+			r.w = Sub(Sub(Sub(Mul(q.w, p.w), Mul(q.x, p.x)), Mul(q.y, p.y)), Mul(q.z, p.z));
+			StoreBlock(out, i, r);
+		}
+		return i;
+	}
+
+	size_t NlerpSIMD(const QuaternionArrays& a, const QuaternionArrays& b, const float* t, const QuaternionArrays& out, size_t first, size_t n)
+	{
+		const Float4 zero = Splat(0.0f);
+		const Float4 one = Splat(1.0f);
+		const Float4 half = Splat(0.5f);
+		size_t i = first;
+		for (; i + 4 <= n; i += 4) {
+			const Block p = LoadBlock(a, i);
+			Block q = LoadBlock(b, i);
+			const Float4 s = Load(t + i);
+			Float4 cosOmega = Add(Add(Add(Mul(p.x, q.x), Mul(p.y, q.y)), Mul(p.z, q.z)), Mul(p.w, q.w));
+			// flip the sign of q where the dot is negative
+			const Float4 sign = And(CmpLT(cosOmega, zero), Splat(-0.0f));
+			cosOmega = Xor(cosOmega, sign);
+			const Block q1 = { Xor(q.x, sign), Xor(q.y, sign), Xor(q.z, sign), Xor(q.w, sign) };
+			const Float4 ka = Add(Splat(1.0904f), Mul(cosOmega, Add(Splat(-3.2452f), Mul(cosOmega, Sub(Splat(3.55645f), Mul(cosOmega, Splat(1.43519f)))))));
+			const Float4 kb = Add(Splat(0.848013f), Mul(cosOmega, Add(Splat(-1.06021f), Mul(cosOmega, Splat(0.215638f)))));
+			const Float4 centered = Sub(s, half);
+			const Float4 k = Add(Mul(Mul(ka, centered), centered), kb);
+			const Float4 k1 = Add(s, Mul(Mul(Mul(s, centered), Sub(s, one)), k));
+			const Float4 k0 = Sub(one, k1);
+			Block r = { Add(Mul(k0, p.x), Mul(k1, q1.x)), Add(Mul(k0, p.y), Mul(k1, q1.y)),
+				Add(Mul(k0, p.z), Mul(k1, q1.z)), Add(Mul(k0, p.w), Mul(k1, q1.w)) };
+			r = NormalizeBlock(r);
+			// end points
+			const Float4 atEnd = CmpLE(one, s);
+			const Float4 atStart = CmpLE(s, zero);
+			r.x = Select(atStart, p.x, Select(atEnd, q.x, r.x));
+			r.y = Select(atStart, p.y, Select(atEnd, q.y, r.y));
+			r.z = Select(atStart, p.z, Select(atEnd, q.z, r.z));
+			r.w = Select(atStart, p.w, Select(atEnd, q.w, r.w));
+			StoreBlock(out, i, r);
+		}
+		return i;
+	}
+
+	INLINE void StoreMatrices(Matrix4x4* out, Float4 m0, Float4 m1, Float4 m2, Float4 m4, Float4 m5, Float4 m6, Float4 m8, Float4 m9, Float4 m10)
+	{
+		// rows of lanes to columns of the four matrices
+		Float4 zero0 = Splat(0.0f);
+		Float4 zero1 = zero0;
+		Float4 zero2 = zero0;
+		Transpose(m0, m1, m2, zero0);
+		Transpose(m4, m5, m6, zero1);
+		Transpose(m8, m9, m10, zero2);
+		const Float4 position = Set(0.0f, 0.0f, 0.0f, 1.0f);
+		const Float4 columns[3][4] = {
+			{ m0, m1, m2, zero0 },
+			{ m4, m5, m6, zero1 },
+			{ m8, m9, m10, zero2 }
+		};
+		for (uint j = 0; j < 4; ++j) {
+			float* m = &out[j][0];
+			Store(m, columns[0][j]);
+			Store(m + 4, columns[1][j]);
+			Store(m + 8, columns[2][j]);
+			Store(m + 12, position);
+		}
+	}
+
+	size_t ToMatrixSIMD(const QuaternionArrays& q, Matrix4x4* out, size_t first, size_t n)
+	{
+		const Float4 one = Splat(1.0f);
+		size_t i = first;
+		for (; i + 4 <= n; i += 4) {
+			const Block b = LoadBlock(q, i);
+			const Float4 x2 = Add(b.x, b.x);
+			const Float4 y2 = Add(b.y, b.y);
+			const Float4 z2 = Add(b.z, b.z);
+			const Float4 xx = Mul(b.x, x2);
+			const Float4 yy = Mul(b.y, y2);
+			const Float4 zz = Mul(b.z, z2);
+			const Float4 xy = Mul(b.x, y2);
+			const Float4 yz = Mul(b.y, z2);
+			const Float4 xz = Mul(b.z, x2);
+			const Float4 wx = Mul(b.w, x2);
+			const Float4 wy = Mul(b.w, y2);
+			const Float4 wz = Mul(b.w, z2);
+			StoreMatrices(out + i, Sub(one, Add(yy, zz)), Add(xy, wz), Sub(xz, wy),
+				Sub(xy, wz), Sub(one, Add(xx, zz)), Add(yz, wx),
+				Add(xz, wy), Sub(yz, wx), Sub(one, Add(xx, yy)));
+		}
+		return i;
+	}
+
+#ifdef CPU_X86
+	TARGET_AVX2 size_t NormalizeAVX2(const QuaternionArrays& q, const QuaternionArrays& out, size_t n)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256 x = _mm256_loadu_ps(q.x + i);
+			const __m256 y = _mm256_loadu_ps(q.y + i);
+			const __m256 z = _mm256_loadu_ps(q.z + i);
+			const __m256 w = _mm256_loadu_ps(q.w + i);
+			__m256 lengthSq = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+			lengthSq = _mm256_add_ps(_mm256_add_ps(lengthSq, _mm256_mul_ps(z, z)), _mm256_mul_ps(w, w));
+			const __m256 oneOverMag = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+			_mm256_storeu_ps(out.x + i, _mm256_mul_ps(x, oneOverMag));
+			_mm256_storeu_ps(out.y + i, _mm256_mul_ps(y, oneOverMag));
+			_mm256_storeu_ps(out.z + i, _mm256_mul_ps(z, oneOverMag));
+			_mm256_storeu_ps(out.w + i, _mm256_mul_ps(w, oneOverMag));
+		}
+		_mm256_zeroupper();
+		return i;
+	}
+
+	TARGET_AVX2 size_t MulAVX2(const QuaternionArrays& a, const QuaternionArrays& b, const QuaternionArrays& out, size_t n)
+	{
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256 px = _mm256_loadu_ps(a.x + i);
+			const __m256 py = _mm256_loadu_ps(a.y + i);
+			const __m256 pz = _mm256_loadu_ps(a.z + i);
+			const __m256 pw = _mm256_loadu_ps(a.w + i);
+			const __m256 qx = _mm256_loadu_ps(b.x + i);
+			const __m256 qy = _mm256_loadu_ps(b.y + i);
+			const __m256 qz = _mm256_loadu_ps(b.z + i);
+			const __m256 qw = _mm256_loadu_ps(b.w + i);
+			const __m256 x = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qw, px), _mm256_mul_ps(qx, pw)), _mm256_mul_ps(qy, pz)), _mm256_mul_ps(qz, py));
+			const __m256 y = _mm256_add_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(qw, py), _mm256_mul_ps(qx, pz)), _mm256_mul_ps(qy, pw)), _mm256_mul_ps(qz, px));
+			const __m256 z = _mm256_add_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(qw, pz), _mm256_mul_ps(qx, py)), _mm256_mul_ps(qy, px)), _mm256_mul_ps(qz, pw));
+			const __m256 w = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(qw, pw), _mm256_mul_ps(qx, px)), _mm256_mul_ps(qy, py)), _mm256_mul_ps(qz, pz));
+			_mm256_storeu_ps(out.x + i, x);
+			_mm256_storeu_ps(out.y + i, y);
+			_mm256_storeu_ps(out.z + i, z);
+			_mm256_storeu_ps(out.w + i, w);
+		}
+		_mm256_zeroupper();
+		return i;
+	}
+
+	TARGET_AVX2 size_t NlerpAVX2(const QuaternionArrays& a, const QuaternionArrays& b, const float* t, const QuaternionArrays& out, size_t n)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 signBit = _mm256_set1_ps(-0.0f);
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256 p[4] = { _mm256_loadu_ps(a.x + i), _mm256_loadu_ps(a.y + i), _mm256_loadu_ps(a.z + i), _mm256_loadu_ps(a.w + i) };
+			const __m256 q[4] = { _mm256_loadu_ps(b.x + i), _mm256_loadu_ps(b.y + i), _mm256_loadu_ps(b.z + i), _mm256_loadu_ps(b.w + i) };
+			const __m256 s = _mm256_loadu_ps(t + i);
+			__m256 cosOmega = _mm256_add_ps(_mm256_mul_ps(p[0], q[0]), _mm256_mul_ps(p[1], q[1]));
+			cosOmega = _mm256_add_ps(_mm256_add_ps(cosOmega, _mm256_mul_ps(p[2], q[2])), _mm256_mul_ps(p[3], q[3]));
+			const __m256 sign = _mm256_and_ps(_mm256_cmp_ps(cosOmega, zero, _CMP_LT_OQ), signBit);
+			cosOmega = _mm256_xor_ps(cosOmega, sign);
+			__m256 ka = _mm256_sub_ps(_mm256_set1_ps(3.55645f), _mm256_mul_ps(cosOmega, _mm256_set1_ps(1.43519f)));
+			ka = _mm256_add_ps(_mm256_set1_ps(-3.2452f), _mm256_mul_ps(cosOmega, ka));
+			ka = _mm256_add_ps(_mm256_set1_ps(1.0904f), _mm256_mul_ps(cosOmega, ka));
+			__m256 kb = _mm256_add_ps(_mm256_set1_ps(-1.06021f), _mm256_mul_ps(cosOmega, _mm256_set1_ps(0.215638f)));
+			kb = _mm256_add_ps(_mm256_set1_ps(0.848013f), _mm256_mul_ps(cosOmega, kb));
+			const __m256 centered = _mm256_sub_ps(s, half);
+			const __m256 k = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ka, centered), centered), kb);
+			const __m256 k1 = _mm256_add_ps(s, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(s, centered), _mm256_sub_ps(s, one)), k));
+			const __m256 k0 = _mm256_sub_ps(one, k1);
+			__m256 r[4];
+			for (uint j = 0; j < 4; ++j) {
+				r[j] = _mm256_add_ps(_mm256_mul_ps(k0, p[j]), _mm256_mul_ps(k1, _mm256_xor_ps(q[j], sign)));
+			}
+			__m256 lengthSq = _mm256_add_ps(_mm256_mul_ps(r[0], r[0]), _mm256_mul_ps(r[1], r[1]));
+			lengthSq = _mm256_add_ps(_mm256_add_ps(lengthSq, _mm256_mul_ps(r[2], r[2])), _mm256_mul_ps(r[3], r[3]));
+			const __m256 oneOverMag = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+			const __m256 atEnd = _mm256_cmp_ps(one, s, _CMP_LE_OQ);
+			const __m256 atStart = _mm256_cmp_ps(s, zero, _CMP_LE_OQ);
+			float* outComponents[4] = { out.x, out.y, out.z, out.w };
+			for (uint j = 0; j < 4; ++j) {
+				r[j] = _mm256_blendv_ps(_mm256_mul_ps(r[j], oneOverMag), q[j], atEnd);
+				_mm256_storeu_ps(outComponents[j] + i, _mm256_blendv_ps(r[j], p[j], atStart));
+			}
+		}
+		_mm256_zeroupper();
+		return i;
+	}
+
+	TARGET_AVX2 size_t ToMatrixAVX2(const QuaternionArrays& q, Matrix4x4* out, size_t n)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m128 position = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256 x = _mm256_loadu_ps(q.x + i);
+			const __m256 y = _mm256_loadu_ps(q.y + i);
+			const __m256 z = _mm256_loadu_ps(q.z + i);
+			const __m256 w = _mm256_loadu_ps(q.w + i);
+			const __m256 x2 = _mm256_add_ps(x, x);
+			const __m256 y2 = _mm256_add_ps(y, y);
+			const __m256 z2 = _mm256_add_ps(z, z);
+			const __m256 xx = _mm256_mul_ps(x, x2);
+			const __m256 yy = _mm256_mul_ps(y, y2);
+			const __m256 zz = _mm256_mul_ps(z, z2);
+			const __m256 xy = _mm256_mul_ps(x, y2);
+			const __m256 yz = _mm256_mul_ps(y, z2);
+			const __m256 xz = _mm256_mul_ps(z, x2);
+			const __m256 wx = _mm256_mul_ps(w, x2);
+			const __m256 wy = _mm256_mul_ps(w, y2);
+			const __m256 wz = _mm256_mul_ps(w, z2);
+			// rows 0, 1, 2 of columns 0, 1, 2
+			const __m256 m[3][3] = {
+				{ _mm256_sub_ps(one, _mm256_add_ps(yy, zz)), _mm256_add_ps(xy, wz), _mm256_sub_ps(xz, wy) },
+				{ _mm256_sub_ps(xy, wz), _mm256_sub_ps(one, _mm256_add_ps(xx, zz)), _mm256_add_ps(yz, wx) },
+				{ _mm256_add_ps(xz, wy), _mm256_sub_ps(yz, wx), _mm256_sub_ps(one, _mm256_add_ps(xx, yy)) }
+			};
+			// lanes 0-3 and 4-7 are transposed to columns of 4 matrices each
+			for (uint h = 0; h < 2; ++h) {
+				__m128 columns[3][4];
+				for (uint c = 0; c < 3; ++c) {
+					for (uint r = 0; r < 3; ++r) {
+						columns[c][r] = h ? _mm256_extractf128_ps(m[c][r], 1) : _mm256_castps256_ps128(m[c][r]);
+					}
+					columns[c][3] = _mm_setzero_ps();
+					_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+				}
+				for (uint j = 0; j < 4; ++j) {
+					float* matrix = &out[i + h * 4 + j][0];
+					_mm_storeu_ps(matrix, columns[0][j]);
+					_mm_storeu_ps(matrix + 4, columns[1][j]);
+					_mm_storeu_ps(matrix + 8, columns[2][j]);
+					_mm_storeu_ps(matrix + 12, position);
+				}
+			}
+		}
+		_mm256_zeroupper();
+		return i;
+	}
+#endif
+
+	INLINE bool UseAVX2()
+	{
+#ifdef CPU_X86
+		return CPUFeatures::GetSIMDLevel() >= CPUFeatures::AVX2Level;
+#else
+		return false;
+#endif
+	}
+
+}
+
+void Quaternion::NormalizeMany(const QuaternionArrays& q, const QuaternionArrays& out, size_t n)
+{
+	size_t i = 0;
+#ifdef CPU_X86
+	if (UseAVX2()) {
+		i = NormalizeAVX2(q, out, n);
+	}
+#endif
+	for (i = NormalizeSIMD(q, out, i, n); i < n; ++i) {
+		Quaternion r = GetQuaternion(q, i);
+		r.Normalize();
+		SetQuaternion(out, i, r);
+	}
+}
+
+void Quaternion::MulMany(const QuaternionArrays& a, const QuaternionArrays& b, const QuaternionArrays& out, size_t n)
+{
+	size_t i = 0;
+#ifdef CPU_X86
+	if (UseAVX2()) {
+		i = MulAVX2(a, b, out, n);
+	}
+#endif
+	for (i = MulSIMD(a, b, out, i, n); i < n; ++i) {
+		SetQuaternion(out, i, GetQuaternion(a, i) * GetQuaternion(b, i));
+	}
+}
+
+void Quaternion::SlerpMany(const QuaternionArrays& a, const QuaternionArrays& b, const float* t, const QuaternionArrays& out, size_t n, SlerpMode mode)
+{
+	assert((!n || t) && "NULL Pointer");
+	size_t i = 0;
+	if (mode == SlerpFast) {
+#ifdef CPU_X86
+		if (UseAVX2()) {
+			i = NlerpAVX2(a, b, t, out, n);
+		}
+#endif
+		i = NlerpSIMD(a, b, t, out, i, n);
+	}
+	// sin and atan2 of Slerp have no SIMD counterparts, exact mode stays scalar
+	for (; i < n; ++i) {
+		Quaternion r;
+		if (mode == SlerpFast) {
+			Nlerp(GetQuaternion(a, i), GetQuaternion(b, i), t[i], r);
+		}
+		else {
+			Slerp(GetQuaternion(a, i), GetQuaternion(b, i), t[i], r);
+		}
+		SetQuaternion(out, i, r);
+	}
+}
+
+void Quaternion::ToMatrixMany(const QuaternionArrays& q, Matrix4x4* out, size_t n)
+{
+	assert((!n || out) && "NULL Pointer");
+	size_t i = 0;
+#ifdef CPU_X86
+	if (UseAVX2()) {
+		i = ToMatrixAVX2(q, out, n);
+	}
+#endif
+	for (i = ToMatrixSIMD(q, out, i, n); i < n; ++i) {
+		const Quaternion r = GetQuaternion(q, i);
+		out[i].LoadIdentity();
+		out[i].FromQuaternion(r);
+	}
+}
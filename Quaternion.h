@@ -17,11 +17,28 @@
 //
 
 #include "Vector3D.h"
+#include "SIMD.h"
 
 struct D3DXQUATERNION;
+class Matrix4x4;
+
+// Quaternions as structure of arrays for the batch operations, inputs are only read
+struct QuaternionArrays {
+	float* x;
+	float* y;
+	float* z;
+	float* w;
+};
 
 class Quaternion {// quaternion
 public:
+	// Interpolation of SlerpMany
+	enum SlerpMode {
+		// Slerp of every pair
+		SlerpExact,
+		// Nlerp, less than 0.1 degrees off
+		SlerpFast
+	};
 	float x;
 	float y;
 	float z;
@@ -49,6 +66,16 @@ public:
 	{
 		return reinterpret_cast<const D3DXQUATERNION *>(this);
 	}
+	//
+	INLINE SIMD::Float4 Load() const
+	{
+		return SIMD::Load(&x);
+	}
+	//
+	INLINE void Store(SIMD::Float4 v)
+	{
+		SIMD::Store(&x, v);
+	}
 	INLINE bool operator == (const Quaternion& q) const
 	{
 		return x == q.x && y == q.y && z == q.z && w == q.w;
@@ -85,28 +112,19 @@ public:
 	}
 	INLINE Quaternion& operator /= (const Quaternion& q)
 	{
-		x /= q.x;
-		y /= q.y;
-		z /= q.z;
-		w /= q.w;
+		Store(SIMD::Div(Load(), q.Load()));
 		return *this;
 	}
 	INLINE Quaternion& operator /= (float value)
 	{
 		assert(value != 0.0f && "Invalid Value");
 		value = 1.0f / value;
-		x *= value;
-		y *= value;
-		z *= value;
-		w *= value;
+		Store(SIMD::Mul(Load(), SIMD::Splat(value)));
 		return *this;
 	}
 	INLINE Quaternion& operator *= (float value)
 	{
-		x *= value;
-		y *= value;
-		z *= value;
-		w *= value;
+		Store(SIMD::Mul(Load(), SIMD::Splat(value)));
 		return *this;
 	}
 	INLINE Quaternion& operator *= (const Quaternion& q)
@@ -147,19 +165,13 @@ public:
 	INLINE friend Quaternion operator + (const Quaternion& q1, const Quaternion& q2)
 	{
 		Quaternion q;
-		q.x = q1.x + q2.x;
-		q.y = q1.y + q2.y;
-		q.z = q1.z + q2.z;
-		q.w = q1.w + q2.w;
+		q.Store(SIMD::Add(q1.Load(), q2.Load()));
 		return q;
 	}
 	INLINE friend Quaternion operator - (const Quaternion& q1, const Quaternion& q2)
 	{
 		Quaternion q;
-		q.x = q1.x - q2.x;
-		q.y = q1.y - q2.y;
-		q.z = q1.z - q2.z;
-		q.w = q1.w - q2.w;
+		q.Store(SIMD::Sub(q1.Load(), q2.Load()));
 		return q;
 	}
 	//
@@ -167,11 +179,19 @@ public:
 	{
 #if 1
 		// qq' = [ cross(v,v') + wv' + w'v, ww'  dot(v,v')]
+		// q.x = q2.w * q1.x + q2.x * q1.w + q2.y * q1.z - q2.z * q1.y;
+		// q.y = q2.w * q1.y - q2.x * q1.z + q2.y * q1.w + q2.z * q1.x;
+		// q.z = q2.w * q1.z + q2.x * q1.y - q2.y * q1.x + q2.z * q1.w;
+		// q.w = q2.w * q1.w - q2.x * q1.x - q2.y * q1.y - q2.z * q1.z;
+		// a subtracted term is added negated, which rounds the same
+		const SIMD::Float4 a = q1.Load();
+		const SIMD::Float4 b = q2.Load();
+		SIMD::Float4 r = SIMD::Mul(SIMD::Broadcast<3>(b), a);
+		r = SIMD::Add(r, SIMD::Mul(SIMD::Broadcast<0>(b), SIMD::Mul(SIMD::Shuffle<3, 2, 1, 0>(a), SIMD::Set(1.0f, -1.0f, 1.0f, -1.0f))));
+		r = SIMD::Add(r, SIMD::Mul(SIMD::Broadcast<1>(b), SIMD::Mul(SIMD::Shuffle<2, 3, 0, 1>(a), SIMD::Set(1.0f, 1.0f, -1.0f, -1.0f))));
+		r = SIMD::Add(r, SIMD::Mul(SIMD::Broadcast<2>(b), SIMD::Mul(SIMD::Shuffle<1, 0, 3, 2>(a), SIMD::Set(-1.0f, 1.0f, 1.0f, -1.0f))));
 		Quaternion q;
-		q.x = q2.w * q1.x + q2.x * q1.w + q2.y * q1.z - q2.z * q1.y;
-		q.y = q2.w * q1.y - q2.x * q1.z + q2.y * q1.w + q2.z * q1.x;
-		q.z = q2.w * q1.z + q2.x * q1.y - q2.y * q1.x + q2.z * q1.w;
-		q.w = q2.w * q1.w - q2.x * q1.x - q2.y * q1.y - q2.z * q1.z;
+		q.Store(r);
 		return q;
 #else
 		float t0 = (q1.x - q1.y) * (q2.y - q2.x);
@@ -573,6 +593,50 @@ public:
 		out.y = (k0 * qa[1]) + (k1 * q1y);
 		out.z = (k0 * qa[2]) + (k1 * q1z);
 	}
+	// Normalized linear interpolation with t corrected by a fit of the slerp curve.
+	// The angle differs from Slerp by less than 0.1 degrees for unit quaternions
+	INLINE friend void Nlerp(const Quaternion& qa, const Quaternion& qb, float t, Quaternion& out)
+	{
+		if (t <= 0.0f) {
+			out = qa;
+			return;
+		}
+		if (t >= 1.0f) {
+			out = qb;
+			return;
+		}
+		float cosOmega = dotProduct(qa, qb);
+		float q1x = qb.x;
+		float q1y = qb.y;
+		float q1z = qb.z;
+		float q1w = qb.w;
+		if (cosOmega < 0.0f) {
+			q1x = -q1x;
+			q1y = -q1y;
+			q1z = -q1z;
+			q1w = -q1w;
+			cosOmega = -cosOmega;
+		}
+		const float a = 1.0904f + cosOmega * (-3.2452f + cosOmega * (3.55645f - cosOmega * 1.43519f));
+		const float b = 0.848013f + cosOmega * (-1.06021f + cosOmega * 0.215638f);
+		const float k = a * (t - 0.5f) * (t - 0.5f) + b;
+		const float k1 = t + t * (t - 0.5f) * (t - 1.0f) * k;
+		const float k0 = 1.0f - k1;
+		const float x = k0 * qa.x + k1 * q1x;
+		const float y = k0 * qa.y + k1 * q1y;
+		const float z = k0 * qa.z + k1 * q1z;
+		const float w = k0 * qa.w + k1 * q1w;
+		const float oneOverMag = 1.0f / sqrtf(x * x + y * y + z * z + w * w);
+		out.Set(x * oneOverMag, y * oneOverMag, z * oneOverMag, w * oneOverMag);
+	}
+	// Batch operations, out may be an input. Results are the same as Normalize,
+	// operator *, Slerp or Nlerp and Matrix4x4::FromQuaternion on every SIMD level
+	static void NormalizeMany(const QuaternionArrays& q, const QuaternionArrays& out, size_t n);
+	// out[i] = a[i] * b[i]
+	static void MulMany(const QuaternionArrays& a, const QuaternionArrays& b, const QuaternionArrays& out, size_t n);
+	static void SlerpMany(const QuaternionArrays& a, const QuaternionArrays& b, const float* t, const QuaternionArrays& out, size_t n, SlerpMode mode = SlerpExact);
+	// Rotation matrices, the translation is zero
+	static void ToMatrixMany(const QuaternionArrays& q, Matrix4x4* out, size_t n);
 	//
 	INLINE Quaternion(const Vector3D& v) : x(v.x), y(v.y), z(v.z), w(0.0f)
 	{
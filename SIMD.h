@@ -0,0 +1,586 @@
+// SIMD.h: portable SIMD backend of the math classes.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+// The backend is picked at compile time:
+//	SIMD_AVX2 - AVX2 is enabled (/arch:AVX2, -mavx2), SSE2 plus 8 wide operations
+//	SIMD_SSE2 - x64, or x86 with SSE2
+//	SIMD_NEON - AArch64
+//	SIMD_SCALAR - everything else, or forced with SIMD_FORCE_SCALAR
+// All backends evaluate the same IEEE operations lane by lane in the same order
+// as the scalar code, so results are identical on every backend as long as the
+// compiler doesn't contract multiply and add into FMA (/fp:precise, -ffp-contract=off;
+// GCC and Clang contract by default on AArch64).
+// Loads and stores are unaligned, the math classes keep plain float storage.
+
+#if defined(SIMD_FORCE_SCALAR)
+#define SIMD_SCALAR
+#elif defined(__AVX2__)
+#define SIMD_AVX2
+#define SIMD_SSE2
+#elif defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON
+#else
+#define SIMD_SCALAR
+#endif
+
+#if defined(SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(SIMD_SSE2)
+#include <emmintrin.h>
+#elif defined(SIMD_NEON)
+#include <arm_neon.h>
+#else
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#endif
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+#define ALIGN16 alignas(16)
+
+namespace SIMD {
+
+#if defined(SIMD_SSE2)
+	typedef __m128 Float4;
+
+	INLINE Float4 Load(const float* p)
+	{
+		return _mm_loadu_ps(p);
+	}
+	INLINE void Store(float* p, Float4 v)
+	{
+		_mm_storeu_ps(p, v);
+	}
+	INLINE Float4 Set(float x, float y, float z, float w)
+	{
+		return _mm_setr_ps(x, y, z, w);
+	}
+	INLINE Float4 Splat(float value)
+	{
+		return _mm_set1_ps(value);
+	}
+	INLINE Float4 Add(Float4 a, Float4 b)
+	{
+		return _mm_add_ps(a, b);
+	}
+	INLINE Float4 Sub(Float4 a, Float4 b)
+	{
+		return _mm_sub_ps(a, b);
+	}
+	INLINE Float4 Mul(Float4 a, Float4 b)
+	{
+		return _mm_mul_ps(a, b);
+	}
+	INLINE Float4 Div(Float4 a, Float4 b)
+	{
+		return _mm_div_ps(a, b);
+	}
+	INLINE Float4 Sqrt(Float4 v)
+	{
+		return _mm_sqrt_ps(v);
+	}
+	// 1 / sqrt(v), relative error below 1.5 * 2^-12
+	INLINE Float4 RSqrtEstimate(Float4 v)
+	{
+		return _mm_rsqrt_ps(v);
+	}
+	// a < b ? a : b, b if either is NaN
+	INLINE Float4 Min(Float4 a, Float4 b)
+	{
+		return _mm_min_ps(a, b);
+	}
+	// a > b ? a : b, b if either is NaN
+	INLINE Float4 Max(Float4 a, Float4 b)
+	{
+		return _mm_max_ps(a, b);
+	}
+	// Comparisons give lane masks, all bits set where true
+	INLINE Float4 CmpLT(Float4 a, Float4 b)
+	{
+		return _mm_cmplt_ps(a, b);
+	}
+	INLINE Float4 CmpLE(Float4 a, Float4 b)
+	{
+		return _mm_cmple_ps(a, b);
+	}
+	INLINE Float4 CmpGT(Float4 a, Float4 b)
+	{
+		return _mm_cmpgt_ps(a, b);
+	}
+	// bit i is the sign bit of lane i
+	INLINE int MoveMask(Float4 v)
+	{
+		return _mm_movemask_ps(v);
+	}
+	INLINE Float4 And(Float4 a, Float4 b)
+	{
+		return _mm_and_ps(a, b);
+	}
+	INLINE Float4 Xor(Float4 a, Float4 b)
+	{
+		return _mm_xor_ps(a, b);
+	}
+	// lane i of the result is lane Ii of v
+	template <int I0, int I1, int I2, int I3>
+	INLINE Float4 Shuffle(Float4 v)
+	{
+		return _mm_shuffle_ps(v, v, _MM_SHUFFLE(I3, I2, I1, I0));
+	}
+	// lanes 0, 1 of the result from a, lanes 2, 3 from b
+	template <int I0, int I1, int J2, int J3>
+	INLINE Float4 Shuffle2(Float4 a, Float4 b)
+	{
+		return _mm_shuffle_ps(a, b, _MM_SHUFFLE(J3, J2, I1, I0));
+	}
+	template <int Lane>
+	INLINE float GetLane(Float4 v)
+	{
+		return _mm_cvtss_f32(Shuffle<Lane, Lane, Lane, Lane>(v));
+	}
+#elif defined(SIMD_NEON)
+	typedef float32x4_t Float4;
+
+	INLINE Float4 Load(const float* p)
+	{
+		return vld1q_f32(p);
+	}
+	INLINE void Store(float* p, Float4 v)
+	{
+		vst1q_f32(p, v);
+	}
+	INLINE Float4 Set(float x, float y, float z, float w)
+	{
+		const float v[4] = { x, y, z, w };
+		return vld1q_f32(v);
+	}
+	INLINE Float4 Splat(float value)
+	{
+		return vdupq_n_f32(value);
+	}
+	INLINE Float4 Add(Float4 a, Float4 b)
+	{
+		return vaddq_f32(a, b);
+	}
+	INLINE Float4 Sub(Float4 a, Float4 b)
+	{
+		return vsubq_f32(a, b);
+	}
+	INLINE Float4 Mul(Float4 a, Float4 b)
+	{
+		return vmulq_f32(a, b);
+	}
+	INLINE Float4 Div(Float4 a, Float4 b)
+	{
+		return vdivq_f32(a, b);
+	}
+	INLINE Float4 Sqrt(Float4 v)
+	{
+		return vsqrtq_f32(v);
+	}
+	// vrsqrteq_f32 has 8 bits only, one step of vrsqrtsq_f32 brings it on par with SSE
+	INLINE Float4 RSqrtEstimate(Float4 v)
+	{
+		const float32x4_t e = vrsqrteq_f32(v);
+		return vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(v, e), e));
+	}
+	// selects like SSE, vminq_f32 and vmaxq_f32 would return NaN instead of b
+	INLINE Float4 Min(Float4 a, Float4 b)
+	{
+		return vbslq_f32(vcltq_f32(a, b), a, b);
+	}
+	INLINE Float4 Max(Float4 a, Float4 b)
+	{
+		return vbslq_f32(vcgtq_f32(a, b), a, b);
+	}
+	INLINE Float4 CmpLT(Float4 a, Float4 b)
+	{
+		return vreinterpretq_f32_u32(vcltq_f32(a, b));
+	}
+	INLINE Float4 CmpLE(Float4 a, Float4 b)
+	{
+		return vreinterpretq_f32_u32(vcleq_f32(a, b));
+	}
+	INLINE Float4 CmpGT(Float4 a, Float4 b)
+	{
+		return vreinterpretq_f32_u32(vcgtq_f32(a, b));
+	}
+	INLINE int MoveMask(Float4 v)
+	{
+		const uint32_t bits[4] = { 1, 2, 4, 8 };
+		const uint32x4_t signs = vshrq_n_u32(vreinterpretq_u32_f32(v), 31);
+		return static_cast<int>(vaddvq_u32(vmulq_u32(signs, vld1q_u32(bits))));
+	}
+	INLINE Float4 And(Float4 a, Float4 b)
+	{
+		return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+	INLINE Float4 Xor(Float4 a, Float4 b)
+	{
+		return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+	template <int I0, int I1, int I2, int I3>
+	INLINE Float4 Shuffle(Float4 v)
+	{
+#if defined(__clang__)
+		return __builtin_shufflevector(v, v, I0, I1, I2, I3);
+#else
+		Float4 r = vmovq_n_f32(vgetq_lane_f32(v, I0));
+		r = vsetq_lane_f32(vgetq_lane_f32(v, I1), r, 1);
+		r = vsetq_lane_f32(vgetq_lane_f32(v, I2), r, 2);
+		return vsetq_lane_f32(vgetq_lane_f32(v, I3), r, 3);
+#endif
+	}
+	template <int I0, int I1, int J2, int J3>
+	INLINE Float4 Shuffle2(Float4 a, Float4 b)
+	{
+#if defined(__clang__)
+		return __builtin_shufflevector(a, b, I0, I1, J2 + 4, J3 + 4);
+#else
+		Float4 r = vmovq_n_f32(vgetq_lane_f32(a, I0));
+		r = vsetq_lane_f32(vgetq_lane_f32(a, I1), r, 1);
+		r = vsetq_lane_f32(vgetq_lane_f32(b, J2), r, 2);
+		return vsetq_lane_f32(vgetq_lane_f32(b, J3), r, 3);
+#endif
+	}
+	template <int Lane>
+	INLINE float GetLane(Float4 v)
+	{
+		return vgetq_lane_f32(v, Lane);
+	}
+#else
+	struct Float4 {
+		float f[4];
+	};
+
+	INLINE Float4 Load(const float* p)
+	{
+		const Float4 r = { { p[0], p[1], p[2], p[3] } };
+		return r;
+	}
+	INLINE void Store(float* p, Float4 v)
+	{
+		p[0] = v.f[0];
+		p[1] = v.f[1];
+		p[2] = v.f[2];
+		p[3] = v.f[3];
+	}
+	INLINE Float4 Set(float x, float y, float z, float w)
+	{
+		const Float4 r = { { x, y, z, w } };
+		return r;
+	}
+	INLINE Float4 Splat(float value)
+	{
+		return Set(value, value, value, value);
+	}
+	INLINE Float4 Add(Float4 a, Float4 b)
+	{
+		return Set(a.f[0] + b.f[0], a.f[1] + b.f[1], a.f[2] + b.f[2], a.f[3] + b.f[3]);
+	}
+	INLINE Float4 Sub(Float4 a, Float4 b)
+	{
+		return Set(a.f[0] - b.f[0], a.f[1] - b.f[1], a.f[2] - b.f[2], a.f[3] - b.f[3]);
+	}
+	INLINE Float4 Mul(Float4 a, Float4 b)
+	{
+		return Set(a.f[0] * b.f[0], a.f[1] * b.f[1], a.f[2] * b.f[2], a.f[3] * b.f[3]);
+	}
+	INLINE Float4 Div(Float4 a, Float4 b)
+	{
+		return Set(a.f[0] / b.f[0], a.f[1] / b.f[1], a.f[2] / b.f[2], a.f[3] / b.f[3]);
+	}
+	INLINE Float4 Sqrt(Float4 v)
+	{
+		return Set(std::sqrt(v.f[0]), std::sqrt(v.f[1]), std::sqrt(v.f[2]), std::sqrt(v.f[3]));
+	}
+	INLINE Float4 RSqrtEstimate(Float4 v)
+	{
+		return Div(Splat(1.0f), Sqrt(v));
+	}
+	INLINE Float4 Min(Float4 a, Float4 b)
+	{
+		return Set(a.f[0] < b.f[0] ? a.f[0] : b.f[0], a.f[1] < b.f[1] ? a.f[1] : b.f[1],
+			a.f[2] < b.f[2] ? a.f[2] : b.f[2], a.f[3] < b.f[3] ? a.f[3] : b.f[3]);
+	}
+	INLINE Float4 Max(Float4 a, Float4 b)
+	{
+		return Set(a.f[0] > b.f[0] ? a.f[0] : b.f[0], a.f[1] > b.f[1] ? a.f[1] : b.f[1],
+			a.f[2] > b.f[2] ? a.f[2] : b.f[2], a.f[3] > b.f[3] ? a.f[3] : b.f[3]);
+	}
+	// lane with all bits set or cleared
+	INLINE float MaskLane(bool value)
+	{
+		const uint32_t bits = value ? 0xffffffffu : 0u;
+		float lane;
+		memcpy(&lane, &bits, sizeof(lane));
+		return lane;
+	}
+	INLINE Float4 CmpLT(Float4 a, Float4 b)
+	{
+		return Set(MaskLane(a.f[0] < b.f[0]), MaskLane(a.f[1] < b.f[1]), MaskLane(a.f[2] < b.f[2]), MaskLane(a.f[3] < b.f[3]));
+	}
+	INLINE Float4 CmpLE(Float4 a, Float4 b)
+	{
+		return Set(MaskLane(a.f[0] <= b.f[0]), MaskLane(a.f[1] <= b.f[1]), MaskLane(a.f[2] <= b.f[2]), MaskLane(a.f[3] <= b.f[3]));
+	}
+	INLINE Float4 CmpGT(Float4 a, Float4 b)
+	{
+		return Set(MaskLane(a.f[0] > b.f[0]), MaskLane(a.f[1] > b.f[1]), MaskLane(a.f[2] > b.f[2]), MaskLane(a.f[3] > b.f[3]));
+	}
+	INLINE int MoveMask(Float4 v)
+	{
+		int mask = 0;
+		for (int i = 0; i < 4; ++i) {
+			uint32_t bits;
+			memcpy(&bits, &v.f[i], sizeof(bits));
+			mask |= static_cast<int>(bits >> 31) << i;
+		}
+		return mask;
+	}
+	// bitwise operation of the lanes
+	template <typename Operation>
+	INLINE Float4 Bitwise(Float4 a, Float4 b, Operation operation)
+	{
+		Float4 r;
+		for (int i = 0; i < 4; ++i) {
+			uint32_t x;
+			uint32_t y;
+			memcpy(&x, &a.f[i], sizeof(x));
+			memcpy(&y, &b.f[i], sizeof(y));
+			x = operation(x, y);
+			memcpy(&r.f[i], &x, sizeof(x));
+		}
+		return r;
+	}
+	INLINE Float4 And(Float4 a, Float4 b)
+	{
+		return Bitwise(a, b, [](uint32_t x, uint32_t y) { return x & y; });
+	}
+	INLINE Float4 Xor(Float4 a, Float4 b)
+	{
+		return Bitwise(a, b, [](uint32_t x, uint32_t y) { return x ^ y; });
+	}
+	template <int I0, int I1, int I2, int I3>
+	INLINE Float4 Shuffle(Float4 v)
+	{
+		return Set(v.f[I0], v.f[I1], v.f[I2], v.f[I3]);
+	}
+	template <int I0, int I1, int J2, int J3>
+	INLINE Float4 Shuffle2(Float4 a, Float4 b)
+	{
+		return Set(a.f[I0], a.f[I1], b.f[J2], b.f[J3]);
+	}
+	template <int Lane>
+	INLINE float GetLane(Float4 v)
+	{
+		return v.f[Lane];
+	}
+#endif
+
+	// all lanes set to lane of v
+	template <int Lane>
+	INLINE Float4 Broadcast(Float4 v)
+	{
+		return Shuffle<Lane, Lane, Lane, Lane>(v);
+	}
+	// mask ? a : b per lane, mask is a comparison result
+	INLINE Float4 Select(Float4 mask, Float4 a, Float4 b)
+	{
+		return Xor(b, And(Xor(a, b), mask));
+	}
+	// 1 / sqrt(v), the estimate refined by one Newton-Raphson step. The NEON estimate
+	// has a step already, so NEON takes two
+	INLINE Float4 RSqrt(Float4 v)
+	{
+		const Float4 e = RSqrtEstimate(v);
+		// e * (1.5 - 0.5 * v * e * e)
+		return Mul(e, Sub(Splat(1.5f), Mul(Mul(Mul(Splat(0.5f), v), e), e)));
+	}
+	// Transpose of the matrix with rows r0, r1, r2, r3
+	INLINE void Transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3)
+	{
+		const Float4 t0 = Shuffle2<0, 1, 0, 1>(r0, r1);
+		const Float4 t1 = Shuffle2<2, 3, 2, 3>(r0, r1);
+		const Float4 t2 = Shuffle2<0, 1, 0, 1>(r2, r3);
+		const Float4 t3 = Shuffle2<2, 3, 2, 3>(r2, r3);
+		r0 = Shuffle2<0, 2, 0, 2>(t0, t2);
+		r1 = Shuffle2<1, 3, 1, 3>(t0, t2);
+		r2 = Shuffle2<0, 2, 0, 2>(t1, t3);
+		r3 = Shuffle2<1, 3, 1, 3>(t1, t3);
+	}
+	// Cross product of xyz, w is 0 for finite input
+	INLINE Float4 Cross(Float4 a, Float4 b)
+	{
+		return Sub(Mul(Shuffle<1, 2, 0, 3>(a), Shuffle<2, 0, 1, 3>(b)), Mul(Shuffle<2, 0, 1, 3>(a), Shuffle<1, 2, 0, 3>(b)));
+	}
+	// Column major 4x4 matrix product, c may be a or b.
+	// Column j of c is ((a0 * b[j][0] + a1 * b[j][1]) + a2 * b[j][2]) + a3 * b[j][3]
+	INLINE void MultiplyMatrix(const float* a, const float* b, float* c)
+	{
+#if defined(SIMD_AVX2)
+		// two columns of c per iteration
+		const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a));
+		const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 4));
+		const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 8));
+		const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(a + 12));
+		const __m256 b01 = _mm256_loadu_ps(b);
+		const __m256 b23 = _mm256_loadu_ps(b + 8);
+		__m256 c01 = _mm256_add_ps(_mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00)), _mm256_mul_ps(a1, _mm256_permute_ps(b01, 0x55)));
+		c01 = _mm256_add_ps(c01, _mm256_mul_ps(a2, _mm256_permute_ps(b01, 0xaa)));
+		c01 = _mm256_add_ps(c01, _mm256_mul_ps(a3, _mm256_permute_ps(b01, 0xff)));
+		__m256 c23 = _mm256_add_ps(_mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00)), _mm256_mul_ps(a1, _mm256_permute_ps(b23, 0x55)));
+		c23 = _mm256_add_ps(c23, _mm256_mul_ps(a2, _mm256_permute_ps(b23, 0xaa)));
+		c23 = _mm256_add_ps(c23, _mm256_mul_ps(a3, _mm256_permute_ps(b23, 0xff)));
+		_mm256_storeu_ps(c, c01);
+		_mm256_storeu_ps(c + 8, c23);
+#else
+		const Float4 a0 = Load(a);
+		const Float4 a1 = Load(a + 4);
+		const Float4 a2 = Load(a + 8);
+		const Float4 a3 = Load(a + 12);
+		Float4 r[4];
+		for (int j = 0; j < 4; ++j) {
+			const Float4 bj = Load(b + 4 * j);
+			r[j] = Add(Mul(a0, Broadcast<0>(bj)), Mul(a1, Broadcast<1>(bj)));
+			r[j] = Add(r[j], Mul(a2, Broadcast<2>(bj)));
+			r[j] = Add(r[j], Mul(a3, Broadcast<3>(bj)));
+		}
+		for (int j = 0; j < 4; ++j) {
+			Store(c + 4 * j, r[j]);
+		}
+#endif
+	}
+
+	// Column major 4x4 matrix times column vector, ((a0 * v.x + a1 * v.y) + a2 * v.z) + a3 * v.w
+	INLINE Float4 MultiplyVector(const float* a, Float4 v)
+	{
+		Float4 r = Add(Mul(Load(a), Broadcast<0>(v)), Mul(Load(a + 4), Broadcast<1>(v)));
+		r = Add(r, Mul(Load(a + 8), Broadcast<2>(v)));
+		return Add(r, Mul(Load(a + 12), Broadcast<3>(v)));
+	}
+
+	// 2x2 matrices are stored in one vector as (m00, m01, m10, m11)
+	// a * b
+	INLINE Float4 Multiply2x2(Float4 a, Float4 b)
+	{
+		return Add(Mul(a, Shuffle<0, 3, 0, 3>(b)), Mul(Shuffle<1, 0, 3, 2>(a), Shuffle<2, 1, 2, 1>(b)));
+	}
+	// adjugate(a) * b
+	INLINE Float4 AdjugateMultiply2x2(Float4 a, Float4 b)
+	{
+		return Sub(Mul(Shuffle<3, 3, 0, 0>(a), b), Mul(Shuffle<1, 1, 2, 2>(a), Shuffle<2, 3, 0, 1>(b)));
+	}
+	// a * adjugate(b)
+	INLINE Float4 MultiplyAdjugate2x2(Float4 a, Float4 b)
+	{
+		return Sub(Mul(a, Shuffle<3, 0, 3, 0>(b)), Mul(Shuffle<1, 0, 3, 2>(a), Shuffle<2, 1, 2, 1>(b)));
+	}
+
+	// General 4x4 inverse with Cramer's rule on 2x2 blocks, m may be out.
+	// The rule is symmetric in rows and columns, so it works on either storage order.
+	// A singular matrix gives inf or NaN.
+	INLINE void InvertMatrix(const float* m, float* out)
+	{
+		const Float4 m0 = Load(m);
+		const Float4 m1 = Load(m + 4);
+		const Float4 m2 = Load(m + 8);
+		const Float4 m3 = Load(m + 12);
+		// blocks | A B |
+		//        | C D |
+		const Float4 a = Shuffle2<0, 1, 0, 1>(m0, m1);
+		const Float4 b = Shuffle2<2, 3, 2, 3>(m0, m1);
+		const Float4 c = Shuffle2<0, 1, 0, 1>(m2, m3);
+		const Float4 d = Shuffle2<2, 3, 2, 3>(m2, m3);
+		// (|A|, |B|, |C|, |D|)
+		const Float4 detSub = Sub(Mul(Shuffle2<0, 2, 0, 2>(m0, m2), Shuffle2<1, 3, 1, 3>(m1, m3)),
+			Mul(Shuffle2<1, 3, 1, 3>(m0, m2), Shuffle2<0, 2, 0, 2>(m1, m3)));
+		const Float4 detA = Broadcast<0>(detSub);
+		const Float4 detB = Broadcast<1>(detSub);
+		const Float4 detC = Broadcast<2>(detSub);
+		const Float4 detD = Broadcast<3>(detSub);
+		// inverse is 1 / |M| * | X Y |
+		//                      | Z W |
+		const Float4 dc = AdjugateMultiply2x2(d, c);
+		const Float4 ab = AdjugateMultiply2x2(a, b);
+		// adjugates of X, Y, Z, W
+		Float4 x = Sub(Mul(detD, a), Multiply2x2(b, dc));
+		Float4 w = Sub(Mul(detA, d), Multiply2x2(c, ab));
+		Float4 y = Sub(Mul(detB, c), MultiplyAdjugate2x2(d, ab));
+		Float4 z = Sub(Mul(detC, b), MultiplyAdjugate2x2(a, dc));
+		// |M| = |A| |D| + |B| |C| - tr(A#B D#C)
+		Float4 tr = Mul(ab, Shuffle<0, 2, 1, 3>(dc));
+		tr = Add(tr, Shuffle<1, 0, 3, 2>(tr));
+		tr = Add(tr, Shuffle<2, 3, 0, 1>(tr));
+		const Float4 detM = Sub(Add(Mul(detA, detD), Mul(detB, detC)), tr);
+		// signs of the adjugate
+		const Float4 invDetM = Div(Set(1.0f, -1.0f, -1.0f, 1.0f), detM);
+		x = Mul(x, invDetM);
+		y = Mul(y, invDetM);
+		z = Mul(z, invDetM);
+		w = Mul(w, invDetM);
+		// adjugate swizzle and block order in one shuffle
+		Store(out, Shuffle2<3, 1, 3, 1>(x, y));
+		Store(out + 4, Shuffle2<2, 0, 2, 0>(x, y));
+		Store(out + 8, Shuffle2<3, 1, 3, 1>(z, w));
+		Store(out + 12, Shuffle2<2, 0, 2, 0>(z, w));
+	}
+
+	// Inverse of a column major affine matrix (last row 0, 0, 0, 1), m may be out.
+	// The 3x3 part is inverted with cross products, so it may have scale and shear.
+	INLINE void InvertAffineMatrix(const float* m, float* out)
+	{
+		const Float4 c0 = Load(m);
+		const Float4 c1 = Load(m + 4);
+		const Float4 c2 = Load(m + 8);
+		const Float4 t = Load(m + 12);
+		// rows of the inverse are the cross products of the columns divided by the determinant
+		Float4 r0 = Cross(c1, c2);
+		Float4 r1 = Cross(c2, c0);
+		Float4 r2 = Cross(c0, c1);
+		const Float4 dot = Mul(c0, r0);
+		const Float4 det = Add(Add(Broadcast<0>(dot), Broadcast<1>(dot)), Broadcast<2>(dot));
+		const Float4 invDet = Div(Splat(1.0f), det);
+		r0 = Mul(r0, invDet);
+		r1 = Mul(r1, invDet);
+		r2 = Mul(r2, invDet);
+		Float4 r3 = Splat(0.0f);
+		Transpose(r0, r1, r2, r3);
+		// translation is -(inverse * t), w is 1
+		Float4 p = Add(Mul(r0, Broadcast<0>(t)), Mul(r1, Broadcast<1>(t)));
+		p = Add(p, Mul(r2, Broadcast<2>(t)));
+		Store(out, r0);
+		Store(out + 4, r1);
+		Store(out + 8, r2);
+		Store(out + 12, Sub(Set(0.0f, 0.0f, 0.0f, 1.0f), p));
+	}
+
+	//
+	INLINE const char* GetBackendName()
+	{
+#if defined(SIMD_AVX2)
+		return "AVX2";
+#elif defined(SIMD_SSE2)
+		return "SSE2";
+#elif defined(SIMD_NEON)
+		return "NEON";
+#else
+		return "Scalar";
+#endif
+	}
+
+}
+
+#endif // __SIMD_H__
@@ -0,0 +1,423 @@
+// ShaderCache.cpp: implementation of the ShaderCache class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "ShaderCache.h"
+#include "Hasher.h"
+#include <cassert>
+#include <cstdio>
+#include <cinttypes>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+namespace {
+	const uint EntryMagic = 0x43444853; // SHDC
+	const uint IndexMagic = 0x58494353; // SCIX
+
+	struct EntryHeader {
+		uint magic;
+		uint version;
+		uint64 key;
+		uint64 size;
+		uint64 checksum;
+	};
+
+	struct IndexHeader {
+		uint magic;
+		uint version;
+		uint64 numEntries;
+		uint64 useCounter;
+		uint64 checksum;
+	};
+
+	struct IndexRecord {
+		uint64 key;
+		uint64 size;
+		uint64 lastUse;
+	};
+
+	void MakeDirectory(const std::string& dir)
+	{
+#ifdef _WIN32
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+
+	// names of the files in dir
+	std::vector<std::string> ListFiles(const std::string& dir)
+	{
+		std::vector<std::string> names;
+#ifdef _WIN32
+		_finddata_t data;
+		const intptr_t handle = _findfirst((dir + "/*").c_str(), &data);
+		if (handle == -1) {
+			return names;
+		}
+		do {
+			if (!(data.attrib & _A_SUBDIR)) {
+				names.push_back(data.name);
+			}
+		} while (!_findnext(handle, &data));
+		_findclose(handle);
+#else
+		DIR* d = opendir(dir.c_str());
+		if (!d) {
+			return names;
+		}
+		while (const dirent* entry = readdir(d)) {
+			if (entry->d_name[0] != '.') {
+				names.push_back(entry->d_name);
+			}
+		}
+		closedir(d);
+#endif
+		return names;
+	}
+
+	// key of an entry file name, 16 hex digits and .bin
+	bool ParseEntryName(const std::string& name, uint64& key)
+	{
+		if (name.size() != 20 || name.compare(16, 4, ".bin")) {
+			return false;
+		}
+		key = 0;
+		for (size_t i = 0; i < 16; ++i) {
+			const char c = name[i];
+			const uint digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : 16;
+			if (digit > 15) {
+				return false;
+			}
+			key = key << 4 | digit;
+		}
+		return true;
+	}
+
+	bool ReadBlob(const std::string& fileName, ShaderCache::Blob& data)
+	{
+		FILE* f = fopen(fileName.c_str(), "rb");
+		if (!f) {
+			return false;
+		}
+		bool res = !fseek(f, 0, SEEK_END);
+		long size = res ? ftell(f) : -1;
+		res = size >= 0 && !fseek(f, 0, SEEK_SET);
+		if (res) {
+			data.resize(static_cast<size_t>(size));
+			res = !size || fread(data.data(), 1, data.size(), f) == data.size();
+		}
+		fclose(f);
+		return res;
+	}
+
+	bool WriteBlob(const std::string& fileName, const void* header, size_t headerSize, const void* data, size_t size)
+	{
+		// write to temporary file first, so a crash can't leave a half written entry
+		const std::string tmpName = fileName + ".tmp";
+		FILE* f = fopen(tmpName.c_str(), "wb");
+		if (!f) {
+			return false;
+		}
+		bool res = fwrite(header, 1, headerSize, f) == headerSize;
+		res = res && (!size || fwrite(data, 1, size, f) == size);
+		res = !fclose(f) && res;
+		if (!res) {
+			remove(tmpName.c_str());
+			return false;
+		}
+		remove(fileName.c_str());
+		if (rename(tmpName.c_str(), fileName.c_str())) {
+			remove(tmpName.c_str());
+			return false;
+		}
+		return true;
+	}
+}
+
+ShaderCache::ShaderCache() :
+	maxSize(0),
+	totalSize(0),
+	useCounter(0),
+	salt(0),
+	isIndexDirty(false)
+{
+}
+
+ShaderCache::~ShaderCache()
+{
+	SaveIndex();
+}
+
+bool ShaderCache::Init(const std::string& dir, uint64 sizeBudget, uint64 keySalt)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	assert(!dir.empty() && "Invalid Value");
+	directory = dir;
+	maxSize = sizeBudget;
+	salt = keySalt;
+	entries.clear();
+	totalSize = 0;
+	useCounter = 0;
+	MakeDirectory(directory);
+	if (!LoadIndex()) {
+		// missing or corrupted index, the scan counts the entries as least recently used
+		entries.clear();
+		totalSize = 0;
+		useCounter = 0;
+		isIndexDirty = true;
+	}
+	ScanDirectory();
+	EvictLocked(0);
+	return true;
+}
+
+std::string ShaderCache::GetEntryPath(uint64 key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016" PRIx64 ".bin", key);
+	return directory + name;
+}
+
+std::string ShaderCache::GetIndexPath() const
+{
+	return directory + "/index.bin";
+}
+
+uint64 ShaderCache::MakeKey(const char* source, size_t sourceSize, const Defines& defines, const char* entryPoint, const char* target, uint flags, uint64 compilerVersion) const
+{
+	Hasher hasher;
+	hasher.Add(static_cast<uint64>(Version));
+	hasher.Add(salt);
+	hasher.Add(static_cast<uint64>(sourceSize));
+	hasher.Add(source, sourceSize);
+	hasher.Add(static_cast<uint64>(defines.size()));
+	for (const auto& define : defines) {
+		hasher.Add(define.first.c_str());
+		hasher.Add(define.second.c_str());
+	}
+	hasher.Add(entryPoint);
+	hasher.Add(target);
+	hasher.Add(static_cast<uint64>(flags));
+	hasher.Add(compilerVersion);
+	return hasher.Get();
+}
+
+uint64 ShaderCache::MakeKey(const char* name) const
+{
+	Hasher hasher;
+	hasher.Add(static_cast<uint64>(Version));
+	hasher.Add(salt);
+	hasher.Add(name);
+	return hasher.Get();
+}
+
+void ShaderCache::Touch(uint64 key, uint64 size)
+{
+	Entry& entry = entries[key];
+	totalSize -= entry.size;
+	entry.size = size;
+	entry.lastUse = ++useCounter;
+	totalSize += size;
+	isIndexDirty = true;
+}
+
+void ShaderCache::RemoveEntry(uint64 key)
+{
+	remove(GetEntryPath(key).c_str());
+	Entries::iterator it = entries.find(key);
+	if (it != entries.end()) {
+		totalSize -= it->second.size;
+		entries.erase(it);
+		isIndexDirty = true;
+	}
+}
+
+bool ShaderCache::Load(uint64 key, Blob& data)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!IsEnabled()) {
+		return false;
+	}
+	Blob fileData;
+	if (!ReadBlob(GetEntryPath(key), fileData)) {
+		if (entries.count(key)) {
+			RemoveEntry(key);
+		}
+		return false;
+	}
+	EntryHeader header;
+	bool isValid = fileData.size() >= sizeof(header);
+	if (isValid) {
+		memcpy(&header, fileData.data(), sizeof(header));
+		const ubyte* payload = fileData.data() + sizeof(header);
+		isValid = header.magic == EntryMagic && header.version == Version && header.key == key &&
+			header.size == fileData.size() - sizeof(header) &&
+			header.checksum == Hasher::Hash(payload, static_cast<size_t>(header.size));
+	}
+	if (!isValid) {
+		// truncated, corrupted or written by other version
+		RemoveEntry(key);
+		return false;
+	}
+	data.assign(fileData.begin() + sizeof(header), fileData.end());
+	Touch(key, header.size);
+	return true;
+}
+
+bool ShaderCache::Store(uint64 key, const void* data, size_t size)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!IsEnabled()) {
+		return false;
+	}
+	assert((data || !size) && "NULL Pointer");
+	EntryHeader header;
+	header.magic = EntryMagic;
+	header.version = Version;
+	header.key = key;
+	header.size = size;
+	header.checksum = Hasher::Hash(data, size);
+	if (!WriteBlob(GetEntryPath(key), &header, sizeof(header), data, size)) {
+		return false;
+	}
+	Touch(key, size);
+	EvictLocked(key);
+	return true;
+}
+
+void ShaderCache::EvictLocked(uint64 keepKey)
+{
+	if (!maxSize) {
+		return;
+	}
+	while (totalSize > maxSize && entries.size() > 1) {
+		Entries::iterator oldest = entries.end();
+		for (Entries::iterator it = entries.begin(); it != entries.end(); ++it) {
+			if (it->first == keepKey) {
+				continue;
+			}
+			if (oldest == entries.end() || it->second.lastUse < oldest->second.lastUse) {
+				oldest = it;
+			}
+		}
+		if (oldest == entries.end()) {
+			break;
+		}
+		RemoveEntry(oldest->first);
+	}
+}
+
+void ShaderCache::Evict()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	EvictLocked(0);
+}
+
+bool ShaderCache::LoadIndex()
+{
+	Blob data;
+	if (!ReadBlob(GetIndexPath(), data) || data.size() < sizeof(IndexHeader)) {
+		return false;
+	}
+	IndexHeader header;
+	memcpy(&header, data.data(), sizeof(header));
+	const size_t recordsSize = data.size() - sizeof(header);
+	if (header.magic != IndexMagic || header.version != Version ||
+		recordsSize != header.numEntries * sizeof(IndexRecord) ||
+		header.checksum != Hasher::Hash(data.data() + sizeof(header), recordsSize)) {
+		return false;
+	}
+	const IndexRecord* records = reinterpret_cast<const IndexRecord *>(data.data() + sizeof(header));
+	for (uint64 i = 0; i < header.numEntries; ++i) {
+		IndexRecord record;
+		memcpy(&record, &records[i], sizeof(record));
+		Entry& entry = entries[record.key];
+		entry.size = record.size;
+		entry.lastUse = record.lastUse;
+		totalSize += record.size;
+	}
+	useCounter = header.useCounter;
+	isIndexDirty = false;
+	return true;
+}
+
+void ShaderCache::ScanDirectory()
+{
+	// files of the index which are gone
+	Entries found;
+	for (const std::string& name : ListFiles(directory)) {
+		const std::string fileName = directory + "/" + name;
+		uint64 key;
+		if (!ParseEntryName(name, key)) {
+			// a .tmp file is left by a crash before its rename
+			if (name.size() > 4 && !name.compare(name.size() - 4, 4, ".tmp")) {
+				remove(fileName.c_str());
+			}
+			continue;
+		}
+		// the header only, Load checks the payload
+		FILE* f = fopen(fileName.c_str(), "rb");
+		if (!f) {
+			continue;
+		}
+		EntryHeader header;
+		bool isValid = fread(&header, 1, sizeof(header), f) == sizeof(header) && !fseek(f, 0, SEEK_END);
+		const long fileSize = isValid ? ftell(f) : -1;
+		fclose(f);
+		isValid = isValid && fileSize >= static_cast<long>(sizeof(header)) && header.magic == EntryMagic && header.version == Version &&
+			header.key == key && header.size == static_cast<uint64>(fileSize) - sizeof(header);
+		if (!isValid) {
+			// written by another version or damaged
+			remove(fileName.c_str());
+			continue;
+		}
+		Entries::const_iterator it = entries.find(key);
+		Entry& entry = found[key];
+		entry.size = header.size;
+		entry.lastUse = it != entries.end() ? it->second.lastUse : 0;
+		isIndexDirty = isIndexDirty || it == entries.end() || it->second.size != header.size;
+	}
+	isIndexDirty = isIndexDirty || found.size() != entries.size();
+	entries.swap(found);
+	totalSize = 0;
+	for (const auto& it : entries) {
+		totalSize += it.second.size;
+	}
+}
+
+bool ShaderCache::SaveIndexLocked()
+{
+	if (!IsEnabled() || !isIndexDirty) {
+		return true;
+	}
+	std::vector<IndexRecord> records;
+	records.reserve(entries.size());
+	for (const auto& it : entries) {
+		const IndexRecord record = { it.first, it.second.size, it.second.lastUse };
+		records.push_back(record);
+	}
+	IndexHeader header;
+	header.magic = IndexMagic;
+	header.version = Version;
+	header.numEntries = records.size();
+	header.useCounter = useCounter;
+	header.checksum = Hasher::Hash(records.data(), records.size() * sizeof(IndexRecord));
+	if (!WriteBlob(GetIndexPath(), &header, sizeof(header), records.data(), records.size() * sizeof(IndexRecord))) {
+		return false;
+	}
+	isIndexDirty = false;
+	return true;
+}
+
+bool ShaderCache::SaveIndex()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return SaveIndexLocked();
+}
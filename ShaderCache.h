@@ -0,0 +1,97 @@
+// ShaderCache.h: interface for the ShaderCache class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __SHADERCACHE_H__
+#define __SHADERCACHE_H__
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "types.h"
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+// Content addressed on-disk cache of binary blobs (shader bytecode, serialized pipelines).
+// Every entry is a separate file with a header holding magic, version, key, size and
+// checksum of the payload; entries failing validation are removed and reported as miss.
+// Recency is tracked in an index file and the least recently used entries are evicted
+// when the cache grows over its size budget. The directory is scanned on Init, so entries
+// the index doesn't know (a crash before the index was saved) count against the budget
+// and entries of other versions are removed.
+class ShaderCache  {
+public:
+	// Bump to invalidate all caches written by older builds
+	static const uint Version = 1;
+	typedef std::vector<ubyte> Blob;
+	typedef std::vector<std::pair<std::string, std::string> > Defines;
+private:
+	struct Entry {
+		uint64 size;
+		uint64 lastUse;
+	};
+	typedef std::map<uint64, Entry> Entries;
+	// cache directory, empty if cache is disabled
+	std::string directory;
+	// size budget in bytes, 0 - unlimited
+	uint64 maxSize;
+	// payload bytes of all entries
+	uint64 totalSize;
+	// use counter for LRU
+	uint64 useCounter;
+	// salt mixed into keys, e.g. compiler version
+	uint64 salt;
+	Entries entries;
+	bool isIndexDirty;
+	mutable std::mutex mutex;
+
+	std::string GetEntryPath(uint64 key) const;
+	std::string GetIndexPath() const;
+	void Touch(uint64 key, uint64 size);
+	void RemoveEntry(uint64 key);
+	void EvictLocked(uint64 keepKey);
+	bool LoadIndex();
+	void ScanDirectory();
+	bool SaveIndexLocked();
+public:
+	ShaderCache();
+	~ShaderCache();
+	// Open or create cache in directory
+	bool Init(const std::string& dir, uint64 sizeBudget = 0, uint64 keySalt = 0);
+	// Key of a shader compilation, compilerVersion tells apart compilers loaded at run time
+	uint64 MakeKey(const char* source, size_t sourceSize, const Defines& defines, const char* entryPoint, const char* target, uint flags, uint64 compilerVersion = 0) const;
+	// Key of a named blob, e.g. pipeline library
+	uint64 MakeKey(const char* name) const;
+	// false if entry doesn't exist or is corrupted
+	bool Load(uint64 key, Blob& data);
+	bool Store(uint64 key, const void* data, size_t size);
+	// Remove least recently used entries until the cache fits into the budget
+	void Evict();
+	// Write recency information, called on destruction too
+	bool SaveIndex();
+	//
+	INLINE bool IsEnabled() const
+	{
+		return !directory.empty();
+	}
+	//
+	INLINE uint64 GetTotalSize() const
+	{
+		return totalSize;
+	}
+	//
+	INLINE size_t GetNumEntries() const
+	{
+		return entries.size();
+	}
+};
+
+#endif // __SHADERCACHE_H__
@@ -0,0 +1,186 @@
+// ShaderPermutation.h: interface for the ShaderPermutation class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __SHADERPERMUTATION_H__
+#define __SHADERPERMUTATION_H__
+
+#include <cassert>
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include "types.h"
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+// Declared keyword sets of a shader and the variants they produce.
+// Every keyword set selects exactly one of its keywords, a keyword is "NAME",
+// "NAME=VALUE" or "" (nothing defined). The selection of all sets is packed
+// into a variant key, every set takes just enough bits for its keywords.
+class ShaderPermutation  {
+public:
+	typedef uint VariantKey;
+	static const uint MaxKeyBits = sizeof(VariantKey) * 8;
+private:
+	struct Keyword {
+		std::string name;
+		std::string value;
+	};
+	struct KeywordSet {
+		std::string name;
+		std::vector<Keyword> keywords;
+		// position of the set in the variant key
+		uint shift;
+		uint bits;
+	};
+	std::vector<KeywordSet> sets;
+	// bits used by all sets
+	uint numBits;
+	//
+	INLINE static uint GetNumBits(size_t numKeywords)
+	{
+		uint bits = 0;
+		while ((static_cast<size_t>(1) << bits) < numKeywords) {
+			++bits;
+		}
+		return bits;
+	}
+	//
+	INLINE static VariantKey GetMask(uint bits)
+	{
+		return bits ? (~0u >> (MaxKeyBits - bits)) : 0;
+	}
+public:
+	ShaderPermutation() : numBits(0)
+	{
+	}
+	// Returns index of the set
+	uint AddKeywordSet(const char* name, std::initializer_list<const char *> keywords)
+	{
+		assert(name && "NULL Pointer");
+		assert(keywords.size() && "Invalid Value");
+		KeywordSet set;
+		set.name = name;
+		for (const char* keyword : keywords) {
+			const std::string str = keyword ? keyword : "";
+			const size_t pos = str.find('=');
+			Keyword k;
+			k.name = str.substr(0, pos);
+			k.value = pos != std::string::npos ? str.substr(pos + 1) : "";
+			set.keywords.push_back(k);
+		}
+		set.shift = numBits;
+		set.bits = GetNumBits(set.keywords.size());
+		numBits += set.bits;
+		assert(numBits <= MaxKeyBits && "Out Of Range");
+		sets.push_back(set);
+		return static_cast<uint>(sets.size() - 1);
+	}
+	// Key with keyword of the set replaced
+	VariantKey SetKeyword(VariantKey key, uint set, uint keyword) const
+	{
+		assert(set < sets.size() && "Out Of Range");
+		const KeywordSet& s = sets[set];
+		assert(keyword < s.keywords.size() && "Out Of Range");
+		const VariantKey mask = GetMask(s.bits) << s.shift;
+		return (key & ~mask) | (static_cast<VariantKey>(keyword) << s.shift);
+	}
+	// Index of keyword selected by the key in the set
+	uint GetKeyword(VariantKey key, uint set) const
+	{
+		assert(set < sets.size() && "Out Of Range");
+		const KeywordSet& s = sets[set];
+		return (key >> s.shift) & GetMask(s.bits);
+	}
+	// false if the key selects a keyword which doesn't exist
+	bool IsValid(VariantKey key) const
+	{
+		if (key & ~GetMask(numBits)) {
+			return false;
+		}
+		for (uint i = 0; i < sets.size(); ++i) {
+			if (GetKeyword(key, i) >= sets[i].keywords.size()) {
+				return false;
+			}
+		}
+		return true;
+	}
+	// Number of valid keys
+	uint GetNumVariants() const
+	{
+		uint numVariants = 1;
+		for (const KeywordSet& s : sets) {
+			numVariants *= static_cast<uint>(s.keywords.size());
+		}
+		return numVariants;
+	}
+	// Key of variant with index in [0, GetNumVariants())
+	VariantKey GetVariant(uint index) const
+	{
+		assert(index < GetNumVariants() && "Out Of Range");
+		VariantKey key = 0;
+		for (uint i = 0; i < sets.size(); ++i) {
+			const uint numKeywords = static_cast<uint>(sets[i].keywords.size());
+			key = SetKeyword(key, i, index % numKeywords);
+			index /= numKeywords;
+		}
+		return key;
+	}
+	// Append macros of the variant terminated by { nullptr, nullptr }, Macro is
+	// a { Name, Definition } struct, e.g. D3D_SHADER_MACRO. Strings are owned by
+	// the permutation and live as long as it does.
+	template <typename Macro>
+	void GetMacros(VariantKey key, std::vector<Macro>& macros) const
+	{
+		assert(IsValid(key) && "Invalid Value");
+		for (uint i = 0; i < sets.size(); ++i) {
+			const Keyword& keyword = sets[i].keywords[GetKeyword(key, i)];
+			if (keyword.name.empty()) {
+				continue;
+			}
+			Macro macro = { keyword.name.c_str(), keyword.value.c_str() };
+			macros.push_back(macro);
+		}
+		Macro macro = { nullptr, nullptr };
+		macros.push_back(macro);
+	}
+	// Human readable keywords of the variant, for logs and debug names
+	std::string GetName(VariantKey key) const
+	{
+		std::string name;
+		for (uint i = 0; i < sets.size(); ++i) {
+			const Keyword& keyword = sets[i].keywords[GetKeyword(key, i)];
+			if (keyword.name.empty()) {
+				continue;
+			}
+			if (!name.empty()) {
+				name += ' ';
+			}
+			name += keyword.name;
+			if (!keyword.value.empty()) {
+				name += '=';
+				name += keyword.value;
+			}
+		}
+		return name;
+	}
+	//
+	INLINE uint GetNumKeywordSets() const
+	{
+		return static_cast<uint>(sets.size());
+	}
+	//
+	INLINE uint GetNumKeywords(uint set) const
+	{
+		assert(set < sets.size() && "Out Of Range");
+		return static_cast<uint>(sets[set].keywords.size());
+	}
+};
+
+#endif // __SHADERPERMUTATION_H__
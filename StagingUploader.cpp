@@ -0,0 +1,162 @@
+// StagingUploader.cpp: implementation of the StagingUploader class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "DXSampleHelper.h"
+#include "StagingUploader.h"
+
+StagingUploader::~StagingUploader()
+{
+	if (ringData) {
+		ringBuffer->Unmap(0, nullptr);
+	}
+	if (fenceEvent) {
+		CloseHandle(fenceEvent);
+	}
+}
+
+void StagingUploader::Init(ID3D12Device* pDevice, ID3D12CommandQueue* pCopyQueue, size_t ringSize)
+{
+	assert(pDevice && "NULL Pointer");
+	assert(pCopyQueue && "NULL Pointer");
+	assert(ringSize && "Invalid Value");
+	device = pDevice;
+	copyQueue = pCopyQueue;
+
+	ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&commandAllocator)));
+	ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, commandAllocator.Get(), nullptr, IID_PPV_ARGS(&commandList)));
+	ThrowIfFailed(commandList->Close());
+
+	ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
+	fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (fenceEvent == nullptr) {
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+	}
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(ringSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&ringBuffer)));
+	ringBuffer->SetName(L"StagingRing");
+
+	// Upload heap stays mapped for the whole lifetime of the ring
+	CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
+	ThrowIfFailed(ringBuffer->Map(0, &readRange, reinterpret_cast<void **>(&ringData)));
+	ring.Reset(ringSize);
+}
+
+void StagingUploader::WaitForFenceValue(UINT64 value)
+{
+	if (fence->GetCompletedValue() < value) {
+		ThrowIfFailed(fence->SetEventOnCompletion(value, fenceEvent));
+		WaitForSingleObject(fenceEvent, INFINITE);
+	}
+}
+
+void StagingUploader::BeginRecording()
+{
+	if (isRecording) {
+		return;
+	}
+	// Command list allocators can only be reset when the associated
+	// command lists have finished execution on the GPU.
+	WaitForFenceValue(allocatorFenceValue);
+	ThrowIfFailed(commandAllocator->Reset());
+	ThrowIfFailed(commandList->Reset(commandAllocator.Get(), nullptr));
+	isRecording = true;
+}
+
+uint64 StagingUploader::AllocateStaging(size_t size, size_t alignment)
+{
+	if (size > ring.GetSize()) {
+		ThrowIfFailed(E_OUTOFMEMORY);
+	}
+	Retire();
+	uint64 offset = ring.Allocate(size, alignment);
+	while (offset == UploadRing::InvalidOffset) {
+		// Ring is full: submit the copies which hold the pending memory
+		// and wait for the oldest submission to give its memory back
+		if (ring.GetPendingSize()) {
+			Flush();
+		}
+		WaitForFenceValue(ring.GetOldestFenceValue());
+		Retire();
+		offset = ring.Allocate(size, alignment);
+	}
+	return offset;
+}
+
+ID3D12Resource* StagingUploader::CreateBuffer(const void* data, size_t size, const wchar_t* name)
+{
+	ID3D12Resource* buffer = nullptr;
+	// Buffers are promoted from COMMON to COPY_DEST on the copy queue and decay back
+	// to COMMON after the submission, so the direct queue can read them without barriers.
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&buffer)));
+	if (name) {
+		buffer->SetName(name);
+	}
+	UploadBuffer(buffer, 0, data, size);
+	return buffer;
+}
+
+void StagingUploader::UploadBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* data, size_t size)
+{
+	assert(dest && "NULL Pointer");
+	assert(data && "NULL Pointer");
+	assert(ringData && "NULL Pointer");
+	// data larger than the ring goes in pieces, AllocateStaging submits and waits
+	// for the previous pieces when the ring is full
+	const ubyte* source = static_cast<const ubyte *>(data);
+	const size_t chunkSize = static_cast<size_t>(ring.GetChunkSize());
+	for (size_t copied = 0; copied < size; copied += chunkSize) {
+		const size_t chunk = size - copied < chunkSize ? size - copied : chunkSize;
+		const uint64 offset = AllocateStaging(chunk, 16);
+		memcpy(ringData + offset, source + copied, chunk);
+		BeginRecording();
+		commandList->CopyBufferRegion(dest, destOffset + copied, ringBuffer.Get(), offset, chunk);
+	}
+}
+
+UINT64 StagingUploader::Flush()
+{
+	if (!isRecording) {
+		return fenceValue;
+	}
+	ThrowIfFailed(commandList->Close());
+	ID3D12CommandList* ppCommandLists[] = { commandList.Get() };
+	copyQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+
+	ThrowIfFailed(copyQueue->Signal(fence.Get(), ++fenceValue));
+	ring.Submit(fenceValue);
+	allocatorFenceValue = fenceValue;
+	isRecording = false;
+	return fenceValue;
+}
+
+void StagingUploader::QueueWait(ID3D12CommandQueue* queue, UINT64 value) const
+{
+	assert(queue && "NULL Pointer");
+	assert(value <= fenceValue && "Invalid Value");
+	ThrowIfFailed(queue->Wait(fence.Get(), value));
+}
+
+void StagingUploader::WaitForIdle()
+{
+	WaitForFenceValue(fenceValue);
+	Retire();
+}
+
+void StagingUploader::Retire()
+{
+	ring.Retire(fence->GetCompletedValue());
+}
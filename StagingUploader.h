@@ -0,0 +1,66 @@
+// StagingUploader.h: interface for the StagingUploader class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __STAGINGUPLOADER_H__
+#define __STAGINGUPLOADER_H__
+
+#include "UploadRing.h"
+
+// Uploads static data into default heap resources through a persistently
+// mapped staging ring and the copy queue.
+// Copies are recorded into one copy command list until Flush() is called, so
+// all uploads made between two flushes go to the GPU as a single submission.
+class StagingUploader {
+private:
+	Microsoft::WRL::ComPtr<ID3D12Device> device;
+	// copy queue, owned by the caller
+	ID3D12CommandQueue* copyQueue = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> commandAllocator;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList;
+	Microsoft::WRL::ComPtr<ID3D12Fence> fence;
+	HANDLE fenceEvent = nullptr;
+	// last signaled fence value
+	UINT64 fenceValue = 0;
+	// fence value of the submission which last used the command allocator
+	UINT64 allocatorFenceValue = 0;
+	// staging memory
+	Microsoft::WRL::ComPtr<ID3D12Resource> ringBuffer;
+	ubyte* ringData = nullptr;
+	UploadRing ring;
+	// true when commandList is open and has commands
+	bool isRecording = false;
+
+	void WaitForFenceValue(UINT64 value);
+	void BeginRecording();
+	uint64 AllocateStaging(size_t size, size_t alignment);
+public:
+	StagingUploader() {}
+	~StagingUploader();
+	void Init(ID3D12Device* pDevice, ID3D12CommandQueue* pCopyQueue, size_t ringSize);
+	// Create a default heap buffer and schedule the copy of data into it
+	ID3D12Resource* CreateBuffer(const void* data, size_t size, const wchar_t* name = nullptr);
+	// Schedule the copy of data into dest, dest must be in the COMMON state.
+	// Data of any size is copied, in pieces if it doesn't fit the ring
+	void UploadBuffer(ID3D12Resource* dest, UINT64 destOffset, const void* data, size_t size);
+	// Submit all scheduled copies, returns fence value which signals their completion
+	UINT64 Flush();
+	// Make queue wait on the GPU until the copies up to value are done
+	void QueueWait(ID3D12CommandQueue* queue, UINT64 value) const;
+	// Wait on the CPU for all submitted copies
+	void WaitForIdle();
+	// Give back staging memory of completed submissions
+	void Retire();
+	//
+	INLINE ID3D12Fence* GetFence() const
+	{
+		return fence.Get();
+	}
+	//
+	INLINE UINT64 GetFenceValue() const
+	{
+		return fenceValue;
+	}
+};
+
+#endif // __STAGINGUPLOADER_H__
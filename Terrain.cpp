@@ -0,0 +1,261 @@
+// Terrain.cpp: implementation of the Terrain class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Terrain.h"
+#include "GridGenerator.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+	// LOD of a distance without hysteresis
+	uint GetLod(const Terrain::Settings& settings, float distance)
+	{
+		uint lod = 0;
+		float lodDistance = settings.lodDistance;
+		while (lod + 1 < settings.numLods && distance >= lodDistance) {
+			++lod;
+			lodDistance *= 2.0f;
+		}
+		return lod;
+	}
+
+	// skirt of the border vertices of a grid, they are copied down by depth
+	void AddSkirt(Mesh& mesh, uint numCells, float depth)
+	{
+		const uint numColumns = numCells + 1;
+		// border counter-clockwise, corners once
+		std::vector<uint> border;
+		border.reserve(numCells * 4);
+		for (uint x = 0; x < numCells; ++x) {
+			border.push_back(x);
+		}
+		for (uint z = 0; z < numCells; ++z) {
+			border.push_back(z * numColumns + numCells);
+		}
+		for (uint x = numCells; x > 0; --x) {
+			border.push_back(numCells * numColumns + x);
+		}
+		for (uint z = numCells; z > 0; --z) {
+			border.push_back(z * numColumns);
+		}
+		const uint first = mesh.GetNumVertices();
+		const uint numBorder = static_cast<uint>(border.size());
+		mesh.vertices.resize(static_cast<size_t>(first + numBorder) * mesh.stride);
+		Vertex* vertices = reinterpret_cast<Vertex *>(mesh.vertices.data());
+		for (uint i = 0; i < numBorder; ++i) {
+			Vertex& v = vertices[first + i];
+			v = vertices[border[i]];
+			v.position.y -= depth;
+		}
+		// both sides, the skirt is seen from inside and outside the tile
+		for (uint i = 0; i < numBorder; ++i) {
+			const uint next = (i + 1) % numBorder;
+			const uint a = border[i];
+			const uint b = border[next];
+			const uint c = first + i;
+			const uint d = first + next;
+			const uint quad[12] = {a, b, c, c, b, d, a, c, b, c, d, b};
+			mesh.indices.insert(mesh.indices.end(), quad, quad + 12);
+		}
+	}
+
+}
+
+Terrain::Terrain(const Settings& terrainSettings, const VertexFormat& vertexFormat) : settings(terrainSettings), format(vertexFormat)
+{
+	assert(settings.tileSize > 0.0f && "Invalid Value");
+	assert(settings.numLods && settings.numLods <= MaxLods && "Out Of Range");
+	assert(settings.numCells >> (settings.numLods - 1) && !(settings.numCells & (settings.numCells - 1)) && "Invalid Value");
+	assert(settings.maxPendingTiles && "Invalid Value");
+	assert(format.GetSourceFormat().GetStride() == sizeof(Vertex) && "Invalid Value");
+}
+
+Terrain::~Terrain()
+{
+	Wait();
+}
+
+void Terrain::Update(const Vector3D& position, std::vector<TileMesh>& loadedTiles, std::vector<TileKey>& evictedTiles)
+{
+	const float loadDistance = settings.loadRadius * settings.tileSize;
+	const float evictDistance = loadDistance + settings.tileSize;
+	// generated tiles, the ones out of range by now are dropped
+	for (std::list<PendingTile>::iterator it = pendingTiles.begin(); it != pendingTiles.end(); ) {
+		if (it->task.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			++it;
+			continue;
+		}
+		it->task.get();
+		if (GetTileDistance(it->key, position) <= evictDistance) {
+			Tile& tile = tiles[it->key];
+			tile.key = it->key;
+			tile.bounds = it->mesh.bounds;
+			std::copy(it->mesh.lods, it->mesh.lods + MaxLods, tile.lods);
+			tile.lod = settings.numLods - 1;
+			loadedTiles.push_back(std::move(it->mesh));
+		}
+		it = pendingTiles.erase(it);
+	}
+	for (Tiles::iterator it = tiles.begin(); it != tiles.end(); ) {
+		if (GetTileDistance(it->first, position) > evictDistance) {
+			evictedTiles.push_back(it->first);
+			it = tiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+	// missing tiles in range, nearest first
+	if (pendingTiles.size() < settings.maxPendingTiles) {
+		const TileKey center = GetTileKey(position);
+		const int radius = static_cast<int>(settings.loadRadius) + 1;
+		std::vector<std::pair<float, TileKey> > missingTiles;
+		for (int z = center.z - radius; z <= center.z + radius; ++z) {
+			for (int x = center.x - radius; x <= center.x + radius; ++x) {
+				const TileKey key = {x, z};
+				const float distance = GetTileDistance(key, position);
+				if (distance > loadDistance || tiles.count(key)) {
+					continue;
+				}
+				bool isPending = false;
+				for (const PendingTile& pendingTile : pendingTiles) {
+					isPending = isPending || pendingTile.key == key;
+				}
+				if (!isPending) {
+					missingTiles.push_back(std::make_pair(distance, key));
+				}
+			}
+		}
+		std::sort(missingTiles.begin(), missingTiles.end(), [](const std::pair<float, TileKey>& a, const std::pair<float, TileKey>& b)
+		{
+			return a.first < b.first || (a.first == b.first && a.second < b.second);
+		});
+		for (size_t i = 0; i < missingTiles.size() && pendingTiles.size() < settings.maxPendingTiles; ++i) {
+			pendingTiles.push_back(PendingTile());
+			PendingTile& pendingTile = pendingTiles.back();
+			pendingTile.key = missingTiles[i].second;
+			TileMesh* mesh = &pendingTile.mesh;
+			const TileKey key = pendingTile.key;
+			pendingTile.task = std::async(std::launch::async, [this, key, mesh]()
+			{
+				CreateTileMesh(key, *mesh);
+			});
+		}
+	}
+	for (Tiles::value_type& tile : tiles) {
+		tile.second.lod = SelectLod(GetDistance(tile.second.bounds, position), tile.second.lod);
+	}
+}
+
+void Terrain::Wait()
+{
+	for (PendingTile& pendingTile : pendingTiles) {
+		pendingTile.task.wait();
+	}
+}
+
+Terrain::TileKey Terrain::GetTileKey(const Vector3D& position) const
+{
+	const TileKey key = {static_cast<int>(floorf(position.x / settings.tileSize)), static_cast<int>(floorf(position.z / settings.tileSize))};
+	return key;
+}
+
+float Terrain::GetTileDistance(const TileKey& key, const Vector3D& position) const
+{
+	const float minX = key.x * settings.tileSize;
+	const float minZ = key.z * settings.tileSize;
+	const float dx = std::max(std::max(minX - position.x, position.x - minX - settings.tileSize), 0.0f);
+	const float dz = std::max(std::max(minZ - position.z, position.z - minZ - settings.tileSize), 0.0f);
+	return sqrtf(dx * dx + dz * dz);
+}
+
+uint Terrain::SelectLod(float distance, uint currentLod) const
+{
+	const uint lod = GetLod(settings, distance);
+	if (lod > currentLod) {
+		return std::max(currentLod, GetLod(settings, distance * (1.0f - settings.lodHysteresis)));
+	}
+	if (lod < currentLod) {
+		return std::min(currentLod, GetLod(settings, distance * (1.0f + settings.lodHysteresis)));
+	}
+	return lod;
+}
+
+float Terrain::GetHeight(float x, float z) const
+{
+	// weights add up to 1
+	const float height = 0.5f * sinf(x * 0.011f) * cosf(z * 0.013f) + 0.3f * sinf((x + z) * 0.023f) + 0.2f * cosf(x * 0.047f - z * 0.041f);
+	return settings.heightScale * height;
+}
+
+void Terrain::CreateTileMesh(const TileKey& key, TileMesh& mesh) const
+{
+	const uint stride = format.GetStride();
+	mesh.key = key;
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	std::fill(mesh.lods, mesh.lods + MaxLods, Lod());
+	Vector3D minimum(FLT_MAX, FLT_MAX, FLT_MAX);
+	Vector3D maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	std::vector<float> heights;
+	for (uint lod = 0; lod < settings.numLods; ++lod) {
+		GridGenerator::Desc desc;
+		desc.numCellsX = settings.numCells >> lod;
+		desc.numCellsZ = desc.numCellsX;
+		const float cellSize = settings.tileSize / desc.numCellsX;
+		desc.cellSize = Vector2D(cellSize, cellSize);
+		desc.origin = Vector3D(key.x * settings.tileSize, 0.0f, key.z * settings.tileSize);
+		// heights with a border of one cell, the normals on the tile border match the neighbour tiles
+		const uint numColumns = desc.numCellsX + 3;
+		heights.resize(static_cast<size_t>(numColumns) * (desc.numCellsZ + 3));
+		for (uint z = 0; z < desc.numCellsZ + 3; ++z) {
+			for (uint x = 0; x < numColumns; ++x) {
+				heights[z * numColumns + x] = GetHeight(desc.origin.x + (static_cast<int>(x) - 1) * cellSize, desc.origin.z + (static_cast<int>(z) - 1) * cellSize);
+			}
+		}
+		desc.heights = heights.data();
+		desc.hasHeightBorder = true;
+		Mesh grid;
+		// tiles are generated on tasks already
+		GridGenerator::Create(grid, desc, 1);
+		if (!lod) {
+			GridGenerator::GetBounds(desc, minimum, maximum);
+			minimum.y -= settings.skirtDepth;
+		}
+		AddSkirt(grid, desc.numCellsX, settings.skirtDepth);
+		const uint numVertices = grid.GetNumVertices();
+		assert(numVertices <= 0x10000 && "Out Of Range");
+		Lod& tileLod = mesh.lods[lod];
+		tileLod.baseVertex = static_cast<uint>(mesh.vertices.size() / stride);
+		tileLod.startIndex = static_cast<uint>(mesh.indices.size());
+		tileLod.indexCount = static_cast<uint>(grid.indices.size());
+		mesh.vertices.resize(mesh.vertices.size() + static_cast<size_t>(numVertices) * stride);
+		format.Encode(grid.vertices.data(), numVertices, &mesh.vertices[static_cast<size_t>(tileLod.baseVertex) * stride]);
+		mesh.indices.insert(mesh.indices.end(), grid.indices.begin(), grid.indices.end());
+	}
+	// every LOD samples heights of LOD 0
+	mesh.bounds = BoundingBox(minimum, maximum);
+}
+
+VertexFormat Terrain::CreateVertexFormat(VertexFormat::Quantization quantization)
+{
+	assert(quantization < VertexFormat::NumQuantizations && "Out Of Range");
+	const VertexFormat preset = VertexFormat::Create(VertexFormat::TexCoord, quantization);
+	VertexFormat format;
+	format.Add(VertexFormat::Position, VertexFormat::Float3);
+	for (uint i = 1; i < preset.GetNumElements(); ++i) {
+		format.Add(preset.GetElement(i).attribute, preset.GetElement(i).format);
+	}
+	return format;
+}
+
+float Terrain::GetDistance(const BoundingBox& box, const Vector3D& position)
+{
+	const Vector3D& minimum = box.GetMinPoint();
+	const Vector3D& maximum = box.GetMaxPoint();
+	const float dx = std::max(std::max(minimum.x - position.x, position.x - maximum.x), 0.0f);
+	const float dy = std::max(std::max(minimum.y - position.y, position.y - maximum.y), 0.0f);
+	const float dz = std::max(std::max(minimum.z - position.z, position.z - maximum.z), 0.0f);
+	return sqrtf(dx * dx + dy * dy + dz * dz);
+}
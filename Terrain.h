@@ -0,0 +1,146 @@
+// Terrain.h: interface for the Terrain class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __TERRAIN_H__
+#define __TERRAIN_H__
+
+#include "VertexFormat.h"
+#include "BoundingBox.h"
+#include <future>
+#include <list>
+#include <map>
+
+// Streaming terrain of square tiles around the viewer. Every tile has all its LODs in
+// one vertex and index buffer, the border of every LOD has a skirt hiding the cracks
+// between neighbour LODs. Tiles are generated on tasks; Update doesn't wait for them,
+// it hands over the generated tiles and the evicted ones to the renderer.
+// Nothing here depends on Direct3D, residency and LOD selection run headless.
+class Terrain  {
+public:
+	static const uint MaxLods = 8;
+	struct Settings {
+		// size of a tile along X and Z
+		float tileSize;
+		// cells of LOD 0 along a side of a tile, every next LOD has half of them
+		uint numCells;
+		uint numLods;
+		// tiles closer than loadRadius tiles are loaded, tiles farther than
+		// loadRadius + 1 tiles are evicted
+		uint loadRadius;
+		// LOD 0 is used closer than lodDistance, every next LOD up to twice the distance
+		float lodDistance;
+		// fraction of the LOD distance to cross before the LOD changes back
+		float lodHysteresis;
+		// skirts go down by this
+		float skirtDepth;
+		// heights are in [-heightScale, heightScale]
+		float heightScale;
+		// tiles generated at once
+		uint maxPendingTiles;
+
+		Settings() : tileSize(256.0f), numCells(64), numLods(4), loadRadius(4), lodDistance(192.0f), lodHysteresis(0.1f), skirtDepth(4.0f), heightScale(8.0f), maxPendingTiles(4)
+		{
+		}
+	};
+	struct TileKey {
+		int x;
+		int z;
+
+		INLINE bool operator < (const TileKey& key) const
+		{
+			return x < key.x || (x == key.x && z < key.z);
+		}
+		INLINE bool operator == (const TileKey& key) const
+		{
+			return x == key.x && z == key.z;
+		}
+	};
+	// draw of a LOD, indices are relative to baseVertex
+	struct Lod {
+		uint baseVertex;
+		uint startIndex;
+		uint indexCount;
+	};
+	// generated tile in the vertex format
+	struct TileMesh {
+		TileKey key;
+		std::vector<ubyte> vertices;
+		std::vector<ushort> indices;
+		Lod lods[MaxLods];
+		BoundingBox bounds;
+	};
+	// resident tile
+	struct Tile {
+		TileKey key;
+		BoundingBox bounds;
+		Lod lods[MaxLods];
+		// LOD of this frame
+		uint lod;
+	};
+	typedef std::map<TileKey, Tile> Tiles;
+private:
+	struct PendingTile {
+		TileKey key;
+		std::future<void> task;
+		TileMesh mesh;
+	};
+	Settings settings;
+	VertexFormat format;
+	Tiles tiles;
+	// generated tiles in flight, list keeps the meshes in place for the tasks
+	std::list<PendingTile> pendingTiles;
+
+	// tasks refer to the terrain
+	Terrain(const Terrain&);
+	Terrain& operator = (const Terrain&);
+public:
+	Terrain(const Settings& terrainSettings, const VertexFormat& vertexFormat);
+	// Waits for the tiles in flight
+	~Terrain();
+	// Loads tiles around the position, evicts far tiles and selects the LOD of every tile.
+	// Tiles generated since the last update are moved to loadedTiles, keys of the
+	// evicted tiles are added to evictedTiles
+	void Update(const Vector3D& position, std::vector<TileMesh>& loadedTiles, std::vector<TileKey>& evictedTiles);
+	// Waits until the tiles in flight are generated, the next Update hands them over
+	void Wait();
+	//
+	INLINE const Tiles& GetTiles() const
+	{
+		return tiles;
+	}
+	//
+	INLINE uint GetNumPendingTiles() const
+	{
+		return static_cast<uint>(pendingTiles.size());
+	}
+	//
+	INLINE const Settings& GetSettings() const
+	{
+		return settings;
+	}
+	//
+	INLINE const VertexFormat& GetVertexFormat() const
+	{
+		return format;
+	}
+
+	// Tile of a position in XZ
+	TileKey GetTileKey(const Vector3D& position) const;
+	// Distance from the position to the tile in XZ, 0 inside
+	float GetTileDistance(const TileKey& key, const Vector3D& position) const;
+	// LOD of a tile at distance, it changes from currentLod only past the hysteresis
+	uint SelectLod(float distance, uint currentLod) const;
+	// Procedural heightfield
+	float GetHeight(float x, float z) const;
+	// Generates all LODs of a tile, thread safe
+	void CreateTileMesh(const TileKey& key, TileMesh& mesh) const;
+
+	// Float positions as tiles are anywhere in the world, normals and texture
+	// coordinates in the formats of the preset
+	static VertexFormat CreateVertexFormat(VertexFormat::Quantization quantization);
+	// Distance from the position to the box, 0 inside
+	static float GetDistance(const BoundingBox& box, const Vector3D& position);
+};
+
+#endif // __TERRAIN_H__
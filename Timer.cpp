@@ -1,57 +1,52 @@
 // Timer.cpp: implementation of the Timer class.
 //
 //////////////////////////////////////////////////////////////////////
-#include "PrecompileHeaders.h"
+#include "precompileheaders.h"
 #include "Timer.h"
 
-#ifdef _WIN32
-float Timer::rfreq = 1.0f;
-#endif
-
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
 
-Timer::Timer()
-#ifdef _WIN32
-: startTime(0)
-#endif
+Timer::Timer() : startTime(GetTicks()), absoluteStartTime(startTime)
 {
 }
 
 //
-void Timer::Init()
+uint64 Timer::QueryFrequency()
 {
 #ifdef _WIN32
-	if (rfreq < 1.0f) {
-		return;	
-	}
-	LogMsg("Timer init...\n");
-	//
-	SetLastError(0);
-	//
 	LARGE_INTEGER Frequency;
-	//
-	if (!QueryPerformanceFrequency(&Frequency)) {
+	// can't fail since Windows XP
+	if (!QueryPerformanceFrequency(&Frequency) || Frequency.QuadPart <= 0) {
 		//
 		SetLastError(0);
+		return 1;
 	}
-	//
-	rfreq = 1.0f / Frequency.QuadPart;
-	LogMsg(" Timer init completed.\n");
+	return static_cast<uint64>(Frequency.QuadPart);
+#elif defined(USE_CLOCK_GETTIME)
+	return NanosecondsPerSecond;
+#else
+	return 1000000;
 #endif
 }
 
 //
-float Timer::AbsoluteDiffTime()
+void Timer::Init()
 {
-#ifdef _WIN32
-	LARGE_INTEGER temp;
-	// Get counter
-	QueryPerformanceCounter(&temp);
-	float dt = (temp.QuadPart - absoluteStartTime) * rfreq;
-	return dt;
-#else
-	return 0;
-#endif
+	LogMsg("Timer init...\n");
+	LogMsg(" Timer frequency %llu Hz\n", static_cast<unsigned long long>(GetFrequency()));
+	LogMsg(" Timer init completed.\n");
+}
+
+//
+double Timer::AbsoluteDiffTime() const
+{
+	return TicksToSeconds(GetTicks() - absoluteStartTime);
+}
+
+//
+uint64 Timer::AbsoluteDiffTimeInt() const
+{
+	return TicksToNanoseconds(GetTicks() - absoluteStartTime);
 }
@@ -8,118 +8,105 @@
 #include "Platform.h"
 
 #ifndef _WIN32
+#include <time.h>
 #include <sys/time.h>
-#elif defined(__ANDROID__) || defined(__linux__) || defined(BSD)
-#define USE_CLOCK_GETTIME
 #endif
 
 // Timer implememtation
+// Ticks are 64 bit and monotonic: QueryPerformanceCounter on Windows, CLOCK_MONOTONIC_RAW
+// (nanoseconds, not slewed by NTP) elsewhere. Conversions are exact in integers or done
+// in double, so intervals keep their precision for any uptime
 class Timer  {
 private:
-#ifdef _WIN32
-	// 
-	static float rfreq;
-	// current time
+	// ticks of the start
 	uint64 startTime;
-#else
-#ifdef USE_CLOCK_GETTIME
-	typedef timespec timeType_t;
-#else
-	typedef timeval timeType_t;
-#endif
-	timeType_t startTime;
-#endif
-	// absolute start Time
+	// ticks of the absolute start
 	uint64 absoluteStartTime;
-#ifdef _WIN32
-	// calculate delta time
-	INLINE float CalcDeltaTime(uint64& start)
+	//
+	static uint64 QueryFrequency();
+public:
+	static const uint64 NanosecondsPerSecond = 1000000000;
+	// ticks per second
+	static INLINE uint64 GetFrequency()
 	{
+		// queried once, thread safe
+		static const uint64 frequency = QueryFrequency();
+		return frequency;
+	}
+	// ticks from an unspecified point
+	static INLINE uint64 GetTicks()
+	{
+#ifdef _WIN32
 		LARGE_INTEGER temp;
 		// Get counter
 		QueryPerformanceCounter(&temp);
-		float dt = (temp.QuadPart - start) * rfreq;
-		start = temp.QuadPart;
+		return static_cast<uint64>(temp.QuadPart);
+#elif defined(USE_CLOCK_GETTIME)
+		timespec tm;
+#ifdef CLOCK_MONOTONIC_RAW
+		clock_gettime(CLOCK_MONOTONIC_RAW, &tm);
 #else
-		// calculate delta time
-		INLINE float CalcDeltaTime(timeType_t& start)
-		{
-			timeType_t tm;
-#ifdef USE_CLOCK_GETTIME
-			clock_gettime(CLOCK_REALTIME, &tm);
-			float dt = tm.tv_sec - start.tv_sec  + (tm.tv_nsec - start.tv_nsec) * 0.000000001f;
-#else
-			gettimeofday(&tm, NULL);
-			float dt = tm.tv_sec - start.tv_sec  + (tm.tv_usec - start.tv_usec) * 0.000001f;
-#endif
-			start = tm;
+		clock_gettime(CLOCK_MONOTONIC, &tm);
 #endif
-			return dt;
-		}
-		uint64 CalcDeltaTimeInt(uint64& start)
-		{
-			UNUSED(start);
-#ifdef _WIN32
-			LARGE_INTEGER temp;
-			// Get counter
-			QueryPerformanceCounter(&temp);
-			uint64 dt = (temp.QuadPart - start);
-			start = temp.QuadPart;
-			return dt;
-#else
-			return 0;
-#endif
-		}
-#ifdef _WIN32
-		INLINE void RestartTime(uint64& start)
-		{
-			LARGE_INTEGER temp;
-			// 
-			QueryPerformanceCounter(&temp);
-			// 
-			start = temp.QuadPart;
-#else
-		INLINE void RestartTime(timeType_t& start)
-		{
-#ifdef USE_CLOCK_GETTIME
-			clock_gettime(CLOCK_REALTIME, &start);
+		return static_cast<uint64>(tm.tv_sec) * NanosecondsPerSecond + static_cast<uint64>(tm.tv_nsec);
 #else
-			gettimeofday(&start, NULL);
+		// microseconds of the wall clock, the only timer of old systems
+		timeval tm;
+		gettimeofday(&tm, NULL);
+		return static_cast<uint64>(tm.tv_sec) * 1000000 + static_cast<uint64>(tm.tv_usec);
 #endif
-#endif
-		}
-		public:
-			// timer init
-			static void Init();
-			//
-			void RestartTimer()
-			{
-				RestartTime(startTime);
-			}
-			// Restart timer for absolute time
-			void RestartAbsoluteTimer()
-			{
-#ifdef _WIN32
-				RestartTime(absoluteStartTime);
-#endif
-			}
-			// Get delta time
-			float DiffTime()
-			{
-				return CalcDeltaTime(startTime);
-			}
-			//
-			uint64 DiffTimeInt()
-			{
-#ifdef _WIN32
-				return CalcDeltaTimeInt(startTime);
-#else
-				return 0;
-#endif
-			}
-			// Get Absolute Start Time
-			float AbsoluteDiffTime();
-			Timer();
-		};
-		
+	}
+	// the product doesn't overflow for any uptime
+	static INLINE uint64 TicksToNanoseconds(uint64 ticks)
+	{
+		const uint64 frequency = GetFrequency();
+		return ticks / frequency * NanosecondsPerSecond + ticks % frequency * NanosecondsPerSecond / frequency;
+	}
+	//
+	static INLINE double TicksToSeconds(uint64 ticks)
+	{
+		const uint64 frequency = GetFrequency();
+		return static_cast<double>(ticks / frequency) + static_cast<double>(ticks % frequency) / static_cast<double>(frequency);
+	}
+	// nanoseconds from an unspecified point
+	static INLINE uint64 GetNanoseconds()
+	{
+		return TicksToNanoseconds(GetTicks());
+	}
+	// timer init, logs the tick source
+	static void Init();
+	//
+	void RestartTimer()
+	{
+		startTime = GetTicks();
+	}
+	// Restart timer for absolute time
+	void RestartAbsoluteTimer()
+	{
+		absoluteStartTime = GetTicks();
+	}
+	// Get delta time in seconds and restart
+	double DiffTime()
+	{
+		const uint64 time = GetTicks();
+		const uint64 dt = time - startTime;
+		startTime = time;
+		return TicksToSeconds(dt);
+	}
+	// Get delta time in nanoseconds and restart
+	uint64 DiffTimeInt()
+	{
+		const uint64 time = GetTicks();
+		const uint64 dt = time - startTime;
+		startTime = time;
+		return TicksToNanoseconds(dt);
+	}
+	// Get Absolute Start Time in seconds
+	double AbsoluteDiffTime() const;
+	// Get Absolute Start Time in nanoseconds
+	uint64 AbsoluteDiffTimeInt() const;
+	// both timers start now
+	Timer();
+};
+
 #endif // __TIMER_H__
@@ -0,0 +1,164 @@
+// UploadRing.h: interface for the UploadRing class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __UPLOADRING_H__
+#define __UPLOADRING_H__
+
+#include <cassert>
+#include <deque>
+#include "types.h"
+
+#ifndef INLINE
+#ifdef _MSC_VER
+#define INLINE __forceinline
+#else
+#define INLINE inline
+#endif
+#endif
+
+// Ring allocator for staging memory. Allocations are grouped into batches,
+// every batch is tagged with the fence value of the submission which reads it
+// and the memory is given back once that fence value has been reached.
+// Doesn't know anything about the GPU, so it can be driven by any fence source.
+class UploadRing  {
+public:
+	static const uint64 InvalidOffset = ~0ull;
+private:
+	struct Batch {
+		// fence value which retires the batch
+		uint64 fenceValue;
+		// head of the ring at the end of the batch
+		uint64 end;
+		// bytes (including wrap padding) used by the batch
+		uint64 size;
+	};
+	// submitted batches, oldest first
+	std::deque<Batch> batches;
+	// total size of the ring
+	uint64 ringSize;
+	// next allocation offset
+	uint64 head;
+	// start of the oldest allocation still in use
+	uint64 tail;
+	// bytes in use (submitted and pending)
+	uint64 usedSize;
+	// bytes allocated since last Submit
+	uint64 pendingSize;
+	//
+	INLINE static uint64 AlignUp(uint64 value, uint64 alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+public:
+	UploadRing(uint64 size = 0)
+	{
+		Reset(size);
+	}
+	// Drop all allocations and resize the ring
+	void Reset(uint64 size)
+	{
+		batches.clear();
+		ringSize = size;
+		head = 0;
+		tail = 0;
+		usedSize = 0;
+		pendingSize = 0;
+	}
+	// Returns offset in the ring or InvalidOffset if there is no room left
+	uint64 Allocate(uint64 size, uint64 alignment = 1)
+	{
+		assert(size && "Invalid Value");
+		assert(alignment && !(alignment & (alignment - 1)) && "Invalid Value");
+		if (size > ringSize || usedSize == ringSize) {
+			return InvalidOffset;
+		}
+		if (!usedSize) {
+			// ring is empty, start from the beginning to get the largest contiguous block
+			head = 0;
+			tail = 0;
+		}
+		uint64 offset = AlignUp(head, alignment);
+		uint64 padding = offset - head;
+		if (head >= tail) {
+			// free space is [head, ringSize) and [0, tail)
+			if (offset + size > ringSize) {
+				if (size > tail) {
+					return InvalidOffset;
+				}
+				// wrap around, the tail of the ring is wasted until this batch retires
+				padding = ringSize - head;
+				offset = 0;
+			}
+		}
+		else if (offset + size > tail) {
+			// free space is [head, tail)
+			return InvalidOffset;
+		}
+		head = offset + size;
+		usedSize += padding + size;
+		pendingSize += padding + size;
+		assert(usedSize <= ringSize && "Out Of Range");
+		return offset;
+	}
+	// Tag all allocations since the previous call with the fence value of the submission
+	void Submit(uint64 fenceValue)
+	{
+		if (!pendingSize) {
+			return;
+		}
+		assert((batches.empty() || batches.back().fenceValue <= fenceValue) && "Invalid Value");
+		const Batch batch = { fenceValue, head, pendingSize };
+		batches.push_back(batch);
+		pendingSize = 0;
+	}
+	// Release the batches whose fence value has been reached
+	void Retire(uint64 completedFenceValue)
+	{
+		while (!batches.empty() && batches.front().fenceValue <= completedFenceValue) {
+			const Batch& batch = batches.front();
+			assert(usedSize >= batch.size && "Out Of Range");
+			usedSize -= batch.size;
+			tail = batch.end;
+			batches.pop_front();
+		}
+		if (!usedSize) {
+			head = 0;
+			tail = 0;
+		}
+	}
+	// Fence value the caller has to wait for to retire the oldest batch, 0 if nothing is in flight
+	uint64 GetOldestFenceValue() const
+	{
+		return batches.empty() ? 0 : batches.front().fenceValue;
+	}
+	//
+	INLINE uint64 GetSize() const
+	{
+		return ringSize;
+	}
+	// Largest piece of an upload which is split to fit the ring: a quarter of it,
+	// so the copies of the previous pieces can run while the next one is written
+	INLINE uint64 GetChunkSize() const
+	{
+		const uint64 chunkSize = (ringSize / 4) & ~15ull;
+		return chunkSize ? chunkSize : ringSize;
+	}
+	//
+	INLINE uint64 GetUsedSize() const
+	{
+		return usedSize;
+	}
+	//
+	INLINE uint64 GetPendingSize() const
+	{
+		return pendingSize;
+	}
+	//
+	INLINE bool IsEmpty() const
+	{
+		return !usedSize;
+	}
+};
+
+#endif // __UPLOADRING_H__
@@ -31,15 +31,15 @@ class Vector2D  { //
 public:
 	float x;
 	float y;
-	INLINE static const Vector2D Zero()
+	INLINE static constexpr const Vector2D Zero()
 	{
 		return Vector2D(0.0f, 0.0f);
 	}
-	INLINE static const Vector2D X()
+	INLINE static constexpr const Vector2D X()
 	{
 		return Vector2D(1.0f, 0.0f);
 	}
-	INLINE static const Vector2D Y()
+	INLINE static constexpr const Vector2D Y()
 	{
 		return Vector2D(0.0f, 1.0f);
 	}
@@ -71,63 +71,63 @@ public:
 	{
 	return &x;
 	}
-	INLINE Vector2D operator - () const
+	INLINE constexpr Vector2D operator - () const
 	{
 		return Vector2D(- x, - y);
 	}
-	INLINE Vector2D& operator += (const Vector2D& Vector)
+	INLINE constexpr Vector2D& operator += (const Vector2D& Vector)
 	{
 		x += Vector.x;
 		y += Vector.y;
 		return *this;
 	}
-	INLINE Vector2D& operator -= (const Vector2D& Vector)
+	INLINE constexpr Vector2D& operator -= (const Vector2D& Vector)
 	{
 		x -= Vector.x;
 		y -= Vector.y;
 		return *this;
 	}
-	INLINE Vector2D& operator *= (float Value)
+	INLINE constexpr Vector2D& operator *= (float Value)
 	{
 		x *= Value;
 		y *= Value;
 		return *this;
 	}
-	INLINE Vector2D& operator /= (float Value)
+	INLINE constexpr Vector2D& operator /= (float Value)
 	{
 		x /= Value;
 		y /= Value;
 		return *this;
 	}
-	INLINE Vector2D& operator -= (float Value)
+	INLINE constexpr Vector2D& operator -= (float Value)
 	{
 		x -= Value;
 		y -= Value;
 		return *this;
 	}
-	INLINE Vector2D& operator += (float Value)
+	INLINE constexpr Vector2D& operator += (float Value)
 	{
 		x += Value;
 		y += Value;
 	return *this;
 	}
-	INLINE Vector2D& operator /= (const Vector2D& vector)
+	INLINE constexpr Vector2D& operator /= (const Vector2D& vector)
 	{
 		x /= vector.x;
 		y /= vector.y;
 		return *this;
 	}
-	INLINE Vector2D& operator *= (const Vector2D& vector)
+	INLINE constexpr Vector2D& operator *= (const Vector2D& vector)
 	{
 		x *= vector.x;
 		y *= vector.y;
 		return *this;
 	}
-	INLINE bool operator == (const Vector2D& vector) const
+	INLINE constexpr bool operator == (const Vector2D& vector) const
 	{
 		return (x == vector.x && y == vector.y);
 	}
-	INLINE bool operator != (const Vector2D& vector) const
+	INLINE constexpr bool operator != (const Vector2D& vector) const
 	{
 		return (x != vector.x || y != vector.y);
 	}
@@ -140,47 +140,47 @@ public:
 	{
 		return *(index + &x);
 	}
-	INLINE bool operator > (const Vector2D& v) const
+	INLINE constexpr bool operator > (const Vector2D& v) const
 	{
 		return x > v.x && y > v.y;
 	}
-	INLINE bool operator < (const Vector2D& v) const
+	INLINE constexpr bool operator < (const Vector2D& v) const
 	{
 		return x < v.x && y < v.y;
 	}
-	INLINE friend Vector2D operator + (const Vector2D& vector1, const Vector2D& vector2)
+	INLINE constexpr friend Vector2D operator + (const Vector2D& vector1, const Vector2D& vector2)
 	{
 		return Vector2D(vector1.x + vector2.x, vector1.y + vector2.y);
 	}
-	INLINE friend Vector2D operator + (const Vector2D& vector, float value)
+	INLINE constexpr friend Vector2D operator + (const Vector2D& vector, float value)
 	{
 		return Vector2D(vector.x + value, vector.y + value);
 	}
-	INLINE friend Vector2D operator - (const Vector2D& vector1, const Vector2D& vector2)
+	INLINE constexpr friend Vector2D operator - (const Vector2D& vector1, const Vector2D& vector2)
 	{
 		return Vector2D(vector1.x - vector2.x, vector1.y - vector2.y);
 	}
-	INLINE friend Vector2D operator - (const Vector2D& vector, float value)
+	INLINE constexpr friend Vector2D operator - (const Vector2D& vector, float value)
 	{
 		return Vector2D(vector.x - value, vector.y - value);
 	}
-	INLINE friend Vector2D operator * (const Vector2D& vector, float Value)
+	INLINE constexpr friend Vector2D operator * (const Vector2D& vector, float Value)
 	{
 		return Vector2D(vector.x * Value, vector.y * Value);
 	}
-	INLINE friend Vector2D operator * (float Value, const Vector2D& vector)
+	INLINE constexpr friend Vector2D operator * (float Value, const Vector2D& vector)
 	{
 		return Vector2D(vector.x * Value, vector.y * Value);
 	}
-	INLINE friend Vector2D operator * (const Vector2D& vector1, const Vector2D& vector2)
+	INLINE constexpr friend Vector2D operator * (const Vector2D& vector1, const Vector2D& vector2)
 	{
 		return Vector2D(vector1.x * vector2.x, vector1.y * vector2.y);
 	}
-	INLINE friend Vector2D operator / (const Vector2D& vector, float Value)
+	INLINE constexpr friend Vector2D operator / (const Vector2D& vector, float Value)
 	{
 		return Vector2D(vector.x / Value, vector.y / Value);
 	}
-	INLINE friend Vector2D operator / (float Value, const Vector2D& vector)
+	INLINE constexpr friend Vector2D operator / (float Value, const Vector2D& vector)
 	{
 		return Vector2D(Value / vector.x, Value / vector.y);
 	}
@@ -190,7 +190,7 @@ public:
 		return static_cast<float>(LengthSq());
 	}
 	// 
-	INLINE float LengthSq() const
+	INLINE constexpr float LengthSq() const
 	{
 		return x * x + y * y;
 	}
@@ -237,14 +237,14 @@ public:
 	INLINE Vector2D()// : x(0), y(0)
 	{
 	}
-	INLINE Vector2D(const Vector2D &vector) : x(vector.x), y(vector.y)
+	INLINE constexpr Vector2D(const Vector2D &vector) : x(vector.x), y(vector.y)
 	{
 	}
-	INLINE Vector2D(float X, float Y) : x(X), y(Y)
+	INLINE constexpr Vector2D(float X, float Y) : x(X), y(Y)
 	{
 	}
 	template<typename T>
-	INLINE Vector2D(T X, T Y) : x(static_cast<float>(X)), y(static_cast<float>(Y))
+	INLINE constexpr Vector2D(T X, T Y) : x(static_cast<float>(X)), y(static_cast<float>(Y))
 	{
 	}
 	template<typename T>
@@ -259,13 +259,21 @@ public:
 		assert(sizeof(*data) >= sizeof(Vector2D) && "Invalid Data");
 		*this = reinterpret_cast<const Vector2D &>(*data);
 	}
-	INLINE ~Vector2D() {}
 };
 
 // 
-INLINE float dotProduct(const Vector2D& vector1, const Vector2D& vector2)
+INLINE constexpr float dotProduct(const Vector2D& vector1, const Vector2D& vector2)
 {
 	return vector1.x * vector2.x + vector1.y * vector2.y;
 }
 
+// constexpr members have to stay constant expressions
+static_assert(Vector2D(Vector2D(1.0f, 2.0f)) == Vector2D(1.0f, 2.0f) && Vector2D(1, 2) == Vector2D(1.0f, 2.0f), "Vector2D constructors must be constexpr");
+static_assert(Vector2D::Zero() + Vector2D::X() - Vector2D::Y() == Vector2D(1.0f, -1.0f) && -Vector2D::X() != Vector2D::X(), "Vector2D operators must be constexpr");
+static_assert(Vector2D(1.0f, 2.0f) * 2.0f == 2.0f * Vector2D(1.0f, 2.0f) && Vector2D(2.0f, 4.0f) / 2.0f == Vector2D(1.0f, 2.0f) &&
+	4.0f / Vector2D(1.0f, 2.0f) == Vector2D(4.0f, 2.0f) * Vector2D(1.0f, 1.0f) && Vector2D(1.0f, 2.0f) + 1.0f - 2.0f == Vector2D(0.0f, 1.0f), "Vector2D operators must be constexpr");
+static_assert((Vector2D(1.0f, 2.0f) += Vector2D(1.0f, 1.0f)) == Vector2D(2.0f, 3.0f) && (Vector2D(1.0f, 2.0f) *= 2.0f) == Vector2D(2.0f, 4.0f) &&
+	(Vector2D(2.0f, 4.0f) /= Vector2D(2.0f, 2.0f)) == Vector2D(1.0f, 2.0f) && Vector2D(1.0f, 2.0f) < Vector2D(2.0f, 3.0f), "Vector2D operators must be constexpr");
+static_assert(dotProduct(Vector2D(1.0f, 2.0f), Vector2D(3.0f, 4.0f)) == 11.0f && Vector2D(3.0f, 4.0f).LengthSq() == 25.0f, "dotProduct and LengthSq must be constexpr");
+
 #endif
@@ -0,0 +1,148 @@
+// Vector3D.cpp: implementation of the Vector3D class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Vector3D.h"
+#include "SIMD.h"
+#include "CPUFeatures.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Kernels of the batch normalization. The squared length is ((x * x + y * y) + z * z)
+// on every level. The reciprocal square root estimate is the same on every level
+// of a CPU (rsqrtps), but may differ between CPU vendors. The SIMD.h kernels handle
+// blocks of 4, the AVX2 ones blocks of 8, tails are padded to a block of 4.
+
+namespace {
+
+	using namespace SIMD;
+
+	// vectors of the strided version gathered per block
+	const size_t BlockSize = 64;
+
+	template <bool Fast>
+	INLINE Float4 InvLength(Float4 lengthSq)
+	{
+		const Float4 inv = Fast ? RSqrt(lengthSq) : Div(Splat(1.0f), Sqrt(lengthSq));
+		// zero vectors stay zero instead of NaN
+		return And(inv, CmpGT(lengthSq, Splat(0.0f)));
+	}
+
+	template <bool Fast>
+	INLINE void NormalizeBlock(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ)
+	{
+		const Float4 x = Load(xs);
+		const Float4 y = Load(ys);
+		const Float4 z = Load(zs);
+		const Float4 inv = InvLength<Fast>(Add(Add(Mul(x, x), Mul(y, y)), Mul(z, z)));
+		Store(outX, Mul(x, inv));
+		Store(outY, Mul(y, inv));
+		Store(outZ, Mul(z, inv));
+	}
+
+	template <bool Fast>
+	void NormalizeSIMD(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t first, size_t n)
+	{
+		size_t i = first;
+		for (; i + 4 <= n; i += 4) {
+			NormalizeBlock<Fast>(xs + i, ys + i, zs + i, outX + i, outY + i, outZ + i);
+		}
+		if (i == n) {
+			return;
+		}
+		float block[3][4] = {};
+		for (size_t j = i; j < n; ++j) {
+			block[0][j - i] = xs[j];
+			block[1][j - i] = ys[j];
+			block[2][j - i] = zs[j];
+		}
+		NormalizeBlock<Fast>(block[0], block[1], block[2], block[0], block[1], block[2]);
+		for (size_t j = i; j < n; ++j) {
+			outX[j] = block[0][j - i];
+			outY[j] = block[1][j - i];
+			outZ[j] = block[2][j - i];
+		}
+	}
+
+#ifdef CPU_X86
+	template <bool Fast>
+	TARGET_AVX2 size_t NormalizeAVX2(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 threeHalfs = _mm256_set1_ps(1.5f);
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m256 x = _mm256_loadu_ps(xs + i);
+			const __m256 y = _mm256_loadu_ps(ys + i);
+			const __m256 z = _mm256_loadu_ps(zs + i);
+			const __m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+			__m256 inv;
+			if (Fast) {
+				const __m256 e = _mm256_rsqrt_ps(lengthSq);
+				inv = _mm256_mul_ps(e, _mm256_sub_ps(threeHalfs, _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(half, lengthSq), e), e)));
+			} else {
+				inv = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+			}
+			inv = _mm256_and_ps(inv, _mm256_cmp_ps(lengthSq, zero, _CMP_GT_OQ));
+			_mm256_storeu_ps(outX + i, _mm256_mul_ps(x, inv));
+			_mm256_storeu_ps(outY + i, _mm256_mul_ps(y, inv));
+			_mm256_storeu_ps(outZ + i, _mm256_mul_ps(z, inv));
+		}
+		_mm256_zeroupper();
+		return i;
+	}
+#endif
+
+	template <bool Fast>
+	void NormalizeArrays(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n)
+	{
+		size_t i = 0;
+#ifdef CPU_X86
+		if (CPUFeatures::GetSIMDLevel() >= CPUFeatures::AVX2Level) {
+			i = NormalizeAVX2<Fast>(xs, ys, zs, outX, outY, outZ, n);
+		}
+#endif
+		NormalizeSIMD<Fast>(xs, ys, zs, outX, outY, outZ, i, n);
+	}
+
+}
+
+void Vector3D::NormalizeMany(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n, NormalizeMode mode)
+{
+	assert((!n || (xs && ys && zs && outX && outY && outZ)) && "NULL Pointer");
+	if (mode == NormalizeFast) {
+		NormalizeArrays<true>(xs, ys, zs, outX, outY, outZ, n);
+	} else {
+		NormalizeArrays<false>(xs, ys, zs, outX, outY, outZ, n);
+	}
+}
+
+void Vector3D::NormalizeMany(const Vector3D* vectors, size_t stride, Vector3D* out, size_t outStride, size_t n, NormalizeMode mode)
+{
+	assert((!n || (vectors && out)) && "NULL Pointer");
+	float x[BlockSize];
+	float y[BlockSize];
+	float z[BlockSize];
+	const char* src = reinterpret_cast<const char *>(vectors);
+	char* dst = reinterpret_cast<char *>(out);
+	for (size_t first = 0; first < n; first += BlockSize) {
+		const size_t count = n - first < BlockSize ? n - first : BlockSize;
+		for (size_t i = 0; i < count; ++i) {
+			const Vector3D& v = *reinterpret_cast<const Vector3D *>(src + (first + i) * stride);
+			x[i] = v.x;
+			y[i] = v.y;
+			z[i] = v.z;
+		}
+		NormalizeMany(x, y, z, x, y, z, count, mode);
+		for (size_t i = 0; i < count; ++i) {
+			Vector3D& v = *reinterpret_cast<Vector3D *>(dst + (first + i) * outStride);
+			v.x = x[i];
+			v.y = y[i];
+			v.z = z[i];
+		}
+	}
+}
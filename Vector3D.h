@@ -30,9 +30,10 @@ struct D3DXVECTOR3;
 INLINE float InvSqrt(float x)
 {
 	float xhalf = 0.5f * x;
-	int i = *reinterpret_cast<int *>(&x);
+	int i;
+	memcpy(&i, &x, sizeof(i));
 	i = 0x5f3759df - (i >> 1);
-	x = *reinterpret_cast<float *>(&i);
+	memcpy(&x, &i, sizeof(x));
 	x = x * (1.5f - xhalf * x * x);
 	return x;
 }
@@ -49,22 +50,32 @@ private:
 		val2 = Val2;
 	}
 public:
+	// Accuracy of NormalizeMany
+	enum NormalizeMode {
+		// 1 / sqrt of the squared length, components within 4 ulp
+		NormalizeAccurate,
+		// reciprocal square root estimate refined by Newton-Raphson, within 7 ulp. The bound is
+		// for x86, one step on the 12 bit rsqrtps estimate. NEON takes two steps on the 8 bit
+		// vrsqrteq_f32 estimate, one in SIMD::RSqrtEstimate and one in SIMD::RSqrt, which
+		// leaves less error than x86. The scalar build takes one step on 1 / sqrt, within 4 ulp
+		NormalizeFast
+	};
 	float x;
 	float y;
 	float z;
-	INLINE static const Vector3D Zero()
+	INLINE static constexpr const Vector3D Zero()
 	{
 		return Vector3D(0.0f, 0.0f, 0.0f);
 	}
-	INLINE static const Vector3D Z()
+	INLINE static constexpr const Vector3D Z()
 	{
 		return Vector3D(0.0f, 0.0f, 1.0f);
 	}
-	INLINE static const Vector3D Y()
+	INLINE static constexpr const Vector3D Y()
 	{
 		return Vector3D(0.0f, 1.0f, 0.0f);
 	}
-	INLINE static const Vector3D X()
+	INLINE static constexpr const Vector3D X()
 	{
 		return Vector3D(1.0f, 0.0f, 0.0f);
 	}
@@ -105,67 +116,67 @@ public:
 	{
 		return &x;
 	}
-	INLINE Vector3D operator - () const
+	INLINE constexpr Vector3D operator - () const
 	{
 		return Vector3D(- x, - y, - z);
 	}
-	INLINE bool operator == (const Vector3D& vector) const
+	INLINE constexpr bool operator == (const Vector3D& vector) const
 	{
 		return (x == vector.x && y == vector.y && z == vector.z);
 	}
-	INLINE bool operator != (const Vector3D& vector) const
+	INLINE constexpr bool operator != (const Vector3D& vector) const
 	{
 		return (x != vector.x || y != vector.y || z != vector.z);
 	}
-	INLINE Vector3D& operator += (const Vector3D& Vector)
+	INLINE constexpr Vector3D& operator += (const Vector3D& Vector)
 	{
 		x += Vector.x;
  		y += Vector.y;
  		z += Vector.z;
  		return *this;
 	}
-	INLINE Vector3D& operator -= (const Vector3D& Vector)
+	INLINE constexpr Vector3D& operator -= (const Vector3D& Vector)
 	{
 		x -= Vector.x;
  		y -= Vector.y;
  		z -= Vector.z;
  		return *this;
 	}
-	INLINE Vector3D& operator *= (float Value)
+	INLINE constexpr Vector3D& operator *= (float Value)
 	{
 		x *= Value;
  		y *= Value;
  		z *= Value;
  		return *this;
 	}
-	INLINE Vector3D& operator /= (float Value)
+	INLINE constexpr Vector3D& operator /= (float Value)
 	{
 		assert(Value && "Zero Value");
 		*this *= (1.0f / Value);
 		return *this;
 	}
-	INLINE Vector3D& operator += (float Value)
+	INLINE constexpr Vector3D& operator += (float Value)
 	{
 		x += Value;
 		y += Value;
 		z += Value;
 		return *this;
 	}
-	INLINE Vector3D& operator -= (float Value)
+	INLINE constexpr Vector3D& operator -= (float Value)
 	{
 		x -= Value;
 		y -= Value;
 		z -= Value;
 		return *this;
 	}
-	INLINE Vector3D& operator /= (const Vector3D& vector)
+	INLINE constexpr Vector3D& operator /= (const Vector3D& vector)
 	{
 		x /= vector.x;
  		y /= vector.y;
  		z /= vector.z;
  		return *this;
 	}
-	INLINE Vector3D& operator *= (const Vector3D& vector)
+	INLINE constexpr Vector3D& operator *= (const Vector3D& vector)
 	{
 		x *= vector.x;
 		y *= vector.y;
@@ -183,58 +194,58 @@ public:
 		assert(index < 3 && "Out Of Range");
 		return * (index + (&x));
 	}
-	INLINE bool operator > (const Vector3D& v) const
+	INLINE constexpr bool operator > (const Vector3D& v) const
 	{
 		return x > v.x && y > v.y && z > v.z;
 	}
-	INLINE bool operator >= (const Vector3D& v) const
+	INLINE constexpr bool operator >= (const Vector3D& v) const
 	{
 		return x >= v.x && y >= v.y && z >= v.z;
 	}
-	INLINE bool operator < (const Vector3D& v) const
+	INLINE constexpr bool operator < (const Vector3D& v) const
 	{
 		return x < v.x && y < v.y && z < v.z;
 	}
-	INLINE bool operator <= (const Vector3D& v) const
+	INLINE constexpr bool operator <= (const Vector3D& v) const
 	{
 		return x <= v.x && y <= v.y && z <= v.z;
 	}
-	INLINE friend Vector3D operator + (const Vector3D& vector1, const Vector3D& vector2)
+	INLINE constexpr friend Vector3D operator + (const Vector3D& vector1, const Vector3D& vector2)
 	{
 		return Vector3D(vector1.x + vector2.x, vector1.y + vector2.y, vector1.z + vector2.z);
 	}
-	INLINE friend Vector3D operator + (const Vector3D& vector, float value)
+	INLINE constexpr friend Vector3D operator + (const Vector3D& vector, float value)
 	{
 		return Vector3D(vector.x + value, vector.y + value, vector.z + value);
 	}
-	INLINE friend Vector3D operator - (const Vector3D& vector1, const Vector3D& vector2)
+	INLINE constexpr friend Vector3D operator - (const Vector3D& vector1, const Vector3D& vector2)
 	{
 		return Vector3D(vector1.x - vector2.x, vector1.y - vector2.y, vector1.z - vector2.z);
 	}
-	INLINE friend Vector3D operator - (const Vector3D& vector, float value)
+	INLINE constexpr friend Vector3D operator - (const Vector3D& vector, float value)
 	{
 		return Vector3D(vector.x - value, vector.y - value, vector.z - value);
 	}
-	INLINE friend Vector3D operator * (const Vector3D& vector, float Value)
+	INLINE constexpr friend Vector3D operator * (const Vector3D& vector, float Value)
 	{
 		return Vector3D(vector.x * Value, vector.y * Value, vector.z * Value);
 	}
-	INLINE friend Vector3D operator * (float Value, const Vector3D& vector)
+	INLINE constexpr friend Vector3D operator * (float Value, const Vector3D& vector)
 	{
 		return Vector3D(vector.x * Value, vector.y * Value, vector.z * Value);
 	}
 	//
-	INLINE friend Vector3D operator * (const Vector3D& v1, const Vector3D& v2)
+	INLINE constexpr friend Vector3D operator * (const Vector3D& v1, const Vector3D& v2)
 	{
 		return Vector3D(v1.x * v2.x, v1.y * v2.y, v1.z * v2.z);
 	}
-	INLINE friend Vector3D operator / (const Vector3D& vector, float Value)
+	INLINE constexpr friend Vector3D operator / (const Vector3D& vector, float Value)
 	{
 		assert(Value && "Zero Value");
 		Value = 1.0f / Value;
 		return vector * Value;
 	}
-	INLINE friend Vector3D operator / (float Value, const Vector3D& vector)
+	INLINE constexpr friend Vector3D operator / (float Value, const Vector3D& vector)
 	{
 		return Vector3D ( Value / vector.x, Value / vector.y, Value / vector.z );
 	}
@@ -244,11 +255,11 @@ public:
 		return sqrtf(LengthSq());
 	}
 	// Square of vector length
-	INLINE float LengthSq() const
+	INLINE constexpr float LengthSq() const
 	{
 		return x * x + y * y + z * z;
 	}
-	INLINE float GetDistanceSqFrom(const Vector3D& other) const
+	INLINE constexpr float GetDistanceSqFrom(const Vector3D& other) const
 	{
 		Vector3D d = *this - other;
 		float lenSq = d.LengthSq();
@@ -260,7 +271,7 @@ public:
 		return sqrtf(lenSq);
 	}
 	//
-	INLINE bool IsZero() const
+	INLINE constexpr bool IsZero() const
 	{
 		return !x && !y && !z;
 	}
@@ -290,10 +301,14 @@ public:
 		Rotate(y, z, angle);
 		return *this;
 	}
+	// Batch normalization, out may be an input, zero vectors stay zero
+	static void NormalizeMany(const float* xs, const float* ys, const float* zs, float* outX, float* outY, float* outZ, size_t n, NormalizeMode mode = NormalizeAccurate);
+	// Strides are in bytes, normals of a vertex buffer can be normalized in place
+	static void NormalizeMany(const Vector3D* vectors, size_t stride, Vector3D* out, size_t outStride, size_t n, NormalizeMode mode = NormalizeAccurate);
 	INLINE Vector3D()// : x(0), y(0), z(0)
 	{
 	}
-	INLINE Vector3D(float X, float Y, float Z) : x(X), y(Y), z(Z)
+	INLINE constexpr Vector3D(float X, float Y, float Z) : x(X), y(Y), z(Z)
 	{
 	}
 	template<typename T>
@@ -306,10 +321,10 @@ public:
 	{
 		*this = *reinterpret_cast<const Vector3D *>(data);
 	}
-	INLINE Vector3D(const Vector3D& vector) : x(vector.x), y(vector.y), z(vector.z)
+	INLINE constexpr Vector3D(const Vector3D& vector) : x(vector.x), y(vector.y), z(vector.z)
 	{
 	}
-	INLINE Vector3D(const float* vector) : x(vector[0]), y(vector[1]), z(vector[2])
+	INLINE constexpr Vector3D(const float* vector) : x(vector[0]), y(vector[1]), z(vector[2])
 	{
 	}
 };
@@ -337,15 +352,25 @@ INLINE void CopyVector(Vector3D& outVector, const Vector3D* inVector)
 }
 
 // 
-INLINE float dotProduct(const Vector3D& vector1, const Vector3D& vector2)
+INLINE constexpr float dotProduct(const Vector3D& vector1, const Vector3D& vector2)
 {
 	return vector1.x * vector2.x + vector1.y * vector2.y + vector1.z * vector2.z;
 }
 
 // a x b equal square are created from its vectors
-INLINE Vector3D crossProduct(const Vector3D& v1, const Vector3D& v2)
+INLINE constexpr Vector3D crossProduct(const Vector3D& v1, const Vector3D& v2)
 {
 	return Vector3D(v1.y * v2.z - v1.z * v2.y, -v1.x * v2.z + v1.z * v2.x, v1.x * v2.y - v1.y * v2.x);		
 }
 
+// constexpr members have to stay constant expressions
+static_assert(Vector3D(Vector3D(1.0f, 2.0f, 3.0f)) == Vector3D(1.0f, 2.0f, 3.0f) && Vector3D::Zero().IsZero(), "Vector3D constructors must be constexpr");
+static_assert(Vector3D::X() + Vector3D::Y() - Vector3D::Z() == Vector3D(1.0f, 1.0f, -1.0f) && -Vector3D::X() != Vector3D::X(), "Vector3D operators must be constexpr");
+static_assert(Vector3D(1.0f, 2.0f, 3.0f) * 2.0f == 2.0f * Vector3D(1.0f, 2.0f, 3.0f) && Vector3D(2.0f, 4.0f, 6.0f) / 2.0f == Vector3D(1.0f, 2.0f, 3.0f) &&
+	6.0f / Vector3D(1.0f, 2.0f, 3.0f) == Vector3D(6.0f, 3.0f, 2.0f) * Vector3D(1.0f, 1.0f, 1.0f) && Vector3D(1.0f, 2.0f, 3.0f) - 1.0f + 2.0f == Vector3D(2.0f, 3.0f, 4.0f), "Vector3D operators must be constexpr");
+static_assert((Vector3D(1.0f, 2.0f, 3.0f) += Vector3D(1.0f, 1.0f, 1.0f)) == Vector3D(2.0f, 3.0f, 4.0f) && (Vector3D(1.0f, 2.0f, 3.0f) /= 0.5f) == Vector3D(2.0f, 4.0f, 6.0f) &&
+	(Vector3D(1.0f, 2.0f, 3.0f) *= Vector3D(2.0f, 2.0f, 2.0f)) == Vector3D(2.0f, 4.0f, 6.0f) && Vector3D(1.0f, 2.0f, 3.0f) <= Vector3D(1.0f, 2.0f, 3.0f), "Vector3D operators must be constexpr");
+static_assert(dotProduct(Vector3D(1.0f, 2.0f, 3.0f), Vector3D(4.0f, 5.0f, 6.0f)) == 32.0f && crossProduct(Vector3D::X(), Vector3D::Y()) == Vector3D::Z(), "dotProduct and crossProduct must be constexpr");
+static_assert(Vector3D(2.0f, 3.0f, 6.0f).LengthSq() == 49.0f && Vector3D(3.0f, 4.0f, 1.0f).GetDistanceSqFrom(Vector3D(0.0f, 0.0f, 1.0f)) == 25.0f, "LengthSq must be constexpr");
+
 #endif // __VECTOR3D_H__
@@ -0,0 +1,71 @@
+// Vector4D.cpp: implementation of the Vector4D class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Vector4D.h"
+
+// Kernels of the batch normalization. The squared length of xyz is ((x * x + y * y) + z * z)
+// on every backend, the accurate mode returns the bits of Normalize. Blocks of 4 vectors
+// are transposed to get 4 lengths at once, tails are single vectors. An AVX2 kernel
+// with 2 vectors per register was slower, it computes every length 4 times.
+
+namespace {
+
+	using namespace SIMD;
+
+	template <bool Fast>
+	INLINE Float4 InvLength(Float4 lengthSq)
+	{
+		const Float4 inv = Fast ? RSqrt(lengthSq) : Div(Splat(1.0f), Sqrt(lengthSq));
+		// zero vectors stay zero instead of NaN
+		return And(inv, CmpGT(lengthSq, Splat(0.0f)));
+	}
+
+	template <bool Fast>
+	size_t NormalizeSIMD(const Vector4D* vectors, Vector4D* out, size_t first, size_t n)
+	{
+		size_t i = first;
+		for (; i + 4 <= n; i += 4) {
+			const Float4 v[4] = { vectors[i].Load(), vectors[i + 1].Load(), vectors[i + 2].Load(), vectors[i + 3].Load() };
+			Float4 x = v[0];
+			Float4 y = v[1];
+			Float4 z = v[2];
+			Float4 w = v[3];
+			Transpose(x, y, z, w);
+			const Float4 inv = InvLength<Fast>(Add(Add(Mul(x, x), Mul(y, y)), Mul(z, z)));
+			out[i].Store(Mul(v[0], Broadcast<0>(inv)));
+			out[i + 1].Store(Mul(v[1], Broadcast<1>(inv)));
+			out[i + 2].Store(Mul(v[2], Broadcast<2>(inv)));
+			out[i + 3].Store(Mul(v[3], Broadcast<3>(inv)));
+		}
+		return i;
+	}
+
+	template <bool Fast>
+	INLINE void NormalizeVector(const Vector4D& vector, Vector4D& out)
+	{
+		const Float4 v = vector.Load();
+		const Float4 square = Mul(v, v);
+		const Float4 lengthSq = Add(Add(Broadcast<0>(square), Broadcast<1>(square)), Broadcast<2>(square));
+		out.Store(Mul(v, InvLength<Fast>(lengthSq)));
+	}
+
+	template <bool Fast>
+	void NormalizeVectors(const Vector4D* vectors, Vector4D* out, size_t n)
+	{
+		for (size_t i = NormalizeSIMD<Fast>(vectors, out, 0, n); i < n; ++i) {
+			NormalizeVector<Fast>(vectors[i], out[i]);
+		}
+	}
+
+}
+
+void Vector4D::NormalizeMany(const Vector4D* vectors, Vector4D* out, size_t n, NormalizeMode mode)
+{
+	assert((!n || (vectors && out)) && "NULL Pointer");
+	if (mode == NormalizeFast) {
+		NormalizeVectors<true>(vectors, out, n);
+	} else {
+		NormalizeVectors<false>(vectors, out, n);
+	}
+}
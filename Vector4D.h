@@ -8,35 +8,9 @@
 #include <cmath>
 #include <cassert>
 #include <climits>
+#include <cstddef>
 
-#ifdef STLPORT
-#ifndef __GNUC__
-#define SSE
-#endif
-#endif
-
-#ifdef SSE
-#ifdef __GNUC__
-#define __SSE__
-#define  __MMX__
-#ifndef __inline
-#ifdef __MINGW32__
-#define __inline inline
-#else
-//#define __inline __attribute__((always_inline))
-#endif
-#endif
-#endif
-#include <xmmintrin.h>
-#ifdef _MSC_VER
-#define ALIGN16 _MM_ALIGN16
-#elif __GNUC__
-#define ALIGN16 __attribute__(aligned(16))
-#else
-#endif
-#else
-#define ALIGN16
-#endif
+#include "SIMD.h"
 
 #undef INLINE
 #ifdef _WIN32
@@ -55,29 +29,21 @@
 
 class Vector3D;
 
-class Vector4D  {
+class ALIGN16 Vector4D  {
 private:
 	typedef unsigned char uchar;
 	typedef unsigned int uint;
 public:
-#ifdef SSE
-	union ALIGN16 {
-		__m128 v;
-		struct {
-			float x;
-			float y;
-			float z;
-			float w;
-		};
-		struct 
-		{
-			float r;
-			float g;
-			float b;
-			float a;
-		};
+	// Accuracy of NormalizeMany
+	enum NormalizeMode {
+		// 1 / sqrt of the squared length, the same as Normalize
+		NormalizeAccurate,
+		// reciprocal square root estimate refined by Newton-Raphson, within 7 ulp. The bound is
+		// for x86, one step on the 12 bit rsqrtps estimate. NEON takes two steps on the 8 bit
+		// vrsqrteq_f32 estimate, one in SIMD::RSqrtEstimate and one in SIMD::RSqrt, which
+		// leaves less error than x86. The scalar build takes one step on 1 / sqrt, within 4 ulp
+		NormalizeFast
 	};
-#else
 	union  {
 		struct {
 			float x;
@@ -93,8 +59,17 @@ public:
 		};
 		float v[4];
 	};
-#endif
-	INLINE static const Vector4D Zero()
+	//
+	INLINE SIMD::Float4 Load() const
+	{
+		return SIMD::Load(&x);
+	}
+	//
+	INLINE void Store(SIMD::Float4 V)
+	{
+		SIMD::Store(&x, V);
+	}
+	INLINE static constexpr const Vector4D Zero()
 	{
 		return Vector4D(0.0f, 0.0f, 0.0f, 0.0f);
 	}
@@ -148,77 +123,59 @@ public:
 	{
 		return &x;
 	}
-	INLINE Vector4D operator - () const
+	INLINE constexpr Vector4D operator - () const
 	{
 		return Vector4D(- x, - y, - z, - w);
 	}
 	INLINE Vector4D& operator += (const Vector4D& vector)
 	{
-		x += vector.x;
-		y += vector.y;
-		z += vector.z;
-		w += vector.w;
+		Store(SIMD::Add(Load(), vector.Load()));
 		return *this;
 	}
 	INLINE Vector4D& operator -= (const Vector4D& vector)
 	{
-		x -= vector.x;
-		y -= vector.y;
-		z -= vector.z;
-		w -= vector.w;
+		Store(SIMD::Sub(Load(), vector.Load()));
 		return *this;
 	}
 	INLINE Vector4D& operator *= (float Value)
 	{
-		x *= Value;
-		y *= Value;
-		z *= Value;
-		w *= Value;
+		Store(SIMD::Mul(Load(), SIMD::Splat(Value)));
 		return *this;
 	}
 	INLINE Vector4D& operator /= (float Value)
 	{
-		x /= Value;
-		y /= Value;
-		z /= Value;
-		w /= Value;
+		Store(SIMD::Div(Load(), SIMD::Splat(Value)));
 		return *this;
 	}
 	INLINE Vector4D& operator /= (const Vector4D& vector)
 	{
-		x /= vector.x;
- 		y /= vector.y;
- 		z /= vector.z;
-		w /= vector.w;
+		Store(SIMD::Div(Load(), vector.Load()));
 		return *this;
 	}
 	INLINE Vector4D& operator *= (const Vector4D& vector)
 	{
-		x *= vector.x;
- 		y *= vector.y;
- 		z *= vector.z;
-		w *= vector.w;
+		Store(SIMD::Mul(Load(), vector.Load()));
 		return *this;
 	}
-	INLINE Vector4D& operator += (float Value)
+	INLINE constexpr Vector4D& operator += (float Value)
 	{
 		x += Value;
 		y += Value;
 		z += Value;
 		return *this;
 	}
-	INLINE Vector4D& operator -= (float Value)
+	INLINE constexpr Vector4D& operator -= (float Value)
 	{
 		x -= Value;
 		y -= Value;
 		z -= Value;
 		return *this;
 	}
-	INLINE bool operator == (const Vector4D& v)
+	INLINE constexpr bool operator == (const Vector4D& v) const
 	{
 		return (x == v.x && y == v.y && z == v.z && w == v.w);
 	}
-	INLINE bool operator != (const Vector4D& v) const
+	INLINE constexpr bool operator != (const Vector4D& v) const
 	{
 		return (x != v.x || y != v.y || z != v.z || w != v.w);
 	}
@@ -233,64 +190,52 @@ public:
 		assert(index < 4 && "Out of Range");
 		return * (index + &x);
 	}
-	INLINE bool operator > (const Vector4D& v) const
+	INLINE constexpr bool operator > (const Vector4D& v) const
 	{
 		return x > v.x && y > v.y && z > v.z && w > v.w;
 	}
-	INLINE bool operator < (const Vector4D& v) const
+	INLINE constexpr bool operator < (const Vector4D& v) const
 	{
 		return x < v.x && y < v.y && z < v.z && w < v.w;
 	}
 	INLINE friend Vector4D operator + ( const Vector4D& vector1, const Vector4D& vector2)
 	{
-#ifdef SSE
-		return Vector4D(_mm_add_ps(vector1.v, vector2.v));
-#else
-		return Vector4D (vector1.x+vector2.x, vector1.y+vector2.y, vector1.z+vector2.z, vector1.w+vector2.w );
-#endif
+		return Vector4D(SIMD::Add(vector1.Load(), vector2.Load()));
 	}
-	INLINE friend Vector4D operator + ( const Vector4D& vector, float value)
+	INLINE constexpr friend Vector4D operator + ( const Vector4D& vector, float value)
 	{
 		return Vector4D(vector.x + value, vector.y + value, vector.z + value, vector.w);
 	}
 	INLINE friend Vector4D operator - ( const Vector4D& vector1, const Vector4D& vector2)
 	{
-#ifdef SSE
-		return Vector4D(_mm_sub_ps(vector1.v, vector2.v));
-#else
-		return Vector4D(vector1.x-vector2.x, vector1.y-vector2.y, vector1.z-vector2.z, vector1.w-vector2.w );
-#endif
+		return Vector4D(SIMD::Sub(vector1.Load(), vector2.Load()));
 	}
-	INLINE friend Vector4D operator - ( const Vector4D& vector, float value)
+	INLINE constexpr friend Vector4D operator - ( const Vector4D& vector, float value)
 	{
 		return Vector4D(vector.x - value, vector.y - value, vector.z - value, vector.w);
 	}
 	INLINE friend Vector4D operator * (float Value, const Vector4D& vector)
 	{
-		return Vector4D (vector.x * Value, vector.y * Value, vector.z * Value, vector.w * Value);
+		return Vector4D(SIMD::Mul(vector.Load(), SIMD::Splat(Value)));
 	}
 	INLINE friend Vector4D operator * (const Vector4D& vector, float Value)
 	{
-		return Vector4D(vector.x * Value, vector.y * Value, vector.z * Value, vector.w * Value);
+		return Vector4D(SIMD::Mul(vector.Load(), SIMD::Splat(Value)));
 	}
 	INLINE friend Vector4D operator * (const Vector4D& vector1, const Vector4D& vector2)
 	{
-#ifdef SSE
-		return Vector4D(_mm_mul_ps(vector1.v, vector2.v));
-#else
-		return Vector4D(vector1.x *vector2.x, vector1.y * vector2.y, vector1.z * vector2.z, vector1.w * vector2.w );
-#endif
+		return Vector4D(SIMD::Mul(vector1.Load(), vector2.Load()));
 	}
 	INLINE friend Vector4D operator / (const Vector4D& vector, float Value)
 	{
-		return Vector4D(vector.x / Value, vector.y / Value, vector.z / Value, vector.w / Value);
+		return Vector4D(SIMD::Div(vector.Load(), SIMD::Splat(Value)));
 	}
 	INLINE friend Vector4D operator / (float Value, const Vector4D& vector)
 	{
-		return Vector4D ( Value / vector.x, Value / vector.y, Value / vector.z, Value / vector.w);
+		return Vector4D(SIMD::Div(SIMD::Splat(Value), vector.Load()));
 	}
 	//
-	bool IsZero() const
+	INLINE constexpr bool IsZero() const
 	{
 		return !x && !y && !z && !w;
 	}
@@ -298,7 +243,7 @@ public:
 	{
 		return sqrtf(LengthSq());
 	}
-	INLINE float LengthSq() const
+	INLINE constexpr float LengthSq() const
 	{
 		return x * x + y * y + z * z;
 	}
@@ -314,6 +259,9 @@ public:
 		w *= l;
 		return *this;
 	};
+	// Batch normalization by the length of xyz like Normalize, out may be vectors.
+	// Zero vectors stay zero
+	static void NormalizeMany(const Vector4D* vectors, Vector4D* out, size_t n, NormalizeMode mode = NormalizeAccurate);
 	Vector4D& FromARGB(uint color)
 	{
 		const float f = 1.0f / 255.0f;
@@ -344,15 +292,14 @@ public:
 	INLINE Vector4D()
 	{
 	}
-#ifdef SSE
-	INLINE Vector4D (const __m128& V) : v(V)
+	INLINE explicit Vector4D(SIMD::Float4 V)
 	{
+		Store(V);
 	}
-#endif
-	INLINE Vector4D (float X, float Y, float Z, float W ): x(X), y(Y), z(Z), w(W)
+	INLINE constexpr Vector4D (float X, float Y, float Z, float W ): x(X), y(Y), z(Z), w(W)
 	{
 	}
-	INLINE Vector4D (const Vector4D& vector) : x(vector.x), y(vector.y), z(vector.z),
+	INLINE constexpr Vector4D (const Vector4D& vector) : x(vector.x), y(vector.y), z(vector.z),
 		w(vector.w)
 	{
 	}
@@ -362,5 +309,12 @@ public:
 	}
 };
 
+// constexpr members have to stay constant expressions, the SIMD operators can't be
+static_assert(Vector4D(Vector4D(1.0f, 2.0f, 3.0f, 4.0f)) == Vector4D(1.0f, 2.0f, 3.0f, 4.0f) && Vector4D::Zero().IsZero(), "Vector4D constructors must be constexpr");
+static_assert(-Vector4D(1.0f, 2.0f, 3.0f, 4.0f) == Vector4D(-1.0f, -2.0f, -3.0f, -4.0f) && Vector4D(1.0f, 2.0f, 3.0f, 4.0f) + 1.0f - 2.0f == Vector4D(0.0f, 1.0f, 2.0f, 4.0f), "Vector4D operators must be constexpr");
+static_assert((Vector4D(1.0f, 2.0f, 3.0f, 4.0f) += 1.0f) == Vector4D(2.0f, 3.0f, 4.0f, 4.0f) && (Vector4D(1.0f, 2.0f, 3.0f, 4.0f) -= 1.0f) != Vector4D::Zero() &&
+	Vector4D::Zero() < Vector4D(1.0f, 2.0f, 3.0f, 4.0f), "Vector4D operators must be constexpr");
+static_assert(Vector4D(2.0f, 3.0f, 6.0f, 8.0f).LengthSq() == 49.0f, "LengthSq must be constexpr");
+
 #endif // __VECTOR4D_H__
 
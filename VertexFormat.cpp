@@ -0,0 +1,359 @@
+// VertexFormat.cpp: implementation of the VertexFormat class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "VertexFormat.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+	const float SNorm16Max = 32767.0f;
+
+	// round to nearest as the conversion of D3D to SNORM
+	INLINE int QuantizeSNorm(float value, float maxValue)
+	{
+		value = std::max(-1.0f, std::min(1.0f, value));
+		return static_cast<int>(floorf(value * maxValue + 0.5f));
+	}
+	// -maxValue - 1 decodes to -1 too
+	INLINE float DequantizeSNorm(int value, float maxValue)
+	{
+		return std::max(value / maxValue, -1.0f);
+	}
+
+	// float source offsets and sizes of the attributes
+	INLINE VertexFormat::ElementFormat GetSourceElementFormat(VertexFormat::Attribute attribute)
+	{
+		return attribute == VertexFormat::TexCoord ? VertexFormat::Float2 : VertexFormat::Float3;
+	}
+
+	INLINE void PrintFloat3(std::string& code, const Vector3D& value)
+	{
+		char text[128];
+		snprintf(text, sizeof(text), "float3(%.9g, %.9g, %.9g)", value.x, value.y, value.z);
+		code += text;
+	}
+
+}
+
+VertexFormat::VertexFormat() : numElements(0), stride(0), positionOffset(0.0f, 0.0f, 0.0f), positionScale(1.0f, 1.0f, 1.0f)
+{
+}
+
+VertexFormat VertexFormat::Create(Attribute last, Quantization quantization)
+{
+	assert(last < NumAttributes && "Out Of Range");
+	assert(quantization < NumQuantizations && "Out Of Range");
+	VertexFormat format;
+	const bool quantized = quantization != NoQuantization;
+	format.Add(Position, quantized ? SNorm16x4 : Float3);
+	if (last >= Normal) {
+		format.Add(Normal, quantized ? Octahedral16 : Float3);
+	}
+	if (last >= TexCoord) {
+		format.Add(TexCoord, quantized ? Half2 : Float2);
+	}
+	return format;
+}
+
+VertexFormat& VertexFormat::Add(Attribute attribute, ElementFormat format)
+{
+	assert(attribute < NumAttributes && "Out Of Range");
+	assert(format < NumElementFormats && "Out Of Range");
+	assert(numElements < NumAttributes && "Out Of Range");
+	for (uint i = 0; i < numElements; ++i) {
+		assert(elements[i].attribute != attribute && "Invalid Value");
+	}
+	// offset is aligned as the components of the format, stride to 4
+	const uint size = GetSize(format);
+	const uint alignment = std::min(size, 4u);
+	const uint end = numElements ? elements[numElements - 1].offset + GetSize(elements[numElements - 1].format) : 0;
+	Element& element = elements[numElements++];
+	element.attribute = attribute;
+	element.format = format;
+	element.offset = (end + alignment - 1) / alignment * alignment;
+	stride = (element.offset + size + 3) & ~3u;
+	return *this;
+}
+
+VertexFormat VertexFormat::GetSourceFormat() const
+{
+	VertexFormat format;
+	for (uint i = 0; i < numElements; ++i) {
+		format.Add(elements[i].attribute, GetSourceElementFormat(elements[i].attribute));
+	}
+	return format;
+}
+
+void VertexFormat::SetBounds(const Vector3D& minimum, const Vector3D& maximum)
+{
+	assert(minimum.x <= maximum.x && minimum.y <= maximum.y && minimum.z <= maximum.z && "Invalid Value");
+	positionOffset = (minimum + maximum) * 0.5f;
+	const Vector3D halfSize = (maximum - minimum) * 0.5f;
+	// flat axes keep the offset, any scale works
+	positionScale = Vector3D(halfSize.x > 0.0f ? halfSize.x : 1.0f, halfSize.y > 0.0f ? halfSize.y : 1.0f, halfSize.z > 0.0f ? halfSize.z : 1.0f);
+}
+
+void VertexFormat::SetBounds(const Mesh& mesh)
+{
+	assert(mesh.stride == GetSourceFormat().GetStride() && "Invalid Value");
+	if (!mesh.GetNumVertices()) {
+		return;
+	}
+	Vector3D minimum;
+	Vector3D maximum;
+	mesh.GetBounds(minimum, maximum);
+	SetBounds(minimum, maximum);
+}
+
+void VertexFormat::Encode(const void* source, uint numVertices, void* destination) const
+{
+	assert((!numVertices || (source && destination)) && "NULL Pointer");
+	const VertexFormat sourceFormat = GetSourceFormat();
+	const ubyte* src = static_cast<const ubyte *>(source);
+	ubyte* dst = static_cast<ubyte *>(destination);
+	for (uint v = 0; v < numVertices; ++v, src += sourceFormat.stride, dst += stride) {
+		memset(dst, 0, stride);
+		for (uint i = 0; i < numElements; ++i) {
+			const Element& element = elements[i];
+			const ubyte* in = src + sourceFormat.elements[i].offset;
+			ubyte* out = dst + element.offset;
+			switch (element.format) {
+			case Float2:
+			case Float3:
+				memcpy(out, in, GetSize(element.format));
+				break;
+			case SNorm16x4: {
+				const Vector3D& position = *reinterpret_cast<const Vector3D *>(in);
+				Vector3D value = position - positionOffset;
+				value /= positionScale;
+				const short quantized[4] = { static_cast<short>(QuantizeSNorm(value.x, SNorm16Max)), static_cast<short>(QuantizeSNorm(value.y, SNorm16Max)), static_cast<short>(QuantizeSNorm(value.z, SNorm16Max)), 0 };
+				memcpy(out, quantized, sizeof(quantized));
+				break;
+			}
+			case Octahedral16: {
+				Vector3D normal = *reinterpret_cast<const Vector3D *>(in);
+				const float length = normal.Length();
+				if (length > 0.0f) {
+					normal /= length;
+				}
+				const Vector2D value = OctahedralEncode(normal);
+				const short quantized[2] = { static_cast<short>(QuantizeSNorm(value.x, SNorm16Max)), static_cast<short>(QuantizeSNorm(value.y, SNorm16Max)) };
+				memcpy(out, quantized, sizeof(quantized));
+				break;
+			}
+			case Half2: {
+				const Vector2D& texCoord = *reinterpret_cast<const Vector2D *>(in);
+				const ushort half[2] = { FloatToHalf(texCoord.x), FloatToHalf(texCoord.y) };
+				memcpy(out, half, sizeof(half));
+				break;
+			}
+			default:
+				assert(false && "Invalid Value");
+				break;
+			}
+		}
+	}
+}
+
+void VertexFormat::Encode(Mesh& mesh) const
+{
+	assert(mesh.stride == GetSourceFormat().GetStride() && "Invalid Value");
+	const uint numVertices = mesh.GetNumVertices();
+	std::vector<ubyte> vertices(static_cast<size_t>(numVertices) * stride);
+	Encode(mesh.vertices.data(), numVertices, vertices.data());
+	mesh.vertices.swap(vertices);
+	mesh.stride = stride;
+}
+
+void VertexFormat::Decode(const void* vertex, Vector3D* position, Vector3D* normal, Vector2D* texCoord) const
+{
+	assert(vertex && "NULL Pointer");
+	for (uint i = 0; i < numElements; ++i) {
+		const Element& element = elements[i];
+		const ubyte* in = static_cast<const ubyte *>(vertex) + element.offset;
+		switch (element.format) {
+		case Float3:
+			if (Vector3D* out = element.attribute == Position ? position : normal) {
+				*out = *reinterpret_cast<const Vector3D *>(in);
+			}
+			break;
+		case Float2:
+			if (texCoord) {
+				*texCoord = *reinterpret_cast<const Vector2D *>(in);
+			}
+			break;
+		case SNorm16x4:
+			if (position) {
+				short quantized[4];
+				memcpy(quantized, in, sizeof(quantized));
+				const Vector3D value(DequantizeSNorm(quantized[0], SNorm16Max), DequantizeSNorm(quantized[1], SNorm16Max), DequantizeSNorm(quantized[2], SNorm16Max));
+				*position = positionOffset + value * positionScale;
+			}
+			break;
+		case Octahedral16:
+			if (normal) {
+				short quantized[2];
+				memcpy(quantized, in, sizeof(quantized));
+				*normal = OctahedralDecode(Vector2D(DequantizeSNorm(quantized[0], SNorm16Max), DequantizeSNorm(quantized[1], SNorm16Max)));
+			}
+			break;
+		case Half2:
+			if (texCoord) {
+				ushort half[2];
+				memcpy(half, in, sizeof(half));
+				*texCoord = Vector2D(HalfToFloat(half[0]), HalfToFloat(half[1]));
+			}
+			break;
+		default:
+			assert(false && "Invalid Value");
+			break;
+		}
+	}
+}
+
+std::string VertexFormat::GetShaderCode() const
+{
+	static const char* const MemberNames[NumAttributes] = { "position", "normal", "texCoord" };
+	static const char* const FunctionNames[NumAttributes] = { "DecodePosition", "DecodeNormal", "DecodeTexCoord" };
+	static const char* const MemberTypes[NumElementFormats] = { "float2", "float3", "float4", "float2", "float2" };
+	std::string code = "struct VertexInput {\n";
+	bool octahedral = false;
+	for (uint i = 0; i < numElements; ++i) {
+		const Element& element = elements[i];
+		code += std::string("\t") + MemberTypes[element.format] + " " + MemberNames[element.attribute] + " : " + GetSemanticName(element.attribute) + ";\n";
+		octahedral |= element.format == Octahedral16;
+	}
+	code += "};\n";
+	if (octahedral) {
+		code += "float3 OctahedralDecode(float2 value)\n{\n"
+			"\tfloat3 normal = float3(value, 1.0f - abs(value.x) - abs(value.y));\n"
+			"\tconst float t = saturate(-normal.z);\n"
+			"\tnormal.xy += normal.xy >= 0.0f ? -t : t;\n"
+			"\treturn normalize(normal);\n}\n";
+	}
+	for (uint i = 0; i < numElements; ++i) {
+		const Element& element = elements[i];
+		const std::string member = std::string("input.") + MemberNames[element.attribute];
+		code += std::string(element.attribute == TexCoord ? "float2 " : "float3 ") + FunctionNames[element.attribute] + "(VertexInput input)\n{\n\treturn ";
+		switch (element.format) {
+		case SNorm16x4:
+			PrintFloat3(code, positionOffset);
+			code += " + " + member + ".xyz * ";
+			PrintFloat3(code, positionScale);
+			break;
+		case Octahedral16:
+			code += "OctahedralDecode(" + member + ")";
+			break;
+		default:
+			code += member;
+			break;
+		}
+		code += ";\n}\n";
+	}
+	return code;
+}
+
+uint VertexFormat::GetSize(ElementFormat format)
+{
+	static const uint Sizes[NumElementFormats] = { 8, 12, 8, 4, 4 };
+	assert(format < NumElementFormats && "Out Of Range");
+	return Sizes[format];
+}
+
+const char* VertexFormat::GetSemanticName(Attribute attribute)
+{
+	static const char* const Names[NumAttributes] = { "POSITION", "NORMAL", "TEXCOORD" };
+	assert(attribute < NumAttributes && "Out Of Range");
+	return Names[attribute];
+}
+
+const char* VertexFormat::GetName(Quantization quantization)
+{
+	static const char* const Names[NumQuantizations] = { "Float", "Quantized16" };
+	assert(quantization < NumQuantizations && "Out Of Range");
+	return Names[quantization];
+}
+
+Vector2D VertexFormat::OctahedralEncode(const Vector3D& normal)
+{
+	const float sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	const float invSum = sum > 0.0f ? 1.0f / sum : 0.0f;
+	const float x = normal.x * invSum;
+	const float y = normal.y * invSum;
+	if (normal.z >= 0.0f) {
+		return Vector2D(x, y);
+	}
+	// lower hemisphere is folded over the diagonals
+	return Vector2D((1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f));
+}
+
+Vector3D VertexFormat::OctahedralDecode(const Vector2D& value)
+{
+	Vector3D normal(value.x, value.y, 1.0f - fabsf(value.x) - fabsf(value.y));
+	const float t = std::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -t : t;
+	normal.y += normal.y >= 0.0f ? -t : t;
+	return normal / normal.Length();
+}
+
+ushort VertexFormat::FloatToHalf(float value)
+{
+	uint bits;
+	memcpy(&bits, &value, sizeof(bits));
+	const uint sign = (bits >> 16) & 0x8000;
+	const uint magnitude = bits & 0x7FFFFFFF;
+	if (magnitude >= 0x7F800000) {
+		// infinity, NaN stays NaN
+		return static_cast<ushort>(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+	}
+	if (magnitude >= 0x477FF000) {
+		// 65520 and above round to infinity
+		return static_cast<ushort>(sign | 0x7C00);
+	}
+	uint half;
+	uint remainder;
+	uint halfway;
+	if (magnitude < 0x38800000) {
+		// denormal, units of 2^-24
+		const uint shift = 126 - (magnitude >> 23);
+		if (shift > 24) {
+			return static_cast<ushort>(sign);
+		}
+		const uint mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+		half = mantissa >> shift;
+		remainder = mantissa & ((1u << shift) - 1);
+		halfway = 1u << (shift - 1);
+	} else {
+		// exponent is rebiased from 127 to 15, a carry of the mantissa goes to the exponent
+		half = (magnitude - 0x38000000) >> 13;
+		remainder = magnitude & 0x1FFF;
+		halfway = 0x1000;
+	}
+	if (remainder > halfway || (remainder == halfway && (half & 1))) {
+		++half;
+	}
+	return static_cast<ushort>(sign | half);
+}
+
+float VertexFormat::HalfToFloat(ushort value)
+{
+	const uint sign = (value & 0x8000u) << 16;
+	const uint exponent = (value >> 10) & 0x1F;
+	const uint mantissa = value & 0x3FF;
+	uint bits;
+	if (!exponent) {
+		// zero and denormals are exact in float
+		const float magnitude = mantissa * (1.0f / 16777216.0f);
+		memcpy(&bits, &magnitude, sizeof(bits));
+		bits |= sign;
+	} else if (exponent == 0x1F) {
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	} else {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
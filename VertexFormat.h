@@ -0,0 +1,106 @@
+// VertexFormat.h: interface for the VertexFormat class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __VERTEXFORMAT_H__
+#define __VERTEXFORMAT_H__
+
+#include "MeshGenerator.h"
+#include <string>
+
+// Layout of a vertex buffer: attributes in order, every one in its format. The source
+// of the encoding has the same attributes as floats (Vertex or Vector3D positions).
+// Input layouts and the HLSL decode are made from the same description.
+class VertexFormat  {
+public:
+	enum Attribute {
+		Position,
+		Normal,
+		TexCoord,
+		NumAttributes
+	};
+	enum ElementFormat {
+		Float2,
+		Float3,
+		// xyz relative to the bounds, w is padding
+		SNorm16x4,
+		// octahedral normal
+		Octahedral16,
+		Half2,
+		NumElementFormats
+	};
+	// presets of the scene and light geometry
+	enum Quantization {
+		// 32 bit floats
+		NoQuantization,
+		// 16 bit positions, 16 bit octahedral normals, half texture coordinates
+		Quantization16,
+		NumQuantizations
+	};
+	struct Element {
+		Attribute attribute;
+		ElementFormat format;
+		// offset in the vertex, aligned to the size of the format up to 4
+		uint offset;
+	};
+private:
+	Element elements[NumAttributes];
+	uint numElements;
+	uint stride;
+	// positions are offset + value * scale
+	Vector3D positionOffset;
+	Vector3D positionScale;
+public:
+	VertexFormat();
+	// Attributes from Position to last in the formats of the preset
+	static VertexFormat Create(Attribute last, Quantization quantization);
+	// Appends an attribute, every attribute is added once
+	VertexFormat& Add(Attribute attribute, ElementFormat format);
+	//
+	INLINE uint GetNumElements() const
+	{
+		return numElements;
+	}
+	//
+	INLINE const Element& GetElement(uint index) const
+	{
+		assert(index < numElements && "Out Of Range");
+		return elements[index];
+	}
+	//
+	INLINE uint GetStride() const
+	{
+		return stride;
+	}
+	// Float layout of the attributes, the source of the encoding
+	VertexFormat GetSourceFormat() const;
+	// Quantized positions cover the box
+	void SetBounds(const Vector3D& minimum, const Vector3D& maximum);
+	// Bounds of the positions of a mesh in the source format
+	void SetBounds(const Mesh& mesh);
+
+	// Encodes vertices of the source format
+	void Encode(const void* source, uint numVertices, void* destination) const;
+	// Encodes vertices of a mesh in the source format in place
+	void Encode(Mesh& mesh) const;
+	// Decodes a vertex as the shader does, attributes the format has not stay unchanged
+	void Decode(const void* vertex, Vector3D* position, Vector3D* normal, Vector2D* texCoord) const;
+	// HLSL struct VertexInput with the semantics of the input layout and
+	// DecodePosition/DecodeNormal/DecodeTexCoord(VertexInput) of the attributes
+	std::string GetShaderCode() const;
+
+	//
+	static uint GetSize(ElementFormat format);
+	// input layout semantic, the index is 0
+	static const char* GetSemanticName(Attribute attribute);
+	//
+	static const char* GetName(Quantization quantization);
+	// Octahedral mapping of a unit vector to [-1, 1]^2 and back
+	static Vector2D OctahedralEncode(const Vector3D& normal);
+	static Vector3D OctahedralDecode(const Vector2D& value);
+	// IEEE half float, rounded to nearest even
+	static ushort FloatToHalf(float value);
+	static float HalfToFloat(ushort value);
+};
+
+#endif // __VERTEXFORMAT_H__
@@ -59,12 +59,11 @@ float4 CalculateLighting(float4 Color, float3 worldPos, float3 Normal, float3 vi
     
     float3 n = normalize(Normal);
     float3 v = normalize(viewDir);
-// NO_LIGHT_BUFFER standart Forward lighting 
-//#define NO_LIGHT_BUFFER 
+// NO_LIGHT_BUFFER standart Forward lighting, selected by the application per variant
 #ifndef NO_LIGHT_BUFFER
     for (int i = 0; i < 4; ++i)
 #else
-    for (int i = 0; i < 255; ++i)
+    for (int i = 0; i < NUM_LIGHTS; ++i)
 #endif
     {                   
 #ifndef NO_LIGHT_BUFFER
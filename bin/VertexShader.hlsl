@@ -31,13 +31,16 @@ float4 CalcLightProjSpaceLookup(float4 projectSpace)
 	//return uv;
 }
 
-VS_OUTPUT VSmain(float4 Pos: POSITION, float3 Normal: NORMAL, float2 texCoord: TEXCOORD0)
+// VertexInput and its Decode functions are generated from the vertex format
+VS_OUTPUT VSmain(VertexInput input)
 {
 	VS_OUTPUT Out;
-	Out.position = mul(float4(Pos.xyz, 1.0f), ViewProjMatrix);
-	Out.worldPos = mul(float4(Pos.xyz, 1.0f), ViewMatrix).xyz;
-	Out.texCoord = texCoord;
-	Out.viewDir = cameraPosition.xyz - Pos.xyz;
+	const float3 Pos = DecodePosition(input);
+	const float3 Normal = DecodeNormal(input);
+	Out.position = mul(float4(Pos, 1.0f), ViewProjMatrix);
+	Out.worldPos = mul(float4(Pos, 1.0f), ViewMatrix).xyz;
+	Out.texCoord = DecodeTexCoord(input);
+	Out.viewDir = cameraPosition.xyz - Pos;
 	Out.normal =  mul(Normal, (float3x3)ViewMatrix);
 	Out.lightProjSpaceLokup = CalcLightProjSpaceLookup(Out.position);
 	return Out;
@@ -24,6 +24,7 @@
 #include <d3d12.h>
 #include <dxgi1_4.h>
 #include <D3Dcompiler.h>
+#include <dxcapi.h>
 #include <DirectXMath.h>
 #include "d3dx12.h"
 